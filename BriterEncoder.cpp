@@ -4,6 +4,47 @@
 
 namespace BriterEncoder {
 
+    // Last mode commanded per encoder (0 = query mode)
+    static uint16_t autoIntervalMs[NUM_ENCODERS] = {0};
+
+    static bool validId(uint8_t id)
+    {
+        return id >= FIRST_ID && id <= LAST_ID;
+    }
+
+    static bool sendCommand(uint8_t id, uint8_t func,
+                            const uint8_t* payload, uint8_t payloadLen)
+    {
+        twai_message_t msg = {};
+        msg.identifier = id;
+        msg.extd = 0;
+        msg.rtr = 0;
+
+        // LEN counts LEN + ID + FUNC + payload
+        msg.data_length_code = 3 + payloadLen;
+        msg.data[0] = msg.data_length_code;
+        msg.data[1] = id;
+        msg.data[2] = func;
+        memcpy(&msg.data[3], payload, payloadLen);
+
+        return sendCANFrame(msg);
+    }
+
+    /*
+     * Strict frame check: value frames (READ responses and auto-report
+     * pushes) carry LEN=7, the encoder's own ID and FUNC_READ.
+     * Used where unrelated traffic may share the IDs (sniffer mode).
+     */
+    bool isBriterMessage(const twai_message_t& msg)
+    {
+        return !msg.extd &&
+               validId((uint8_t)msg.identifier) &&
+               msg.data_length_code == 7 &&
+               msg.data[0] == 0x07 &&
+               msg.data[1] == msg.identifier &&
+               msg.data[2] == FUNC_READ;
+    }
+
     bool parseReadResponse(const twai_message_t& msg,
                        uint8_t& outId,
                        int32_t& outRaw)
@@ -22,7 +63,7 @@ namespace BriterEncoder {
         return true;
     }
 
-    void sendRead(uint8_t id)
+    bool sendRead(uint8_t id)
     {
         twai_message_t msg = {};
         msg.identifier = id;
@@ -35,7 +76,48 @@ namespace BriterEncoder {
         msg.data[1] = id;
         msg.data[2] = FUNC_READ;
 
-        sendCANFrame(msg);
+        return sendCANFrame(msg);
+    }
+
+    bool setAutoReport(uint8_t id, uint16_t intervalMs)
+    {
+        if (!validId(id) || intervalMs < AUTO_TIME_MIN_MS)
+            return false;
+
+        // Interval first, so the encoder never pushes at a stale rate
+        uint8_t t[2] = { (uint8_t)intervalMs, (uint8_t)(intervalMs >> 8) };
+        if (!sendCommand(id, FUNC_SET_AUTO_TIME, t, sizeof(t)))
+            return false;
+
+        uint8_t mode = MODE_AUTO;
+        if (!sendCommand(id, FUNC_SET_MODE, &mode, 1))
+            return false;
+
+        autoIntervalMs[id - FIRST_ID] = intervalMs;
+        return true;
+    }
+
+    bool setQueryMode(uint8_t id)
+    {
+        if (!validId(id))
+            return false;
+
+        uint8_t mode = MODE_QUERY;
+        if (!sendCommand(id, FUNC_SET_MODE, &mode, 1))
+            return false;
+
+        autoIntervalMs[id - FIRST_ID] = 0;
+        return true;
+    }
+
+    bool isAutoReport(uint8_t id)
+    {
+        return validId(id) && autoIntervalMs[id - FIRST_ID] != 0;
+    }
+
+    uint16_t autoReportInterval(uint8_t id)
+    {
+        return validId(id) ? autoIntervalMs[id - FIRST_ID] : 0;
     }
 
     void sendZero(uint8_t id)
@@ -9,14 +9,35 @@ namespace BriterEncoder {
     constexpr uint8_t NUM_ENCODERS  = (LAST_ID - FIRST_ID + 1);
 
     // Protocol function codes
-    constexpr uint8_t FUNC_READ = 0x01;
-    constexpr uint8_t FUNC_ZERO = 0x06;
+    constexpr uint8_t FUNC_READ          = 0x01;
+    constexpr uint8_t FUNC_SET_MODE      = 0x04;
+    constexpr uint8_t FUNC_SET_AUTO_TIME = 0x05;
+    constexpr uint8_t FUNC_ZERO          = 0x06;
+
+    // FUNC_SET_MODE values
+    constexpr uint8_t MODE_QUERY = 0x00;    // value only on FUNC_READ request
+    constexpr uint8_t MODE_AUTO  = 0xAA;    // encoder pushes value every auto time
+
+    // Auto-return interval limits (ms)
+    constexpr uint16_t AUTO_TIME_MIN_MS = 1;
+    constexpr uint16_t AUTO_TIME_MAX_MS = 65535;
 
     // TX commands
-    void sendRead(uint8_t id);
+    bool sendRead(uint8_t id);
     void sendZero(uint8_t id);
     void sendZeroAll();
 
+    /*
+     * Auto-report (push) mode.
+     * In MODE_AUTO the encoder sends its value unsolicited every
+     * interval, in the same frame layout as a READ response, so no
+     * request traffic is needed at all.
+     */
+    bool setAutoReport(uint8_t id, uint16_t intervalMs);
+    bool setQueryMode(uint8_t id);
+    bool isAutoReport(uint8_t id);
+    uint16_t autoReportInterval(uint8_t id);
+
     // RX handling
     bool isBriterMessage(const twai_message_t& msg);
     bool parseReadResponse(const twai_message_t& msg,
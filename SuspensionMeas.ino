@@ -4,11 +4,15 @@
 #include "can_bus.h"
 #include "BriterEncoder.h"
 #include "measurements.h"
+#include "encoder_poll.h"
 #include "serial_cli.h"
+#include "sdlog.h"
+#include "telemetry.h"
+#include "debug.h"
+#include "perf.h"
 // #include "ota_update.h"   // myöhemmin
 
-// Active encoder ID (Briter encoders start from ID 3)
-uint8_t actID = 3;
+// Briter encoders start from ID 3
 const uint8_t FIRST_ID = 3;
 const uint8_t LAST_ID  = 6;
 
@@ -16,25 +20,27 @@ const uint8_t LAST_ID  = 6;
 void setup()
 {
     initSerialCli();
+    initDebug();
+    initPerf();
     initCAN();
     initMeasurements();
-    // initOTA();
-}
-
-void loop()
-{
-    handleCAN();
+    startCANRxTask();
 
-    static uint32_t lastPoll = 0;
-    if (millis() - lastPoll >= 10) {
-        BriterEncoder::sendRead(actID);
+    initEncoderPolling();
+    startEncoderPolling();
 
-        actID++;
-        if (actID > BriterEncoder::LAST_ID)
-            actID = BriterEncoder::FIRST_ID;
+    initTelemetry();
 
-        lastPoll = millis();
+    if (!sdlog_init()) {
+        DBG_ERROR("[SD][ERR] SD card init failed, logging unavailable");
     }
+    // initOTA();
+}
 
+void loop()
+{
+    // CAN RX (startCANRxTask) and encoder polling (startEncoderPolling)
+    // run in their own tasks; loop() only does housekeeping.
+    PerfScope perf(PERF_LOOP);
     handleSerialCli();
 }
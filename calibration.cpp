@@ -0,0 +1,223 @@
+#include "calibration.h"
+#include "BriterEncoder.h"
+#include "sdlog.h"
+#include "debug.h"
+
+#include <Preferences.h>
+#include <atomic>
+#include <string.h>
+
+/* =========================
+ *  NVS LAYOUT
+ * ========================= */
+
+#define CAL_NVS_NAMESPACE   "suspmeas"
+#define CAL_NVS_KEY         "cal"
+
+/*
+ * CAL_NVS_VERSION
+ *
+ * Increment whenever CalBlob changes; a stored blob of another version
+ * (or size) is ignored and defaults are used.
+ */
+#define CAL_NVS_VERSION     1
+
+typedef struct __attribute__((packed)) {
+    uint8_t version;
+    struct __attribute__((packed)) {
+        int32_t scale_q16;
+        int32_t offset;
+        int32_t wrap_at;
+        int32_t wrap_span;
+        uint8_t invert;
+    } enc[BriterEncoder::NUM_ENCODERS];
+} CalBlob;
+
+/* =========================
+ *  INTERNAL STATE
+ * ========================= */
+
+/*
+ * Written from the CLI, read on every sample by the RX task: each entry
+ * has its own sequence counter (odd while being updated).
+ */
+struct CalSlot {
+    std::atomic<uint32_t> seq;
+    EncoderCal cal;
+};
+
+static CalSlot slots[BriterEncoder::NUM_ENCODERS];
+static std::atomic<bool> changed{false};
+
+static EncoderCal defaultCal()
+{
+    EncoderCal c = {};
+    c.scale_q16 = CAL_DEFAULT_SCALE_Q16;
+    c.offset    = 0;
+    c.wrap_at   = CAL_DEFAULT_WRAP_AT;
+    c.wrap_span = CAL_DEFAULT_WRAP_SPAN;
+    c.invert    = false;
+    return c;
+}
+
+static void store(uint8_t idx, const EncoderCal& cal)
+{
+    CalSlot& s = slots[idx];
+    const uint32_t seq = s.seq.load(std::memory_order_relaxed);
+
+    s.seq.store(seq + 1, std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_release);
+    s.cal = cal;
+    s.seq.store(seq + 2, std::memory_order_release);
+
+    changed.store(true, std::memory_order_release);
+}
+
+static bool save()
+{
+    CalBlob blob = {};
+    blob.version = CAL_NVS_VERSION;
+
+    for (uint8_t i = 0; i < BriterEncoder::NUM_ENCODERS; i++) {
+        EncoderCal c;
+        getCalibration(i, c);
+        blob.enc[i].scale_q16 = c.scale_q16;
+        blob.enc[i].offset    = c.offset;
+        blob.enc[i].wrap_at   = c.wrap_at;
+        blob.enc[i].wrap_span = c.wrap_span;
+        blob.enc[i].invert    = c.invert ? 1 : 0;
+    }
+
+    Preferences prefs;
+    if (!prefs.begin(CAL_NVS_NAMESPACE, false))
+        return false;
+
+    bool ok = prefs.putBytes(CAL_NVS_KEY, &blob, sizeof(blob)) == sizeof(blob);
+    prefs.end();
+
+    if (!ok)
+        DBG_ERROR("[CAL][ERR] NVS save failed");
+    return ok;
+}
+
+/* =========================
+ *  PUBLIC API
+ * ========================= */
+
+void initCalibration()
+{
+    CalBlob blob = {};
+    bool loaded = false;
+
+    Preferences prefs;
+    if (prefs.begin(CAL_NVS_NAMESPACE, true)) {
+        loaded = prefs.getBytesLength(CAL_NVS_KEY) == sizeof(blob) &&
+                 prefs.getBytes(CAL_NVS_KEY, &blob, sizeof(blob)) == sizeof(blob) &&
+                 blob.version == CAL_NVS_VERSION;
+        prefs.end();
+    }
+
+    for (uint8_t i = 0; i < BriterEncoder::NUM_ENCODERS; i++) {
+        EncoderCal c = defaultCal();
+        if (loaded) {
+            c.scale_q16 = blob.enc[i].scale_q16;
+            c.offset    = blob.enc[i].offset;
+            c.wrap_at   = blob.enc[i].wrap_at;
+            c.wrap_span = blob.enc[i].wrap_span;
+            c.invert    = blob.enc[i].invert != 0;
+        }
+        store(i, c);
+    }
+
+    DBG_INFO(loaded ? "[CAL] loaded from NVS" : "[CAL] defaults (nothing stored)");
+}
+
+bool getCalibration(uint8_t idx, EncoderCal& out)
+{
+    if (idx >= BriterEncoder::NUM_ENCODERS)
+        return false;
+
+    const CalSlot& s = slots[idx];
+    uint32_t s0, s1;
+
+    do {
+        s0 = s.seq.load(std::memory_order_acquire);
+        out = s.cal;
+        std::atomic_thread_fence(std::memory_order_acquire);
+        s1 = s.seq.load(std::memory_order_relaxed);
+    } while ((s0 & 1) || s0 != s1);
+
+    return true;
+}
+
+int32_t calibrateUm(uint8_t idx, int32_t raw)
+{
+    EncoderCal c;
+    getCalibration(idx, c);
+    return calibrationApply(c, raw);
+}
+
+bool setCalibration(uint8_t idx, const EncoderCal& cal)
+{
+    if (idx >= BriterEncoder::NUM_ENCODERS)
+        return false;
+
+    store(idx, cal);
+    return save();
+}
+
+bool resetCalibration(uint8_t idx)
+{
+    return setCalibration(idx, defaultCal());
+}
+
+bool calibrationTakeChanged()
+{
+    return changed.load(std::memory_order_relaxed) &&
+           changed.exchange(false, std::memory_order_acquire);
+}
+
+/* =========================
+ *  LOG RECORD
+ * ========================= */
+
+size_t calibrationEncodeRecord(uint8_t* out, size_t maxLen, uint64_t tsUs)
+{
+    const size_t payloadLen = sizeof(SdlogCalHeader) +
+                              BriterEncoder::NUM_ENCODERS * sizeof(SdlogCalEntry);
+    const size_t total = SDLOG_LP_HEADER_SIZE + payloadLen;
+
+    if (total > maxLen)
+        return 0;
+
+    size_t n = 0;
+    out[n++] = REC_CALIB;
+    uint16_t len = (uint16_t)payloadLen;
+    memcpy(&out[n], &len, 2);
+    n += 2;
+
+    SdlogCalHeader hdr = {
+        .ts_us    = tsUs,
+        .encoders = BriterEncoder::NUM_ENCODERS
+    };
+    memcpy(&out[n], &hdr, sizeof(hdr));
+    n += sizeof(hdr);
+
+    for (uint8_t i = 0; i < BriterEncoder::NUM_ENCODERS; i++) {
+        EncoderCal c;
+        getCalibration(i, c);
+
+        SdlogCalEntry e = {
+            .id        = (uint8_t)(BriterEncoder::FIRST_ID + i),
+            .scale_q16 = c.scale_q16,
+            .offset    = c.offset,
+            .wrap_at   = c.wrap_at,
+            .wrap_span = c.wrap_span,
+            .flags     = (uint8_t)(c.invert ? SDLOG_CAL_INVERT : 0)
+        };
+        memcpy(&out[n], &e, sizeof(e));
+        n += sizeof(e);
+    }
+
+    return n;
+}
@@ -0,0 +1,72 @@
+#pragma once
+
+#include <stdint.h>
+#include <stddef.h>
+
+/*
+ * Per-encoder raw count -> length calibration.
+ *
+ *   counts = raw
+ *   if (wrap_span && counts >= wrap_at) counts -= wrap_span
+ *   um     = ((counts - offset) * scale_q16) >> 16
+ *   if (invert) um = -um
+ *
+ * Integer only: one 32x32 -> 64 bit multiply per sample. The table is
+ * persisted in NVS and written to every log file (REC_CALIB), so logs
+ * can keep raw counts and be recalibrated offline.
+ */
+
+struct EncoderCal {
+    int32_t scale_q16;      // micrometres per count, Q16.16
+    int32_t offset;         // counts, subtracted after wrap correction
+    int32_t wrap_at;        // raw counts at or above this are wrapped
+    int32_t wrap_span;      // counts subtracted when wrapping, 0 = no wrap
+    bool    invert;
+};
+
+/*
+ * Defaults reproduce the original fixed conversion:
+ * 485 mm per 32767 counts, values above 700 mm wrapped by -1455 mm.
+ */
+#define CAL_DEFAULT_SCALE_Q16   970030      // 485000 um / 32767 counts * 65536
+#define CAL_DEFAULT_WRAP_AT     47293       // 700 mm
+#define CAL_DEFAULT_WRAP_SPAN   98301       // 1455 mm
+
+static inline int32_t calibrationApply(const EncoderCal& c, int32_t raw)
+{
+    int32_t counts = raw;
+    if (c.wrap_span != 0 && counts >= c.wrap_at)
+        counts -= c.wrap_span;
+
+    int32_t um = (int32_t)(((int64_t)(counts - c.offset) * c.scale_q16) >> 16);
+    return c.invert ? -um : um;
+}
+
+// Load the table from NVS (defaults if missing or invalid)
+void initCalibration();
+
+// Consistent copy of encoder index 0..3, safe from any task
+bool getCalibration(uint8_t idx, EncoderCal& out);
+
+// Raw counts -> micrometres for encoder index 0..3 (RX path)
+int32_t calibrateUm(uint8_t idx, int32_t raw);
+
+/*
+ * Replace the calibration of encoder index 0..3 and save the table to
+ * NVS. Returns false for a bad index or if saving failed (the new
+ * values are in use either way).
+ */
+bool setCalibration(uint8_t idx, const EncoderCal& cal);
+bool resetCalibration(uint8_t idx);
+
+/*
+ * True once after any calibration change. The log producer uses this
+ * to write a new REC_CALIB record while logging.
+ */
+bool calibrationTakeChanged();
+
+/*
+ * Encode the REC_CALIB record (see sdlog.h) for all encoders.
+ * Returns the record length, 0 if it does not fit.
+ */
+size_t calibrationEncodeRecord(uint8_t* out, size_t maxLen, uint64_t tsUs);
@@ -1,45 +1,689 @@
 #include "can_bus.h"
 #include "config.h"
 #include "measurements.h"
+#include "BriterEncoder.h"
 #include "debug.h"
 #include "sdlog.h"
+#include "sniff_filter.h"
+#include "perf.h"
+#include "tasks.h"
+#include "can_id_table.h"
 
 #include <Arduino.h>
+#include <Preferences.h>
+#include <esp_timer.h>
+
+#include <atomic>
+
+/* =========================
+ *  CAN RX CONFIGURATION
+ * ========================= */
+
+/*
+ * CAN_RX_QUEUE_LEN
+ *
+ * TWAI driver RX queue length (frames).
+ * Covers the time the RX task may be blocked by higher priority work.
+ * At 500 kbit/s a full bus is ~4500 frames/s, i.e. ~4.5 frames per ms.
+ * Default only: "can queue" (or the automatic growth) overrides it.
+ */
+#define CAN_RX_QUEUE_LEN    64
+
+/*
+ * CAN_TX_QUEUE_LEN
+ *
+ * TWAI driver TX queue length (frames).
+ * Must hold one full pipelined polling burst (all encoders) plus margin.
+ */
+#define CAN_TX_QUEUE_LEN    16
+
+/*
+ * CAN_RX_QUEUE_MIN / CAN_RX_QUEUE_MAX / CAN_TX_QUEUE_MIN / CAN_TX_QUEUE_MAX
+ *
+ * Limits for "can queue" and the automatic RX queue growth. A queued
+ * frame takes ~16 bytes of driver RAM, so the largest RX queue costs
+ * 16 KB and holds ~230 ms of a full bus.
+ */
+#define CAN_RX_QUEUE_MIN    16
+#define CAN_RX_QUEUE_MAX    1024
+#define CAN_TX_QUEUE_MIN    4
+#define CAN_TX_QUEUE_MAX    64
+
+/*
+ * CAN_QUEUE_NVS_NAMESPACE / CAN_QUEUE_NVS_KEY
+ *
+ * Queue lengths set at runtime (or grown automatically) are stored
+ * here and used by initCAN() on the next boot.
+ */
+#define CAN_QUEUE_NVS_NAMESPACE "suspmeas"
+#define CAN_QUEUE_NVS_KEY       "canq"
+
+/*
+ * CAN_RX_BATCH_MAX
+ *
+ * Maximum frames drained from the driver per wakeup before they are
+ * dispatched. Bounds stack usage and dispatch latency of the first frame.
+ */
+#define CAN_RX_BATCH_MAX    16
+
+/*
+ * CAN_RX_WAIT_MS
+ *
+ * Block time for the first frame of a batch. Only limits how quickly
+ * the task notices the driver going away; frames wake it immediately.
+ */
+#define CAN_RX_WAIT_MS      100
+
+/*
+ * CAN_BITRATE / CAN_FRAME_MIN_BITS / CAN_FRAME_MIN_BITS_EXT
+ *
+ * Shortest possible frame on the wire (no stuff bits) plus the 3 bit
+ * intermission, excluding data. Used to back-date frames that were
+ * already queued when the RX task woke up.
+ */
+#define CAN_BITRATE             500000
+#define CAN_FRAME_MIN_BITS      47
+#define CAN_FRAME_MIN_BITS_EXT  67
+
+/* =========================
+ *  CAN HEALTH CONFIGURATION
+ * ========================= */
+
+/*
+ * CAN_STATE_CHECK_MS
+ *
+ * How often the RX task reads the controller state. Bounds how long a
+ * bus-off goes unnoticed before recovery is started.
+ */
+#define CAN_STATE_CHECK_MS      100
+
+/*
+ * CAN_HEALTH_INTERVAL_MS
+ *
+ * Length of one health interval: frame rates, bus load and the
+ * REC_CAN_HEALTH record in the SD log (while logging) are per interval.
+ */
+#define CAN_HEALTH_INTERVAL_MS  1000
+
+/*
+ * CAN_HEALTH_MAX_IDS / CAN_HEALTH_ID_SLOTS
+ *
+ * Distinct IDs with their own rate; frames of further IDs are only
+ * counted as "other". The table (can_id_table.h) has twice as many
+ * slots, so a lookup in the RX path is one or two probes.
+ */
+#define CAN_HEALTH_MAX_IDS      32
+#define CAN_HEALTH_ID_SLOTS     64
+
+/*
+ * CAN_STUFF_PERCENT
+ *
+ * Bus load is estimated from the frames seen, not measured: each frame
+ * counts with its minimal length plus this many percent of stuff bits
+ * (typical for vehicle data; the worst case is ~20 %).
+ */
+#define CAN_STUFF_PERCENT       10
+
+static std::atomic<bool> canInitialized{false};
+static TaskHandle_t canRxTaskHandle = nullptr;
+static TaskHandle_t canCtlTaskHandle = nullptr;
+static CanRxStats rxStats = {};
+static uint64_t lastRxUs = 0;       // RX time of the last dispatched frame
+
+// Driver queue lengths in use, and requested changes (applied by the RX task)
+static uint32_t rxQueueLen = CAN_RX_QUEUE_LEN;
+static uint32_t txQueueLen = CAN_TX_QUEUE_LEN;
+static std::atomic<uint32_t> pendingRxQueueLen{0};
+static std::atomic<uint32_t> pendingTxQueueLen{0};
+static std::atomic<bool>     queueAuto{true};
+static std::atomic<bool>     filterReloadPending{false};
+
+/*
+ * TX gate: sendCANFrame() callers count themselves in before
+ * twai_transmit(), a driver restart closes the gate and waits for the
+ * count to drop to zero (at most the 50 ms transmit timeout), so no
+ * transmit is blocked on a queue the uninstall deletes. Both sides
+ * store before they load, hence the default (seq_cst) ordering.
+ */
+static std::atomic<bool>     txPaused{false};
+static std::atomic<uint32_t> txInFlight{0};
+
+// Driver restart handed to the can_ctl task (see reinstallDriver())
+struct DriverSwap {
+    uint32_t     rxLen;
+    uint32_t     txLen;
+    bool         ok;
+    TaskHandle_t waiter;
+};
+static DriverSwap ctlSwap;
+
+/*
+ * Health monitor state. Written by the RX task (processRxBatch() and
+ * canHealthTick()) only, except the TX counters, which the polling task
+ * updates in sendCANFrame().
+ */
+struct IdCounts {
+    uint32_t frames;            // since reset
+    uint32_t interval;          // in the current interval
+    uint32_t rate;              // frames/s, last interval
+};
+
+// Status counters as last read from the driver, and folded totals
+struct DriverCounters {
+    uint32_t rx_missed;
+    uint32_t rx_overrun;
+    uint32_t tx_failed;
+    uint32_t arb_lost;
+    uint32_t bus_errors;
+};
+
+static CanIdTable<IdCounts, CAN_HEALTH_ID_SLOTS, CAN_HEALTH_MAX_IDS> idTable;
+static uint32_t otherFrames = 0;            // current interval
+static uint32_t rxBits = 0;                 // current interval
+static uint32_t rxFrames = 0;
+static std::atomic<uint32_t> txBits{0};
+static std::atomic<uint32_t> txFrames{0};
+
+static DriverCounters drvLast = {};
+static DriverCounters drvTotal = {};
+static CanHealth health = {};
+static uint64_t  intervalStartUs = 0;
+static uint64_t  lastStateCheckUs = 0;
+static bool      recovering = false;
+static bool      recoveredInInterval = false;
+static std::atomic<bool> healthResetPending{false};
 
-static bool canInitialized = false;
 // Global CAN operating mode
 CanMode canMode = CAN_MODE_NORMAL;
 
-void initCAN()
+struct QueueConfig {
+    uint16_t rx_len;
+    uint16_t tx_len;
+    uint8_t  auto_grow;
+};
+
+static void loadQueueConfig()
 {
-    pinMode(CAN_SE_PIN, OUTPUT);
-    digitalWrite(CAN_SE_PIN, LOW);   // SN65HVD231
+    QueueConfig cfg;
+    Preferences prefs;
+    if (!prefs.begin(CAN_QUEUE_NVS_NAMESPACE, true))
+        return;
+
+    if (prefs.getBytesLength(CAN_QUEUE_NVS_KEY) == sizeof(cfg) &&
+        prefs.getBytes(CAN_QUEUE_NVS_KEY, &cfg, sizeof(cfg)) == sizeof(cfg) &&
+        cfg.rx_len >= CAN_RX_QUEUE_MIN && cfg.rx_len <= CAN_RX_QUEUE_MAX &&
+        cfg.tx_len >= CAN_TX_QUEUE_MIN && cfg.tx_len <= CAN_TX_QUEUE_MAX) {
+        rxQueueLen = cfg.rx_len;
+        txQueueLen = cfg.tx_len;
+        queueAuto.store(cfg.auto_grow != 0, std::memory_order_relaxed);
+    }
+    prefs.end();
+}
 
+static void storeQueueConfig(uint32_t rxLen, uint32_t txLen)
+{
+    QueueConfig cfg = {
+        .rx_len    = (uint16_t)rxLen,
+        .tx_len    = (uint16_t)txLen,
+        .auto_grow = (uint8_t)(queueAuto.load(std::memory_order_relaxed) ? 1 : 0)
+    };
+    Preferences prefs;
+    if (prefs.begin(CAN_QUEUE_NVS_NAMESPACE, false)) {
+        prefs.putBytes(CAN_QUEUE_NVS_KEY, &cfg, sizeof(cfg));
+        prefs.end();
+    }
+}
+
+static bool installDriver(uint32_t rxLen, uint32_t txLen)
+{
     twai_general_config_t g_config =
         TWAI_GENERAL_CONFIG_DEFAULT(CAN_TX_PIN, CAN_RX_PIN, TWAI_MODE_NORMAL);
+    g_config.rx_queue_len = rxLen;
+    g_config.tx_queue_len = txLen;
 
     twai_timing_config_t t_config = TWAI_TIMING_CONFIG_500KBITS();
-    twai_filter_config_t f_config = TWAI_FILTER_CONFIG_ACCEPT_ALL();
+    twai_filter_config_t f_config;
+    sniffAcceptanceFilter(f_config);
 
     if (twai_driver_install(&g_config, &t_config, &f_config) != ESP_OK) {
         DBG_ERROR("[CAN][ERR] TWAI driver install failed");
-        return;
+        return false;
     }
 
     if (twai_start() != ESP_OK) {
         DBG_ERROR("[CAN][ERR] TWAI start failed");
-        return;
+        twai_driver_uninstall();
+        return false;
     }
 
+    rxQueueLen = rxLen;
+    txQueueLen = txLen;
+    return true;
+}
+
+void initCAN()
+{
+    pinMode(CAN_SE_PIN, OUTPUT);
+    digitalWrite(CAN_SE_PIN, LOW);   // SN65HVD231
+
+    loadQueueConfig();
+    initSniffFilter();
+    if (!installDriver(rxQueueLen, txQueueLen))
+        return;
+
     canInitialized = true;
-    DBG_INFO("[CAN] initialized");
+    DBG_INFOF("[CAN] initialized, RX queue %lu, TX queue %lu\n",
+              (unsigned long)rxQueueLen, (unsigned long)txQueueLen);
 
     twai_status_info_t status;
     twai_get_status_info(&status);
     DBG_INFOF("[CAN] TWAI state: %d\n", status.state);
 }
 
-void handleCAN()
+static void dispatchFrame(const twai_message_t& msg, uint64_t rxUs)
+{
+    PerfScope perf(PERF_CAN_FRAME);
+
+    CanFrame frame;
+    frame.ts_us = rxUs;
+    frame.id   = msg.identifier;
+    frame.extd = msg.extd;
+    frame.dlc  = (msg.data_length_code > 8) ? 8 : msg.data_length_code;
+    memcpy(frame.data, msg.data, frame.dlc);
+
+    // ===== SNIFFER MODE =====
+    if (canMode == CAN_MODE_SNIFFER) {
+        if (sdlog_is_running() && sniffFilterAccept(frame))
+            sdlog_log_sniff(frame);
+
+        // Encoders in auto-report mode need no TX: their pushed values
+        // are still usable while sniffing.
+        if (BriterEncoder::isBriterMessage(msg)) {
+            handleCANMessage(msg, rxUs);
+        }
+        return;   // EI muuta logiikkaa
+    }
+
+    // ===== NORMAL MODE =====
+    DBG_VERBOSEF("[CAN][RX] ID=0x%lX DLC=%d\n",
+                 msg.identifier,
+                 msg.data_length_code);
+
+    // Encoder values are logged as four-corner REC_SENSORS frames,
+    // everything else as raw frames
+    if (!handleCANMessage(msg, rxUs)) {
+        sdlog_log_vehicle_frame(frame);
+    }
+}
+
+static uint32_t frameMinBits(const twai_message_t& msg)
+{
+    return (msg.extd ? CAN_FRAME_MIN_BITS_EXT : CAN_FRAME_MIN_BITS) +
+           8 * ((msg.data_length_code > 8) ? 8 : msg.data_length_code);
+}
+
+static uint32_t frameMinWireUs(const twai_message_t& msg)
+{
+    return frameMinBits(msg) * 1000000UL / CAN_BITRATE;
+}
+
+/* =========================
+ *  CAN HEALTH
+ * ========================= */
+
+// Count a received frame for its ID (RX task)
+static void countRxFrame(const twai_message_t& msg)
+{
+    rxFrames++;
+    rxBits += frameMinBits(msg);
+
+    const bool counted = idTable.update(canIdKey(msg.identifier, msg.extd), [](IdCounts& e) {
+        e.frames++;
+        e.interval++;
+    });
+    if (!counted)
+        otherFrames++;
+}
+
+static uint32_t counterDelta(uint32_t now, uint32_t last)
+{
+    // Counters restart at 0 with the driver
+    return now >= last ? now - last : now;
+}
+
+// Fold the driver's counters into the totals (RX task)
+static void foldDriverCounters(const twai_status_info_t& st, uint32_t* missed, uint32_t* overrun)
+{
+    DriverCounters now = {
+        .rx_missed  = st.rx_missed_count,
+        .rx_overrun = st.rx_overrun_count,
+        .tx_failed  = st.tx_failed_count,
+        .arb_lost   = st.arb_lost_count,
+        .bus_errors = st.bus_error_count
+    };
+
+    const uint32_t m = counterDelta(now.rx_missed, drvLast.rx_missed);
+    const uint32_t o = counterDelta(now.rx_overrun, drvLast.rx_overrun);
+    drvTotal.rx_missed  += m;
+    drvTotal.rx_overrun += o;
+    drvTotal.tx_failed  += counterDelta(now.tx_failed, drvLast.tx_failed);
+    drvTotal.arb_lost   += counterDelta(now.arb_lost, drvLast.arb_lost);
+    drvTotal.bus_errors += counterDelta(now.bus_errors, drvLast.bus_errors);
+    drvLast = now;
+
+    if (missed)
+        *missed += m;
+    if (overrun)
+        *overrun += o;
+}
+
+static void logHealthRecord(uint8_t flags, uint32_t frames)
+{
+    static uint8_t rec[SDLOG_LP_HEADER_SIZE + sizeof(SdlogCanHealthHeader) +
+                       CAN_HEALTH_MAX_IDS * sizeof(SdlogCanIdRate)];
+    size_t n = SDLOG_LP_HEADER_SIZE + sizeof(SdlogCanHealthHeader);
+    uint16_t ids = 0;
+
+    idTable.forEach([&](uint32_t key, const IdCounts& e) {
+        if (e.interval == 0)
+            return;
+        SdlogCanIdRate r = {
+            .id     = canIdOf(key) | (canIdExtd(key) ? SDLOG_CANH_ID_EXTD : 0),
+            .frames = e.interval
+        };
+        memcpy(&rec[n], &r, sizeof(r));
+        n += sizeof(r);
+        ids++;
+    });
+
+    SdlogCanHealthHeader h = {
+        .ts_us             = health.ts_us,
+        .interval_ms       = health.interval_ms,
+        .state             = (uint8_t)health.state,
+        .flags             = flags,
+        .bus_load_permille = (uint16_t)health.bus_load_permille,
+        .tx_error_counter  = (uint16_t)health.tx_error_counter,
+        .rx_error_counter  = (uint16_t)health.rx_error_counter,
+        .frames            = frames,
+        .rx_missed         = drvTotal.rx_missed,
+        .rx_overrun        = drvTotal.rx_overrun,
+        .tx_failed         = drvTotal.tx_failed,
+        .arb_lost          = drvTotal.arb_lost,
+        .bus_errors        = drvTotal.bus_errors,
+        .bus_off           = (uint16_t)health.bus_off,
+        .rx_queue_len      = (uint16_t)rxQueueLen,
+        .tx_queue_len      = (uint16_t)txQueueLen,
+        .ids               = ids,
+        .other_frames      = otherFrames,
+        .dropped           = sdlog_dropped()
+    };
+
+    rec[0] = REC_CAN_HEALTH;
+    const uint16_t len = (uint16_t)(n - SDLOG_LP_HEADER_SIZE);
+    memcpy(&rec[1], &len, 2);
+    memcpy(&rec[SDLOG_LP_HEADER_SIZE], &h, sizeof(h));
+    sdlog_push(rec, n);
+}
+
+/*
+ * Close the current health interval: per-ID rates, bus load, lost
+ * frames. Missed frames were on the bus too and count towards the load
+ * with the average length of the received ones.
+ */
+static void closeHealthInterval(uint64_t nowUs, const twai_status_info_t& st)
+{
+    const uint64_t dtUs = nowUs - intervalStartUs;
+
+    uint32_t missed = 0, overrun = 0;
+    foldDriverCounters(st, &missed, &overrun);
+
+    const uint32_t tf = txFrames.exchange(0, std::memory_order_relaxed);
+    const uint32_t tb = txBits.exchange(0, std::memory_order_relaxed);
+    uint64_t frames = (uint64_t)rxFrames + tf + missed;
+    uint64_t bits   = (uint64_t)rxBits + tb;
+    if (missed)
+        bits += (uint64_t)missed * (rxFrames ? rxBits / rxFrames : CAN_FRAME_MIN_BITS + 64);
+    bits += bits * CAN_STUFF_PERCENT / 100;
+
+    health.ts_us             = nowUs;
+    health.interval_ms       = (uint32_t)(dtUs / 1000);
+    health.state             = st.state;
+    health.tx_error_counter  = st.tx_error_counter;
+    health.rx_error_counter  = st.rx_error_counter;
+    health.frame_rate        = (uint32_t)(frames * 1000000ULL / dtUs);
+    health.bus_load_permille = (uint32_t)(bits * 1000ULL * 1000000ULL / ((uint64_t)CAN_BITRATE * dtUs));
+    health.other_rate        = (uint32_t)((uint64_t)otherFrames * 1000000ULL / dtUs);
+    health.ids               = idTable.count();
+
+    idTable.forEach([&](uint32_t, IdCounts& e) {
+        e.rate = (uint32_t)((uint64_t)e.interval * 1000000ULL / dtUs);
+    });
+
+    uint8_t flags = 0;
+    if (missed || overrun) {
+        flags |= SDLOG_CANH_LOSS;
+        health.loss_intervals++;
+        DBG_ERRORF("[CAN][ERR] lost frames: %lu missed (RX queue %lu full), %lu overrun\n",
+                   (unsigned long)missed, (unsigned long)rxQueueLen, (unsigned long)overrun);
+
+        // Only a full driver queue is helped by a longer one
+        if (missed && queueAuto.load(std::memory_order_relaxed) &&
+            rxQueueLen < CAN_RX_QUEUE_MAX &&
+            pendingRxQueueLen.load(std::memory_order_relaxed) == 0) {
+            const uint32_t grown = rxQueueLen * 2 > CAN_RX_QUEUE_MAX ? CAN_RX_QUEUE_MAX
+                                                                     : rxQueueLen * 2;
+            pendingTxQueueLen.store(txQueueLen, std::memory_order_relaxed);
+            pendingRxQueueLen.store(grown, std::memory_order_release);
+            health.queue_grows++;
+        }
+    }
+    if (recoveredInInterval)
+        flags |= SDLOG_CANH_RECOVERED;
+
+    if (sdlog_is_running())
+        logHealthRecord(flags, (uint32_t)frames);
+
+    idTable.forEach([](uint32_t, IdCounts& e) { e.interval = 0; });
+    rxFrames = 0;
+    rxBits = 0;
+    otherFrames = 0;
+    recoveredInInterval = false;
+    intervalStartUs = nowUs;
+}
+
+static void clearHealth()
+{
+    idTable.clear();
+    otherFrames = 0;
+    rxFrames = 0;
+    rxBits = 0;
+    txFrames.store(0, std::memory_order_relaxed);
+    txBits.store(0, std::memory_order_relaxed);
+    drvTotal = {};
+    health = {};
+    recoveredInInterval = false;
+    intervalStartUs = (uint64_t)esp_timer_get_time();
+}
+
+static int processRxBatch(TickType_t wait);
+
+static void pauseTx()
+{
+    txPaused.store(true);
+    while (txInFlight.load() != 0)
+        vTaskDelay(1);
+}
+
+static void resumeTx()
+{
+    txPaused.store(false);
+}
+
+// Stop, uninstall and install again; runs on TASK_CORE_IO
+static bool swapDriver(uint32_t rxLen, uint32_t txLen)
+{
+    twai_stop();
+    twai_driver_uninstall();
+
+    if (installDriver(rxLen, txLen))
+        return true;
+    // Fall back to what worked before
+    return installDriver(rxQueueLen, txQueueLen);
+}
+
+/*
+ * The TWAI interrupt is allocated on the core that installs the driver,
+ * and it has to stay off the acquisition core: the RX task hands the
+ * uninstall / install pair to this task on TASK_CORE_IO and waits.
+ */
+static void can_ctl_task(void*)
+{
+    while (true) {
+        ulTaskNotifyTake(pdTRUE, portMAX_DELAY);
+        ctlSwap.ok = swapDriver(ctlSwap.rxLen, ctlSwap.txLen);
+        xTaskNotifyGive(ctlSwap.waiter);
+    }
+}
+
+static bool swapDriverOnIoCore(uint32_t rxLen, uint32_t txLen)
+{
+    if (xPortGetCoreID() == TASK_CORE_IO)
+        return swapDriver(rxLen, txLen);
+
+    if (canCtlTaskHandle == nullptr &&
+        !startTask(can_ctl_task, "can_ctl", CAN_CTL_TASK_STACK,
+                   CAN_CTL_TASK_PRIO, TASK_CORE_IO, &canCtlTaskHandle)) {
+        DBG_ERROR("[CAN][ERR] can_ctl task failed, driver restarted on this core");
+        return swapDriver(rxLen, txLen);
+    }
+
+    ctlSwap.rxLen = rxLen;
+    ctlSwap.txLen = txLen;
+    ctlSwap.waiter = xTaskGetCurrentTaskHandle();
+    xTaskNotifyGive(canCtlTaskHandle);
+    ulTaskNotifyTake(pdTRUE, portMAX_DELAY);
+    return ctlSwap.ok;
+}
+
+/*
+ * Restart the driver with new queue lengths and the current acceptance
+ * filter. Frames already queued are received first; only frames
+ * arriving during the restart (well under a millisecond) are lost.
+ * Transmits are held off meanwhile (sendCANFrame() returns false).
+ * RX task context, or the Arduino loop when there is no RX task.
+ */
+static void reinstallDriver(uint32_t rxLen, uint32_t txLen)
+{
+    while (processRxBatch(0) > 0) {
+    }
+
+    twai_status_info_t st;
+    if (twai_get_status_info(&st) == ESP_OK)
+        foldDriverCounters(st, nullptr, nullptr);
+
+    canInitialized = false;
+    pauseTx();
+    const bool ok = swapDriverOnIoCore(rxLen, txLen);
+    drvLast = {};
+    recovering = false;
+    resumeTx();
+    if (!ok)
+        return;
+
+    canInitialized = true;
+    storeQueueConfig(rxQueueLen, txQueueLen);
+    DBG_INFOF("[CAN] queues now RX %lu, TX %lu\n",
+              (unsigned long)rxQueueLen, (unsigned long)txQueueLen);
+}
+
+/*
+ * Bus-off handling: the controller stops taking part in the bus; after
+ * twai_initiate_recovery() it waits for 128 x 11 recessive bits, then
+ * stops, and twai_start() puts it back on the bus.
+ */
+static void recoverBusOff(twai_state_t state)
+{
+    if (state == TWAI_STATE_BUS_OFF && !recovering) {
+        health.bus_off++;
+        DBG_ERROR("[CAN][ERR] bus-off, starting recovery");
+        if (twai_initiate_recovery() == ESP_OK)
+            recovering = true;
+    }
+    else if (state == TWAI_STATE_STOPPED && recovering) {
+        if (twai_start() == ESP_OK) {
+            recovering = false;
+            recoveredInInterval = true;
+            health.recoveries++;
+            DBG_INFO("[CAN] bus-off recovery complete, running");
+        }
+    }
+}
+
+/*
+ * Periodic part of the health monitor, called by whoever receives
+ * (RX task or handleCAN()): applies requested changes, watches the
+ * controller state and closes health intervals.
+ */
+static void canHealthTick(void)
+{
+    // Every pass while recovering: back on the bus as soon as possible
+    const uint64_t nowUs = (uint64_t)esp_timer_get_time();
+    if (!recovering && nowUs - lastStateCheckUs < CAN_STATE_CHECK_MS * 1000ULL)
+        return;
+    lastStateCheckUs = nowUs;
+
+    if (healthResetPending.exchange(false, std::memory_order_acquire))
+        clearHealth();
+
+    sniffFilterTick(nowUs);
+
+    if (!canInitialized)
+        return;
+
+    twai_status_info_t st;
+    if (twai_get_status_info(&st) != ESP_OK)
+        return;
+
+    recoverBusOff(st.state);
+
+    // The driver can only be restarted while running, not during recovery
+    if (st.state == TWAI_STATE_RUNNING &&
+        pendingRxQueueLen.load(std::memory_order_acquire) != 0) {
+        const uint32_t rxLen = pendingRxQueueLen.exchange(0, std::memory_order_acquire);
+        filterReloadPending.store(false, std::memory_order_relaxed);
+        reinstallDriver(rxLen, pendingTxQueueLen.load(std::memory_order_relaxed));
+        return;
+    }
+    if (st.state == TWAI_STATE_RUNNING &&
+        filterReloadPending.exchange(false, std::memory_order_acquire)) {
+        reinstallDriver(rxQueueLen, txQueueLen);
+        return;
+    }
+
+    if (intervalStartUs == 0)
+        intervalStartUs = nowUs;
+    else if (nowUs - intervalStartUs >= CAN_HEALTH_INTERVAL_MS * 1000ULL)
+        closeHealthInterval(nowUs, st);
+}
+
+/*
+ * Drain up to CAN_RX_BATCH_MAX frames from the driver queue, waiting up
+ * to 'wait' ticks for the first one, then dispatch them.
+ * Receiving the whole batch first frees driver queue slots as early as
+ * possible.
+ *
+ * RX time: the TWAI driver keeps no per-frame timestamp, so each frame
+ * is stamped the moment twai_receive() hands it over, before any
+ * dispatch work. A frame that was already waiting in the queue arrived
+ * earlier than that: it ended at least one (minimal) wire time of its
+ * successor before the successor did, so the stamps are walked back
+ * from the last frame. The result is an upper bound of the true arrival,
+ * exact when the bus was busy and the RX task was late, which is when
+ * it matters.
+ *
+ * Returns frames dispatched, or -1 if the driver reported an error.
+ */
+static int processRxBatch(TickType_t wait)
 {
     // Alive debug (verbose only)
     static uint32_t lastAlive = 0;
@@ -48,35 +692,98 @@ void handleCAN()
         lastAlive = millis();
     }
 
-    if (!canInitialized) {
-        return;
+    twai_message_t batch[CAN_RX_BATCH_MAX];
+    uint64_t rxUs[CAN_RX_BATCH_MAX];
+    size_t count = 0;
+
+    esp_err_t res = twai_receive(&batch[0], wait);
+    rxUs[0] = (uint64_t)esp_timer_get_time();
+    if (res == ESP_ERR_TIMEOUT) {
+        return 0;
+    }
+    if (res != ESP_OK) {
+        rxStats.rx_errors++;
+        DBG_ERRORF("[CAN][RX][ERR] receive failed, err=%d\n", res);
+        return -1;
     }
+    count = 1;
 
-    twai_message_t msg;
-    esp_err_t res = twai_receive(&msg, 0);
+    while (count < CAN_RX_BATCH_MAX && twai_receive(&batch[count], 0) == ESP_OK) {
+        rxUs[count] = (uint64_t)esp_timer_get_time();
+        count++;
+    }
 
-    if (res == ESP_OK) {
+    // Never before a frame already dispatched: keeps RX times monotonic
+    for (size_t i = count - 1; i > 0; i--) {
+        uint64_t latest = rxUs[i] - frameMinWireUs(batch[i]);
+        if (latest < lastRxUs)
+            latest = lastRxUs;
+        if (rxUs[i - 1] > latest)
+            rxUs[i - 1] = latest;
+    }
+    lastRxUs = rxUs[count - 1];
 
-        CanFrame frame;
-        frame.id  = msg.identifier;
-        frame.dlc = msg.data_length_code;
-        memcpy(frame.data, msg.data, frame.dlc);
+    for (size_t i = 0; i < count; i++) {
+        dispatchFrame(batch[i], rxUs[i]);
+        countRxFrame(batch[i]);
+        jitterAdd(JITTER_RX_LATENCY, (uint32_t)((uint64_t)esp_timer_get_time() - rxUs[i]));
+    }
 
-        // ===== SNIFFER MODE =====
-        if (canMode == CAN_MODE_SNIFFER) {
-            sdlog_log_sniff(frame);
-            return;   // EI muuta logiikkaa
+    rxStats.frames += count;
+    rxStats.batches++;
+    if (count > rxStats.batch_max)
+        rxStats.batch_max = count;
+
+    return (int)count;
+}
+
+static void can_rx_task(void*)
+{
+    while (true) {
+        if (!canInitialized) {
+            vTaskDelay(pdMS_TO_TICKS(CAN_RX_WAIT_MS));
+            continue;
+        }
+
+        if (processRxBatch(pdMS_TO_TICKS(CAN_RX_WAIT_MS)) < 0) {
+            // Driver not running (stopped / bus-off): don't spin
+            vTaskDelay(pdMS_TO_TICKS(10));
         }
+        canHealthTick();
+    }
+}
+
+void startCANRxTask()
+{
+    if (canRxTaskHandle != nullptr)
+        return;
 
-        // ===== NORMAL MODE =====
-        DBG_VERBOSEF("[CAN][RX] ID=0x%lX DLC=%d\n",
-                     msg.identifier,
-                     msg.data_length_code);
+    startTask(can_rx_task, "can_rx", CAN_RX_TASK_STACK,
+              CAN_RX_TASK_PRIO, TASK_CORE_ACQ, &canRxTaskHandle);
+
+    DBG_INFOF("[CAN] RX task started (core %d, prio %d)\n",
+              TASK_CORE_ACQ, CAN_RX_TASK_PRIO);
+}
 
-        handleCANMessage(msg);
+void handleCAN()
+{
+    // Polled mode: only when the RX task is not running
+    if (!canInitialized || canRxTaskHandle != nullptr) {
+        return;
     }
-    else if (res != ESP_ERR_TIMEOUT) {
-        DBG_ERRORF("[CAN][RX][ERR] receive failed, err=%d\n", res);
+
+    processRxBatch(0);
+    canHealthTick();
+}
+
+void getCANRxStats(CanRxStats& out)
+{
+    out = rxStats;
+
+    twai_status_info_t status;
+    if (canInitialized && twai_get_status_info(&status) == ESP_OK) {
+        out.rx_missed  = status.rx_missed_count;
+        out.rx_overrun = status.rx_overrun_count;
     }
 }
 
@@ -87,11 +794,109 @@ bool sendCANFrame(const twai_message_t& msg)
         return false;
     }
 
+    // Not while the driver is down or being restarted (reinstallDriver())
+    txInFlight.fetch_add(1);
+    if (txPaused.load() || !canInitialized) {
+        txInFlight.fetch_sub(1);
+        return false;
+    }
     esp_err_t res = twai_transmit(&msg, pdMS_TO_TICKS(50));
+    txInFlight.fetch_sub(1);
     if (res != ESP_OK) {
         DBG_ERRORF("[CAN][TX][ERR] transmit failed, err=%d\n", res);
         return false;
     }
+
+    txFrames.fetch_add(1, std::memory_order_relaxed);
+    txBits.fetch_add(frameMinBits(msg), std::memory_order_relaxed);
+    return true;
+}
+
+void getCANHealth(CanHealth& out)
+{
+    out = health;
+    out.rx_queue_len = rxQueueLen;
+    out.tx_queue_len = txQueueLen;
+
+    // Lost-frame counters up to now, not just to the last interval
+    out.rx_missed  = drvTotal.rx_missed;
+    out.rx_overrun = drvTotal.rx_overrun;
+    out.tx_failed  = drvTotal.tx_failed;
+    out.arb_lost   = drvTotal.arb_lost;
+    out.bus_errors = drvTotal.bus_errors;
+
+    twai_status_info_t st;
+    if (canInitialized && twai_get_status_info(&st) == ESP_OK) {
+        out.state            = st.state;
+        out.tx_error_counter = st.tx_error_counter;
+        out.rx_error_counter = st.rx_error_counter;
+        out.rx_missed  += counterDelta(st.rx_missed_count, drvLast.rx_missed);
+        out.rx_overrun += counterDelta(st.rx_overrun_count, drvLast.rx_overrun);
+        out.tx_failed  += counterDelta(st.tx_failed_count, drvLast.tx_failed);
+        out.arb_lost   += counterDelta(st.arb_lost_count, drvLast.arb_lost);
+        out.bus_errors += counterDelta(st.bus_error_count, drvLast.bus_errors);
+    }
+}
+
+size_t getCANIdRates(CanIdRate* out, size_t max)
+{
+    // By rate, then total
+    return idTable.sorted(out, max,
+        [](uint32_t key, const IdCounts& e) {
+            return CanIdRate{ canIdOf(key), canIdExtd(key), e.rate, e.frames };
+        },
+        [](const CanIdRate& a, const CanIdRate& b) {
+            return a.rate > b.rate || (a.rate == b.rate && a.frames > b.frames);
+        });
+}
+
+void resetCANHealth()
+{
+    // Applied by the RX task, the only writer of the health state
+    if (canRxTaskHandle != nullptr)
+        healthResetPending.store(true, std::memory_order_release);
+    else
+        clearHealth();
+}
+
+bool setCANQueueLengths(uint32_t rxLen, uint32_t txLen)
+{
+    if (rxLen < CAN_RX_QUEUE_MIN || rxLen > CAN_RX_QUEUE_MAX ||
+        txLen < CAN_TX_QUEUE_MIN || txLen > CAN_TX_QUEUE_MAX)
+        return false;
+
+    if (!canInitialized || canRxTaskHandle == nullptr) {
+        if (canInitialized)
+            reinstallDriver(rxLen, txLen);
+        else
+            storeQueueConfig(rxLen, txLen);
+        return true;
+    }
+
+    pendingTxQueueLen.store(txLen, std::memory_order_relaxed);
+    pendingRxQueueLen.store(rxLen, std::memory_order_release);
     return true;
 }
 
+void reloadCANFilter()
+{
+    if (!canInitialized || canRxTaskHandle == nullptr) {
+        if (canInitialized)
+            reinstallDriver(rxQueueLen, txQueueLen);
+        return;
+    }
+
+    filterReloadPending.store(true, std::memory_order_release);
+}
+
+void setCANQueueAuto(bool on)
+{
+    queueAuto.store(on, std::memory_order_relaxed);
+    storeQueueConfig(rxQueueLen, txQueueLen);
+}
+
+bool getCANQueueAuto()
+{
+    return queueAuto.load(std::memory_order_relaxed);
+}
+
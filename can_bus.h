@@ -1,14 +1,13 @@
 #pragma once
 
 #include <stdint.h>
+#include <stddef.h>
 #include <driver/twai.h>
 
-// external active device ID (defined in main)
-extern uint8_t actID;
-
 // Init / lifecycle
 void initCAN();
-void handleCAN();
+void startCANRxTask();      // dedicated RX task, replaces handleCAN() polling
+void handleCAN();           // polled RX (no-op while the RX task runs)
 
 // TX
 bool sendCANFrame(const twai_message_t& msg);
@@ -22,7 +21,78 @@ extern CanMode canMode;
 
 // CAN frame
 struct CanFrame {
+    uint64_t ts_us;     // RX time (esp_timer), see processRxBatch()
     uint32_t id;
+    bool     extd;      // 29-bit identifier
     uint8_t  dlc;
     uint8_t  data[8];
-};
\ No newline at end of file
+};
+
+// RX statistics
+struct CanRxStats {
+    uint32_t frames;        // frames dispatched
+    uint32_t batches;       // RX wakeups with at least one frame
+    uint32_t batch_max;     // largest batch drained in one wakeup
+    uint32_t rx_errors;     // twai_receive() failures
+    uint32_t rx_missed;     // driver: RX queue full
+    uint32_t rx_overrun;    // driver: controller FIFO overrun
+};
+
+void getCANRxStats(CanRxStats& out);
+
+/*
+ * Bus health, sampled by the RX task (see CAN_HEALTH_INTERVAL_MS).
+ * Rates, load and error counters describe the last closed interval;
+ * lost-frame and bus-off counters are cumulative since the last
+ * resetCANHealth(), across driver restarts.
+ */
+struct CanHealth {
+    uint64_t     ts_us;             // end of the last interval, 0 = none yet
+    uint32_t     interval_ms;
+    twai_state_t state;
+    uint32_t     tx_error_counter;
+    uint32_t     rx_error_counter;
+    uint32_t     frame_rate;        // frames/s on the bus (RX + TX + missed)
+    uint32_t     bus_load_permille; // estimated from frame lengths
+    uint32_t     rx_missed;         // driver: RX queue full
+    uint32_t     rx_overrun;        // driver: controller FIFO overrun
+    uint32_t     tx_failed;
+    uint32_t     arb_lost;
+    uint32_t     bus_errors;
+    uint32_t     bus_off;           // times the controller went bus-off
+    uint32_t     recoveries;        // automatic bus-off recoveries completed
+    uint32_t     loss_intervals;    // intervals in which frames were lost
+    uint32_t     queue_grows;       // automatic RX queue enlargements
+    uint32_t     rx_queue_len;
+    uint32_t     tx_queue_len;
+    uint32_t     ids;               // IDs in the rate table
+    uint32_t     other_rate;        // frames/s of IDs that did not fit
+};
+
+struct CanIdRate {
+    uint32_t id;
+    bool     extd;
+    uint32_t rate;          // frames/s over the last interval
+    uint32_t frames;        // since the last reset
+};
+
+void getCANHealth(CanHealth& out);
+size_t getCANIdRates(CanIdRate* out, size_t max);     // busiest first
+void resetCANHealth();
+
+/*
+ * TWAI driver queue lengths. Changing them restarts the driver from
+ * the RX task (frames already queued are received first); the values
+ * are saved in NVS and used from the next boot on. In auto mode the RX
+ * queue is doubled, up to CAN_RX_QUEUE_MAX, after every interval in
+ * which the driver dropped frames because it was full.
+ */
+bool setCANQueueLengths(uint32_t rxLen, uint32_t txLen);
+void setCANQueueAuto(bool on);
+bool getCANQueueAuto();
+
+/*
+ * Program the acceptance filter again (see sniffAcceptanceFilter()),
+ * by the same driver restart as a queue change.
+ */
+void reloadCANFilter();
@@ -0,0 +1,188 @@
+#pragma once
+
+#include <stdint.h>
+#include <stddef.h>
+#include <atomic>
+
+#include "sdlog.h"
+
+/*
+ * Per-CAN-ID state of the RX path.
+ *
+ * An open addressed table keyed by canIdKey(): Fibonacci hashing and
+ * linear probing, so a lookup is one or two probes for standard and
+ * extended IDs alike. Used by the CAN health monitor (frame rates) and
+ * the sniff filter (change tracking); only the entry type, the size
+ * and the report order differ.
+ *
+ *   Entry   per-ID state, value-initialized when the ID is first seen
+ *   Slots   table size, a power of two
+ *   MaxIds  IDs with an entry; further IDs get none. At most 75 % of
+ *           Slots, which keeps the probe sequences short.
+ *
+ * Only the RX task modifies a table, through update(), forEach() and
+ * clear(). Every slot has a sequence counter (odd while the RX task is
+ * changing it), so sorted() gives consistent per-ID values from any
+ * task; the IDs are not a snapshot of one instant.
+ */
+
+// ID plus a flag bit that is never 0: 29-bit IDs bit 31, 11-bit IDs bit 30
+static inline uint32_t canIdKey(uint32_t id, bool extd)
+{
+    return id | (extd ? SDLOG_CANH_ID_EXTD : 0x40000000u);
+}
+
+static inline uint32_t canIdOf(uint32_t key)
+{
+    return key & 0x1FFFFFFFu;
+}
+
+static inline bool canIdExtd(uint32_t key)
+{
+    return (key & SDLOG_CANH_ID_EXTD) != 0;
+}
+
+template <typename Entry, uint32_t Slots, uint32_t MaxIds>
+class CanIdTable {
+    static_assert(Slots >= 2 && (Slots & (Slots - 1)) == 0, "Slots must be a power of two");
+    static_assert(MaxIds * 4 <= Slots * 3, "keep the table under 75 % full");
+
+public:
+    uint32_t count() const { return count_; }
+
+    /*
+     * RX task: fn(entry) on the entry of key, added if the ID is new.
+     * False (fn not called) once MaxIds are taken.
+     */
+    template <typename Fn>
+    bool update(uint32_t key, Fn fn)
+    {
+        uint32_t slot = (key * 2654435761u) >> SHIFT;
+
+        for (uint32_t probe = 0; probe < Slots; probe++) {
+            Slot& s = slots_[slot];
+            if (s.key == key) {
+                beginWrite(s);
+                fn(s.entry);
+                endWrite(s);
+                return true;
+            }
+            if (s.key == 0) {
+                if (count_ >= MaxIds)
+                    return false;
+                beginWrite(s);
+                s.key = key;
+                s.entry = Entry();
+                fn(s.entry);
+                endWrite(s);
+                count_++;
+                return true;
+            }
+            slot = (slot + 1) & (Slots - 1);
+        }
+        return false;
+    }
+
+    // RX task: fn(key, entry) for every ID in the table
+    template <typename Fn>
+    void forEach(Fn fn)
+    {
+        for (uint32_t i = 0; i < Slots; i++) {
+            Slot& s = slots_[i];
+            if (s.key == 0)
+                continue;
+            beginWrite(s);
+            fn(s.key, s.entry);
+            endWrite(s);
+        }
+    }
+
+    // RX task, read only
+    template <typename Fn>
+    void forEach(Fn fn) const
+    {
+        for (uint32_t i = 0; i < Slots; i++)
+            if (slots_[i].key != 0)
+                fn(slots_[i].key, (const Entry&)slots_[i].entry);
+    }
+
+    // RX task
+    void clear()
+    {
+        for (uint32_t i = 0; i < Slots; i++) {
+            Slot& s = slots_[i];
+            beginWrite(s);
+            s.key = 0;
+            s.entry = Entry();
+            endWrite(s);
+        }
+        count_ = 0;
+    }
+
+    /*
+     * Report: up to max entries, converted by conv(key, entry) and
+     * ordered by before(a, b) (true: a first). Insertion sort, the
+     * table is small. Returns the entries written.
+     */
+    template <typename Out, typename Conv, typename Before>
+    size_t sorted(Out* out, size_t max, Conv conv, Before before) const
+    {
+        size_t n = 0;
+
+        for (uint32_t i = 0; i < Slots; i++) {
+            uint32_t key;
+            Entry e;
+            read(slots_[i], key, e);
+            if (key == 0)
+                continue;
+
+            const Out v = conv(key, e);
+            size_t at = n;
+            while (at > 0 && before(v, out[at - 1])) {
+                if (at < max)
+                    out[at] = out[at - 1];
+                at--;
+            }
+            if (at < max)
+                out[at] = v;
+            if (n < max)
+                n++;
+        }
+        return n;
+    }
+
+private:
+    static constexpr uint32_t log2(uint32_t n) { return n <= 1 ? 0 : 1 + log2(n >> 1); }
+    static const uint32_t SHIFT = 32 - log2(Slots);
+
+    struct Slot {
+        std::atomic<uint32_t> seq{0};   // +1 while the RX task writes
+        uint32_t key = 0;               // see canIdKey(), 0 = free
+        Entry    entry = Entry();
+    };
+
+    static void beginWrite(Slot& s)
+    {
+        s.seq.store(s.seq.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+        std::atomic_thread_fence(std::memory_order_release);
+    }
+
+    static void endWrite(Slot& s)
+    {
+        s.seq.store(s.seq.load(std::memory_order_relaxed) + 1, std::memory_order_release);
+    }
+
+    static void read(const Slot& s, uint32_t& key, Entry& e)
+    {
+        uint32_t seq;
+        do {
+            seq = s.seq.load(std::memory_order_acquire);
+            key = s.key;
+            e = s.entry;
+            std::atomic_thread_fence(std::memory_order_acquire);
+        } while ((seq & 1) || seq != s.seq.load(std::memory_order_relaxed));
+    }
+
+    Slot     slots_[Slots];
+    uint32_t count_ = 0;
+};
@@ -0,0 +1,70 @@
+#pragma once
+
+#include <stdint.h>
+#include <stddef.h>
+
+/*
+ * Consistent Overhead Byte Stuffing.
+ *
+ * Encoded data never contains 0x00, so 0x00 can delimit frames on a
+ * byte stream: a receiver resyncs at the next delimiter after any error.
+ * Overhead is one byte per 254 bytes, plus one.
+ */
+
+// Worst-case frame size for len bytes, including the delimiter
+#define COBS_MAX_FRAME(len)     ((len) + (len) / 254 + 2)
+
+/*
+ * Encode len bytes into out (COBS_MAX_FRAME(len) bytes) and append the
+ * 0x00 delimiter. Returns the frame length including the delimiter.
+ */
+static inline size_t cobs_encode(const uint8_t* in, size_t len, uint8_t* out)
+{
+    size_t codeIdx = 0;
+    size_t n = 1;
+    uint8_t code = 1;
+
+    for (size_t i = 0; i < len; i++) {
+        if (in[i] == 0) {
+            out[codeIdx] = code;
+            codeIdx = n++;
+            code = 1;
+            continue;
+        }
+
+        out[n++] = in[i];
+        if (++code == 0xFF) {
+            out[codeIdx] = code;
+            codeIdx = n++;
+            code = 1;
+        }
+    }
+
+    out[codeIdx] = code;
+    out[n++] = 0x00;
+    return n;
+}
+
+/*
+ * Decode one frame (without its delimiter). out may alias in.
+ * Returns the decoded length, or -1 if the frame is malformed.
+ */
+static inline int cobs_decode(const uint8_t* in, size_t len, uint8_t* out)
+{
+    size_t i = 0;
+    size_t n = 0;
+
+    while (i < len) {
+        const uint8_t code = in[i++];
+        if (code == 0 || i + code - 1 > len)
+            return -1;
+
+        for (uint8_t k = 1; k < code; k++)
+            out[n++] = in[i++];
+
+        if (code != 0xFF && i < len)
+            out[n++] = 0x00;
+    }
+
+    return (int)n;
+}
@@ -1,4 +1,8 @@
 #include "debug.h"
+#include "tasks.h"
+
+#include <esp_timer.h>
+#include <atomic>
 
 /*
  * Default debug level.
@@ -9,3 +13,156 @@
  * - DEBUG_INFO    for development
  */
 DebugLevel debugLevel = DEBUG_INFO;
+
+bool debugDeferred = false;
+
+static_assert((DEBUG_DEFER_RING & (DEBUG_DEFER_RING - 1)) == 0,
+              "DEBUG_DEFER_RING must be a power of two");
+
+/* =========================
+ *  DEFERRED RECORD RING
+ * =========================
+ * Bounded multi-producer / single-consumer queue. Every slot carries a
+ * sequence number: equal to the position when free for that lap,
+ * position + 1 once written. Producers claim a position with one CAS,
+ * so a task preempted mid-write never blocks the others, it only holds
+ * back the consumer at that slot.
+ */
+
+struct DebugSlot {
+    std::atomic<uint32_t> seq;
+    DebugRecord           rec;
+};
+
+static DebugSlot ring[DEBUG_DEFER_RING];
+static std::atomic<uint32_t> head{0};       // next position to claim
+static uint32_t tail = 0;                   // consumer only
+static std::atomic<bool> consumerBusy{false};
+static std::atomic<bool> externalDrain{false};
+static std::atomic<bool> drainPrinting{false};     // drain task inside its Serial prints
+
+static std::atomic<uint32_t> statDeferred{0};
+static std::atomic<uint32_t> statDropped{0};
+static std::atomic<uint32_t> statDirect{0};
+
+static TaskHandle_t debugTaskHandle = nullptr;
+
+void debugPush(const DebugFormat* format, const DebugArgs& args)
+{
+    const uint32_t now = (uint32_t)esp_timer_get_time();
+
+    uint32_t pos = head.load(std::memory_order_relaxed);
+    DebugSlot* slot;
+
+    while (true) {
+        slot = &ring[pos & (DEBUG_DEFER_RING - 1)];
+        const int32_t dif = (int32_t)(slot->seq.load(std::memory_order_acquire) - pos);
+
+        if (dif == 0) {
+            if (head.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed))
+                break;
+        } else if (dif < 0) {
+            statDropped.fetch_add(1, std::memory_order_relaxed);
+            return;
+        } else {
+            pos = head.load(std::memory_order_relaxed);
+        }
+    }
+
+    slot->rec.t_us = now;
+    slot->rec.format = format;
+    slot->rec.args = args;
+    slot->seq.store(pos + 1, std::memory_order_release);
+
+    statDeferred.fetch_add(1, std::memory_order_relaxed);
+}
+
+void debugCountDirect()
+{
+    statDirect.fetch_add(1, std::memory_order_relaxed);
+}
+
+bool debugPopRecord(DebugRecord& out)
+{
+    if (consumerBusy.exchange(true, std::memory_order_acquire))
+        return false;
+
+    DebugSlot& slot = ring[tail & (DEBUG_DEFER_RING - 1)];
+    const bool ready = slot.seq.load(std::memory_order_acquire) == tail + 1;
+
+    if (ready) {
+        out = slot.rec;
+        slot.seq.store(tail + DEBUG_DEFER_RING, std::memory_order_release);
+        tail++;
+    }
+
+    consumerBusy.store(false, std::memory_order_release);
+    return ready;
+}
+
+void debugSetExternalDrain(bool enabled)
+{
+    externalDrain.store(enabled);
+
+    // Serial changes hands after this: wait out a drain pass in progress
+    if (enabled) {
+        while (drainPrinting.load())
+            vTaskDelay(1);
+    }
+}
+
+void getDebugStats(DebugStats& out)
+{
+    out.deferred = statDeferred.load(std::memory_order_relaxed);
+    out.dropped  = statDropped.load(std::memory_order_relaxed);
+    out.direct   = statDirect.load(std::memory_order_relaxed);
+}
+
+/* =========================
+ *  DRAIN TASK
+ * ========================= */
+
+static void debug_task(void*)
+{
+    uint32_t reportedDrops = 0;
+    char line[160];
+
+    while (true) {
+        vTaskDelay(pdMS_TO_TICKS(DEBUG_DRAIN_PERIOD_MS));
+
+        // Flag, then check: debugSetExternalDrain() sees either the
+        // pass or the check failing (both seq_cst)
+        drainPrinting.store(true);
+        if (externalDrain.load()) {
+            drainPrinting.store(false);
+            continue;
+        }
+
+        DebugRecord rec;
+        while (debugPopRecord(rec)) {
+            int n = snprintf(line, sizeof(line), "[%10lu] ", (unsigned long)rec.t_us);
+            debugFormatRecord(line + n, sizeof(line) - n, rec.format->fmt,
+                              rec.args.kinds, rec.args.nargs, rec.args.words);
+            Serial.print(line);
+        }
+
+        const uint32_t drops = statDropped.load(std::memory_order_relaxed);
+        if (drops != reportedDrops) {
+            Serial.printf("[DBG] %lu deferred records dropped (ring full)\n",
+                          (unsigned long)(drops - reportedDrops));
+            reportedDrops = drops;
+        }
+        drainPrinting.store(false);
+    }
+}
+
+void initDebug()
+{
+    if (debugTaskHandle == nullptr) {
+        for (uint32_t i = 0; i < DEBUG_DEFER_RING; i++)
+            ring[i].seq.store(i, std::memory_order_relaxed);
+
+        startTask(debug_task, "debug", DEBUG_TASK_STACK,
+                  DEBUG_TASK_PRIO, TASK_CORE_IO, &debugTaskHandle);
+    }
+}
@@ -1,5 +1,8 @@
 #pragma once
 #include <Arduino.h>
+#include <type_traits>
+
+#include "debug_fmt.h"
 
 /*
  * Global debug levels.
@@ -18,6 +21,157 @@ enum DebugLevel : uint8_t {
  */
 extern DebugLevel debugLevel;
 
+/*
+ * Deferred mode (runtime configurable, "debug defer on|off").
+ *
+ * The printf-style macros then only store the format string's address,
+ * a timestamp and the raw arguments in a lock-free ring; a low-priority
+ * task formats and prints them later. While telemetry is streaming the
+ * telemetry task sends the records in binary instead and the host
+ * decoder formats them (telemetry.h).
+ *
+ * Calls with string or pointer arguments are not deferrable and are
+ * still printed directly. Records that do not fit in the ring are
+ * dropped and counted, never waited for.
+ */
+extern bool debugDeferred;
+
+/* =========================
+ *  DEFERRED LOG CONFIG
+ * ========================= */
+
+/*
+ * DEBUG_DEFER_RING
+ *
+ * Records in flight (power of two), 52 bytes each. At full bus load
+ * with verbose on the drain task needs to run every ~10 ms.
+ */
+#define DEBUG_DEFER_RING        128
+
+/*
+ * DEBUG_DEFER_MAX_ARGS / DEBUG_DEFER_MAX_WORDS
+ *
+ * Argument limit per record; 64-bit arguments take two words.
+ */
+#define DEBUG_DEFER_MAX_ARGS    6
+#define DEBUG_DEFER_MAX_WORDS   8
+
+/*
+ * DEBUG_DRAIN_PERIOD_MS
+ *
+ * Poll period of the drain task (stack and priority: tasks.h).
+ */
+#define DEBUG_DRAIN_PERIOD_MS   10
+
+/*
+ * One per macro call site, in flash. Its address identifies the format.
+ */
+struct DebugFormat {
+    const char* fmt;
+};
+
+struct DebugArgs {
+    uint8_t  nargs;
+    uint8_t  nwords;
+    uint8_t  kinds[DEBUG_DEFER_MAX_ARGS];
+    uint32_t words[DEBUG_DEFER_MAX_WORDS];
+};
+
+struct DebugRecord {
+    uint32_t           t_us;
+    const DebugFormat* format;
+    DebugArgs          args;
+};
+
+struct DebugStats {
+    uint32_t deferred;          // records queued
+    uint32_t dropped;           // ring full
+    uint32_t direct;            // not deferrable, printed directly
+};
+
+void initDebug();               // starts the drain task
+void getDebugStats(DebugStats& out);
+
+// Producer side, used by the macros
+void debugPush(const DebugFormat* format, const DebugArgs& args);
+void debugCountDirect();
+
+/*
+ * Consumer side. Only one consumer at a time: the drain task yields the
+ * ring and Serial to an external drain (telemetry) or to a binary file
+ * transfer while that is enabled. Enabling returns once the drain task
+ * has finished any line it was printing.
+ */
+bool debugPopRecord(DebugRecord& out);
+void debugSetExternalDrain(bool enabled);
+
+/* =========================
+ *  ARGUMENT PACKING
+ * ========================= */
+
+template <typename T>
+constexpr uint8_t debugArgKind()
+{
+    using U = typename std::decay<T>::type;
+    if constexpr (std::is_enum<U>::value)
+        return debugArgKind<typename std::underlying_type<U>::type>();
+    else if constexpr (std::is_floating_point<U>::value)
+        return DBG_ARG_F32;
+    else if constexpr (std::is_integral<U>::value && sizeof(U) <= 4)
+        return std::is_signed<U>::value ? DBG_ARG_I32 : DBG_ARG_U32;
+    else if constexpr (std::is_integral<U>::value && sizeof(U) == 8)
+        return std::is_signed<U>::value ? DBG_ARG_I64 : DBG_ARG_U64;
+    else
+        return DBG_ARG_NONE;
+}
+
+template <typename... Args>
+constexpr bool debugDeferrable()
+{
+    return sizeof...(Args) <= DEBUG_DEFER_MAX_ARGS &&
+           ((debugArgKind<Args>() != DBG_ARG_NONE) && ... && true) &&
+           (0 + ... + (debugArgKind<Args>() == DBG_ARG_NONE ? 0 : debugArgWords(debugArgKind<Args>())))
+               <= DEBUG_DEFER_MAX_WORDS;
+}
+
+template <typename T>
+inline void debugPackArg(DebugArgs& a, T v)
+{
+    constexpr uint8_t kind = debugArgKind<T>();
+    a.kinds[a.nargs++] = kind;
+
+    if constexpr (kind == DBG_ARG_F32) {
+        float f = (float)v;
+        memcpy(&a.words[a.nwords++], &f, 4);
+    } else if constexpr (kind == DBG_ARG_I64 || kind == DBG_ARG_U64) {
+        uint64_t u = (uint64_t)v;
+        a.words[a.nwords++] = (uint32_t)u;
+        a.words[a.nwords++] = (uint32_t)(u >> 32);
+    } else {
+        a.words[a.nwords++] = (uint32_t)v;
+    }
+}
+
+/*
+ * Queue a record. Returns false if the arguments are not deferrable,
+ * in which case the caller prints directly.
+ */
+template <typename... Args>
+inline bool debugDefer(const DebugFormat* format, Args... args)
+{
+    if constexpr (!debugDeferrable<Args...>()) {
+        debugCountDirect();
+        return false;
+    } else {
+        DebugArgs a;
+        a.nargs = 0;
+        a.nwords = 0;
+        (debugPackArg(a, args), ...);
+        debugPush(format, a);
+        return true;
+    }
+}
+
 /*
  * Core debug macros.
  * These must be cheap when disabled.
@@ -45,25 +199,18 @@ extern DebugLevel debugLevel;
     } while (0)
 
 /*
- * printf-style helpers (optional but very useful for CAN/measurements)
+ * printf-style helpers (optional but very useful for CAN/measurements).
+ * These honour deferred mode; fmt must be a string literal.
  */
-#define DBG_ERRORF(fmt, ...) \
+#define DBG_LOGF_(level, fmt, ...) \
     do { \
-        if (debugLevel >= DEBUG_ERROR) { \
-            Serial.printf(fmt, ##__VA_ARGS__); \
+        if (debugLevel >= (level)) { \
+            static const DebugFormat dbgFormat_ = { fmt }; \
+            if (!debugDeferred || !debugDefer(&dbgFormat_, ##__VA_ARGS__)) \
+                Serial.printf(fmt, ##__VA_ARGS__); \
         } \
     } while (0)
 
-#define DBG_INFOF(fmt, ...) \
-    do { \
-        if (debugLevel >= DEBUG_INFO) { \
-            Serial.printf(fmt, ##__VA_ARGS__); \
-        } \
-    } while (0)
-
-#define DBG_VERBOSEF(fmt, ...) \
-    do { \
-        if (debugLevel >= DEBUG_VERBOSE) { \
-            Serial.printf(fmt, ##__VA_ARGS__); \
-        } \
-    } while (0)
+#define DBG_ERRORF(fmt, ...)    DBG_LOGF_(DEBUG_ERROR, fmt, ##__VA_ARGS__)
+#define DBG_INFOF(fmt, ...)     DBG_LOGF_(DEBUG_INFO, fmt, ##__VA_ARGS__)
+#define DBG_VERBOSEF(fmt, ...)  DBG_LOGF_(DEBUG_VERBOSE, fmt, ##__VA_ARGS__)
@@ -0,0 +1,145 @@
+#pragma once
+
+#include <stdint.h>
+#include <stddef.h>
+#include <stdio.h>
+#include <string.h>
+
+/*
+ * Formatting of deferred debug records (debug.h).
+ *
+ * A deferred record holds the format string's address and the raw
+ * argument words; the text is produced later, by the debug drain task on
+ * the device or by a host decoder that got the format string from the
+ * telemetry stream. Header only, so both sides use the same code.
+ *
+ * Arguments are stored by kind, not by C type, so "%ld" works the same
+ * whether long is 32 bits (ESP32) or 64 bits (host).
+ */
+
+typedef enum : uint8_t {
+    DBG_ARG_I32 = 0,
+    DBG_ARG_U32 = 1,
+    DBG_ARG_F32 = 2,            // float and double, stored as float
+    DBG_ARG_I64 = 3,            // two words, low first
+    DBG_ARG_U64 = 4,
+    DBG_ARG_NONE = 0xFF,        // not deferrable (strings, pointers)
+} DebugArgKind;
+
+static constexpr uint8_t debugArgWords(uint8_t kind)
+{
+    return (kind == DBG_ARG_I64 || kind == DBG_ARG_U64) ? 2 : 1;
+}
+
+/*
+ * printf(fmt, args...) into out (always NUL terminated).
+ * Conversions without a matching argument print "<?>".
+ * Returns the string length.
+ */
+static inline size_t debugFormatRecord(char* out, size_t size,
+                                       const char* fmt,
+                                       const uint8_t* kinds, uint8_t nargs,
+                                       const uint32_t* words)
+{
+    size_t n = 0;
+    uint8_t arg = 0;
+    uint8_t word = 0;
+
+    if (size == 0)
+        return 0;
+
+    auto put = [&](const char* s, size_t len) {
+        while (len-- > 0 && n + 1 < size)
+            out[n++] = *s++;
+    };
+
+    while (*fmt != '\0' && n + 1 < size) {
+        if (*fmt != '%') {
+            out[n++] = *fmt++;
+            continue;
+        }
+        if (fmt[1] == '%') {
+            out[n++] = '%';
+            fmt += 2;
+            continue;
+        }
+
+        // %[flags][width][.precision][length]conv
+        char spec[24] = "%";
+        size_t sl = 1;
+        const char* p = fmt + 1;
+        while (*p != '\0' && strchr("-+ #0123456789.", *p) != nullptr) {
+            if (sl < sizeof(spec) - 4)
+                spec[sl++] = *p;
+            p++;
+        }
+        int lenMod = 0;             // bits of hh / h, 0 = default
+        while (*p != '\0' && strchr("hlLqjzt", *p) != nullptr) {
+            lenMod = (*p == 'h') ? (lenMod == 16 ? 8 : 16) : 0;
+            p++;
+        }
+        const char conv = *p;
+        if (conv == '\0')
+            break;
+        fmt = p + 1;
+
+        if (arg >= nargs) {
+            put("<?>", 3);
+            continue;
+        }
+
+        const uint8_t kind = kinds[arg++];
+        uint64_t u = words[word++];
+        if (kind == DBG_ARG_I64 || kind == DBG_ARG_U64)
+            u |= (uint64_t)words[word++] << 32;
+
+        int64_t  i;
+        double   d;
+        if (kind == DBG_ARG_F32) {
+            float f;
+            memcpy(&f, &u, sizeof(f));
+            d = f;
+            i = (int64_t)f;
+            u = (uint64_t)i;
+        } else {
+            i = (kind == DBG_ARG_I32) ? (int64_t)(int32_t)u : (int64_t)u;
+            d = (kind == DBG_ARG_I32 || kind == DBG_ARG_I64) ? (double)i : (double)u;
+        }
+
+        char tmp[48];
+        int len;
+
+        switch (conv) {
+        case 'd': case 'i':
+            if (lenMod == 8)  i = (int8_t)i;
+            if (lenMod == 16) i = (int16_t)i;
+            memcpy(&spec[sl], "lld", 4);
+            len = snprintf(tmp, sizeof(tmp), spec, (long long)i);
+            break;
+        case 'u': case 'x': case 'X': case 'o':
+            if (kind == DBG_ARG_I32 || kind == DBG_ARG_U32) u = (uint32_t)u;
+            if (lenMod == 8)  u = (uint8_t)u;
+            if (lenMod == 16) u = (uint16_t)u;
+            spec[sl] = 'l'; spec[sl + 1] = 'l'; spec[sl + 2] = conv; spec[sl + 3] = '\0';
+            len = snprintf(tmp, sizeof(tmp), spec, (unsigned long long)u);
+            break;
+        case 'c':
+            spec[sl] = 'c'; spec[sl + 1] = '\0';
+            len = snprintf(tmp, sizeof(tmp), spec, (int)i);
+            break;
+        case 'f': case 'F': case 'e': case 'E': case 'g': case 'G': case 'a': case 'A':
+            spec[sl] = conv; spec[sl + 1] = '\0';
+            len = snprintf(tmp, sizeof(tmp), spec, d);
+            break;
+        default:
+            len = snprintf(tmp, sizeof(tmp), "<?>");
+            break;
+        }
+
+        if (len > 0)
+            put(tmp, (size_t)len < sizeof(tmp) ? (size_t)len : sizeof(tmp) - 1);
+    }
+
+    out[n] = '\0';
+    return n;
+}
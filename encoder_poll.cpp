@@ -0,0 +1,440 @@
+#include "encoder_poll.h"
+#include "BriterEncoder.h"
+#include "can_bus.h"
+#include "debug.h"
+#include "perf.h"
+#include "tasks.h"
+
+#include <Arduino.h>
+#include <esp_timer.h>
+#include <atomic>
+#include <string.h>
+
+/* =========================
+ *  POLL CONFIGURATION
+ * ========================= */
+
+/*
+ * POLL_TICK_US
+ *
+ * Scheduler tick period. Upper bound for any encoder rate
+ * (1000 us -> max 1000 Hz per encoder).
+ */
+#define POLL_TICK_US            1000
+
+/*
+ * ENCODER_POLL_DEFAULT_HZ
+ *
+ * Rate each encoder is polled at after boot.
+ */
+#define ENCODER_POLL_DEFAULT_HZ 500
+
+/*
+ * ENCODER_POLL_TIMEOUT_US
+ *
+ * A request is counted as lost if no response arrives within this time
+ * (or before the next request for the same encoder, if that is sooner).
+ */
+#define ENCODER_POLL_TIMEOUT_US 3000
+
+/*
+ * POLL_BITS_PER_EXCHANGE / POLL_BITS_PER_PUSH / POLL_BUS_BITRATE
+ *
+ * Bus load estimate: READ request (3 data bytes) plus response
+ * (7 data bytes) including stuffing and inter-frame space is ~180 bits,
+ * an auto-report push alone is ~110 bits.
+ */
+#define POLL_BITS_PER_EXCHANGE  180
+#define POLL_BITS_PER_PUSH      110
+#define POLL_BUS_BITRATE        500000
+
+/* =========================
+ *  INTERNAL STATE
+ * ========================= */
+
+struct EncoderSlot {
+    uint16_t rateHz;
+    uint16_t periodTicks;
+    uint16_t countdown;
+    uint32_t timeoutUs;
+
+    // Send time (low 32 bits of esp_timer, never 0) of the outstanding
+    // request, 0 when none. Set by the poll task, cleared by RX.
+    std::atomic<uint32_t> sentUs;
+
+    uint32_t requests;
+    uint32_t timeouts;
+    uint32_t txFail;
+
+    // Responses and latency, written by the RX path only and published
+    // with rxSeq (odd while being updated). Reset by the RX path too,
+    // on rxResetPending.
+    std::atomic<uint32_t> rxSeq;
+    uint32_t responses;
+    uint32_t pushed;
+    uint32_t late;
+    uint32_t latMin;
+    uint32_t latMax;
+    uint64_t latSum;
+    uint32_t latHist[POLL_LATENCY_BINS];
+};
+
+static EncoderSlot slots[BriterEncoder::NUM_ENCODERS];
+
+static esp_timer_handle_t pollTimer = nullptr;
+static TaskHandle_t pollTaskHandle = nullptr;
+static std::atomic<bool> pollRunning{false};
+static std::atomic<bool> rxResetPending{false};
+
+static PollTimingStats timing = {};
+static int64_t lastTickUs = 0;
+
+static int slotIndex(uint8_t id)
+{
+    if (id < BriterEncoder::FIRST_ID || id > BriterEncoder::LAST_ID)
+        return -1;
+    return id - BriterEncoder::FIRST_ID;
+}
+
+static uint32_t nowUs32()
+{
+    uint32_t t = (uint32_t)esp_timer_get_time();
+    return t ? t : 1;
+}
+
+/* =========================
+ *  SCHEDULER
+ * ========================= */
+
+static void pollTick()
+{
+    PerfScope perf(PERF_POLL_TICK);
+
+    const int64_t now = esp_timer_get_time();
+
+    if (lastTickUs != 0) {
+        int64_t dev = (now - lastTickUs) - POLL_TICK_US;
+        if (dev < 0) dev = -dev;
+        if ((uint32_t)dev > timing.jitter_max_us)
+            timing.jitter_max_us = (uint32_t)dev;
+        jitterAdd(JITTER_POLL_PERIOD, (uint32_t)dev);
+    }
+    lastTickUs = now;
+    timing.ticks++;
+
+    // Sniffer mode never transmits
+    if (canMode == CAN_MODE_SNIFFER)
+        return;
+
+    for (int i = 0; i < BriterEncoder::NUM_ENCODERS; i++) {
+        EncoderSlot& s = slots[i];
+
+        // Disabled, or the encoder pushes its value by itself
+        if (s.periodTicks == 0 || BriterEncoder::isAutoReport(BriterEncoder::FIRST_ID + i))
+            continue;
+
+        // Expire a lost request as soon as its timeout passes
+        uint32_t sent = s.sentUs.load(std::memory_order_acquire);
+        if (sent != 0 && (uint32_t)now - sent >= s.timeoutUs) {
+            if (s.sentUs.compare_exchange_strong(sent, 0))
+                s.timeouts++;
+        }
+
+        if (--s.countdown > 0)
+            continue;
+        s.countdown = s.periodTicks;
+
+        // Still outstanding at its next slot: treat as lost, poll again
+        sent = s.sentUs.exchange(0);
+        if (sent != 0)
+            s.timeouts++;
+
+        s.sentUs.store(nowUs32(), std::memory_order_release);
+        s.requests++;
+
+        if (!BriterEncoder::sendRead(BriterEncoder::FIRST_ID + i)) {
+            s.sentUs.store(0, std::memory_order_relaxed);
+            s.txFail++;
+        }
+    }
+}
+
+static void poll_task(void*)
+{
+    while (true) {
+        uint32_t pending = ulTaskNotifyTake(pdTRUE, portMAX_DELAY);
+        if (pending == 0 || !pollRunning)
+            continue;
+
+        // More than one notification: ticks were missed while busy
+        timing.missed_ticks += pending - 1;
+
+        pollTick();
+    }
+}
+
+static void poll_timer_cb(void*)
+{
+    xTaskNotifyGive(pollTaskHandle);
+}
+
+/* =========================
+ *  PUBLIC API
+ * ========================= */
+
+void initEncoderPolling()
+{
+    for (uint8_t id = BriterEncoder::FIRST_ID; id <= BriterEncoder::LAST_ID; id++) {
+        setEncoderPollRate(id, ENCODER_POLL_DEFAULT_HZ);
+    }
+    resetEncoderPollStats();
+
+    if (pollTaskHandle == nullptr) {
+        startTask(poll_task, "enc_poll", POLL_TASK_STACK,
+                  POLL_TASK_PRIO, TASK_CORE_ACQ, &pollTaskHandle);
+    }
+
+    if (pollTimer == nullptr) {
+        esp_timer_create_args_t args = {
+            .callback = poll_timer_cb,
+            .arg = nullptr,
+            .dispatch_method = ESP_TIMER_TASK,
+            .name = "enc_poll",
+            .skip_unhandled_events = true
+        };
+
+        if (esp_timer_create(&args, &pollTimer) != ESP_OK) {
+            DBG_ERROR("[POLL][ERR] timer create failed");
+            pollTimer = nullptr;
+        }
+    }
+}
+
+void startEncoderPolling()
+{
+    if (pollTimer == nullptr || pollRunning)
+        return;
+
+    lastTickUs = 0;
+    pollRunning = true;
+
+    if (esp_timer_start_periodic(pollTimer, POLL_TICK_US) != ESP_OK) {
+        pollRunning = false;
+        DBG_ERROR("[POLL][ERR] timer start failed");
+        return;
+    }
+
+    DBG_INFOF("[POLL] started, tick %d us\n", POLL_TICK_US);
+}
+
+void stopEncoderPolling()
+{
+    if (!pollRunning)
+        return;
+
+    pollRunning = false;
+    esp_timer_stop(pollTimer);
+
+    for (int i = 0; i < BriterEncoder::NUM_ENCODERS; i++) {
+        slots[i].sentUs.store(0, std::memory_order_relaxed);
+    }
+}
+
+bool isEncoderPollingRunning()
+{
+    return pollRunning;
+}
+
+bool setEncoderPollRate(uint8_t id, uint16_t hz)
+{
+    int idx = slotIndex(id);
+    if (idx < 0)
+        return false;
+
+    const uint32_t maxHz = 1000000UL / POLL_TICK_US;
+    if (hz > maxHz)
+        return false;
+
+    EncoderSlot& s = slots[idx];
+    uint32_t ticks = hz ? (1000000UL / POLL_TICK_US + hz / 2) / hz : 0;
+
+    s.rateHz = hz;
+    s.periodTicks = (uint16_t)ticks;
+    s.countdown = 1;    // first request on the next tick, in step with the others
+
+    uint32_t periodUs = ticks * POLL_TICK_US;
+    s.timeoutUs = (periodUs && periodUs < ENCODER_POLL_TIMEOUT_US) ? periodUs : ENCODER_POLL_TIMEOUT_US;
+
+    return true;
+}
+
+uint16_t getEncoderPollRate(uint8_t id)
+{
+    int idx = slotIndex(id);
+    return idx < 0 ? 0 : slots[idx].rateHz;
+}
+
+uint8_t encoderPollActiveMask()
+{
+    const bool polling = pollRunning && canMode != CAN_MODE_SNIFFER;
+    uint8_t mask = 0;
+
+    for (int i = 0; i < BriterEncoder::NUM_ENCODERS; i++) {
+        if ((polling && slots[i].periodTicks != 0) ||
+            BriterEncoder::isAutoReport(BriterEncoder::FIRST_ID + i))
+            mask |= (uint8_t)(1u << i);
+    }
+    return mask;
+}
+
+uint8_t estimatePollBusLoad()
+{
+    uint32_t bitsPerSec = 0;
+    for (int i = 0; i < BriterEncoder::NUM_ENCODERS; i++) {
+        uint8_t id = BriterEncoder::FIRST_ID + i;
+        uint16_t autoMs = BriterEncoder::autoReportInterval(id);
+
+        if (autoMs)
+            bitsPerSec += (1000UL / autoMs) * POLL_BITS_PER_PUSH;
+        else if (slots[i].periodTicks)
+            bitsPerSec += 1000000UL / (slots[i].periodTicks * POLL_TICK_US) * POLL_BITS_PER_EXCHANGE;
+    }
+
+    uint32_t pct = bitsPerSec / (POLL_BUS_BITRATE / 100);
+    return pct > 255 ? 255 : (uint8_t)pct;
+}
+
+static uint8_t latencyBin(uint32_t us)
+{
+    if (us < 128)
+        return 0;
+    uint8_t bin = (uint8_t)(31 - __builtin_clz(us)) - 6;
+    return bin < POLL_LATENCY_BINS ? bin : POLL_LATENCY_BINS - 1;
+}
+
+static void rxBeginWrite(EncoderSlot& s)
+{
+    s.rxSeq.store(s.rxSeq.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_release);
+}
+
+static void rxEndWrite(EncoderSlot& s)
+{
+    s.rxSeq.store(s.rxSeq.load(std::memory_order_relaxed) + 1, std::memory_order_release);
+}
+
+// RX path: the reset requested by resetEncoderPollStats()
+static void clearRxStats()
+{
+    for (int i = 0; i < BriterEncoder::NUM_ENCODERS; i++) {
+        EncoderSlot& s = slots[i];
+        rxBeginWrite(s);
+        s.responses = 0;
+        s.pushed = 0;
+        s.late = 0;
+        s.latMin = UINT32_MAX;
+        s.latMax = 0;
+        s.latSum = 0;
+        memset(s.latHist, 0, sizeof(s.latHist));
+        rxEndWrite(s);
+    }
+}
+
+void encoderPollOnResponse(uint8_t id, uint32_t rxUs)
+{
+    int idx = slotIndex(id);
+    if (idx < 0)
+        return;
+
+    if (rxResetPending.load(std::memory_order_relaxed) &&
+        rxResetPending.exchange(false, std::memory_order_acquire))
+        clearRxStats();
+
+    EncoderSlot& s = slots[idx];
+
+    // Late responses (already expired) are still valid samples,
+    // they just don't count against the outstanding request.
+    uint32_t sent = s.sentUs.exchange(0, std::memory_order_acq_rel);
+    if (sent == 0) {
+        rxBeginWrite(s);
+        if (BriterEncoder::isAutoReport(id))
+            s.pushed++;
+        else
+            s.late++;
+        rxEndWrite(s);
+        return;
+    }
+
+    // The request is stamped before it is queued, so a negative
+    // difference can only be clock granularity
+    int32_t lat = (int32_t)(rxUs - sent);
+    uint32_t us = lat > 0 ? (uint32_t)lat : 0;
+
+    rxBeginWrite(s);
+    s.responses++;
+    if (us < s.latMin) s.latMin = us;
+    if (us > s.latMax) s.latMax = us;
+    s.latSum += us;
+    s.latHist[latencyBin(us)]++;
+    rxEndWrite(s);
+}
+
+void getEncoderPollStats(uint8_t id, EncoderPollStats& out)
+{
+    out = {};
+
+    int idx = slotIndex(id);
+    if (idx < 0)
+        return;
+
+    const EncoderSlot& s = slots[idx];
+    out.rate_hz   = s.rateHz;
+    out.requests  = s.requests;
+    out.timeouts  = s.timeouts;
+    out.tx_fail   = s.txFail;
+
+    // A reset the RX path has not taken over yet reads as zero
+    if (rxResetPending.load(std::memory_order_acquire))
+        return;
+
+    uint32_t seq;
+    uint64_t latSum;
+    do {
+        seq = s.rxSeq.load(std::memory_order_acquire);
+        out.responses      = s.responses;
+        out.pushed         = s.pushed;
+        out.late           = s.late;
+        out.latency_min_us = s.latMin;
+        out.latency_max_us = s.latMax;
+        latSum             = s.latSum;
+        memcpy(out.latency_hist, s.latHist, sizeof(out.latency_hist));
+        std::atomic_thread_fence(std::memory_order_acquire);
+    } while ((seq & 1) || seq != s.rxSeq.load(std::memory_order_relaxed));
+
+    if (out.responses != 0) {
+        out.latency_avg_us = (uint32_t)(latSum / out.responses);
+    } else {
+        out.latency_min_us = 0;
+        out.latency_max_us = 0;
+    }
+}
+
+void getPollTimingStats(PollTimingStats& out)
+{
+    out = timing;
+    out.tick_us = POLL_TICK_US;
+}
+
+void resetEncoderPollStats()
+{
+    for (int i = 0; i < BriterEncoder::NUM_ENCODERS; i++) {
+        slots[i].requests = 0;
+        slots[i].timeouts = 0;
+        slots[i].txFail = 0;
+    }
+    timing = {};
+    lastTickUs = 0;
+
+    // Responses and latency: cleared by the RX path with its next response
+    rxResetPending.store(true, std::memory_order_release);
+}
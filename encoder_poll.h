@@ -0,0 +1,78 @@
+#pragma once
+
+#include <stdint.h>
+
+/*
+ * Encoder polling scheduler.
+ *
+ * A periodic esp_timer (hardware timer backed) wakes the poll task every
+ * POLL_TICK_US. On each tick, every encoder whose period has elapsed gets
+ * a READ request. All due requests are sent back-to-back (pipelined):
+ * responses are not awaited before the next request goes out, so the
+ * four corners are sampled within a few frame times of each other.
+ *
+ * Each encoder has at most one outstanding request. A request without a
+ * response within its timeout is counted and the next one is sent on
+ * schedule.
+ *
+ * Encoders in auto-report mode (BriterEncoder::setAutoReport) are skipped;
+ * their pushed values are counted separately.
+ *
+ * Latency is measured from just before the request is queued for TX to
+ * the response's RX time (CanFrame::ts_us), so it includes TX queueing
+ * behind the other requests of the same burst.
+ */
+
+/*
+ * POLL_LATENCY_BINS
+ *
+ * Latency histogram: bin 0 counts < 128 us, bin i [64 << i, 128 << i),
+ * the last bin everything from 8192 us up.
+ */
+#define POLL_LATENCY_BINS       8
+
+struct EncoderPollStats {
+    uint16_t rate_hz;        // configured target rate (0 = disabled)
+    uint32_t requests;
+    uint32_t responses;
+    uint32_t pushed;         // unsolicited values (auto-report mode)
+    uint32_t timeouts;       // no response before timeout / next request
+    uint32_t late;           // response after its request was expired
+    uint32_t tx_fail;        // sendCANFrame() refused or failed
+
+    // request -> response latency of answered requests
+    uint32_t latency_min_us;
+    uint32_t latency_max_us;
+    uint32_t latency_avg_us;
+    uint32_t latency_hist[POLL_LATENCY_BINS];
+};
+
+struct PollTimingStats {
+    uint32_t ticks;
+    uint32_t tick_us;        // scheduler tick period
+    uint32_t jitter_max_us;  // worst |actual - expected| tick start
+    uint32_t missed_ticks;   // timer fired while previous tick still running
+};
+
+void initEncoderPolling();
+void startEncoderPolling();
+void stopEncoderPolling();
+bool isEncoderPollingRunning();
+
+// Rate per encoder, 0 disables. Rounded to a whole number of ticks.
+bool setEncoderPollRate(uint8_t id, uint16_t hz);
+uint16_t getEncoderPollRate(uint8_t id);
+
+// Bit i set if encoder FIRST_ID + i currently delivers values
+// (polled while polling runs, or in auto-report mode)
+uint8_t encoderPollActiveMask();
+
+// Estimated CAN bus load of the configured polling, percent
+uint8_t estimatePollBusLoad();
+
+// RX hook: call for every valid READ response, rxUs = its RX time
+void encoderPollOnResponse(uint8_t id, uint32_t rxUs);
+
+void getEncoderPollStats(uint8_t id, EncoderPollStats& out);
+void getPollTimingStats(PollTimingStats& out);
+void resetEncoderPollStats();
@@ -0,0 +1,359 @@
+#include "file_xfer.h"
+#include "serial_cli.h"
+#include "sdlog.h"
+#include "telemetry.h"
+#include "crc.h"
+#include "cobs.h"
+#include "debug.h"
+
+#include <Arduino.h>
+#include <SD.h>
+
+/*
+ * XFER_RX_FRAME_MAX
+ *
+ * Receiver -> device packets are tiny (ACK / NAK / ABORT); anything
+ * longer is line noise or CLI text and is skipped.
+ */
+#define XFER_RX_FRAME_MAX   32
+
+/*
+ * XFER_NAK_QUEUE
+ *
+ * Pending selective retransmits. Duplicates are ignored; if it is full
+ * the ACK timeout recovers the rest.
+ */
+#define XFER_NAK_QUEUE      8
+
+/* =========================
+ *  LISTING
+ * ========================= */
+
+void listSdFiles(const char* dir)
+{
+    File root = SD.open(dir);
+    if (!root || !root.isDirectory()) {
+        Serial.println("ls: cannot open directory (SD not ready?)");
+        return;
+    }
+
+    uint32_t count = 0;
+    uint64_t total = 0;
+
+    File f = root.openNextFile();
+    while (f) {
+        if (f.isDirectory()) {
+            Serial.printf("  %-24s <dir>\n", f.name());
+        } else {
+            Serial.printf("  %-24s %10lu\n", f.name(), (unsigned long)f.size());
+            total += f.size();
+        }
+        count++;
+        f.close();
+        f = root.openNextFile();
+    }
+    root.close();
+
+    Serial.printf("%lu entries, %llu bytes\n", (unsigned long)count, (unsigned long long)total);
+}
+
+/* =========================
+ *  TRANSFER SESSION
+ * ========================= */
+
+struct XferSession {
+    File     file;
+    uint32_t size;
+    uint32_t acked;             // receiver has everything below this
+    uint32_t next;              // next new offset to send
+    uint32_t lastProgressMs;    // last ACK that moved 'acked'
+    uint32_t lastRxMs;          // last valid packet from the receiver
+    bool     started;           // first ACK seen (handshake done)
+    bool     aborted;
+
+    uint32_t nak[XFER_NAK_QUEUE];
+    uint8_t  nakCount;
+
+    uint8_t  rxFrame[XFER_RX_FRAME_MAX];
+    uint8_t  rxLen;
+    bool     rxOverflow;
+
+    uint32_t chunksSent;
+    uint32_t retransmits;
+    uint32_t timeouts;
+};
+
+static XferSession xs;
+static uint8_t txPacket[XFER_MAX_PACKET];
+static uint8_t txFrame[XFER_MAX_FRAME];
+
+static void sendPacket(uint8_t type, const uint8_t* body, size_t len)
+{
+    txPacket[0] = type;
+    if (len > 0 && body != &txPacket[1])
+        memcpy(&txPacket[1], body, len);
+
+    uint32_t crc = crc32_ieee(txPacket, 1 + len);
+    memcpy(&txPacket[1 + len], &crc, 4);
+
+    size_t n = cobs_encode(txPacket, 1 + len + 4, txFrame);
+
+    // Blocking write: the UART is the bottleneck and nothing else
+    // uses Serial during a transfer
+    Serial.write(txFrame, n);
+}
+
+static void sendInfo()
+{
+    XferInfo info = {
+        .file_size = xs.size,
+        .offset    = xs.acked,
+        .chunk     = XFER_CHUNK,
+        .window    = XFER_WINDOW,
+        .version   = XFER_PROTOCOL_VERSION
+    };
+    sendPacket(XFER_PKT_INFO, reinterpret_cast<const uint8_t*>(&info), sizeof(info));
+}
+
+static void sendEnd(XferStatus status)
+{
+    XferEnd end = {
+        .file_size   = xs.size,
+        .status      = status,
+        .chunks_sent = xs.chunksSent,
+        .retransmits = xs.retransmits,
+        .timeouts    = xs.timeouts
+    };
+    sendPacket(XFER_PKT_END, reinterpret_cast<const uint8_t*>(&end), sizeof(end));
+}
+
+/*
+ * Read the chunk at offset straight into the packet buffer and send it.
+ * Chunks are always XFER_CHUNK aligned relative to the start offset,
+ * except the last one.
+ */
+static bool sendChunk(uint32_t offset)
+{
+    uint32_t len = xs.size - offset;
+    if (len > XFER_CHUNK)
+        len = XFER_CHUNK;
+
+    if (!xs.file.seek(offset))
+        return false;
+
+    uint8_t* body = &txPacket[1];
+    memcpy(body, &offset, 4);
+    if (xs.file.read(body + 4, len) != len)
+        return false;
+
+    sendPacket(XFER_PKT_DATA, body, 4 + len);
+    xs.chunksSent++;
+    return true;
+}
+
+static void queueNak(uint32_t offset)
+{
+    if (offset < xs.acked || offset >= xs.next)
+        return;
+
+    for (uint8_t i = 0; i < xs.nakCount; i++) {
+        if (xs.nak[i] == offset)
+            return;
+    }
+    if (xs.nakCount < XFER_NAK_QUEUE)
+        xs.nak[xs.nakCount++] = offset;
+}
+
+static void handlePacket(const uint8_t* pkt, size_t len)
+{
+    if (len < 1 + 4)
+        return;
+
+    uint32_t crc;
+    memcpy(&crc, &pkt[len - 4], 4);
+    if (crc32_ieee(pkt, len - 4) != crc)
+        return;
+
+    const uint8_t type = pkt[0];
+    const size_t bodyLen = len - 1 - 4;
+    uint32_t offset = 0;
+    if (bodyLen >= 4)
+        memcpy(&offset, &pkt[1], 4);
+
+    xs.lastRxMs = millis();
+
+    switch (type) {
+    case XFER_PKT_ACK:
+        if (bodyLen < 4 || offset > xs.size)
+            break;
+        if (!xs.started) {
+            // Handshake: the receiver may resume at its own offset
+            xs.started = true;
+            xs.acked = xs.next = offset;
+            xs.lastProgressMs = millis();
+            break;
+        }
+        if (offset > xs.acked) {
+            xs.acked = offset;
+            xs.lastProgressMs = millis();
+        }
+        break;
+
+    case XFER_PKT_NAK:
+        if (bodyLen >= 4)
+            queueNak(offset);
+        break;
+
+    case XFER_PKT_ABORT:
+        xs.aborted = true;
+        break;
+    }
+}
+
+static void pollReceiver()
+{
+    while (Serial.available() > 0) {
+        int c = Serial.read();
+        if (c < 0)
+            break;
+
+        if (c != 0) {
+            if (xs.rxLen < sizeof(xs.rxFrame))
+                xs.rxFrame[xs.rxLen++] = (uint8_t)c;
+            else
+                xs.rxOverflow = true;
+            continue;
+        }
+
+        if (xs.rxLen > 0 && !xs.rxOverflow) {
+            uint8_t pkt[XFER_RX_FRAME_MAX];
+            int n = cobs_decode(xs.rxFrame, xs.rxLen, pkt);
+            if (n > 0)
+                handlePacket(pkt, (size_t)n);
+        }
+        xs.rxLen = 0;
+        xs.rxOverflow = false;
+    }
+}
+
+static XferStatus transferLoop()
+{
+    uint32_t lastInfoMs = 0;
+
+    while (true) {
+        pollReceiver();
+
+        const uint32_t now = millis();
+
+        if (xs.aborted)
+            return XFER_ABORTED;
+
+        if (now - xs.lastRxMs > XFER_IDLE_ABORT_MS)
+            return XFER_TIMEOUT;
+
+        // Handshake: repeat INFO until the receiver has switched baud
+        // and acknowledged it
+        if (!xs.started) {
+            if (now - lastInfoMs >= 100) {
+                sendInfo();
+                lastInfoMs = now;
+            }
+            delay(1);
+            continue;
+        }
+
+        if (xs.acked >= xs.size)
+            return XFER_OK;
+
+        // Selective retransmits first
+        if (xs.nakCount > 0) {
+            uint32_t offset = xs.nak[0];
+            xs.nakCount--;
+            memmove(&xs.nak[0], &xs.nak[1], xs.nakCount * sizeof(xs.nak[0]));
+
+            if (offset >= xs.acked) {
+                if (!sendChunk(offset))
+                    return XFER_READ_ERROR;
+                xs.retransmits++;
+            }
+            continue;
+        }
+
+        // New data while the window is open
+        if (xs.next < xs.size && xs.next - xs.acked < (uint32_t)XFER_WINDOW * XFER_CHUNK) {
+            if (!sendChunk(xs.next))
+                return XFER_READ_ERROR;
+            xs.next += (xs.size - xs.next > XFER_CHUNK) ? XFER_CHUNK : xs.size - xs.next;
+            continue;
+        }
+
+        // Window full or everything sent: wait for ACKs, go back on timeout
+        if (now - xs.lastProgressMs > XFER_ACK_TIMEOUT_MS) {
+            xs.next = xs.acked;
+            xs.lastProgressMs = now;
+            xs.timeouts++;
+            continue;
+        }
+
+        delay(1);
+    }
+}
+
+void runFileTransfer(const char* path, uint32_t offset, uint32_t baud)
+{
+    if (sdlog_is_running()) {
+        Serial.println("XFER ERR logging active (log stop first)");
+        return;
+    }
+
+    File f = SD.open(path, FILE_READ);
+    if (!f || f.isDirectory()) {
+        Serial.println("XFER ERR cannot open file");
+        return;
+    }
+
+    const uint32_t size = (uint32_t)f.size();
+    if (offset > size) {
+        f.close();
+        Serial.println("XFER ERR offset beyond end of file");
+        return;
+    }
+
+    // Serial belongs to the transfer from here on: no telemetry and no
+    // debug prints from other tasks in the middle of a frame (deferred
+    // records already queued stay queued until the end)
+    stopTelemetry();
+    debugSetExternalDrain(true);
+    const DebugLevel savedLevel = debugLevel;
+    debugLevel = DEBUG_OFF;
+
+    xs = {};
+    xs.file = f;
+    xs.size = size;
+    xs.acked = xs.next = offset;
+    xs.lastRxMs = xs.lastProgressMs = millis();
+
+    Serial.printf("XFER %lu %lu %lu\n", (unsigned long)size, (unsigned long)offset, (unsigned long)baud);
+    Serial.flush();
+    Serial.updateBaudRate(baud);
+
+    const uint32_t t0 = millis();
+    XferStatus status = transferLoop();
+    const uint32_t elapsed = millis() - t0;
+
+    // END a few times: it is not acknowledged
+    for (int i = 0; i < 3; i++) {
+        sendEnd(status);
+        delay(20);
+    }
+
+    Serial.flush();
+    Serial.updateBaudRate(SERIAL_CLI_BAUD);
+    xs.file.close();
+    debugLevel = savedLevel;
+    debugSetExternalDrain(false);
+
+    DBG_INFOF("[XFER] %s status %u, %lu bytes in %lu ms, %lu retransmits, %lu timeouts\n",
+              path, status, (unsigned long)(xs.acked - offset), (unsigned long)elapsed,
+              (unsigned long)xs.retransmits, (unsigned long)xs.timeouts);
+}
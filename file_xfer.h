@@ -0,0 +1,99 @@
+#pragma once
+
+#include <stdint.h>
+#include <stddef.h>
+
+/*
+ * SD card file listing and binary file transfer over the serial link.
+ *
+ * "ls" prints a text listing. "get <path> [offset] [baud]" answers with
+ * one text line
+ *   XFER <size> <offset> <baud>
+ * or
+ *   XFER ERR <reason>
+ * then switches to <baud> and runs the binary protocol below until the
+ * transfer ends, after which the CLI is back at SERIAL_CLI_BAUD.
+ *
+ * Logging must be stopped first; telemetry is stopped automatically.
+ */
+
+/* =========================
+ *  WIRE FORMAT
+ * =========================
+ * Frames in both directions:
+ *   COBS(packet) 0x00                   (cobs.h)
+ * packet, little endian:
+ *   uint8_t  type                       XferPacketType
+ *   uint8_t  body[]                     layout by type
+ *   uint32_t crc                        CRC-32 over type..body (crc.h)
+ *
+ * The device keeps up to XFER_WINDOW chunks in flight beyond the
+ * receiver's cumulative ACK and reads the file again for any
+ * retransmit, so it needs no per-chunk buffers.
+ *
+ * Receiver:
+ *  - ACK <offset>: everything below offset is stored. Sent for INFO
+ *    (handshake, offset = resume point) and every few chunks.
+ *  - NAK <offset>: chunk at offset missing or corrupt (a later chunk
+ *    arrived first). The device resends just that chunk.
+ * Device:
+ *  - no ACK progress for XFER_ACK_TIMEOUT_MS: resend from the last ACK
+ *  - nothing from the receiver for XFER_IDLE_ABORT_MS: give up
+ *
+ * Resume is a new "get" with the offset the receiver already has.
+ */
+
+#define XFER_PROTOCOL_VERSION   1
+
+typedef enum : uint8_t {
+    XFER_PKT_INFO   = 0x10,     // device -> host: XferInfo
+    XFER_PKT_DATA   = 0x11,     // device -> host: uint32_t offset, data[]
+    XFER_PKT_END    = 0x12,     // device -> host: XferEnd
+    XFER_PKT_ACK    = 0x20,     // host -> device: uint32_t offset
+    XFER_PKT_NAK    = 0x21,     // host -> device: uint32_t offset
+    XFER_PKT_ABORT  = 0x22,     // host -> device: no body
+} XferPacketType;
+
+typedef enum : uint8_t {
+    XFER_OK         = 0,
+    XFER_ABORTED    = 1,        // by the receiver
+    XFER_TIMEOUT    = 2,        // receiver went silent
+    XFER_READ_ERROR = 3,
+} XferStatus;
+
+typedef struct __attribute__((packed)) {
+    uint32_t file_size;
+    uint32_t offset;            // first byte that will be sent
+    uint16_t chunk;             // data bytes per DATA packet (last may be shorter)
+    uint8_t  window;            // chunks in flight
+    uint8_t  version;           // XFER_PROTOCOL_VERSION
+} XferInfo;
+
+typedef struct __attribute__((packed)) {
+    uint32_t file_size;
+    uint8_t  status;            // XferStatus
+    uint32_t chunks_sent;
+    uint32_t retransmits;
+    uint32_t timeouts;
+} XferEnd;
+
+/*
+ * XFER_CHUNK / XFER_WINDOW
+ *
+ * 1 KB chunks keep the framing overhead under 1.5 %; 32 chunks in
+ * flight cover the USB-serial round trip at 2 Mbaud with room to spare.
+ */
+#define XFER_CHUNK              1024
+#define XFER_WINDOW             32
+
+#define XFER_DATA_HEADER        (1 + 4)
+#define XFER_MAX_PACKET         (XFER_DATA_HEADER + XFER_CHUNK + 4)
+#define XFER_MAX_FRAME          (XFER_MAX_PACKET + XFER_MAX_PACKET / 254 + 2)   // COBS_MAX_FRAME
+
+#define XFER_DEFAULT_BAUD       2000000
+#define XFER_ACK_TIMEOUT_MS     300
+#define XFER_IDLE_ABORT_MS      5000
+
+// CLI entry points (text output on Serial)
+void listSdFiles(const char* dir);
+void runFileTransfer(const char* path, uint32_t offset, uint32_t baud);
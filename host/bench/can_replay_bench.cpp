@@ -0,0 +1,737 @@
+/*
+ * CAN replay benchmark (host build).
+ *
+ * Feeds a frame stream through the fake TWAI driver into handleCAN() and
+ * measures the acquisition path exactly as the firmware runs it:
+ *
+ *   sniff     synthetic vehicle bus, CAN_MODE_SNIFFER, logged via sdlog
+ *   encoders  synthetic Briter READ responses, CAN_MODE_NORMAL, logged raw via sdlog
+ *   replay    frames from a candump log or an SDLG log file
+ *   poll      timer-driven encoder polling against simulated encoders
+ *
+ * Reports frames/sec, per-frame handleCAN() latency percentiles and
+ * sdlog drop counts. With --rx-task the firmware RX task drains the
+ * driver instead, and the report shows driver queue losses and batching.
+ */
+
+#include <Arduino.h>
+#include <SD.h>
+#include <host_hal.h>
+
+#include "can_bus.h"
+#include "BriterEncoder.h"
+#include "measurements.h"
+#include "encoder_poll.h"
+#include "sdlog.h"
+#include "sniff_filter.h"
+#include "debug.h"
+#include "serial_cli.h"
+#include "telemetry.h"
+#include "perf.h"
+#include "tasks.h"
+#include "sdlog_reader.h"
+#include "sdlog_chunk.h"
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <string>
+#include <thread>
+#include <vector>
+
+using Clock = std::chrono::steady_clock;
+
+struct BenchOptions {
+    std::string mode       = "sniff";
+    std::string replayPath;
+    size_t      frames     = 200000;
+    uint32_t    rate       = 0;         // frames/sec, 0 = unthrottled
+    bool        sdEnabled  = true;
+    uint32_t    sdLatency  = 0;         // us per write
+    bool        mute       = false;
+    bool        rxTask     = false;
+    double      seconds    = 2.0;       // poll mode run time
+    int         pollHz     = -1;        // poll mode rate override
+    uint32_t    lossPct    = 0;         // poll mode: dropped responses
+    uint32_t    pushMs     = 0;         // poll mode: encoders in auto-report
+    uint32_t    telemHz    = 0;         // poll mode: binary telemetry rate
+    std::string serialOut;              // Serial output path (tty / pty / file)
+    DebugLevel  debug      = DEBUG_OFF;
+    uint32_t    perfLogS   = 0;
+    double      rotateMb   = -1.0;      // < 0: firmware default
+    long        busOffAt   = -1;        // frame index, < 0: never
+    int         codec      = -1;        // SdlogCodec, < 0: firmware default
+    int         sniffChanges = -1;      // change-only sniff logging, < 0: firmware default
+    uint32_t    counterPct = 100;       // sniff mode: IDs with a rolling counter
+    bool        debugDefer = false;
+};
+
+/* =========================
+ *  FRAME SOURCES
+ * ========================= */
+
+// Small deterministic PRNG so runs are comparable
+static uint32_t lcg(uint32_t& s)
+{
+    s = s * 1664525u + 1013904223u;
+    return s;
+}
+
+/*
+ * Vehicle-bus-like stream: a fixed set of periodic IDs whose payloads
+ * mostly repeat, with occasional signal changes. The first counterPct
+ * percent of the IDs also carry a rolling counter (changing every frame).
+ */
+static void makeSniffFrames(size_t count, uint32_t counterPct, std::vector<twai_message_t>& out)
+{
+    static const uint32_t ids[] = {
+        0x0C0, 0x0D0, 0x100, 0x102, 0x110, 0x120, 0x130, 0x140,
+        0x200, 0x210, 0x220, 0x280, 0x2A0, 0x300, 0x320, 0x340,
+        0x380, 0x3C0, 0x400, 0x420, 0x500, 0x520, 0x580, 0x5A0,
+        0x18FEF100, 0x18FEEE00, 0x0CF00400, 0x18FEF200
+    };
+    const size_t numIds = sizeof(ids) / sizeof(ids[0]);
+
+    uint8_t payload[numIds][8] = {};
+    uint32_t seed = 0x5EED1234;
+
+    out.reserve(out.size() + count);
+    for (size_t i = 0; i < count; i++) {
+        size_t k = lcg(seed) % numIds;
+
+        twai_message_t msg = {};
+        msg.identifier = ids[k];
+        msg.extd = ids[k] > 0x7FF;
+        msg.data_length_code = (uint8_t)(2 + (k % 7));
+
+        if (k * 100 < counterPct * numIds)
+            payload[k][0]++;                      // rolling counter
+        if ((lcg(seed) & 0x0F) == 0)              // occasional signal change
+            payload[k][1 + (lcg(seed) % 7)] = (uint8_t)lcg(seed);
+
+        memcpy(msg.data, payload[k], 8);
+        out.push_back(msg);
+    }
+}
+
+/*
+ * Briter READ responses for all encoders, round-robin, with a slow
+ * sinusoid-ish travel so the conversion path sees realistic values.
+ */
+static twai_message_t makeEncoderFrame(uint8_t id, int32_t raw)
+{
+    twai_message_t msg = {};
+    msg.identifier = id;
+    msg.data_length_code = 7;
+    msg.data[0] = 0x07;
+    msg.data[1] = id;
+    msg.data[2] = BriterEncoder::FUNC_READ;
+    msg.data[3] = (uint8_t)(raw);
+    msg.data[4] = (uint8_t)(raw >> 8);
+    msg.data[5] = (uint8_t)(raw >> 16);
+    msg.data[6] = (uint8_t)(raw >> 24);
+    return msg;
+}
+
+static void makeEncoderFrames(size_t count, std::vector<twai_message_t>& out)
+{
+    out.reserve(out.size() + count);
+    for (size_t i = 0; i < count; i++) {
+        uint8_t id = BriterEncoder::FIRST_ID + (i % BriterEncoder::NUM_ENCODERS);
+        int32_t raw = (int32_t)(8000.0 + 6000.0 * sin((double)i * 0.001));
+        out.push_back(makeEncoderFrame(id, raw));
+    }
+}
+
+/*
+ * candump log format: "(1436509052.249713) can0 123#DEADBEEF"
+ */
+static bool parseCandumpLine(const char* line, twai_message_t& msg)
+{
+    const char* hash = strchr(line, '#');
+    if (!hash)
+        return false;
+
+    const char* idStart = hash;
+    while (idStart > line && isxdigit((unsigned char)idStart[-1]))
+        idStart--;
+    if (idStart == hash)
+        return false;
+
+    msg = {};
+    msg.identifier = (uint32_t)strtoul(idStart, nullptr, 16);
+    msg.extd = (hash - idStart) > 3;
+
+    const char* p = hash + 1;
+    if (*p == 'R') {
+        msg.rtr = 1;
+        return true;
+    }
+
+    uint8_t dlc = 0;
+    while (dlc < 8 && isxdigit((unsigned char)p[0]) && isxdigit((unsigned char)p[1])) {
+        char hex[3] = { p[0], p[1], 0 };
+        msg.data[dlc++] = (uint8_t)strtoul(hex, nullptr, 16);
+        p += 2;
+        if (*p == '.')
+            p++;
+    }
+    msg.data_length_code = dlc;
+    return true;
+}
+
+/*
+ * SDLG log (any supported SDLOG_VERSION): every REC_SNIFF / REC_VEHICLE
+ * record becomes one frame, every REC_SENSORS channel one encoder READ
+ * response.
+ */
+static bool loadSdlog(FILE* fp, std::vector<twai_message_t>& out)
+{
+    std::vector<uint8_t> bytes;
+    uint8_t chunk[64 * 1024];
+    size_t n;
+    while ((n = fread(chunk, 1, sizeof(chunk), fp)) > 0)
+        bytes.insert(bytes.end(), chunk, chunk + n);
+
+    // v5+: records are in chunk payloads, take the intact ones
+    if (sdlog::isChunked(bytes.data(), bytes.size())) {
+        std::vector<uint8_t> stream;
+        std::vector<sdlog::StreamRange> valid;
+        sdlog::ChunkStats st;
+        if (!sdlog::unchunk(bytes.data(), bytes.size(), stream, valid, st) ||
+            valid[0].start != 0) {
+            fprintf(stderr, "SDLG log: first chunk damaged (try sdlog_recover)\n");
+            return false;
+        }
+        stream.resize(valid[0].end);
+        bytes.swap(stream);
+    }
+
+    sdlog::Reader reader;
+    if (!reader.open(bytes.data(), bytes.size())) {
+        fprintf(stderr, "SDLG log: %s\n", reader.errorText());
+        return false;
+    }
+
+    sdlog::Record rec;
+    while (reader.next(rec)) {
+        if (rec.type == REC_SENSORS) {
+            SdlogSensorRecord frame;
+            memcpy(&frame, rec.raw, sizeof(frame));
+            for (uint8_t i = 0; i < BriterEncoder::NUM_ENCODERS; i++) {
+                if (frame.valid & (1u << i))
+                    out.push_back(makeEncoderFrame(BriterEncoder::FIRST_ID + i, frame.raw[i]));
+            }
+            continue;
+        }
+        if (rec.type != REC_SNIFF && rec.type != REC_VEHICLE)
+            continue;
+
+        twai_message_t msg = {};
+        msg.identifier = rec.can_id;
+        msg.extd = rec.extd;
+        msg.data_length_code = rec.dlc;
+        memcpy(msg.data, rec.data, rec.dlc);
+        out.push_back(msg);
+    }
+
+    if (reader.error())
+        fprintf(stderr, "SDLG log: stopped at offset %zu: %s\n", reader.offset(), reader.errorText());
+    return true;
+}
+
+static bool loadReplay(const std::string& path, std::vector<twai_message_t>& out)
+{
+    FILE* fp = fopen(path.c_str(), "rb");
+    if (!fp) {
+        fprintf(stderr, "cannot open %s\n", path.c_str());
+        return false;
+    }
+
+    uint8_t magic[4] = {};
+    size_t n = fread(magic, 1, sizeof(magic), fp);
+    rewind(fp);
+
+    bool ok;
+    if (n == 4 && memcmp(magic, "SDLG", 4) == 0) {
+        ok = loadSdlog(fp, out);
+    } else {
+        char line[256];
+        twai_message_t msg;
+        while (fgets(line, sizeof(line), fp)) {
+            if (parseCandumpLine(line, msg))
+                out.push_back(msg);
+        }
+        ok = true;
+    }
+
+    fclose(fp);
+    return ok;
+}
+
+/* =========================
+ *  REPORT
+ * ========================= */
+
+/*
+ * Firmware perf counters (perf.h) for every site that saw samples.
+ * The percentile is the upper bound of the log2 bin it falls in.
+ */
+static void printPerfCounters()
+{
+    const double mhz = perfCyclesPerUs();
+
+    for (uint8_t i = 0; i < PERF_SITE_COUNT; i++) {
+        PerfCounter c;
+        getPerfCounter((PerfSite)i, c);
+        if (c.count == 0)
+            continue;
+
+        uint64_t seen = 0;
+        uint8_t p99 = 0;
+        for (uint8_t b = 0; b < PERF_HIST_BINS; b++) {
+            seen += c.hist[b];
+            if (seen * 100 >= (uint64_t)c.count * 99) {
+                p99 = b;
+                break;
+            }
+        }
+
+        printf("perf %-11s: %u  avg %.0f ns  max %.0f ns  p99 < %.0f ns\n",
+               perfSiteName((PerfSite)i), c.count,
+               c.sum_cycles * 1000.0 / c.count / mhz,
+               c.max_cycles * 1000.0 / mhz,
+               (2u << p99) * 1000.0 / mhz);
+    }
+}
+
+// Acquisition jitter (tasks.h), the same histograms "tasks" prints
+static void printJitter()
+{
+    for (uint8_t i = 0; i < JITTER_SOURCE_COUNT; i++) {
+        JitterHist h;
+        getJitter((JitterSource)i, h);
+        if (h.count == 0)
+            continue;
+
+        uint64_t seen = 0;
+        uint8_t p99 = JITTER_BINS - 1;
+        for (uint8_t b = 0; b < JITTER_BINS; b++) {
+            seen += h.hist[b];
+            if (seen * 100 >= (uint64_t)h.count * 99) {
+                p99 = b;
+                break;
+            }
+        }
+
+        printf("jitter %-11s: %u  avg %.1f us  max %u us  p99 %s %u us\n",
+               jitterSourceName((JitterSource)i), h.count, (double)h.sum_us / h.count,
+               h.max_us, p99 == JITTER_BINS - 1 ? ">=" : "<",
+               jitterBinUs(p99 == JITTER_BINS - 1 ? p99 : p99 + 1));
+    }
+}
+
+static double percentile(const std::vector<uint32_t>& sorted, double p)
+{
+    if (sorted.empty())
+        return 0.0;
+    size_t idx = (size_t)(p / 100.0 * (double)(sorted.size() - 1) + 0.5);
+    return (double)sorted[std::min(idx, sorted.size() - 1)];
+}
+
+static void usage(const char* prog)
+{
+    fprintf(stderr,
+        "Usage: %s [options]\n"
+        "  --mode sniff|encoders|poll  synthetic stream type (default sniff)\n"
+        "  --seconds <s>             poll mode run time (default 2)\n"
+        "  --poll-hz <hz>            poll mode rate for all encoders\n"
+        "  --response-loss <pct>     poll mode: simulated encoders drop responses\n"
+        "  --push-ms <ms>            poll mode: put encoders in auto-report mode\n"
+        "  --telem-hz <hz>           poll mode: stream binary telemetry on Serial\n"
+        "  --serial-out <path>       firmware Serial output to a file / tty / pty\n"
+        "  --replay <file>           replay candump log or SDLG log (sniffer mode)\n"
+        "  --frames <n>              synthetic frame count (default 200000)\n"
+        "  --rate <fps>              pace injection, 0 = unthrottled (default 0)\n"
+        "  --sd-root <dir>           fake SD card directory (default ./sdcard)\n"
+        "  --sd-latency-us <us>      artificial latency per SD write\n"
+        "  --no-sd                   do not start sdlog\n"
+        "  --rx-task                 run the firmware CAN RX task instead of polling handleCAN()\n"
+        "  --debug off|error|info|verbose\n"
+        "  --debug-defer             deferred (ring buffered) debug output\n"
+        "  --perf-log <s>            REC_PERF snapshot in the SD log every s seconds\n"
+        "  --rotate-mb <mb>          new SD log file every mb MB, 0 = off\n"
+        "  --bus-off-at <n>          controller goes bus-off after frame n (use with --rate)\n"
+        "  --compress on|off         SD log stream compression (default: firmware default)\n"
+        "  --sniff-changes on|off    change-only sniff logging (default: firmware default)\n"
+        "  --counters <pct>          sniff mode: IDs with a rolling counter (default 100)\n"
+        "  --mute                    discard firmware Serial output\n",
+        prog);
+}
+
+static bool parseArgs(int argc, char** argv, BenchOptions& opt)
+{
+    for (int i = 1; i < argc; i++) {
+        std::string a = argv[i];
+        auto next = [&]() -> const char* { return (i + 1 < argc) ? argv[++i] : nullptr; };
+        const char* v = nullptr;
+
+        if (a == "--mode" && (v = next()))               opt.mode = v;
+        else if (a == "--replay" && (v = next()))        { opt.mode = "replay"; opt.replayPath = v; }
+        else if (a == "--frames" && (v = next()))        opt.frames = strtoul(v, nullptr, 10);
+        else if (a == "--rate" && (v = next()))          opt.rate = strtoul(v, nullptr, 10);
+        else if (a == "--sd-root" && (v = next()))       host_hal::sd_set_root(v);
+        else if (a == "--sd-latency-us" && (v = next())) opt.sdLatency = strtoul(v, nullptr, 10);
+        else if (a == "--no-sd")                         opt.sdEnabled = false;
+        else if (a == "--mute")                          opt.mute = true;
+        else if (a == "--debug-defer")                   opt.debugDefer = true;
+        else if (a == "--perf-log" && (v = next()))      opt.perfLogS = strtoul(v, nullptr, 10);
+        else if (a == "--rotate-mb" && (v = next()))     opt.rotateMb = atof(v);
+        else if (a == "--bus-off-at" && (v = next()))    opt.busOffAt = strtol(v, nullptr, 10);
+        else if (a == "--compress" && (v = next())) {
+            std::string c = v;
+            if (c == "on")           opt.codec = SDLOG_CODEC_LZ;
+            else if (c == "off")     opt.codec = SDLOG_CODEC_NONE;
+            else return false;
+        }
+        else if (a == "--sniff-changes" && (v = next())) {
+            std::string c = v;
+            if (c == "on")           opt.sniffChanges = 1;
+            else if (c == "off")     opt.sniffChanges = 0;
+            else return false;
+        }
+        else if (a == "--counters" && (v = next()))      opt.counterPct = strtoul(v, nullptr, 10);
+        else if (a == "--rx-task")                       opt.rxTask = true;
+        else if (a == "--seconds" && (v = next()))       opt.seconds = atof(v);
+        else if (a == "--poll-hz" && (v = next()))       opt.pollHz = atoi(v);
+        else if (a == "--response-loss" && (v = next())) opt.lossPct = strtoul(v, nullptr, 10);
+        else if (a == "--push-ms" && (v = next()))       opt.pushMs = strtoul(v, nullptr, 10);
+        else if (a == "--telem-hz" && (v = next()))      opt.telemHz = strtoul(v, nullptr, 10);
+        else if (a == "--serial-out" && (v = next()))    opt.serialOut = v;
+        else if (a == "--debug" && (v = next())) {
+            std::string l = v;
+            if (l == "off")          opt.debug = DEBUG_OFF;
+            else if (l == "error")   opt.debug = DEBUG_ERROR;
+            else if (l == "info")    opt.debug = DEBUG_INFO;
+            else if (l == "verbose") opt.debug = DEBUG_VERBOSE;
+            else return false;
+        }
+        else return false;
+    }
+    return opt.mode == "sniff" || opt.mode == "encoders" || opt.mode == "replay" ||
+           opt.mode == "poll";
+}
+
+/* =========================
+ *  POLL MODE
+ * ========================= */
+
+/*
+ * Simulated Briter encoders answer every READ request immediately
+ * (optionally dropping a percentage) and honour the auto-report
+ * commands; the firmware polling scheduler and RX task run as on the
+ * device.
+ */
+static std::atomic<uint32_t> simAutoMs[BriterEncoder::NUM_ENCODERS];
+
+static void simSendValue(uint8_t id)
+{
+    int32_t raw = (int32_t)(esp_timer_get_time() & 0x3FFF);
+    host_hal::twai_inject(makeEncoderFrame(id, raw));
+}
+
+static void simPushThread()
+{
+    int64_t due[BriterEncoder::NUM_ENCODERS] = {};
+
+    while (true) {
+        int64_t now = esp_timer_get_time();
+        for (int i = 0; i < BriterEncoder::NUM_ENCODERS; i++) {
+            uint32_t ms = simAutoMs[i].load();
+            if (ms == 0 || now < due[i])
+                continue;
+            due[i] = (due[i] && now - due[i] < (int64_t)ms * 1000) ? due[i] + ms * 1000 : now + ms * 1000;
+            simSendValue(BriterEncoder::FIRST_ID + i);
+        }
+        std::this_thread::sleep_for(std::chrono::microseconds(50));
+    }
+}
+
+static int runPollBench(const BenchOptions& opt)
+{
+    canMode = CAN_MODE_NORMAL;
+
+    initCAN();
+    initMeasurements();
+    startCANRxTask();
+    initEncoderPolling();
+
+    if (opt.pollHz >= 0) {
+        for (uint8_t id = BriterEncoder::FIRST_ID; id <= BriterEncoder::LAST_ID; id++)
+            setEncoderPollRate(id, (uint16_t)opt.pollHz);
+    }
+
+    static uint32_t seed = 0xC0FFEE;
+    static uint32_t lossPct;
+    lossPct = opt.lossPct;
+
+    host_hal::twai_set_tx_hook([](const twai_message_t& req) {
+        uint8_t id = req.data[1];
+        if (req.data_length_code < 3 ||
+            id < BriterEncoder::FIRST_ID || id > BriterEncoder::LAST_ID)
+            return;
+
+        std::atomic<uint32_t>& autoMs = simAutoMs[id - BriterEncoder::FIRST_ID];
+        static uint32_t pendingMs[BriterEncoder::NUM_ENCODERS];
+
+        switch (req.data[2]) {
+        case BriterEncoder::FUNC_READ:
+            if (lossPct && lcg(seed) % 100 < lossPct)
+                return;
+            simSendValue(id);
+            break;
+        case BriterEncoder::FUNC_SET_AUTO_TIME:
+            pendingMs[id - BriterEncoder::FIRST_ID] = req.data[3] | (req.data[4] << 8);
+            break;
+        case BriterEncoder::FUNC_SET_MODE:
+            autoMs = (req.data[3] == BriterEncoder::MODE_AUTO) ? pendingMs[id - BriterEncoder::FIRST_ID] : 0;
+            break;
+        }
+    });
+    std::thread(simPushThread).detach();
+
+    if (opt.pushMs) {
+        for (uint8_t id = BriterEncoder::FIRST_ID; id <= BriterEncoder::LAST_ID; id++)
+            BriterEncoder::setAutoReport(id, (uint16_t)opt.pushMs);
+        resetEncoderPollStats();
+    }
+
+    if (opt.telemHz) {
+        Serial.setTxBufferSize(SERIAL_TX_BUFFER);
+        initTelemetry();
+        if (!startTelemetry(TELEM_DEFAULT_BAUD, (uint16_t)opt.telemHz)) {
+            fprintf(stderr, "telemetry start failed\n");
+            return 1;
+        }
+    }
+
+    uint32_t txBefore = host_hal::twai_tx_count();
+    startEncoderPolling();
+    std::this_thread::sleep_for(std::chrono::duration<double>(opt.seconds));
+    stopEncoderPolling();
+    stopTelemetry();
+    std::this_thread::sleep_for(std::chrono::milliseconds(20));
+
+    uint32_t txFrames = host_hal::twai_tx_count() - txBefore;
+
+    PollTimingStats t;
+    getPollTimingStats(t);
+    twai_status_info_t st;
+    twai_get_status_info(&st);
+
+    printf("\n=== Encoder polling benchmark ===\n");
+    printf("run time        : %.2f s\n", opt.seconds);
+    printf("ticks           : %u (tick %u us, jitter max %u us, missed %u)\n",
+           t.ticks, t.tick_us, t.jitter_max_us, t.missed_ticks);
+    printf("est. bus load   : %u %%\n", estimatePollBusLoad());
+    for (uint8_t id = BriterEncoder::FIRST_ID; id <= BriterEncoder::LAST_ID; id++) {
+        EncoderPollStats es;
+        getEncoderPollStats(id, es);
+        if (BriterEncoder::isAutoReport(id)) {
+            printf("encoder %u       : push %u ms, achieved %.0f Hz\n",
+                   id, BriterEncoder::autoReportInterval(id), es.pushed / opt.seconds);
+            continue;
+        }
+        printf("encoder %u       : target %u Hz, achieved %.0f Hz, req %u, resp %u, timeout %u, late %u, txfail %u\n",
+               id, es.rate_hz, es.responses / opt.seconds,
+               es.requests, es.responses, es.timeouts, es.late, es.tx_fail);
+        printf("  latency       : min %u, avg %u, max %u us, hist",
+               es.latency_min_us, es.latency_avg_us, es.latency_max_us);
+        for (int b = 0; b < POLL_LATENCY_BINS; b++)
+            printf(" %u", es.latency_hist[b]);
+        printf("\n");
+    }
+    printf("tx frames       : %u\n", txFrames);
+    printf("twai rx_missed  : %u\n", st.rx_missed_count);
+    if (opt.telemHz) {
+        TelemetryStats ts;
+        getTelemetryStats(ts);
+        printf("telemetry       : %u Hz at %u baud, sent %u, dropped %u, %u bytes\n",
+               ts.rate_hz, ts.baud, ts.sent, ts.dropped, ts.bytes);
+    }
+    printPerfCounters();
+    printJitter();
+
+    fflush(stdout);
+    _Exit(0);
+}
+
+int main(int argc, char** argv)
+{
+    BenchOptions opt;
+    if (!parseArgs(argc, argv, opt)) {
+        usage(argv[0]);
+        return 2;
+    }
+
+    host_hal::serial_set_muted(opt.mute);
+    if (!opt.serialOut.empty() && !host_hal::serial_set_output(opt.serialOut.c_str())) {
+        fprintf(stderr, "cannot open %s\n", opt.serialOut.c_str());
+        return 1;
+    }
+    host_hal::sd_set_write_latency_us(opt.sdLatency);
+    debugLevel = opt.debug;
+    debugDeferred = opt.debugDefer;
+    initDebug();
+    initPerf();
+    setPerfLogInterval(opt.perfLogS);
+    if (opt.rotateMb >= 0.0)
+        sdlog_set_rotation((uint32_t)(opt.rotateMb * 1024 * 1024), 0);
+    if (opt.codec >= 0)
+        sdlog_set_codec((SdlogCodec)opt.codec);
+
+    if (opt.mode == "poll")
+        return runPollBench(opt);
+
+    std::vector<twai_message_t> frames;
+    if (opt.mode == "sniff")
+        makeSniffFrames(opt.frames, opt.counterPct, frames);
+    else if (opt.mode == "encoders")
+        makeEncoderFrames(opt.frames, frames);
+    else if (!loadReplay(opt.replayPath, frames))
+        return 1;
+
+    if (frames.empty()) {
+        fprintf(stderr, "no frames to replay\n");
+        return 1;
+    }
+
+    canMode = (opt.mode == "encoders") ? CAN_MODE_NORMAL : CAN_MODE_SNIFFER;
+
+    initCAN();
+    initMeasurements();
+    if (opt.sniffChanges >= 0)
+        setSniffChangesOnly(opt.sniffChanges != 0);
+    if (opt.rxTask)
+        startCANRxTask();
+
+    bool logging = false;
+    if (opt.sdEnabled) {
+        if (!sdlog_init() || !sdlog_start()) {
+            fprintf(stderr, "sdlog start failed (SD root %s)\n", host_hal::sd_root());
+            return 1;
+        }
+        logging = true;
+    }
+
+    std::vector<uint32_t> latNs;
+    latNs.reserve(frames.size());
+
+    const auto period = opt.rate ? std::chrono::nanoseconds(1000000000ull / opt.rate)
+                                 : std::chrono::nanoseconds(0);
+    const auto start = Clock::now();
+    auto due = start;
+    size_t injected = 0, notReceived = 0;
+
+    for (const twai_message_t& msg : frames) {
+        if (opt.rate) {
+            due += period;
+            std::this_thread::sleep_until(due);
+        }
+
+        if ((long)injected++ == opt.busOffAt)
+            host_hal::twai_bus_off();
+        if (!host_hal::twai_inject(msg))
+            notReceived++;
+
+        if (opt.rxTask)
+            continue;
+
+        auto t0 = Clock::now();
+        handleCAN();
+        auto t1 = Clock::now();
+
+        latNs.push_back((uint32_t)std::chrono::duration_cast<std::chrono::nanoseconds>(t1 - t0).count());
+    }
+
+    // Let the RX task finish what is still queued in the driver
+    while (opt.rxTask && host_hal::twai_rx_pending() > 0)
+        std::this_thread::sleep_for(std::chrono::milliseconds(1));
+
+    const double elapsed = std::chrono::duration<double>(Clock::now() - start).count();
+
+    uint32_t dropped = 0;
+    SdlogStats sdStats = {};
+    if (logging) {
+        dropped = sdlog_dropped();
+        sdlog_stop();
+        sdlog_get_stats(&sdStats);
+    }
+
+    twai_status_info_t st;
+    twai_get_status_info(&st);
+
+    std::sort(latNs.begin(), latNs.end());
+    double sum = 0;
+    for (uint32_t v : latNs) sum += v;
+
+    printf("\n=== CAN replay benchmark ===\n");
+    printf("mode            : %s%s%s\n", opt.mode.c_str(),
+           opt.replayPath.empty() ? "" : " ", opt.replayPath.c_str());
+    printf("frames          : %zu\n", frames.size());
+    printf("elapsed         : %.3f s\n", elapsed);
+    printf("throughput      : %.0f frames/s\n", (double)frames.size() / elapsed);
+    if (opt.rxTask) {
+        CanRxStats rx;
+        getCANRxStats(rx);
+        printf("rx task         : %u frames in %u batches (avg %.1f, max %u)\n",
+               rx.frames, rx.batches,
+               rx.batches ? (double)rx.frames / rx.batches : 0.0, rx.batch_max);
+    } else {
+        printf("handleCAN() ns  : avg %.0f  p50 %.0f  p90 %.0f  p99 %.0f  p99.9 %.0f  max %u\n",
+               sum / (double)latNs.size(),
+               percentile(latNs, 50.0), percentile(latNs, 90.0),
+               percentile(latNs, 99.0), percentile(latNs, 99.9),
+               latNs.back());
+    }
+    printf("twai rx_missed  : %u\n", st.rx_missed_count);
+    CanHealth health;
+    getCANHealth(health);
+    printf("can health      : load ~%.1f %% (last interval), %zu frames not received, "
+           "bus-off %u, recovered %u, RX queue %u%s\n",
+           health.bus_load_permille / 10.0, notReceived, health.bus_off, health.recoveries,
+           health.rx_queue_len, health.queue_grows ? " (grown)" : "");
+    if (canMode == CAN_MODE_SNIFFER && logging) {
+        SniffStats ss;
+        getSniffStats(ss);
+        printf("sniff filter    : %u logged of %u (%.1f %%), %u unchanged, %u excluded, "
+               "%u filtered by the controller\n",
+               ss.logged, ss.frames, ss.frames ? 100.0 * ss.logged / ss.frames : 0.0,
+               ss.suppressed, ss.excluded, host_hal::twai_rx_filtered());
+    }
+    if (logging) {
+        printf("sdlog dropped   : %u records\n", dropped);
+        printf("sdlog written   : %llu bytes in %u writes, %u B/s\n",
+               (unsigned long long)sdStats.bytes_written, sdStats.writes, sdStats.bytes_per_sec);
+        printf("sdlog stream    : %llu bytes, %s, %u chunks (%.2f stream bytes per chunk byte)\n",
+               (unsigned long long)sdStats.stream_bytes,
+               sdStats.codec == SDLOG_CODEC_NONE ? "uncompressed" : "compressed", sdStats.chunks,
+               sdStats.chunks ? (double)sdStats.stream_bytes / ((double)sdStats.chunks * SDLOG_CHUNK_SIZE) : 0.0);
+        printf("sdlog write us  : avg %u  max %u  (flush max %u)\n",
+               sdStats.write_avg_us, sdStats.write_max_us, sdStats.flush_max_us);
+        printf("sdlog buffer    : peak %u / %u bytes\n",
+               sdStats.buffer_high_water, sdStats.buffer_size);
+        printf("sdlog files     : %u, last %s, start %u us (name %u us, %s)\n",
+               sdStats.files, sdStats.file_name, sdStats.start_us, sdStats.start_lookup_us,
+               sdStats.start_scanned ? "scan" : "NVS");
+    }
+    else
+        printf("sdlog           : not running\n");
+    printPerfCounters();
+    printJitter();
+
+    fflush(stdout);
+
+    // sdlog_task never returns; skip static destruction under its feet.
+    _Exit(0);
+}
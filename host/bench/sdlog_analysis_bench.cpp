@@ -0,0 +1,436 @@
+/*
+ * SD log analysis benchmark (host build).
+ *
+ * Writes a synthetic session the way the sdlog writer lays it out -
+ * file header, REC_CALIB, REC_SENSORS frames at 500 Hz with seek points
+ * every second / 64 KB, REC_STATS and the footer index, chunk framed
+ * (v6) or plain (v4) - then runs sdlog::analyzeLogs() over it with one
+ * thread and with all cores, and reports the record stream decoded per
+ * second.
+ *
+ * Travel is a sum of two sines per encoder that crosses the bottom-out
+ * threshold on every peak of the slow one; the generator counts those
+ * the way the firmware does, so both runs are checked against it and
+ * against each other.
+ *
+ *   sdlog_analysis_bench                          # 4 files, 1 GB total
+ *   sdlog_analysis_bench --size 256 --format lz --dir /tmp
+ */
+
+#include "sdlog_analysis.h"
+#include "sdlog.h"
+#include "calibration.h"
+#include "lz_block.h"
+#include "crc.h"
+
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <string>
+#include <thread>
+#include <vector>
+
+struct BenchOptions {
+    std::string dir = ".";
+    uint64_t sizeMb = 1024;         // record stream, all files
+    unsigned files = 4;
+    std::string format = "v6";      // v4 (plain), v6 (chunked), lz (v6 compressed)
+    unsigned threads = 0;
+    bool     keep = false;
+};
+
+static const uint32_t SAMPLE_US     = 2000;
+static const uint32_t INDEX_US      = 1000 * 1000;  // SDLOG_INDEX_INTERVAL_US
+static const uint32_t INDEX_BYTES   = 64 * 1024;    // SDLOG_INDEX_BYTES
+static const uint16_t TABLE_MAX     = 256;          // SDLOG_INDEX_TABLE_MAX
+static const size_t   LZ_WINDOW     = 24 * 1024;    // SDLOG_COMPRESS_WINDOW
+static const float    BOTTOM_MM     = 140.0f;
+
+static void usage()
+{
+    fprintf(stderr,
+        "usage: sdlog_analysis_bench [options]\n"
+        "  --size <MB>       record stream to generate, all files (default 1024)\n"
+        "  --files <n>       split into n log files (default 4)\n"
+        "  --format <f>      v4 (plain), v6 (chunked, default), lz (v6 compressed)\n"
+        "  --threads <n>     threads for the parallel run (default: one per core)\n"
+        "  --dir <path>      where to write the files (default .)\n"
+        "  --keep            leave the files in place\n");
+}
+
+static bool parseArgs(int argc, char** argv, BenchOptions& opt)
+{
+    for (int i = 1; i < argc; i++) {
+        std::string a = argv[i];
+        const char* v = (i + 1 < argc) ? argv[i + 1] : nullptr;
+
+        if (a == "--size" && v)         { opt.sizeMb = strtoull(v, nullptr, 10); i++; }
+        else if (a == "--files" && v)   { opt.files = (unsigned)atoi(v); i++; }
+        else if (a == "--format" && v)  { opt.format = v; i++; }
+        else if (a == "--threads" && v) { opt.threads = (unsigned)atoi(v); i++; }
+        else if (a == "--dir" && v)     { opt.dir = v; i++; }
+        else if (a == "--keep")         opt.keep = true;
+        else return false;
+    }
+    return opt.sizeMb > 0 && opt.files > 0 &&
+           opt.sizeMb / opt.files < 4000 &&            // uint32 stream offsets
+           (opt.format == "v4" || opt.format == "v6" || opt.format == "lz");
+}
+
+/* =========================
+ *  WRITER
+ * ========================= */
+
+// Record stream to file: as is (v4) or in chunks (v6), as sdlog.cpp does
+class StreamWriter {
+public:
+    StreamWriter(FILE* fp, const std::string& format, uint32_t fileId)
+        : fp_(fp), chunked_(format != "v4"), lz_(format == "lz"), fileId_(fileId) {}
+
+    uint64_t pos() const { return pos_; }
+
+    void append(const void* p, size_t n)
+    {
+        const uint8_t* b = static_cast<const uint8_t*>(p);
+        pos_ += n;
+        if (!chunked_) {
+            fwrite(b, 1, n, fp_);
+            return;
+        }
+        pending_.insert(pending_.end(), b, b + n);
+        const size_t fill = lz_ ? LZ_WINDOW : SDLOG_CHUNK_PAYLOAD;
+        while (pending_.size() - head_ >= fill)
+            emit();
+        if (head_ > (1u << 20)) {
+            pending_.erase(pending_.begin(), pending_.begin() + head_);
+            head_ = 0;
+        }
+    }
+
+    void finish()
+    {
+        while (chunked_ && pending_.size() > head_)
+            emit();
+    }
+
+    uint64_t cardBytes() const { return card_; }
+
+private:
+    void emit()
+    {
+        uint8_t chunk[SDLOG_CHUNK_SIZE] = {};
+        const uint8_t* in = &pending_[head_];
+        const size_t avail = pending_.size() - head_;
+        size_t len, used;
+        uint8_t codec = SDLOG_CODEC_NONE;
+
+        if (lz_) {
+            // The writer's packing: as much as compresses into one chunk, stored if that carries more
+            const size_t raw = avail < LZ_WINDOW ? avail : LZ_WINDOW;
+            const size_t storable = raw < SDLOG_BLOCK_CAPACITY ? raw : SDLOG_BLOCK_CAPACITY;
+            uint8_t* data = &chunk[sizeof(SdlogChunkHeader) + sizeof(SdlogBlockHeader)];
+            size_t n = lzb_compress(in, raw, data, SDLOG_BLOCK_CAPACITY, table_, &used);
+            codec = SDLOG_CODEC_LZ;
+            if (used < storable || (used == storable && n >= used)) {
+                used = storable;
+                n = used;
+                memcpy(data, in, used);
+                codec = SDLOG_CODEC_STORED;
+            }
+            SdlogBlockHeader bh = { (uint32_t)(pos_ - avail), (uint16_t)used, 0 };
+            memcpy(&chunk[sizeof(SdlogChunkHeader)], &bh, sizeof(bh));
+            len = sizeof(bh) + n;
+        } else {
+            used = avail < SDLOG_CHUNK_PAYLOAD ? avail : SDLOG_CHUNK_PAYLOAD;
+            memcpy(&chunk[sizeof(SdlogChunkHeader)], in, used);
+            len = used;
+        }
+        head_ += used;
+
+        SdlogChunkHeader h = {};
+        memcpy(h.magic, SDLOG_CHUNK_MAGIC, 4);
+        h.seq = seq_++;
+        h.file_id = fileId_;
+        h.len = (uint16_t)len;
+        h.codec = codec;
+        memcpy(chunk, &h, sizeof(h));
+        const size_t crcOffset = sizeof(h) - sizeof(h.crc);
+        h.crc = crc32_ieee(chunk, crcOffset);
+        h.crc = crc32_ieee(&chunk[sizeof(h)], len, h.crc);
+        memcpy(&chunk[crcOffset], &h.crc, sizeof(h.crc));
+
+        // Full chunks but the last, which is cut to its length
+        const size_t out = pending_.size() > head_ ? SDLOG_CHUNK_SIZE : sizeof(h) + len;
+        fwrite(chunk, 1, out, fp_);
+        card_ += out;
+    }
+
+    FILE*    fp_;
+    bool     chunked_;
+    bool     lz_;
+    uint32_t fileId_;
+    uint32_t seq_ = 0;
+    uint64_t pos_ = 0;
+    uint64_t card_ = 0;
+    std::vector<uint8_t> pending_;
+    size_t   head_ = 0;
+    uint16_t table_[LZB_HASH_SIZE] = {};
+};
+
+static void appendLp(StreamWriter& w, uint8_t type, const void* payload, uint16_t len)
+{
+    uint8_t head[SDLOG_LP_HEADER_SIZE] = { type };
+    memcpy(&head[1], &len, 2);
+    w.append(head, sizeof(head));
+    w.append(payload, len);
+}
+
+/* =========================
+ *  SYNTHETIC SESSION
+ * ========================= */
+
+struct Truth {
+    uint64_t samples[SDLOG_SENSOR_CHANNELS] = {};
+    uint32_t bottomOuts[SDLOG_SENSOR_CHANNELS] = {};
+    bool     armed[SDLOG_SENSOR_CHANNELS];
+    float    slowHz[SDLOG_SENSOR_CHANNELS];
+    uint64_t streamBytes = 0;
+    uint64_t cardBytes = 0;
+};
+
+static EncoderCal benchCal(unsigned ch)
+{
+    EncoderCal c;
+    c.scale_q16 = CAL_DEFAULT_SCALE_Q16;
+    c.offset    = 1000 * (int32_t)ch;
+    c.wrap_at   = CAL_DEFAULT_WRAP_AT;
+    c.wrap_span = CAL_DEFAULT_WRAP_SPAN;
+    c.invert    = false;
+    return c;
+}
+
+// Travel in mm at time t for channel ch, and the raw counts logging it
+static int32_t rawAt(unsigned ch, double t, const Truth& truth)
+{
+    const double mm = 70.0 + 45.0 * sin(2.0 * M_PI * truth.slowHz[ch] * t) +
+                      30.0 * sin(2.0 * M_PI * 7.0 * t + ch);
+    const EncoderCal c = benchCal(ch);
+    // travel = -(counts - offset) * scale
+    return c.offset - (int32_t)lround(mm * 1000.0 * 65536.0 / c.scale_q16);
+}
+
+static bool writeFile(const std::string& path, const BenchOptions& opt, uint64_t streamBytes,
+                      uint64_t& tsUs, Truth& truth)
+{
+    FILE* fp = fopen(path.c_str(), "wb");
+    if (!fp)
+        return false;
+
+    const uint8_t version = opt.format == "v4" ? 0x04 : SDLOG_VERSION;
+    StreamWriter w(fp, opt.format, crc32_ieee(reinterpret_cast<const uint8_t*>(path.data()), path.size()) | 1);
+
+    const uint8_t header[5] = { 'S', 'D', 'L', 'G', version };
+    w.append(header, sizeof(header));
+
+    // Calibration
+    {
+        uint8_t buf[sizeof(SdlogCalHeader) + SDLOG_SENSOR_CHANNELS * sizeof(SdlogCalEntry)];
+        SdlogCalHeader h = { tsUs, SDLOG_SENSOR_CHANNELS };
+        memcpy(buf, &h, sizeof(h));
+        for (unsigned c = 0; c < SDLOG_SENSOR_CHANNELS; c++) {
+            const EncoderCal cal = benchCal(c);
+            SdlogCalEntry e = { (uint8_t)(3 + c), cal.scale_q16, cal.offset, cal.wrap_at, cal.wrap_span, 0 };
+            memcpy(&buf[sizeof(h) + c * sizeof(e)], &e, sizeof(e));
+        }
+        appendLp(w, REC_CALIB, buf, sizeof(buf));
+    }
+
+    std::vector<SdlogIndexEntry> table;
+    uint16_t stride = 1;
+    uint32_t points = 0, records = 0;
+    uint64_t lastIndexPos = 0, lastIndexUs = 0;
+    const uint64_t startUs = tsUs;
+
+    while (w.pos() < streamBytes) {
+        // Seek point, thinned into the footer table as sdlog.cpp does
+        if (lastIndexPos == 0 || tsUs >= lastIndexUs + INDEX_US || w.pos() - lastIndexPos >= INDEX_BYTES) {
+            SdlogIndexRecord idx = { tsUs, (uint32_t)w.pos(), records, 0, (uint32_t)lastIndexPos };
+            if (points % stride == 0) {
+                if (table.size() == TABLE_MAX) {
+                    for (uint16_t i = 0; i < TABLE_MAX / 2; i++)
+                        table[i] = table[2 * i];
+                    table.resize(TABLE_MAX / 2);
+                    stride *= 2;
+                }
+                if (points % stride == 0)
+                    table.push_back({ tsUs, (uint32_t)w.pos() });
+            }
+            points++;
+            lastIndexPos = w.pos();
+            lastIndexUs = tsUs;
+            appendLp(w, REC_INDEX, &idx, sizeof(idx));
+        }
+
+        SdlogSensorRecord f = {};
+        f.type = REC_SENSORS;
+        f.ts_us = tsUs;
+        f.valid = (1u << SDLOG_SENSOR_CHANNELS) - 1;
+        for (unsigned c = 0; c < SDLOG_SENSOR_CHANNELS; c++) {
+            f.dt_us[c] = (uint16_t)(c * 150);
+            f.raw[c] = rawAt(c, (tsUs + f.dt_us[c]) * 1e-6, truth);
+
+            // Bottom-outs as run_stats.cpp counts them
+            const float travel = (float)calibrationApply(benchCal(c), f.raw[c]) * -0.001f;
+            if (truth.armed[c] && travel >= BOTTOM_MM) {
+                truth.bottomOuts[c]++;
+                truth.armed[c] = false;
+            } else if (!truth.armed[c] && travel < BOTTOM_MM - STATS_BOTTOM_HYST_MM) {
+                truth.armed[c] = true;
+            }
+            truth.samples[c]++;
+        }
+        w.append(&f, sizeof(f));
+        records++;
+        tsUs += SAMPLE_US;
+    }
+
+    // Run summary: only the thresholds matter here
+    {
+        const size_t per = sizeof(SdlogStatsEncoder) + (2 * STATS_VEL_BINS + STATS_TRAVEL_BINS) * 4;
+        std::vector<uint8_t> buf(sizeof(SdlogStatsHeader) + SDLOG_SENSOR_CHANNELS * per, 0);
+        SdlogStatsHeader h = { tsUs, (uint32_t)((tsUs - startUs) / 1000), SDLOG_SENSOR_CHANNELS,
+                               STATS_VEL_BINS, STATS_VEL_BIN_MM_S, STATS_LSHS_SPLIT_MM_S,
+                               STATS_TRAVEL_BINS, STATS_TRAVEL_BIN_MM };
+        memcpy(buf.data(), &h, sizeof(h));
+        for (unsigned c = 0; c < SDLOG_SENSOR_CHANNELS; c++) {
+            SdlogStatsEncoder e = {};
+            e.id = (uint8_t)(3 + c);
+            e.bottom_out_mm = BOTTOM_MM;
+            memcpy(&buf[sizeof(h) + c * per], &e, sizeof(e));
+        }
+        appendLp(w, REC_STATS, buf.data(), (uint16_t)buf.size());
+    }
+
+    // Footer index
+    {
+        const uint32_t offset = (uint32_t)w.pos();
+        std::vector<uint8_t> buf(sizeof(SdlogIndexTableHeader) + table.size() * sizeof(SdlogIndexEntry) +
+                                 sizeof(SdlogIndexTrailer));
+        SdlogIndexTableHeader h = { tsUs, records, 0, (uint16_t)table.size(), stride };
+        SdlogIndexTrailer t = { offset, { 'S', 'D', 'I', 'X' } };
+        memcpy(buf.data(), &h, sizeof(h));
+        memcpy(&buf[sizeof(h)], table.data(), table.size() * sizeof(SdlogIndexEntry));
+        memcpy(&buf[buf.size() - sizeof(t)], &t, sizeof(t));
+        appendLp(w, REC_INDEX_TABLE, buf.data(), (uint16_t)buf.size());
+    }
+
+    w.finish();
+    truth.streamBytes += w.pos();
+    truth.cardBytes += opt.format == "v4" ? w.pos() : w.cardBytes();
+    const bool ok = !ferror(fp);
+    return fclose(fp) == 0 && ok;
+}
+
+/* =========================
+ *  RUNS
+ * ========================= */
+
+static void printRun(const char* name, const sdlog::AnalysisResult& r)
+{
+    printf("%-16s: %u threads, decode %.3f s (%.2f GB/s), total %.3f s (%.2f GB/s)\n",
+           name, r.threads, r.decode_s, r.stream_bytes / 1e9 / r.decode_s,
+           r.total_s, r.stream_bytes / 1e9 / r.total_s);
+}
+
+static bool sameResult(const sdlog::AnalysisResult& a, const sdlog::AnalysisResult& b)
+{
+    for (unsigned c = 0; c < SDLOG_SENSOR_CHANNELS; c++) {
+        const sdlog::EncoderAnalysis& x = a.enc[c];
+        const sdlog::EncoderAnalysis& y = b.enc[c];
+        if (x.samples != y.samples || x.total_us != y.total_us || x.bottom_outs != y.bottom_outs ||
+            x.travel_min != y.travel_min || x.travel_max != y.travel_max ||
+            x.vel_comp_max != y.vel_comp_max || x.vel_reb_max != y.vel_reb_max ||
+            x.psd_segments != y.psd_segments ||
+            memcmp(x.vel_comp_us, y.vel_comp_us, sizeof(x.vel_comp_us)) != 0 ||
+            memcmp(x.vel_reb_us, y.vel_reb_us, sizeof(x.vel_reb_us)) != 0 ||
+            memcmp(x.travel_us, y.travel_us, sizeof(x.travel_us)) != 0)
+            return false;
+    }
+    return true;
+}
+
+int main(int argc, char** argv)
+{
+    BenchOptions opt;
+    if (!parseArgs(argc, argv, opt)) {
+        usage();
+        return 2;
+    }
+
+    Truth truth;
+    for (unsigned c = 0; c < SDLOG_SENSOR_CHANNELS; c++) {
+        truth.armed[c] = true;
+        truth.slowHz[c] = (c + 1) * 1e6f / SAMPLE_US / 1024;    // on a bin of the default PSD
+    }
+
+    std::vector<std::string> paths;
+    uint64_t tsUs = 1000000;
+    const uint64_t perFile = opt.sizeMb * 1000000 / opt.files;
+    for (unsigned f = 0; f < opt.files; f++) {
+        char name[32];
+        snprintf(name, sizeof(name), "/BENCH_%04u.BIN", f);
+        paths.push_back(opt.dir + name);
+
+        // Every file starts armed, as a new run does
+        for (unsigned c = 0; c < SDLOG_SENSOR_CHANNELS; c++)
+            truth.armed[c] = true;
+        if (!writeFile(paths.back(), opt, perFile, tsUs, truth)) {
+            fprintf(stderr, "%s: cannot write\n", paths.back().c_str());
+            return 1;
+        }
+    }
+
+    sdlog::AnalysisOptions one;
+    one.threads = 1;
+    sdlog::AnalysisOptions all;
+    all.threads = opt.threads;
+
+    sdlog::AnalysisResult r1, rn;
+    const bool ok = sdlog::analyzeLogs(paths, one, r1) && sdlog::analyzeLogs(paths, all, rn);
+
+    if (!opt.keep)
+        for (const std::string& p : paths)
+            remove(p.c_str());
+    if (!ok) {
+        fprintf(stderr, "analysis failed\n");
+        return 1;
+    }
+
+    printf("\n=== SD log analysis ===\n");
+    printf("session         : %u files, %s, %llu stream bytes, %llu on card\n",
+           opt.files, opt.format.c_str(), (unsigned long long)truth.streamBytes,
+           (unsigned long long)truth.cardBytes);
+    printf("decoded         : %llu records in %u work items\n",
+           (unsigned long long)rn.records, rn.items);
+    printRun("1 thread", r1);
+    printRun("all threads", rn);
+    printf("speedup         : %.2fx decode, %.2fx total (%u hardware threads)\n",
+           r1.decode_s / rn.decode_s, r1.total_s / rn.total_s, std::thread::hardware_concurrency());
+
+    bool match = sameResult(r1, rn);
+    for (unsigned c = 0; c < SDLOG_SENSOR_CHANNELS; c++) {
+        const sdlog::EncoderAnalysis& e = rn.enc[c];
+        size_t peak = 1;
+        for (size_t k = 2; k < e.psd.size(); k++)
+            if (e.psd[k] > e.psd[peak])
+                peak = k;
+        printf("encoder %u       : %llu samples, bottom-outs %u (expected %u), PSD peak %.3f Hz (expected %.3f)\n",
+               e.id, (unsigned long long)e.samples, e.bottom_outs, truth.bottomOuts[c],
+               peak * e.psd_bin_hz, truth.slowHz[c]);
+        match = match && e.samples == truth.samples[c] && e.bottom_outs == truth.bottomOuts[c];
+    }
+    printf("check           : %s\n", match ? "ok" : "MISMATCH");
+    return match ? 0 : 1;
+}
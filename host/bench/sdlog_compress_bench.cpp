@@ -0,0 +1,211 @@
+/*
+ * SD log compression benchmark (host build).
+ *
+ * Takes the record stream of a captured log (any SDLG file: plain,
+ * chunked or already compressed) and packs it into chunks the way the
+ * sdlog writer does with SDLOG_CODEC_LZ: a window of stream bytes,
+ * compressed to fit one chunk, stored if that carries more. Every
+ * block is decoded again and compared.
+ *
+ * Reports the ratio (stream bytes per card byte, chunk framing
+ * included) and compress / decompress throughput on this machine.
+ *
+ *   sdlog_compress_bench LOG_0003.BIN
+ *   sdlog_compress_bench LOG_0003.BIN --window 16384 --repeat 5
+ */
+
+#include "sdlog_chunk.h"
+#include "sdlog.h"
+#include "lz_block.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <algorithm>
+#include <chrono>
+#include <string>
+#include <vector>
+
+using Clock = std::chrono::steady_clock;
+
+struct CompressOptions {
+    std::string path;
+    size_t   window = 24 * 1024;    // SDLOG_COMPRESS_WINDOW
+    int      repeat = 3;
+};
+
+static void usage()
+{
+    fprintf(stderr,
+        "usage: sdlog_compress_bench <LOG.BIN> [options]\n"
+        "  --window <bytes>  stream bytes staged per chunk (default 24576)\n"
+        "  --repeat <n>      timing runs, best one is reported (default 3)\n");
+}
+
+static bool parseArgs(int argc, char** argv, CompressOptions& opt)
+{
+    for (int i = 1; i < argc; i++) {
+        std::string a = argv[i];
+        const char* v = (i + 1 < argc) ? argv[i + 1] : nullptr;
+
+        if (a == "--window" && v)       { opt.window = strtoul(v, nullptr, 10); i++; }
+        else if (a == "--repeat" && v)  { opt.repeat = atoi(v); i++; }
+        else if (opt.path.empty() && a[0] != '-') opt.path = a;
+        else return false;
+    }
+    return !opt.path.empty() && opt.window > SDLOG_BLOCK_CAPACITY &&
+           opt.window <= LZB_MAX_INPUT && opt.repeat > 0;
+}
+
+static bool readFile(const char* path, std::vector<uint8_t>& out)
+{
+    FILE* fp = fopen(path, "rb");
+    if (!fp)
+        return false;
+
+    uint8_t buf[64 * 1024];
+    size_t n;
+    while ((n = fread(buf, 1, sizeof(buf), fp)) > 0)
+        out.insert(out.end(), buf, buf + n);
+    fclose(fp);
+    return true;
+}
+
+struct Block {
+    uint32_t offset;
+    uint16_t raw_len;
+    bool     stored;
+    std::vector<uint8_t> data;
+};
+
+// The writer's packing loop (sdlog.cpp writer_pack()), on a whole stream
+static void pack(const std::vector<uint8_t>& stream, size_t window, std::vector<Block>& blocks)
+{
+    static uint16_t table[LZB_HASH_SIZE];
+    uint8_t out[SDLOG_BLOCK_CAPACITY];
+
+    blocks.clear();
+    size_t pos = 0;
+    while (pos < stream.size()) {
+        const size_t raw = stream.size() - pos < window ? stream.size() - pos : window;
+        const size_t storable = raw < SDLOG_BLOCK_CAPACITY ? raw : SDLOG_BLOCK_CAPACITY;
+
+        size_t used;
+        size_t n = lzb_compress(&stream[pos], raw, out, sizeof(out), table, &used);
+
+        Block b;
+        b.offset = (uint32_t)pos;
+        b.stored = used < storable || (used == storable && n >= used);
+        if (b.stored) {
+            used = storable;
+            b.data.assign(&stream[pos], &stream[pos] + used);
+        } else {
+            b.data.assign(out, out + n);
+        }
+        b.raw_len = (uint16_t)used;
+        blocks.push_back(std::move(b));
+        pos += used;
+    }
+}
+
+static bool unpack(const std::vector<Block>& blocks, std::vector<uint8_t>& out)
+{
+    for (const Block& b : blocks) {
+        if (out.size() < (size_t)b.offset + b.raw_len)
+            return false;
+        if (b.stored)
+            memcpy(&out[b.offset], b.data.data(), b.raw_len);
+        else if (!lzb_decompress(b.data.data(), b.data.size(), &out[b.offset], b.raw_len))
+            return false;
+    }
+    return true;
+}
+
+int main(int argc, char** argv)
+{
+    CompressOptions opt;
+    if (!parseArgs(argc, argv, opt)) {
+        usage();
+        return 2;
+    }
+
+    std::vector<uint8_t> file;
+    if (!readFile(opt.path.c_str(), file)) {
+        fprintf(stderr, "%s: cannot read\n", opt.path.c_str());
+        return 1;
+    }
+
+    // The record stream, as the writer takes it from the ring
+    std::vector<uint8_t> stream;
+    if (sdlog::isChunked(file.data(), file.size())) {
+        std::vector<sdlog::StreamRange> valid;
+        sdlog::ChunkStats st;
+        if (!sdlog::unchunk(file.data(), file.size(), stream, valid, st) ||
+            valid[0].start != 0) {
+            fprintf(stderr, "%s: first chunk damaged (try sdlog_recover)\n", opt.path.c_str());
+            return 1;
+        }
+        stream.resize(valid[0].end);
+    } else {
+        stream.swap(file);
+    }
+    if (stream.size() < 5 || memcmp(stream.data(), "SDLG", 4) != 0) {
+        fprintf(stderr, "%s: not an SDLG log\n", opt.path.c_str());
+        return 1;
+    }
+
+    std::vector<Block> blocks;
+    double packS = 1e9, unpackS = 1e9;
+    std::vector<uint8_t> check(stream.size());
+
+    for (int r = 0; r < opt.repeat; r++) {
+        auto t0 = Clock::now();
+        pack(stream, opt.window, blocks);
+        auto t1 = Clock::now();
+        memset(check.data(), 0, check.size());
+        if (!unpack(blocks, check)) {
+            fprintf(stderr, "block does not decode\n");
+            return 1;
+        }
+        auto t2 = Clock::now();
+
+        packS = std::min(packS, std::chrono::duration<double>(t1 - t0).count());
+        unpackS = std::min(unpackS, std::chrono::duration<double>(t2 - t1).count());
+    }
+
+    if (check != stream) {
+        fprintf(stderr, "round trip mismatch\n");
+        return 1;
+    }
+
+    uint64_t coded = 0;
+    uint32_t stored = 0;
+    for (const Block& b : blocks) {
+        coded += b.data.size();
+        stored += b.stored;
+    }
+
+    // Card bytes: full chunks, the last one cut to its length (as on the card)
+    const size_t head = sizeof(SdlogChunkHeader) + sizeof(SdlogBlockHeader);
+    const uint64_t card = blocks.empty() ? 0 :
+        (uint64_t)(blocks.size() - 1) * SDLOG_CHUNK_SIZE + head + blocks.back().data.size();
+    const uint64_t plainCard = (stream.size() / SDLOG_CHUNK_PAYLOAD) * SDLOG_CHUNK_SIZE +
+        (stream.size() % SDLOG_CHUNK_PAYLOAD ? sizeof(SdlogChunkHeader) + stream.size() % SDLOG_CHUNK_PAYLOAD : 0);
+    const double mb = stream.size() / 1e6;
+
+    printf("\n=== SD log compression ===\n");
+    printf("log             : %s, SDLOG_VERSION %u\n", opt.path.c_str(), stream[4]);
+    printf("stream          : %zu bytes\n", stream.size());
+    printf("window          : %zu bytes\n", opt.window);
+    printf("chunks          : %zu (%u stored), %llu coded bytes\n",
+           blocks.size(), stored, (unsigned long long)coded);
+    printf("card bytes      : %llu compressed, %llu uncompressed\n",
+           (unsigned long long)card, (unsigned long long)plainCard);
+    printf("ratio           : %.2f:1 (coded), %.2f:1 (card)\n",
+           (double)stream.size() / (coded ? coded : 1),
+           (double)plainCard / (card ? card : 1));
+    printf("compress        : %.1f MB/s (%.3f ms)\n", mb / packS, packS * 1e3);
+    printf("decompress      : %.1f MB/s (%.3f ms)\n", mb / unpackS, unpackS * 1e3);
+    return 0;
+}
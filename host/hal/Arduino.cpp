@@ -0,0 +1,680 @@
+#include "Arduino.h"
+#include "host_hal.h"
+#include "esp_cpu.h"
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <mutex>
+#include <thread>
+#include <algorithm>
+#include <cctype>
+
+#include <fcntl.h>
+#include <poll.h>
+#include <pthread.h>
+#include <sched.h>
+#include <termios.h>
+#include <unistd.h>
+
+/* =========================
+ *  TIMING
+ * ========================= */
+
+static const std::chrono::steady_clock::time_point halStart =
+    std::chrono::steady_clock::now();
+
+int64_t esp_timer_get_time(void)
+{
+    return std::chrono::duration_cast<std::chrono::microseconds>(
+               std::chrono::steady_clock::now() - halStart).count();
+}
+
+uint32_t esp_cpu_get_cycle_count(void)
+{
+    int64_t ns = std::chrono::duration_cast<std::chrono::nanoseconds>(
+                     std::chrono::steady_clock::now() - halStart).count();
+    return (uint32_t)(ns * HOST_CPU_FREQ_MHZ / 1000);
+}
+
+uint32_t getCpuFrequencyMhz(void)
+{
+    return HOST_CPU_FREQ_MHZ;
+}
+
+unsigned long millis(void)
+{
+    return (unsigned long)(esp_timer_get_time() / 1000);
+}
+
+unsigned long micros(void)
+{
+    return (unsigned long)esp_timer_get_time();
+}
+
+void delay(uint32_t ms)
+{
+    std::this_thread::sleep_for(std::chrono::milliseconds(ms));
+}
+
+void delayMicroseconds(uint32_t us)
+{
+    std::this_thread::sleep_for(std::chrono::microseconds(us));
+}
+
+/* =========================
+ *  GPIO (no-op)
+ * ========================= */
+
+static uint8_t pinState[64];
+
+void pinMode(uint8_t, uint8_t) {}
+
+void digitalWrite(uint8_t pin, uint8_t val)
+{
+    if (pin < sizeof(pinState))
+        pinState[pin] = val;
+}
+
+int digitalRead(uint8_t pin)
+{
+    return pin < sizeof(pinState) ? pinState[pin] : LOW;
+}
+
+/* =========================
+ *  FREERTOS TASKS
+ * ========================= */
+
+struct HostTask {
+    TaskFunction_t fn;
+    void* param;
+    BaseType_t core;
+
+    std::mutex              notifyMutex;
+    std::condition_variable notifyCv;
+    uint32_t                notifyCount = 0;
+};
+
+static thread_local BaseType_t currentCore = 1;   // Arduino loop runs on core 1
+static thread_local HostTask*  currentTask = nullptr;
+
+// Tasks that never ran through xTaskCreate (main thread, timer threads)
+static HostTask* selfTask()
+{
+    if (!currentTask)
+        currentTask = new HostTask{ nullptr, nullptr, currentCore };
+    return currentTask;
+}
+
+BaseType_t xTaskCreatePinnedToCore(TaskFunction_t fn,
+                                   const char*,
+                                   uint32_t,
+                                   void* param,
+                                   UBaseType_t,
+                                   TaskHandle_t* outHandle,
+                                   BaseType_t coreId)
+{
+    HostTask* task = new HostTask{ fn, param, coreId };
+
+    std::thread([task]() {
+        currentCore = (task->core == tskNO_AFFINITY) ? 0 : task->core;
+        currentTask = task;
+
+        // Keep the firmware's core split where the host has the CPUs
+        if (task->core != tskNO_AFFINITY && task->core < (BaseType_t)std::thread::hardware_concurrency()) {
+            cpu_set_t set;
+            CPU_ZERO(&set);
+            CPU_SET(task->core, &set);
+            pthread_setaffinity_np(pthread_self(), sizeof(set), &set);
+        }
+
+        task->fn(task->param);
+    }).detach();
+
+    if (outHandle)
+        *outHandle = task;
+    return pdPASS;
+}
+
+BaseType_t xTaskCreate(TaskFunction_t fn,
+                       const char* name,
+                       uint32_t stackDepth,
+                       void* param,
+                       UBaseType_t priority,
+                       TaskHandle_t* outHandle)
+{
+    return xTaskCreatePinnedToCore(fn, name, stackDepth, param, priority,
+                                   outHandle, tskNO_AFFINITY);
+}
+
+UBaseType_t uxTaskGetStackHighWaterMark(TaskHandle_t)
+{
+    return 0;
+}
+
+void vTaskDelay(TickType_t ticks)
+{
+    if (ticks == 0) {
+        std::this_thread::yield();
+        return;
+    }
+    std::this_thread::sleep_for(std::chrono::milliseconds(ticks * portTICK_PERIOD_MS));
+}
+
+TickType_t xTaskGetTickCount(void)
+{
+    return (TickType_t)(millis() / portTICK_PERIOD_MS);
+}
+
+BaseType_t xPortGetCoreID(void)
+{
+    return currentCore;
+}
+
+TaskHandle_t xTaskGetCurrentTaskHandle(void)
+{
+    return selfTask();
+}
+
+BaseType_t xTaskNotifyGive(TaskHandle_t handle)
+{
+    HostTask* task = static_cast<HostTask*>(handle);
+    {
+        std::lock_guard<std::mutex> lock(task->notifyMutex);
+        task->notifyCount++;
+    }
+    task->notifyCv.notify_one();
+    return pdPASS;
+}
+
+void vTaskNotifyGiveFromISR(TaskHandle_t handle, BaseType_t* higherPriorityTaskWoken)
+{
+    xTaskNotifyGive(handle);
+    if (higherPriorityTaskWoken)
+        *higherPriorityTaskWoken = pdTRUE;
+}
+
+uint32_t ulTaskNotifyTake(BaseType_t clearCountOnExit, TickType_t ticksToWait)
+{
+    HostTask* task = selfTask();
+    std::unique_lock<std::mutex> lock(task->notifyMutex);
+
+    auto ready = [task] { return task->notifyCount > 0; };
+    if (ticksToWait == portMAX_DELAY)
+        task->notifyCv.wait(lock, ready);
+    else
+        task->notifyCv.wait_for(lock, std::chrono::milliseconds(ticksToWait * portTICK_PERIOD_MS), ready);
+
+    uint32_t count = task->notifyCount;
+    if (count)
+        task->notifyCount = clearCountOnExit ? 0 : count - 1;
+    return count;
+}
+
+/* =========================
+ *  ESP_TIMER
+ * ========================= */
+
+struct esp_timer {
+    esp_timer_cb_t          callback;
+    void*                   arg;
+    std::mutex              mutex;
+    std::condition_variable cv;
+    bool                    running = false;
+    uint64_t                generation = 0;
+};
+
+esp_err_t esp_timer_create(const esp_timer_create_args_t* args, esp_timer_handle_t* out)
+{
+    if (!args || !args->callback || !out)
+        return ESP_ERR_INVALID_ARG;
+
+    esp_timer_handle_t t = new esp_timer;
+    t->callback = args->callback;
+    t->arg = args->arg;
+    *out = t;
+    return ESP_OK;
+}
+
+esp_err_t esp_timer_start_periodic(esp_timer_handle_t t, uint64_t period_us)
+{
+    uint64_t gen;
+    {
+        std::lock_guard<std::mutex> lock(t->mutex);
+        if (t->running)
+            return ESP_ERR_INVALID_STATE;
+        t->running = true;
+        gen = ++t->generation;
+    }
+
+    std::thread([t, gen, period_us]() {
+        auto due = std::chrono::steady_clock::now();
+        std::unique_lock<std::mutex> lock(t->mutex);
+
+        while (true) {
+            due += std::chrono::microseconds(period_us);
+            if (t->cv.wait_until(lock, due, [&] { return !t->running || t->generation != gen; }))
+                return;
+
+            lock.unlock();
+            t->callback(t->arg);
+            lock.lock();
+        }
+    }).detach();
+
+    return ESP_OK;
+}
+
+esp_err_t esp_timer_stop(esp_timer_handle_t t)
+{
+    {
+        std::lock_guard<std::mutex> lock(t->mutex);
+        if (!t->running)
+            return ESP_ERR_INVALID_STATE;
+        t->running = false;
+    }
+    t->cv.notify_all();
+    return ESP_OK;
+}
+
+esp_err_t esp_timer_delete(esp_timer_handle_t t)
+{
+    {
+        std::lock_guard<std::mutex> lock(t->mutex);
+        if (t->running)
+            return ESP_ERR_INVALID_STATE;
+    }
+    // Timer thread may still be unwinding; host timers are never freed.
+    return ESP_OK;
+}
+
+/* =========================
+ *  STRING
+ * ========================= */
+
+String::String(int v) : s_(std::to_string(v)) {}
+String::String(unsigned int v) : s_(std::to_string(v)) {}
+String::String(long v) : s_(std::to_string(v)) {}
+String::String(unsigned long v) : s_(std::to_string(v)) {}
+
+String::String(float v, unsigned int decimals) : String((double)v, decimals) {}
+
+String::String(double v, unsigned int decimals)
+{
+    char buf[64];
+    snprintf(buf, sizeof(buf), "%.*f", (int)decimals, v);
+    s_ = buf;
+}
+
+void String::trim()
+{
+    size_t b = 0;
+    while (b < s_.size() && isspace((unsigned char)s_[b])) b++;
+    size_t e = s_.size();
+    while (e > b && isspace((unsigned char)s_[e - 1])) e--;
+    s_ = s_.substr(b, e - b);
+}
+
+void String::toLowerCase()
+{
+    for (char& c : s_) c = (char)tolower((unsigned char)c);
+}
+
+void String::toUpperCase()
+{
+    for (char& c : s_) c = (char)toupper((unsigned char)c);
+}
+
+bool String::equalsIgnoreCase(const String& o) const
+{
+    if (s_.size() != o.s_.size())
+        return false;
+    for (size_t i = 0; i < s_.size(); i++) {
+        if (tolower((unsigned char)s_[i]) != tolower((unsigned char)o.s_[i]))
+            return false;
+    }
+    return true;
+}
+
+bool String::startsWith(const String& prefix) const
+{
+    return s_.compare(0, prefix.s_.size(), prefix.s_) == 0;
+}
+
+bool String::endsWith(const String& suffix) const
+{
+    return s_.size() >= suffix.s_.size() &&
+           s_.compare(s_.size() - suffix.s_.size(), suffix.s_.size(), suffix.s_) == 0;
+}
+
+int String::indexOf(char c, unsigned int from) const
+{
+    size_t p = s_.find(c, from);
+    return p == std::string::npos ? -1 : (int)p;
+}
+
+int String::indexOf(const String& s, unsigned int from) const
+{
+    size_t p = s_.find(s.s_, from);
+    return p == std::string::npos ? -1 : (int)p;
+}
+
+String String::substring(unsigned int from) const
+{
+    return from >= s_.size() ? String() : String(s_.substr(from));
+}
+
+String String::substring(unsigned int from, unsigned int to) const
+{
+    if (from > to) std::swap(from, to);
+    if (from >= s_.size()) return String();
+    return String(s_.substr(from, to - from));
+}
+
+long String::toInt() const
+{
+    return strtol(s_.c_str(), nullptr, 10);
+}
+
+float String::toFloat() const
+{
+    return strtof(s_.c_str(), nullptr);
+}
+
+/* =========================
+ *  PRINT
+ * ========================= */
+
+size_t Print::write(const uint8_t* buf, size_t len)
+{
+    size_t n = 0;
+    while (len--) n += write(*buf++);
+    return n;
+}
+
+size_t Print::print(long v, int base)
+{
+    char buf[72];
+    if (base == HEX) snprintf(buf, sizeof(buf), "%lX", (unsigned long)v);
+    else             snprintf(buf, sizeof(buf), "%ld", v);
+    return write(buf);
+}
+
+size_t Print::print(unsigned long v, int base)
+{
+    char buf[72];
+    snprintf(buf, sizeof(buf), base == HEX ? "%lX" : "%lu", v);
+    return write(buf);
+}
+
+size_t Print::print(long long v, int base)
+{
+    return print((long)v, base);
+}
+
+size_t Print::print(unsigned long long v, int base)
+{
+    return print((unsigned long)v, base);
+}
+
+size_t Print::print(double v, int digits)
+{
+    char buf[64];
+    snprintf(buf, sizeof(buf), "%.*f", digits, v);
+    return write(buf);
+}
+
+size_t Print::printf(const char* fmt, ...)
+{
+    char stackBuf[256];
+    va_list ap;
+
+    va_start(ap, fmt);
+    int len = vsnprintf(stackBuf, sizeof(stackBuf), fmt, ap);
+    va_end(ap);
+
+    if (len < 0)
+        return 0;
+    if ((size_t)len < sizeof(stackBuf))
+        return write((const uint8_t*)stackBuf, (size_t)len);
+
+    std::string big((size_t)len + 1, '\0');
+    va_start(ap, fmt);
+    vsnprintf(&big[0], big.size(), fmt, ap);
+    va_end(ap);
+    return write((const uint8_t*)big.data(), (size_t)len);
+}
+
+/* =========================
+ *  STREAM
+ * ========================= */
+
+int Stream::timedRead()
+{
+    unsigned long start = millis();
+    do {
+        int c = read();
+        if (c >= 0) return c;
+        delay(1);
+    } while (millis() - start < timeoutMs_);
+    return -1;
+}
+
+size_t Stream::readBytes(uint8_t* buf, size_t len)
+{
+    size_t n = 0;
+    while (n < len) {
+        int c = timedRead();
+        if (c < 0) break;
+        buf[n++] = (uint8_t)c;
+    }
+    return n;
+}
+
+String Stream::readStringUntil(char terminator)
+{
+    std::string out;
+    int c = timedRead();
+    while (c >= 0 && c != terminator) {
+        out += (char)c;
+        c = timedRead();
+    }
+    return String(out);
+}
+
+/* =========================
+ *  SERIAL (stdio)
+ * ========================= */
+
+HardwareSerial Serial;
+
+static std::atomic<bool> serialMuted{ false };
+static std::mutex serialTxMutex;
+static int serialOutFd = -1;          // -1: stdout
+static int serialInFd  = -1;          // -1: stdin
+
+void HardwareSerial::begin(unsigned long baud)
+{
+    baud_ = baud;
+}
+
+void HardwareSerial::updateBaudRate(unsigned long baud)
+{
+    std::lock_guard<std::mutex> lock(serialTxMutex);
+    baud_ = baud;
+}
+
+size_t HardwareSerial::setTxBufferSize(size_t size)
+{
+    std::lock_guard<std::mutex> lock(serialTxMutex);
+    txBufSize_ = size > 128 ? size : 128;
+    return txBufSize_;
+}
+
+int HardwareSerial::availableForWrite()
+{
+    std::lock_guard<std::mutex> lock(serialTxMutex);
+    txAccount(0);
+    return (int)(txBufSize_ - (size_t)txFill_);
+}
+
+/*
+ * Drain the modelled TX buffer for the time since the last call, then
+ * add len bytes, waiting for space first if needed.
+ * Called with serialTxMutex held.
+ */
+void HardwareSerial::txAccount(size_t len)
+{
+    const double bytesPerUs = baud_ / 10.0 / 1e6;
+
+    int64_t now = esp_timer_get_time();
+    txFill_ -= (now - txLastUs_) * bytesPerUs;
+    if (txFill_ < 0.0)
+        txFill_ = 0.0;
+    txLastUs_ = now;
+
+    if (len == 0)
+        return;
+
+    double over = txFill_ + len - txBufSize_;
+    if (over > 0.0) {
+        int64_t waitUs = (int64_t)(over / bytesPerUs);
+        std::this_thread::sleep_for(std::chrono::microseconds(waitUs));
+        txFill_ -= over;
+        txLastUs_ += waitUs;
+    }
+    txFill_ += len;
+}
+
+void HardwareSerial::flush()
+{
+    // Like the UART driver: return once the TX buffer has drained
+    int64_t waitUs;
+    {
+        std::lock_guard<std::mutex> lock(serialTxMutex);
+        txAccount(0);
+        waitUs = (int64_t)(txFill_ / (baud_ / 10.0 / 1e6));
+    }
+    if (waitUs > 0)
+        std::this_thread::sleep_for(std::chrono::microseconds(waitUs));
+
+    if (serialOutFd < 0)
+        fflush(stdout);
+}
+
+bool HardwareSerial::fill(int timeoutMs)
+{
+    if (rxHead_ < rxLen_)
+        return true;
+
+    const int fd = serialInFd >= 0 ? serialInFd : STDIN_FILENO;
+
+    struct pollfd pfd = { fd, POLLIN, 0 };
+    if (poll(&pfd, 1, timeoutMs) <= 0 || !(pfd.revents & POLLIN))
+        return false;
+
+    ssize_t n = ::read(fd, rxBuf_, sizeof(rxBuf_));
+    if (n <= 0)
+        return false;
+
+    rxHead_ = 0;
+    rxLen_ = (size_t)n;
+    return true;
+}
+
+int HardwareSerial::available()
+{
+    return fill(0) ? (int)(rxLen_ - rxHead_) : 0;
+}
+
+int HardwareSerial::read()
+{
+    return fill(0) ? rxBuf_[rxHead_++] : -1;
+}
+
+int HardwareSerial::peek()
+{
+    return fill(0) ? rxBuf_[rxHead_] : -1;
+}
+
+size_t HardwareSerial::write(uint8_t c)
+{
+    return write(&c, 1);
+}
+
+size_t HardwareSerial::write(const uint8_t* buf, size_t len)
+{
+    if (serialMuted.load(std::memory_order_relaxed))
+        return len;
+
+    std::lock_guard<std::mutex> lock(serialTxMutex);
+    txAccount(len);
+
+    if (serialOutFd < 0) {
+        fwrite(buf, 1, len, stdout);
+        return len;
+    }
+
+    size_t done = 0;
+    while (done < len) {
+        ssize_t n = ::write(serialOutFd, buf + done, len - done);
+        if (n <= 0)
+            break;
+        done += (size_t)n;
+    }
+    return len;
+}
+
+namespace host_hal {
+
+bool serial_set_output(const char* path)
+{
+    std::lock_guard<std::mutex> lock(serialTxMutex);
+
+    if (serialOutFd >= 0) {
+        if (serialInFd == serialOutFd)
+            serialInFd = -1;
+        ::close(serialOutFd);
+        serialOutFd = -1;
+    }
+    if (path == nullptr)
+        return true;
+
+    serialOutFd = ::open(path, O_WRONLY | O_NOCTTY | O_CREAT | O_TRUNC, 0644);
+    return serialOutFd >= 0;
+}
+
+bool serial_set_device(const char* path)
+{
+    std::lock_guard<std::mutex> lock(serialTxMutex);
+
+    if (serialOutFd >= 0)
+        ::close(serialOutFd);
+    if (serialInFd >= 0 && serialInFd != serialOutFd)
+        ::close(serialInFd);
+    serialOutFd = serialInFd = -1;
+
+    if (path == nullptr)
+        return true;
+
+    int fd = ::open(path, O_RDWR | O_NOCTTY);
+    if (fd < 0)
+        return false;
+
+    // A pty behaves like a UART only in raw mode
+    struct termios tio;
+    if (isatty(fd) && tcgetattr(fd, &tio) == 0) {
+        cfmakeraw(&tio);
+        tcsetattr(fd, TCSANOW, &tio);
+    }
+
+    serialOutFd = serialInFd = fd;
+    return true;
+}
+
+void serial_set_muted(bool muted)
+{
+    serialMuted.store(muted, std::memory_order_relaxed);
+}
+
+} // namespace host_hal
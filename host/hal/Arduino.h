@@ -0,0 +1,193 @@
+#pragma once
+
+/*
+ * Host stand-in for the Arduino-ESP32 core.
+ *
+ * Provides the small subset the sketch uses: timing, GPIO no-ops,
+ * String, and a stdio-backed Serial. Like the real core, this header
+ * also pulls in the FreeRTOS task API.
+ */
+
+#include <stdint.h>
+#include <stddef.h>
+#include <stdarg.h>
+#include <string.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <math.h>
+
+#include <string>
+
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "esp_timer.h"
+
+#define LOW     0x0
+#define HIGH    0x1
+
+#define INPUT           0x01
+#define OUTPUT          0x03
+#define INPUT_PULLUP    0x05
+
+#define DEC 10
+#define HEX 16
+
+/* =========================
+ *  TIMING / GPIO
+ * ========================= */
+
+unsigned long millis(void);
+unsigned long micros(void);
+void delay(uint32_t ms);
+void delayMicroseconds(uint32_t us);
+uint32_t getCpuFrequencyMhz(void);
+
+void pinMode(uint8_t pin, uint8_t mode);
+void digitalWrite(uint8_t pin, uint8_t val);
+int  digitalRead(uint8_t pin);
+
+/* =========================
+ *  STRING
+ * ========================= */
+
+class String {
+public:
+    String() = default;
+    String(const char* s) : s_(s ? s : "") {}
+    String(const std::string& s) : s_(s) {}
+    String(char c) : s_(1, c) {}
+    explicit String(int v);
+    explicit String(unsigned int v);
+    explicit String(long v);
+    explicit String(unsigned long v);
+    explicit String(float v, unsigned int decimals = 2);
+    explicit String(double v, unsigned int decimals = 2);
+
+    unsigned int length() const { return (unsigned int)s_.size(); }
+    const char* c_str() const { return s_.c_str(); }
+    char charAt(unsigned int i) const { return i < s_.size() ? s_[i] : 0; }
+    char operator[](unsigned int i) const { return charAt(i); }
+
+    void trim();
+    void toLowerCase();
+    void toUpperCase();
+
+    bool equals(const String& o) const { return s_ == o.s_; }
+    bool equalsIgnoreCase(const String& o) const;
+    bool startsWith(const String& prefix) const;
+    bool endsWith(const String& suffix) const;
+
+    int indexOf(char c, unsigned int from = 0) const;
+    int indexOf(const String& s, unsigned int from = 0) const;
+    String substring(unsigned int from) const;
+    String substring(unsigned int from, unsigned int to) const;
+
+    long  toInt() const;
+    float toFloat() const;
+
+    String& operator+=(const String& o) { s_ += o.s_; return *this; }
+    String& operator+=(const char* o) { s_ += (o ? o : ""); return *this; }
+    String& operator+=(char c) { s_ += c; return *this; }
+
+    bool operator==(const String& o) const { return s_ == o.s_; }
+    bool operator==(const char* o) const { return s_ == (o ? o : ""); }
+    bool operator!=(const String& o) const { return s_ != o.s_; }
+    bool operator!=(const char* o) const { return !(*this == o); }
+
+    friend String operator+(const String& a, const String& b) { return String(a.s_ + b.s_); }
+
+private:
+    std::string s_;
+};
+
+/* =========================
+ *  PRINT / SERIAL
+ * ========================= */
+
+class Print {
+public:
+    virtual ~Print() = default;
+
+    virtual size_t write(uint8_t c) = 0;
+    virtual size_t write(const uint8_t* buf, size_t len);
+    size_t write(const char* s) { return s ? write((const uint8_t*)s, strlen(s)) : 0; }
+
+    size_t print(const char* s) { return write(s); }
+    size_t print(const String& s) { return write(s.c_str()); }
+    size_t print(char c) { return write((uint8_t)c); }
+    size_t print(int v, int base = DEC) { return print((long)v, base); }
+    size_t print(unsigned int v, int base = DEC) { return print((unsigned long)v, base); }
+    size_t print(long v, int base = DEC);
+    size_t print(unsigned long v, int base = DEC);
+    size_t print(long long v, int base = DEC);
+    size_t print(unsigned long long v, int base = DEC);
+    size_t print(double v, int digits = 2);
+
+    size_t println() { return write("\r\n"); }
+    template <typename T>
+    size_t println(const T& v) { size_t n = print(v); return n + println(); }
+    template <typename T>
+    size_t println(const T& v, int fmt) { size_t n = print(v, fmt); return n + println(); }
+
+    size_t printf(const char* fmt, ...) __attribute__((format(printf, 2, 3)));
+};
+
+class Stream : public Print {
+public:
+    virtual int available() = 0;
+    virtual int read() = 0;
+    virtual int peek() = 0;
+
+    size_t readBytes(uint8_t* buf, size_t len);
+    String readStringUntil(char terminator);
+    void setTimeout(unsigned long ms) { timeoutMs_ = ms; }
+
+protected:
+    int timedRead();
+    unsigned long timeoutMs_ = 1000;
+};
+
+/*
+ * Serial on the host reads stdin and writes stdout (or the path set with
+ * host_hal::serial_set_output()).
+ *
+ * The UART TX buffer is modelled: it drains at baud / 10 bytes per
+ * second, availableForWrite() reports the free space and write() blocks
+ * while it is full, like the real driver.
+ */
+class HardwareSerial : public Stream {
+public:
+    void begin(unsigned long baud);
+    void end() {}
+    void flush();
+
+    void updateBaudRate(unsigned long baud);
+    unsigned long baudRate() const { return baud_; }
+    size_t setTxBufferSize(size_t size);
+    int availableForWrite();
+
+    int available() override;
+    int read() override;
+    int peek() override;
+
+    size_t write(uint8_t c) override;
+    size_t write(const uint8_t* buf, size_t len) override;
+    using Print::write;
+
+    operator bool() const { return true; }
+
+private:
+    bool fill(int timeoutMs);
+    void txAccount(size_t len);
+
+    unsigned long baud_ = 115200;
+    size_t  txBufSize_ = 128;        // ESP32 UART hardware FIFO
+    double  txFill_ = 0.0;           // modelled bytes in the TX buffer
+    int64_t txLastUs_ = 0;
+
+    uint8_t rxBuf_[256];
+    size_t  rxHead_ = 0;
+    size_t  rxLen_  = 0;
+};
+
+extern HardwareSerial Serial;
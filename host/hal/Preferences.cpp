@@ -0,0 +1,94 @@
+#include "Preferences.h"
+
+#include <map>
+#include <mutex>
+#include <string.h>
+#include <vector>
+
+static std::mutex nvsMutex;
+static std::map<std::string, std::vector<uint8_t>> nvs;   // "namespace/key" -> blob
+
+bool Preferences::begin(const char* name, bool readOnly, const char*)
+{
+    if (name == nullptr || strlen(name) > 15)
+        return false;
+
+    ns_ = name;
+    readOnly_ = readOnly;
+    open_ = true;
+    return true;
+}
+
+void Preferences::end()
+{
+    open_ = false;
+}
+
+bool Preferences::clear()
+{
+    if (!open_ || readOnly_)
+        return false;
+
+    std::lock_guard<std::mutex> lock(nvsMutex);
+    const std::string prefix = ns_ + "/";
+    for (auto it = nvs.begin(); it != nvs.end();) {
+        if (it->first.compare(0, prefix.size(), prefix) == 0)
+            it = nvs.erase(it);
+        else
+            ++it;
+    }
+    return true;
+}
+
+bool Preferences::remove(const char* key)
+{
+    if (!open_ || readOnly_)
+        return false;
+
+    std::lock_guard<std::mutex> lock(nvsMutex);
+    return nvs.erase(ns_ + "/" + key) > 0;
+}
+
+bool Preferences::isKey(const char* key)
+{
+    if (!open_)
+        return false;
+
+    std::lock_guard<std::mutex> lock(nvsMutex);
+    return nvs.count(ns_ + "/" + key) > 0;
+}
+
+size_t Preferences::putBytes(const char* key, const void* value, size_t len)
+{
+    if (!open_ || readOnly_ || key == nullptr || strlen(key) > 15)
+        return 0;
+
+    std::lock_guard<std::mutex> lock(nvsMutex);
+    const uint8_t* p = static_cast<const uint8_t*>(value);
+    nvs[ns_ + "/" + key].assign(p, p + len);
+    return len;
+}
+
+size_t Preferences::getBytes(const char* key, void* buf, size_t maxLen)
+{
+    if (!open_)
+        return 0;
+
+    std::lock_guard<std::mutex> lock(nvsMutex);
+    auto it = nvs.find(ns_ + "/" + key);
+    if (it == nvs.end() || it->second.size() > maxLen)
+        return 0;
+
+    memcpy(buf, it->second.data(), it->second.size());
+    return it->second.size();
+}
+
+size_t Preferences::getBytesLength(const char* key)
+{
+    if (!open_)
+        return 0;
+
+    std::lock_guard<std::mutex> lock(nvsMutex);
+    auto it = nvs.find(ns_ + "/" + key);
+    return it == nvs.end() ? 0 : it->second.size();
+}
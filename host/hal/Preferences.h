@@ -0,0 +1,31 @@
+#pragma once
+
+/*
+ * Host stand-in for the Arduino-ESP32 Preferences (NVS) library.
+ *
+ * Key/value blobs per namespace, kept in memory for the lifetime of the
+ * process. Only the calls the firmware uses are provided.
+ */
+
+#include <stdint.h>
+#include <stddef.h>
+#include <string>
+
+class Preferences {
+public:
+    bool begin(const char* name, bool readOnly = false, const char* partitionLabel = nullptr);
+    void end();
+
+    bool clear();
+    bool remove(const char* key);
+    bool isKey(const char* key);
+
+    size_t putBytes(const char* key, const void* value, size_t len);
+    size_t getBytes(const char* key, void* buf, size_t maxLen);
+    size_t getBytesLength(const char* key);
+
+private:
+    std::string ns_;
+    bool open_ = false;
+    bool readOnly_ = false;
+};
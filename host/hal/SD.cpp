@@ -0,0 +1,310 @@
+#include "SD.h"
+#include "host_hal.h"
+
+#include <atomic>
+#include <chrono>
+#include <string>
+#include <thread>
+
+#include <dirent.h>
+#include <sys/stat.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+/*
+ * File-backed SD card. Every path is resolved below the SD root directory.
+ */
+
+fs::SDFS SD;
+
+static std::string sdRootPath;
+static std::atomic<uint32_t> sdWriteLatencyUs{ 0 };
+
+static std::string hostPath(const char* path)
+{
+    std::string p = host_hal::sd_root();
+    if (path && path[0] != '/')
+        p += '/';
+    if (path)
+        p += path;
+    return p;
+}
+
+/*
+ * ESP-IDF VFS stand-in for the SD mount point.
+ *
+ * The firmware calls POSIX truncate() on "/sd/..." paths because the
+ * Arduino FS API has no truncate. Map that mount point onto the SD root;
+ * anything else goes to the real syscall.
+ */
+static const char SD_MOUNT_POINT[] = "/sd";
+
+extern "C" int truncate(const char* path, off_t length) noexcept
+{
+    std::string p = path;
+    const size_t mlen = sizeof(SD_MOUNT_POINT) - 1;
+
+    if (p.compare(0, mlen, SD_MOUNT_POINT) == 0 && (p.size() == mlen || p[mlen] == '/'))
+        p = hostPath(p.c_str() + mlen);
+
+    return (int)syscall(SYS_truncate, p.c_str(), length);
+}
+
+namespace host_hal {
+
+void sd_set_root(const char* path)
+{
+    sdRootPath = path ? path : "";
+}
+
+const char* sd_root()
+{
+    if (sdRootPath.empty()) {
+        const char* env = getenv("SUSPMEAS_SD_ROOT");
+        sdRootPath = (env && env[0]) ? env : "./sdcard";
+    }
+    return sdRootPath.c_str();
+}
+
+void sd_set_write_latency_us(uint32_t us)
+{
+    sdWriteLatencyUs.store(us, std::memory_order_relaxed);
+}
+
+} // namespace host_hal
+
+namespace fs {
+
+struct File::Impl {
+    FILE*       fp  = nullptr;
+    DIR*        dir = nullptr;
+    std::string path;       // SD-relative, as given by the firmware
+    std::string name;       // last path component
+};
+
+static std::string baseName(const std::string& path)
+{
+    size_t p = path.find_last_of('/');
+    return p == std::string::npos ? path : path.substr(p + 1);
+}
+
+/* =========================
+ *  FILE
+ * ========================= */
+
+size_t File::write(uint8_t c)
+{
+    return write(&c, 1);
+}
+
+size_t File::write(const uint8_t* buf, size_t len)
+{
+    if (!impl_ || !impl_->fp)
+        return 0;
+
+    uint32_t lat = sdWriteLatencyUs.load(std::memory_order_relaxed);
+    if (lat)
+        std::this_thread::sleep_for(std::chrono::microseconds(lat));
+
+    return fwrite(buf, 1, len, impl_->fp);
+}
+
+int File::available()
+{
+    if (!impl_ || !impl_->fp)
+        return 0;
+    long remaining = (long)size() - (long)position();
+    return remaining > 0 ? (int)remaining : 0;
+}
+
+int File::read()
+{
+    if (!impl_ || !impl_->fp)
+        return -1;
+    int c = fgetc(impl_->fp);
+    return c == EOF ? -1 : c;
+}
+
+int File::peek()
+{
+    if (!impl_ || !impl_->fp)
+        return -1;
+    int c = fgetc(impl_->fp);
+    if (c == EOF)
+        return -1;
+    ungetc(c, impl_->fp);
+    return c;
+}
+
+size_t File::read(uint8_t* buf, size_t len)
+{
+    if (!impl_ || !impl_->fp)
+        return 0;
+    return fread(buf, 1, len, impl_->fp);
+}
+
+void File::flush()
+{
+    if (impl_ && impl_->fp)
+        fflush(impl_->fp);
+}
+
+bool File::seek(uint32_t pos, SeekMode mode)
+{
+    if (!impl_ || !impl_->fp)
+        return false;
+    int whence = (mode == SeekCur) ? SEEK_CUR : (mode == SeekEnd) ? SEEK_END : SEEK_SET;
+    return fseek(impl_->fp, (long)pos, whence) == 0;
+}
+
+size_t File::position() const
+{
+    if (!impl_ || !impl_->fp)
+        return 0;
+    long p = ftell(impl_->fp);
+    return p < 0 ? 0 : (size_t)p;
+}
+
+size_t File::size() const
+{
+    if (!impl_ || !impl_->fp)
+        return 0;
+    fflush(impl_->fp);
+    struct stat st;
+    if (fstat(fileno(impl_->fp), &st) != 0)
+        return 0;
+    return (size_t)st.st_size;
+}
+
+void File::close()
+{
+    if (!impl_)
+        return;
+    if (impl_->fp)
+        fclose(impl_->fp);
+    if (impl_->dir)
+        closedir(impl_->dir);
+    impl_->fp  = nullptr;
+    impl_->dir = nullptr;
+    impl_.reset();
+}
+
+const char* File::name() const
+{
+    return impl_ ? impl_->name.c_str() : "";
+}
+
+const char* File::path() const
+{
+    return impl_ ? impl_->path.c_str() : "";
+}
+
+bool File::isDirectory() const
+{
+    return impl_ && impl_->dir;
+}
+
+File File::openNextFile(const char* mode)
+{
+    if (!impl_ || !impl_->dir)
+        return File();
+
+    struct dirent* ent;
+    while ((ent = readdir(impl_->dir)) != nullptr) {
+        if (strcmp(ent->d_name, ".") == 0 || strcmp(ent->d_name, "..") == 0)
+            continue;
+
+        std::string child = impl_->path;
+        if (child.empty() || child.back() != '/')
+            child += '/';
+        child += ent->d_name;
+        return SD.open(child.c_str(), mode);
+    }
+    return File();
+}
+
+void File::rewindDirectory()
+{
+    if (impl_ && impl_->dir)
+        rewinddir(impl_->dir);
+}
+
+File::operator bool() const
+{
+    return impl_ && (impl_->fp || impl_->dir);
+}
+
+/* =========================
+ *  SDFS
+ * ========================= */
+
+bool SDFS::begin(uint8_t)
+{
+    ::mkdir(host_hal::sd_root(), 0777);
+
+    struct stat st;
+    return stat(host_hal::sd_root(), &st) == 0 && S_ISDIR(st.st_mode);
+}
+
+void SDFS::end() {}
+
+File SDFS::open(const char* path, const char* mode)
+{
+    std::string hp = hostPath(path);
+    auto impl = std::make_shared<File::Impl>();
+    impl->path = path ? path : "/";
+    impl->name = baseName(impl->path);
+
+    struct stat st;
+    if (stat(hp.c_str(), &st) == 0 && S_ISDIR(st.st_mode)) {
+        impl->dir = opendir(hp.c_str());
+        return impl->dir ? File(impl) : File();
+    }
+
+    // Arduino-ESP32 opens for writing with "w" and reading with "r";
+    // binary mode keeps the host identical to the card contents.
+    std::string m = mode ? mode : FILE_READ;
+    if (m.find('b') == std::string::npos)
+        m += 'b';
+
+    impl->fp = fopen(hp.c_str(), m.c_str());
+    return impl->fp ? File(impl) : File();
+}
+
+bool SDFS::exists(const char* path)
+{
+    struct stat st;
+    return stat(hostPath(path).c_str(), &st) == 0;
+}
+
+bool SDFS::remove(const char* path)
+{
+    return ::unlink(hostPath(path).c_str()) == 0;
+}
+
+bool SDFS::rename(const char* from, const char* to)
+{
+    return ::rename(hostPath(from).c_str(), hostPath(to).c_str()) == 0;
+}
+
+bool SDFS::mkdir(const char* path)
+{
+    return ::mkdir(hostPath(path).c_str(), 0777) == 0;
+}
+
+bool SDFS::rmdir(const char* path)
+{
+    return ::rmdir(hostPath(path).c_str()) == 0;
+}
+
+uint64_t SDFS::totalBytes()
+{
+    return 32ULL * 1024 * 1024 * 1024;
+}
+
+uint64_t SDFS::usedBytes()
+{
+    return 0;
+}
+
+} // namespace fs
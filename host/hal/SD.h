@@ -0,0 +1,84 @@
+#pragma once
+
+/*
+ * Host stand-in for the Arduino-ESP32 SD / FS library.
+ * Paths are resolved below host_hal::sd_root().
+ */
+
+#include <stdint.h>
+#include <stddef.h>
+#include <memory>
+
+#include "Arduino.h"
+
+#define FILE_READ   "r"
+#define FILE_WRITE  "w"
+#define FILE_APPEND "a"
+
+namespace fs {
+
+enum SeekMode {
+    SeekSet = 0,
+    SeekCur = 1,
+    SeekEnd = 2
+};
+
+class File : public Stream {
+public:
+    struct Impl;
+
+    File() = default;
+    explicit File(std::shared_ptr<Impl> impl) : impl_(std::move(impl)) {}
+
+    size_t write(uint8_t c) override;
+    size_t write(const uint8_t* buf, size_t len) override;
+    using Print::write;
+
+    int available() override;
+    int read() override;
+    int peek() override;
+    size_t read(uint8_t* buf, size_t len);
+
+    void flush();
+    bool seek(uint32_t pos, SeekMode mode = SeekSet);
+    size_t position() const;
+    size_t size() const;
+    void close();
+
+    const char* name() const;
+    const char* path() const;
+    bool isDirectory() const;
+    File openNextFile(const char* mode = FILE_READ);
+    void rewindDirectory();
+
+    operator bool() const;
+
+private:
+    std::shared_ptr<Impl> impl_;
+};
+
+class SDFS {
+public:
+    bool begin(uint8_t ssPin = 0);
+    void end();
+
+    File open(const char* path, const char* mode = FILE_READ);
+    File open(const String& path, const char* mode = FILE_READ) { return open(path.c_str(), mode); }
+
+    bool exists(const char* path);
+    bool exists(const String& path) { return exists(path.c_str()); }
+    bool remove(const char* path);
+    bool rename(const char* from, const char* to);
+    bool mkdir(const char* path);
+    bool rmdir(const char* path);
+
+    uint64_t totalBytes();
+    uint64_t usedBytes();
+};
+
+} // namespace fs
+
+using fs::File;
+using fs::SDFS;
+
+extern fs::SDFS SD;
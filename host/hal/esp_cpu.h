@@ -0,0 +1,12 @@
+#pragma once
+
+#include <stdint.h>
+
+/*
+ * CPU cycle counter (CCOUNT on the ESP32). The host version counts
+ * monotonic-clock nanoseconds scaled to HOST_CPU_FREQ_MHZ, so cycle
+ * based timing code reports real host durations.
+ */
+#define HOST_CPU_FREQ_MHZ   240
+
+uint32_t esp_cpu_get_cycle_count(void);
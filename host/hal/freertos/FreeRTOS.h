@@ -0,0 +1,30 @@
+#pragma once
+
+/*
+ * Host stand-in for the FreeRTOS subset used by the firmware.
+ *
+ * Tasks are backed by std::thread, one tick is one millisecond.
+ * Only what the sketch actually calls is provided.
+ */
+
+#include <stdint.h>
+#include <stddef.h>
+
+typedef int32_t  BaseType_t;
+typedef uint32_t UBaseType_t;
+typedef uint32_t TickType_t;
+
+#define pdFALSE         ((BaseType_t)0)
+#define pdTRUE          ((BaseType_t)1)
+#define pdPASS          pdTRUE
+#define pdFAIL          pdFALSE
+
+#define configTICK_RATE_HZ      1000
+#define portTICK_PERIOD_MS      ((TickType_t)1000 / configTICK_RATE_HZ)
+#define portMAX_DELAY           ((TickType_t)0xFFFFFFFFUL)
+#define tskNO_AFFINITY          0x7FFFFFFF
+
+#define pdMS_TO_TICKS(ms) \
+    ((TickType_t)(((TickType_t)(ms) * (TickType_t)configTICK_RATE_HZ) / (TickType_t)1000U))
+
+#include "freertos/task.h"
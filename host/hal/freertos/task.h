@@ -0,0 +1,44 @@
+#pragma once
+
+#include "freertos/FreeRTOS.h"
+
+typedef void (*TaskFunction_t)(void*);
+typedef void* TaskHandle_t;
+
+/*
+ * Task creation.
+ * Stack size and priority are accepted for API compatibility and
+ * otherwise ignored; the host scheduler decides. A task pinned to core
+ * n runs on host CPU n if there is one.
+ */
+BaseType_t xTaskCreate(TaskFunction_t fn,
+                       const char* name,
+                       uint32_t stackDepth,
+                       void* param,
+                       UBaseType_t priority,
+                       TaskHandle_t* outHandle);
+
+BaseType_t xTaskCreatePinnedToCore(TaskFunction_t fn,
+                                   const char* name,
+                                   uint32_t stackDepth,
+                                   void* param,
+                                   UBaseType_t priority,
+                                   TaskHandle_t* outHandle,
+                                   BaseType_t coreId);
+
+// Host threads have no FreeRTOS stack to measure: always 0
+UBaseType_t uxTaskGetStackHighWaterMark(TaskHandle_t task);
+
+void vTaskDelay(TickType_t ticks);
+TickType_t xTaskGetTickCount(void);
+BaseType_t xPortGetCoreID(void);
+
+/*
+ * Direct-to-task notifications (counting semaphore semantics only).
+ */
+BaseType_t xTaskNotifyGive(TaskHandle_t task);
+void vTaskNotifyGiveFromISR(TaskHandle_t task, BaseType_t* higherPriorityTaskWoken);
+uint32_t ulTaskNotifyTake(BaseType_t clearCountOnExit, TickType_t ticksToWait);
+TaskHandle_t xTaskGetCurrentTaskHandle(void);
+
+#define portYIELD_FROM_ISR(x)   ((void)(x))
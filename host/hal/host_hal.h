@@ -0,0 +1,86 @@
+#pragma once
+
+/*
+ * Host HAL control interface.
+ *
+ * The firmware never includes this header. It is used by host tools
+ * (benchmarks, replay drivers) to feed the stand-in drivers and to
+ * inspect what the firmware did.
+ */
+
+#include <stdint.h>
+#include <stddef.h>
+#include <functional>
+
+#include "driver/twai.h"
+
+namespace host_hal {
+
+/* =========================
+ *  TWAI
+ * ========================= */
+
+/*
+ * Queue a frame as if it had just been received from the bus.
+ * Returns false (and counts rx_missed) when the driver RX queue is full,
+ * exactly like the real driver dropping a frame in its ISR. Frames the
+ * acceptance filter rejects are not queued (twai_rx_filtered()).
+ */
+bool twai_inject(const twai_message_t& msg);
+
+/*
+ * Called for every frame the firmware transmits. May call twai_inject()
+ * to emulate a device answering on the bus. Pass nullptr to clear.
+ */
+void twai_set_tx_hook(std::function<void(const twai_message_t&)> hook);
+
+/*
+ * Put the controller into bus-off, as after a burst of TX errors.
+ * Frames are not received until the firmware has recovered it
+ * (twai_initiate_recovery(), then twai_start()).
+ */
+bool twai_bus_off();
+
+uint32_t twai_rx_pending();
+uint32_t twai_tx_count();
+uint32_t twai_rx_filtered();      // since the driver was installed
+
+/* =========================
+ *  SD
+ * ========================= */
+
+/*
+ * Directory that backs the fake SD card root. Default is ./sdcard,
+ * or $SUSPMEAS_SD_ROOT if set. Created on SD.begin().
+ */
+void sd_set_root(const char* path);
+const char* sd_root();
+
+/*
+ * Artificial per-write latency, to emulate a slow card.
+ */
+void sd_set_write_latency_us(uint32_t us);
+
+/* =========================
+ *  SERIAL
+ * ========================= */
+
+/*
+ * Silence Serial output (debug prints) while benchmarking.
+ */
+void serial_set_muted(bool muted);
+
+/*
+ * Send Serial output to a file or tty (e.g. one end of a pty pair)
+ * instead of stdout. nullptr restores stdout.
+ */
+bool serial_set_output(const char* path);
+
+/*
+ * Use a tty (e.g. one end of a pty pair) for both Serial input and
+ * output, like the USB-serial port of the real board. nullptr restores
+ * stdin / stdout.
+ */
+bool serial_set_device(const char* path);
+
+} // namespace host_hal
@@ -0,0 +1,285 @@
+#include "driver/twai.h"
+#include "host_hal.h"
+
+#include <chrono>
+#include <condition_variable>
+#include <deque>
+#include <mutex>
+
+/*
+ * Fake TWAI controller.
+ *
+ * A bounded RX queue (rx_queue_len from the general config) sits between
+ * the harness and twai_receive(). Overflow is counted in rx_missed_count,
+ * matching the real driver's behaviour when the application falls behind.
+ *
+ * twai_bus_off() takes the controller off the bus; twai_initiate_recovery()
+ * then takes the time of 128 x 11 recessive bits at 500 kbit/s before
+ * the controller reports STOPPED, as on the real hardware.
+ *
+ * The acceptance filter is applied to injected frames in single filter
+ * mode (dual filter mode accepts everything).
+ */
+
+static std::mutex              twaiMutex;
+static std::condition_variable twaiRxCv;
+static std::deque<twai_message_t> rxQueue;
+
+static bool         installed   = false;
+static twai_state_t state       = TWAI_STATE_STOPPED;
+static uint32_t     rxQueueLen  = 5;
+static uint32_t     rxMissed    = 0;
+static uint32_t     txCount     = 0;
+static uint32_t     busErrors   = 0;
+static uint32_t     txErrors    = 0;
+static uint32_t     rxFiltered  = 0;
+static twai_filter_config_t filter = TWAI_FILTER_CONFIG_ACCEPT_ALL();
+
+static std::chrono::steady_clock::time_point recoveryDone;
+
+// Recovery completes on its own; checked whenever the state is looked at
+static void updateRecovery()
+{
+    if (state == TWAI_STATE_RECOVERING && std::chrono::steady_clock::now() >= recoveryDone) {
+        state = TWAI_STATE_STOPPED;
+        txErrors = 0;
+    }
+}
+
+// Single filter layout of the controller (mask bit 1 = don't care)
+static bool acceptedByFilter(const twai_message_t& msg)
+{
+    if (!filter.single_filter)
+        return true;
+
+    uint32_t bits;
+    if (msg.extd) {
+        bits = (msg.identifier << 3) | (msg.rtr ? 0x4u : 0);
+    } else {
+        bits = (msg.identifier << 21) | (msg.rtr ? 0x100000u : 0);
+        if (msg.data_length_code > 0)
+            bits |= (uint32_t)msg.data[0] << 12;
+        if (msg.data_length_code > 1)
+            bits |= (uint32_t)msg.data[1] << 4;
+    }
+    return ((bits ^ filter.acceptance_code) & ~filter.acceptance_mask) == 0;
+}
+
+static std::function<void(const twai_message_t&)> txHook;
+
+esp_err_t twai_driver_install(const twai_general_config_t* g_config,
+                              const twai_timing_config_t*,
+                              const twai_filter_config_t* f_config)
+{
+    std::lock_guard<std::mutex> lock(twaiMutex);
+
+    if (installed)
+        return ESP_ERR_INVALID_STATE;
+
+    rxQueueLen = g_config->rx_queue_len ? g_config->rx_queue_len : 1;
+    rxQueue.clear();
+    rxMissed = 0;
+    txCount  = 0;
+    busErrors = 0;
+    txErrors  = 0;
+    rxFiltered = 0;
+    if (f_config)
+        filter = *f_config;
+    installed = true;
+    state = TWAI_STATE_STOPPED;
+    return ESP_OK;
+}
+
+esp_err_t twai_driver_uninstall(void)
+{
+    std::lock_guard<std::mutex> lock(twaiMutex);
+
+    updateRecovery();
+    if (!installed || state != TWAI_STATE_STOPPED)
+        return ESP_ERR_INVALID_STATE;
+
+    installed = false;
+    rxQueue.clear();
+    return ESP_OK;
+}
+
+esp_err_t twai_start(void)
+{
+    std::lock_guard<std::mutex> lock(twaiMutex);
+
+    updateRecovery();
+    if (!installed || state != TWAI_STATE_STOPPED)
+        return ESP_ERR_INVALID_STATE;
+
+    state = TWAI_STATE_RUNNING;
+    return ESP_OK;
+}
+
+esp_err_t twai_stop(void)
+{
+    std::lock_guard<std::mutex> lock(twaiMutex);
+
+    if (!installed || state != TWAI_STATE_RUNNING)
+        return ESP_ERR_INVALID_STATE;
+
+    state = TWAI_STATE_STOPPED;
+    rxQueue.clear();
+    return ESP_OK;
+}
+
+esp_err_t twai_transmit(const twai_message_t* message, TickType_t)
+{
+    std::function<void(const twai_message_t&)> hook;
+    {
+        std::lock_guard<std::mutex> lock(twaiMutex);
+
+        if (!installed || state != TWAI_STATE_RUNNING)
+            return ESP_ERR_INVALID_STATE;
+        if (message->data_length_code > TWAI_FRAME_MAX_DLC)
+            return ESP_ERR_INVALID_ARG;
+
+        txCount++;
+        hook = txHook;
+    }
+
+    // Outside the lock: the hook typically injects a response frame.
+    if (hook)
+        hook(*message);
+
+    return ESP_OK;
+}
+
+esp_err_t twai_receive(twai_message_t* message, TickType_t ticks_to_wait)
+{
+    std::unique_lock<std::mutex> lock(twaiMutex);
+
+    if (!installed || state != TWAI_STATE_RUNNING)
+        return ESP_ERR_INVALID_STATE;
+
+    if (rxQueue.empty()) {
+        if (ticks_to_wait == 0)
+            return ESP_ERR_TIMEOUT;
+
+        auto ready = [] { return !rxQueue.empty(); };
+        if (ticks_to_wait == portMAX_DELAY) {
+            twaiRxCv.wait(lock, ready);
+        } else if (!twaiRxCv.wait_for(lock,
+                       std::chrono::milliseconds(ticks_to_wait * portTICK_PERIOD_MS),
+                       ready)) {
+            return ESP_ERR_TIMEOUT;
+        }
+    }
+
+    *message = rxQueue.front();
+    rxQueue.pop_front();
+    return ESP_OK;
+}
+
+esp_err_t twai_get_status_info(twai_status_info_t* status_info)
+{
+    std::lock_guard<std::mutex> lock(twaiMutex);
+
+    if (!installed)
+        return ESP_ERR_INVALID_STATE;
+
+    updateRecovery();
+    *status_info = {};
+    status_info->state            = state;
+    status_info->msgs_to_rx       = (uint32_t)rxQueue.size();
+    status_info->tx_error_counter = txErrors;
+    status_info->rx_missed_count  = rxMissed;
+    status_info->bus_error_count  = busErrors;
+    return ESP_OK;
+}
+
+esp_err_t twai_initiate_recovery(void)
+{
+    std::lock_guard<std::mutex> lock(twaiMutex);
+
+    if (!installed || state != TWAI_STATE_BUS_OFF)
+        return ESP_ERR_INVALID_STATE;
+
+    // 128 occurrences of 11 recessive bits
+    state = TWAI_STATE_RECOVERING;
+    recoveryDone = std::chrono::steady_clock::now() +
+                   std::chrono::microseconds(128 * 11 * 2);
+    return ESP_OK;
+}
+
+esp_err_t twai_clear_receive_queue(void)
+{
+    std::lock_guard<std::mutex> lock(twaiMutex);
+
+    if (!installed)
+        return ESP_ERR_INVALID_STATE;
+
+    rxQueue.clear();
+    return ESP_OK;
+}
+
+namespace host_hal {
+
+bool twai_inject(const twai_message_t& msg)
+{
+    {
+        std::lock_guard<std::mutex> lock(twaiMutex);
+
+        if (!installed || state != TWAI_STATE_RUNNING)
+            return false;
+
+        // Dropped by the controller, as if never on the bus for us
+        if (!acceptedByFilter(msg)) {
+            rxFiltered++;
+            return true;
+        }
+
+        if (rxQueue.size() >= rxQueueLen) {
+            rxMissed++;
+            return false;
+        }
+        rxQueue.push_back(msg);
+    }
+    twaiRxCv.notify_one();
+    return true;
+}
+
+void twai_set_tx_hook(std::function<void(const twai_message_t&)> hook)
+{
+    std::lock_guard<std::mutex> lock(twaiMutex);
+    txHook = std::move(hook);
+}
+
+bool twai_bus_off()
+{
+    std::lock_guard<std::mutex> lock(twaiMutex);
+
+    if (!installed || state != TWAI_STATE_RUNNING)
+        return false;
+
+    // TEC past 255: the last 32 error frames were ours
+    state = TWAI_STATE_BUS_OFF;
+    txErrors = 256;
+    busErrors += 32;
+    rxQueue.clear();
+    return true;
+}
+
+uint32_t twai_rx_pending()
+{
+    std::lock_guard<std::mutex> lock(twaiMutex);
+    return (uint32_t)rxQueue.size();
+}
+
+uint32_t twai_tx_count()
+{
+    std::lock_guard<std::mutex> lock(twaiMutex);
+    return txCount;
+}
+
+uint32_t twai_rx_filtered()
+{
+    std::lock_guard<std::mutex> lock(twaiMutex);
+    return rxFiltered;
+}
+
+} // namespace host_hal
@@ -0,0 +1,6 @@
+/*
+ * The Arduino build compiles SuspensionMeas.ino as C++; on the host we
+ * do the same explicitly so setup(), loop() and the sketch globals are
+ * available to host tools.
+ */
+#include "SuspensionMeas.ino"
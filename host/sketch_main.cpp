@@ -0,0 +1,76 @@
+/*
+ * suspmeas_host - run the sketch on the host
+ *
+ * Calls setup() and then loop() forever, like the Arduino core does.
+ * With --serial the CLI talks over a tty instead of stdin / stdout, so
+ * host tools can drive it exactly like the board's USB-serial port:
+ *
+ *   socat -d -d pty,raw,echo=0 pty,raw,echo=0     # prints two pty paths
+ *   suspmeas_host --serial /dev/pts/A --sd-root ./sdcard
+ *   sd_get /dev/pts/B ls
+ *
+ * No encoders answer on the stand-in CAN bus; use can_replay_bench for
+ * acquisition work.
+ */
+
+#include <Arduino.h>
+#include <host_hal.h>
+
+#include <errno.h>
+#include <signal.h>
+#include <stdio.h>
+#include <string.h>
+
+#include <string>
+
+void setup();
+void loop();
+
+static volatile sig_atomic_t stopRequested = 0;
+
+static void onSignal(int)
+{
+    stopRequested = 1;
+}
+
+static void usage()
+{
+    fprintf(stderr,
+        "usage: suspmeas_host [options]\n"
+        "  --serial <tty>     Serial CLI on this tty (default stdin / stdout)\n"
+        "  --sd-root <dir>    directory backing the SD card (default ./sdcard)\n");
+}
+
+int main(int argc, char** argv)
+{
+    for (int i = 1; i < argc; i++) {
+        std::string a = argv[i];
+        const char* v = (i + 1 < argc) ? argv[i + 1] : nullptr;
+
+        if (a == "--serial" && v) {
+            if (!host_hal::serial_set_device(v)) {
+                fprintf(stderr, "open %s: %s\n", v, strerror(errno));
+                return 1;
+            }
+            i++;
+        }
+        else if (a == "--sd-root" && v) {
+            host_hal::sd_set_root(v);
+            i++;
+        }
+        else {
+            usage();
+            return 2;
+        }
+    }
+
+    signal(SIGINT, onSignal);
+    signal(SIGTERM, onSignal);
+
+    setup();
+    while (!stopRequested) {
+        loop();
+        delay(1);
+    }
+    return 0;
+}
@@ -0,0 +1,645 @@
+/*
+ * sd_get - list and download SD card files over the serial CLI
+ *
+ *   sd_get /dev/ttyUSB0 ls [dir]
+ *   sd_get /dev/ttyUSB0 get /LOG_0003.BIN [-o out.bin] [--baud 2000000]
+ *
+ * "get" writes to <out>.part and renames it when the whole file has
+ * arrived. If <out>.part already exists the download resumes from its
+ * size. The protocol is documented in file_xfer.h.
+ *
+ * --drop-pct discards a share of the received DATA packets on purpose,
+ * to exercise NAK / retransmit against a clean link.
+ *
+ * Testing without hardware:
+ *   socat -d -d pty,raw,echo=0 pty,raw,echo=0     # prints two pty paths
+ *   suspmeas_host --serial /dev/pts/A --sd-root ./sdcard
+ *   sd_get /dev/pts/B get /LOG_0000.BIN
+ */
+
+#include "file_xfer.h"
+#include "serial_cli.h"
+#include "crc.h"
+#include "cobs.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <termios.h>
+#include <time.h>
+#include <unistd.h>
+
+#include <map>
+#include <random>
+#include <string>
+#include <vector>
+
+struct GetOptions {
+    std::string tty;
+    std::string command;          // "ls" or "get"
+    std::string path;             // device path
+    std::string out;              // local file
+    unsigned long baud = XFER_DEFAULT_BAUD;
+    double   dropPct = 0.0;
+};
+
+/*
+ * ACK_EVERY / ACK_IDLE_MS
+ *
+ * Cumulative ACK after this many in-order chunks, and again whenever the
+ * link has been quiet for a while (lost ACKs must not stall the window).
+ */
+#define ACK_EVERY       4
+#define ACK_IDLE_MS     50
+#define NAK_REPEAT_MS   100
+
+static volatile sig_atomic_t stopRequested = 0;
+
+static void onSignal(int)
+{
+    stopRequested = 1;
+}
+
+static void usage()
+{
+    fprintf(stderr,
+        "usage: sd_get <tty> ls [dir]\n"
+        "       sd_get <tty> get <path> [options]\n"
+        "  -o <file>        local file (default: basename of path)\n"
+        "  --baud <n>       transfer baud rate (default %d)\n"
+        "  --drop-pct <p>   drop p %% of DATA packets (retransmit test)\n",
+        XFER_DEFAULT_BAUD);
+}
+
+static bool parseArgs(int argc, char** argv, GetOptions& opt)
+{
+    std::vector<std::string> pos;
+
+    for (int i = 1; i < argc; i++) {
+        std::string a = argv[i];
+        const char* v = (i + 1 < argc) ? argv[i + 1] : nullptr;
+
+        if (a == "-o" && v)                  { opt.out = v; i++; }
+        else if (a == "--baud" && v)         { opt.baud = strtoul(v, nullptr, 10); i++; }
+        else if (a == "--drop-pct" && v)     { opt.dropPct = atof(v); i++; }
+        else if (a[0] != '-' || a == "-")    pos.push_back(a);
+        else return false;
+    }
+
+    if (pos.size() < 2)
+        return false;
+
+    opt.tty = pos[0];
+    opt.command = pos[1];
+
+    if (opt.command == "ls") {
+        opt.path = pos.size() > 2 ? pos[2] : "/";
+        return pos.size() <= 3;
+    }
+    if (opt.command == "get" && pos.size() == 3) {
+        opt.path = pos[2];
+        if (opt.out.empty()) {
+            size_t slash = opt.path.find_last_of('/');
+            opt.out = slash == std::string::npos ? opt.path : opt.path.substr(slash + 1);
+        }
+        return !opt.out.empty();
+    }
+    return false;
+}
+
+/* =========================
+ *  TTY
+ * ========================= */
+
+static speed_t baudConstant(unsigned long baud)
+{
+    switch (baud) {
+        case 9600:    return B9600;
+        case 19200:   return B19200;
+        case 38400:   return B38400;
+        case 57600:   return B57600;
+        case 115200:  return B115200;
+        case 230400:  return B230400;
+        case 460800:  return B460800;
+        case 500000:  return B500000;
+        case 921600:  return B921600;
+        case 1000000: return B1000000;
+        case 2000000: return B2000000;
+        default:      return 0;
+    }
+}
+
+static bool setBaud(int fd, unsigned long baud)
+{
+    if (!isatty(fd))
+        return true;
+
+    speed_t speed = baudConstant(baud);
+    struct termios tio;
+    if (speed == 0 || tcgetattr(fd, &tio) != 0)
+        return false;
+
+    cfsetispeed(&tio, speed);
+    cfsetospeed(&tio, speed);
+    return tcsetattr(fd, TCSADRAIN, &tio) == 0;
+}
+
+static int openTty(const std::string& path)
+{
+    int fd = open(path.c_str(), O_RDWR | O_NOCTTY);
+    if (fd < 0) {
+        fprintf(stderr, "open %s: %s\n", path.c_str(), strerror(errno));
+        return -1;
+    }
+
+    struct termios tio;
+    if (isatty(fd) && tcgetattr(fd, &tio) == 0) {
+        cfmakeraw(&tio);
+        tio.c_cflag |= CLOCAL | CREAD;
+        tio.c_cc[VMIN] = 1;
+        tio.c_cc[VTIME] = 0;
+        tcsetattr(fd, TCSANOW, &tio);
+    }
+    if (!setBaud(fd, SERIAL_CLI_BAUD)) {
+        fprintf(stderr, "cannot set %d baud\n", SERIAL_CLI_BAUD);
+        close(fd);
+        return -1;
+    }
+
+    tcflush(fd, TCIOFLUSH);
+    return fd;
+}
+
+static bool writeAll(int fd, const void* buf, size_t len)
+{
+    const uint8_t* p = static_cast<const uint8_t*>(buf);
+    while (len > 0) {
+        ssize_t n = write(fd, p, len);
+        if (n < 0 && errno == EINTR)
+            continue;
+        if (n <= 0)
+            return false;
+        p += n;
+        len -= (size_t)n;
+    }
+    return true;
+}
+
+static double nowSec()
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+/*
+ * Read one text line (without CR/LF). Returns false on timeout.
+ */
+static bool readLine(int fd, std::string& line, double timeoutSec)
+{
+    line.clear();
+    const double deadline = nowSec() + timeoutSec;
+
+    while (nowSec() < deadline && !stopRequested) {
+        struct pollfd pfd = { fd, POLLIN, 0 };
+        if (poll(&pfd, 1, 50) <= 0)
+            continue;
+
+        char c;
+        if (read(fd, &c, 1) != 1)
+            return false;
+        if (c == '\n')
+            return true;
+        if (c != '\r')
+            line += c;
+    }
+    return false;
+}
+
+/* =========================
+ *  LS
+ * ========================= */
+
+static int runLs(int fd, const GetOptions& opt)
+{
+    std::string cmd = "ls " + opt.path + "\n";
+    if (!writeAll(fd, cmd.data(), cmd.size()))
+        return 1;
+
+    // Listing ends with the summary line, or an error line
+    std::string line;
+    while (readLine(fd, line, 3.0)) {
+        printf("%s\n", line.c_str());
+        if (line.find(" entries, ") != std::string::npos || line.rfind("ls:", 0) == 0)
+            return line.rfind("ls:", 0) == 0 ? 1 : 0;
+    }
+
+    fprintf(stderr, "sd_get: no answer from device\n");
+    return 1;
+}
+
+/* =========================
+ *  GET
+ * ========================= */
+
+class Receiver {
+public:
+    Receiver(int fd, FILE* out, uint32_t offset, const GetOptions& opt)
+        : fd_(fd), out_(out), expected_(offset), start_(offset),
+          dropPct_(opt.dropPct), rng_(12345) {}
+
+    // Returns true once END was received
+    bool feed(const uint8_t* data, size_t len);
+    void tick();
+    void abort();
+
+    uint32_t received() const { return expected_; }
+    uint32_t size() const { return size_; }
+    bool     haveInfo() const { return haveInfo_; }
+    const XferEnd& end() const { return end_; }
+
+    uint32_t crcErrors = 0;
+    uint32_t dropped = 0;
+    uint32_t naks = 0;
+    uint32_t duplicates = 0;
+    bool     writeError = false;
+
+private:
+    void handlePacket(const uint8_t* pkt, size_t len);
+    void handleData(uint32_t offset, const uint8_t* data, size_t len);
+    void sendPacket(uint8_t type, uint32_t offset, bool withOffset = true);
+    void sendAck();
+    void requestMissing();
+
+    int      fd_;
+    FILE*    out_;
+    uint32_t expected_;
+    uint32_t start_;
+    uint32_t size_ = 0;
+    uint16_t chunk_ = XFER_CHUNK;
+    bool     haveInfo_ = false;
+    bool     ended_ = false;
+    XferEnd  end_ = {};
+
+    std::map<uint32_t, std::vector<uint8_t>> pending_;    // out of order
+    std::map<uint32_t, double> nakTime_;
+    uint32_t sinceAck_ = 0;
+    double   lastAckSec_ = 0.0;
+    double   lastRxSec_ = 0.0;
+
+    double   dropPct_;
+    std::mt19937 rng_;
+
+    std::vector<uint8_t> frame_;
+};
+
+void Receiver::sendPacket(uint8_t type, uint32_t offset, bool withOffset)
+{
+    uint8_t pkt[1 + 4 + 4];
+    size_t len = 1;
+
+    pkt[0] = type;
+    if (withOffset) {
+        memcpy(&pkt[1], &offset, 4);
+        len += 4;
+    }
+    uint32_t crc = crc32_ieee(pkt, len);
+    memcpy(&pkt[len], &crc, 4);
+    len += 4;
+
+    uint8_t frame[COBS_MAX_FRAME(sizeof(pkt))];
+    size_t n = cobs_encode(pkt, len, frame);
+    writeAll(fd_, frame, n);
+}
+
+void Receiver::sendAck()
+{
+    sendPacket(XFER_PKT_ACK, expected_);
+    sinceAck_ = 0;
+    lastAckSec_ = nowSec();
+}
+
+void Receiver::abort()
+{
+    sendPacket(XFER_PKT_ABORT, 0, false);
+}
+
+/*
+ * NAK every chunk between the in-order point and the highest buffered
+ * chunk that has not arrived, at most once per NAK_REPEAT_MS each.
+ */
+void Receiver::requestMissing()
+{
+    if (pending_.empty())
+        return;
+
+    const uint32_t last = pending_.rbegin()->first;
+    const double now = nowSec();
+
+    for (uint32_t off = expected_; off < last; off += chunk_) {
+        if (pending_.count(off))
+            continue;
+
+        auto it = nakTime_.find(off);
+        if (it != nakTime_.end() && now - it->second < NAK_REPEAT_MS / 1000.0)
+            continue;
+
+        sendPacket(XFER_PKT_NAK, off);
+        nakTime_[off] = now;
+        naks++;
+    }
+}
+
+void Receiver::handleData(uint32_t offset, const uint8_t* data, size_t len)
+{
+    if (len == 0 || offset < expected_ || offset + len > size_) {
+        duplicates++;
+        return;
+    }
+
+    if (offset > expected_) {
+        if (!pending_.count(offset))
+            pending_[offset].assign(data, data + len);
+        else
+            duplicates++;
+        requestMissing();
+        return;
+    }
+
+    if (fwrite(data, 1, len, out_) != len)
+        writeError = true;
+    expected_ += (uint32_t)len;
+    sinceAck_++;
+
+    // Anything buffered that is now in order
+    auto it = pending_.begin();
+    while (it != pending_.end() && it->first == expected_) {
+        if (fwrite(it->second.data(), 1, it->second.size(), out_) != it->second.size())
+            writeError = true;
+        expected_ += (uint32_t)it->second.size();
+        sinceAck_++;
+        it = pending_.erase(it);
+    }
+    while (!nakTime_.empty() && nakTime_.begin()->first < expected_)
+        nakTime_.erase(nakTime_.begin());
+
+    if (sinceAck_ >= ACK_EVERY || expected_ >= size_)
+        sendAck();
+}
+
+void Receiver::handlePacket(const uint8_t* pkt, size_t len)
+{
+    if (len < 1 + 4) {
+        crcErrors++;
+        return;
+    }
+
+    uint32_t crc;
+    memcpy(&crc, &pkt[len - 4], 4);
+    if (crc32_ieee(pkt, len - 4) != crc) {
+        crcErrors++;
+        return;
+    }
+
+    lastRxSec_ = nowSec();
+
+    const uint8_t* body = &pkt[1];
+    const size_t bodyLen = len - 1 - 4;
+
+    switch (pkt[0]) {
+    case XFER_PKT_INFO: {
+        if (bodyLen < sizeof(XferInfo))
+            break;
+        XferInfo info;
+        memcpy(&info, body, sizeof(info));
+        size_ = info.file_size;
+        chunk_ = info.chunk;
+        haveInfo_ = true;
+        sendAck();      // handshake: start (or resume) at our offset
+        break;
+    }
+
+    case XFER_PKT_DATA: {
+        if (!haveInfo_ || bodyLen < 4)
+            break;
+        if (dropPct_ > 0.0 && std::uniform_real_distribution<double>(0.0, 100.0)(rng_) < dropPct_) {
+            dropped++;
+            break;
+        }
+        uint32_t offset;
+        memcpy(&offset, body, 4);
+        handleData(offset, body + 4, bodyLen - 4);
+        break;
+    }
+
+    case XFER_PKT_END:
+        if (bodyLen < sizeof(XferEnd))
+            break;
+        memcpy(&end_, body, sizeof(end_));
+        ended_ = true;
+        break;
+    }
+}
+
+bool Receiver::feed(const uint8_t* data, size_t len)
+{
+    for (size_t i = 0; i < len && !ended_; i++) {
+        if (data[i] != 0) {
+            if (frame_.size() < XFER_MAX_FRAME)
+                frame_.push_back(data[i]);
+            continue;
+        }
+
+        if (!frame_.empty()) {
+            int n = cobs_decode(frame_.data(), frame_.size(), frame_.data());
+            if (n > 0)
+                handlePacket(frame_.data(), (size_t)n);
+            else
+                crcErrors++;
+        }
+        frame_.clear();
+    }
+    return ended_;
+}
+
+void Receiver::tick()
+{
+    if (!haveInfo_)
+        return;
+
+    const double now = nowSec();
+    if (now - lastAckSec_ >= ACK_IDLE_MS / 1000.0 && now - lastRxSec_ >= ACK_IDLE_MS / 1000.0) {
+        sendAck();
+        requestMissing();
+    }
+}
+
+static const char* statusName(uint8_t status)
+{
+    switch (status) {
+        case XFER_OK:         return "ok";
+        case XFER_ABORTED:    return "aborted";
+        case XFER_TIMEOUT:    return "timeout";
+        case XFER_READ_ERROR: return "read error";
+        default:              return "unknown";
+    }
+}
+
+static int runGet(int fd, const GetOptions& opt)
+{
+    const std::string partPath = opt.out + ".part";
+
+    uint32_t offset = 0;
+    struct stat st;
+    if (stat(partPath.c_str(), &st) == 0)
+        offset = (uint32_t)st.st_size;
+
+    FILE* out = fopen(partPath.c_str(), offset > 0 ? "ab" : "wb");
+    if (!out) {
+        fprintf(stderr, "open %s: %s\n", partPath.c_str(), strerror(errno));
+        return 1;
+    }
+
+    char cmd[512];
+    snprintf(cmd, sizeof(cmd), "get %s %lu %lu\n",
+             opt.path.c_str(), (unsigned long)offset, opt.baud);
+    if (!writeAll(fd, cmd, strlen(cmd))) {
+        fclose(out);
+        return 1;
+    }
+
+    // Skip anything the CLI printed before the answer
+    std::string line;
+    bool answered = false;
+    while (readLine(fd, line, 3.0)) {
+        if (line.rfind("XFER ", 0) == 0) {
+            answered = true;
+            break;
+        }
+    }
+    if (!answered) {
+        fprintf(stderr, "sd_get: no answer from device\n");
+        fclose(out);
+        return 1;
+    }
+    if (line.rfind("XFER ERR", 0) == 0) {
+        fprintf(stderr, "sd_get: %s\n", line.c_str() + 5);
+        fclose(out);
+        return 1;
+    }
+
+    unsigned long size = 0, startOffset = 0, baud = 0;
+    if (sscanf(line.c_str(), "XFER %lu %lu %lu", &size, &startOffset, &baud) != 3) {
+        fprintf(stderr, "sd_get: bad answer '%s'\n", line.c_str());
+        fclose(out);
+        return 1;
+    }
+    if (!setBaud(fd, baud)) {
+        fprintf(stderr, "sd_get: cannot set %lu baud\n", baud);
+        fclose(out);
+        return 1;
+    }
+
+    if (offset > 0)
+        fprintf(stderr, "sd_get: resuming %s at %lu of %lu bytes\n", opt.path.c_str(), (unsigned long)offset, size);
+
+    Receiver rx(fd, out, offset, opt);
+    const double t0 = nowSec();
+    double lastReport = t0;
+    double lastData = t0;
+    bool ended = false;
+    bool aborted = false;
+    uint8_t buf[8192];
+
+    while (!ended) {
+        if (stopRequested && !aborted) {
+            rx.abort();
+            aborted = true;
+        }
+
+        struct pollfd pfd = { fd, POLLIN, 0 };
+        int r = poll(&pfd, 1, 10);
+        if (r < 0 && errno != EINTR)
+            break;
+
+        if (r > 0) {
+            ssize_t n = read(fd, buf, sizeof(buf));
+            if (n <= 0)
+                break;
+            ended = rx.feed(buf, (size_t)n);
+            lastData = nowSec();
+        }
+
+        rx.tick();
+
+        const double now = nowSec();
+        if (now - lastData > XFER_IDLE_ABORT_MS / 1000.0 + 1.0) {
+            fprintf(stderr, "\nsd_get: device went silent\n");
+            break;
+        }
+        if (now - lastReport >= 0.5 && rx.haveInfo()) {
+            fprintf(stderr, "\r%10u / %lu bytes  %6.1f KB/s",
+                    rx.received(), size, (rx.received() - offset) / (now - t0) / 1024.0);
+            lastReport = now;
+        }
+    }
+
+    const double elapsed = nowSec() - t0;
+    fclose(out);
+    setBaud(fd, SERIAL_CLI_BAUD);
+
+    fprintf(stderr, "\r%10u / %lu bytes in %.2f s (%.1f KB/s)\n",
+            rx.received(), size, elapsed, (rx.received() - offset) / elapsed / 1024.0);
+    if (ended) {
+        const XferEnd& e = rx.end();
+        fprintf(stderr, "sd_get: device: %s, %u chunks sent, %u retransmits, %u timeouts\n",
+                statusName(e.status), e.chunks_sent, e.retransmits, e.timeouts);
+    }
+    fprintf(stderr, "sd_get: receiver: %u crc errors, %u naks, %u duplicates, %u dropped on purpose\n",
+            rx.crcErrors, rx.naks, rx.duplicates, rx.dropped);
+
+    if (rx.writeError) {
+        fprintf(stderr, "sd_get: write error on %s\n", partPath.c_str());
+        return 1;
+    }
+    if (!ended || rx.end().status != XFER_OK || rx.received() != size) {
+        fprintf(stderr, "sd_get: incomplete, %s kept for resume\n", partPath.c_str());
+        return 1;
+    }
+    if (rename(partPath.c_str(), opt.out.c_str()) != 0) {
+        fprintf(stderr, "rename %s: %s\n", partPath.c_str(), strerror(errno));
+        return 1;
+    }
+
+    printf("%s\n", opt.out.c_str());
+    return 0;
+}
+
+int main(int argc, char** argv)
+{
+    GetOptions opt;
+    if (!parseArgs(argc, argv, opt)) {
+        usage();
+        return 2;
+    }
+    if (opt.command == "get" && baudConstant(opt.baud) == 0) {
+        fprintf(stderr, "unsupported baud rate %lu\n", opt.baud);
+        return 2;
+    }
+
+    int fd = openTty(opt.tty);
+    if (fd < 0)
+        return 1;
+
+    signal(SIGINT, onSignal);
+    signal(SIGTERM, onSignal);
+
+    int rc = opt.command == "ls" ? runLs(fd, opt) : runGet(fd, opt);
+    close(fd);
+    return rc;
+}
@@ -0,0 +1,769 @@
+#include "sdlog_analysis.h"
+#include "sdlog_index.h"
+#include "thread_pool.h"
+#include "calibration.h"
+#include "measurements.h"
+#include "BriterEncoder.h"
+
+#include <math.h>
+#include <string.h>
+
+#include <algorithm>
+#include <chrono>
+#include <memory>
+
+namespace sdlog {
+
+using Clock = std::chrono::steady_clock;
+
+static const unsigned CHANNELS = SDLOG_SENSOR_CHANNELS;
+
+// Work items decoded per thread before they are analysed and released
+static const unsigned BATCH_PER_THREAD = 4;
+
+/* =========================
+ *  WORK ITEMS
+ * ========================= */
+
+struct CalChange {
+    size_t     at;              // first sample it applies to
+    EncoderCal cal;
+};
+
+// Samples of one channel in one work item, in log order
+struct ChannelSamples {
+    std::vector<int64_t>   ts;  // us
+    std::vector<int32_t>   raw; // counts
+    std::vector<CalChange> cal;
+};
+
+// State taken over from the items before (same file)
+struct Carry {
+    EncoderCal cal;
+    bool     havePrev;
+    int64_t  prevTs;
+    float    prevTravel;
+};
+
+struct ChannelResult {
+    uint64_t samples;
+    uint64_t intervals;         // sample intervals credited to the histograms
+    uint64_t totalUs;
+    double   travelUs;          // travel x time, mm x us
+    float    travelMin;
+    float    travelMax;
+    float    compMax;
+    float    rebMax;
+    uint64_t compLsUs, compHsUs, rebLsUs, rebHsUs;
+    uint64_t velCompUs[STATS_VEL_BINS];
+    uint64_t velRebUs[STATS_VEL_BINS];
+    uint64_t travelBinUs[STATS_TRAVEL_BINS];
+
+    // Bottom-outs and arming at the end, for either arming at the start
+    uint32_t outs[2];
+    bool     endArmed[2];
+
+    std::vector<double> psd;    // sum of |X|^2 over segments
+    uint32_t segments;
+};
+
+struct WorkItem {
+    size_t   file;
+    size_t   first, last;       // seek points, see LogFile::mapPoints()
+
+    // Decoded
+    ChannelSamples ch[CHANNELS];
+    float    statsBottomMm[CHANNELS];   // from REC_STATS, < 0 = none
+    uint64_t bytes;
+    uint64_t records;
+    bool     damaged;
+
+    // Carried in, analysed
+    Carry    carry[CHANNELS];
+    float    bottomMm[CHANNELS];
+    ChannelResult res[CHANNELS];
+};
+
+struct FileState {
+    std::unique_ptr<LogFile> log;
+    float    bottomMm[CHANNELS];        // < 0 = from the file's only item
+    Carry    ch[CHANNELS];
+    bool     armed[CHANNELS];
+};
+
+// Per-thread buffers for the kernels
+struct Scratch {
+    std::vector<float>    travel;
+    std::vector<float>    vel;
+    std::vector<uint32_t> dt;
+    std::vector<uint8_t>  travelBin;
+    std::vector<uint8_t>  velBin;
+    std::vector<float>    seg;
+    std::vector<float>    re, im;
+};
+
+static void defaultCal(EncoderCal& c)
+{
+    c.scale_q16 = CAL_DEFAULT_SCALE_Q16;
+    c.offset    = 0;
+    c.wrap_at   = CAL_DEFAULT_WRAP_AT;
+    c.wrap_span = CAL_DEFAULT_WRAP_SPAN;
+    c.invert    = false;
+}
+
+/* =========================
+ *  DECODING
+ * ========================= */
+
+static bool channelOf(uint32_t id, unsigned& ch)
+{
+    if (id < BriterEncoder::FIRST_ID || id > BriterEncoder::LAST_ID)
+        return false;
+    ch = id - BriterEncoder::FIRST_ID;
+    return ch < CHANNELS;
+}
+
+static void decodeCalib(const Record& rec, WorkItem& it)
+{
+    SdlogCalEntry ce;
+    for (size_t e = 0; calibEntry(rec, e, ce); e++) {
+        unsigned ch;
+        if (!channelOf(ce.id, ch))
+            continue;
+
+        CalChange c;
+        c.at = it.ch[ch].ts.size();
+        c.cal.scale_q16 = ce.scale_q16;
+        c.cal.offset    = ce.offset;
+        c.cal.wrap_at   = ce.wrap_at;
+        c.cal.wrap_span = ce.wrap_span;
+        c.cal.invert    = (ce.flags & SDLOG_CAL_INVERT) != 0;
+        it.ch[ch].cal.push_back(c);
+    }
+}
+
+static void decodeStats(const Record& rec, WorkItem& it)
+{
+    if (rec.payload_len < sizeof(SdlogStatsHeader))
+        return;
+
+    SdlogStatsHeader h;
+    memcpy(&h, rec.payload, sizeof(h));
+    const size_t per = sizeof(SdlogStatsEncoder) +
+                       (2u * h.vel_bins + h.travel_bins) * sizeof(uint32_t);
+    size_t pos = sizeof(h);
+
+    for (uint8_t e = 0; e < h.encoders && pos + per <= rec.payload_len; e++, pos += per) {
+        SdlogStatsEncoder se;
+        memcpy(&se, rec.payload + pos, sizeof(se));
+
+        unsigned ch;
+        if (channelOf(se.id, ch))
+            it.statsBottomMm[ch] = se.bottom_out_mm;
+    }
+}
+
+static void decodeItem(const LogFile& log, WorkItem& it)
+{
+    for (unsigned c = 0; c < CHANNELS; c++)
+        it.statsBottomMm[c] = -1.0f;
+    it.bytes = it.records = 0;
+    it.damaged = false;
+
+    Slice slice;
+    Reader r;
+    if (!log.mapPoints(it.first, it.last, slice) || !slice.reader(r)) {
+        it.damaged = true;
+        return;
+    }
+    it.bytes = slice.size();
+
+    // About 34 bytes per sensor frame: reserve once instead of regrowing
+    if (log.version() >= 0x04) {
+        for (unsigned c = 0; c < CHANNELS; c++) {
+            it.ch[c].ts.reserve(slice.size() / 32);
+            it.ch[c].raw.reserve(slice.size() / 32);
+        }
+    }
+
+    // Delta-coded CAN records have absolute time only after a REC_TIMESYNC
+    bool synced = log.version() == 0x01;
+    const bool frames = log.version() < 0x04;
+    Record rec;
+
+    while (r.next(rec)) {
+        it.records++;
+
+        switch (rec.type) {
+        case REC_SENSORS: {
+            SdlogSensorRecord f;
+            memcpy(&f, rec.raw, sizeof(f));
+            for (unsigned c = 0; c < CHANNELS; c++) {
+                if (f.valid & (1u << c)) {
+                    it.ch[c].ts.push_back((int64_t)(f.ts_us + f.dt_us[c]));
+                    it.ch[c].raw.push_back(f.raw[c]);
+                }
+            }
+            break;
+        }
+        case REC_VEHICLE: {
+            uint8_t id;
+            unsigned c;
+            int32_t raw;
+            if (frames && synced && readResponse(rec, id, raw) && channelOf(id, c)) {
+                it.ch[c].ts.push_back((int64_t)rec.ts_us);
+                it.ch[c].raw.push_back(raw);
+            }
+            break;
+        }
+        case REC_TIMESYNC:
+            synced = true;
+            break;
+        case REC_CALIB:
+            decodeCalib(rec, it);
+            break;
+        case REC_STATS:
+            decodeStats(rec, it);
+            break;
+        default:
+            break;
+        }
+    }
+    if (r.error())
+        it.damaged = true;
+}
+
+/* =========================
+ *  FFT
+ * ========================= */
+
+/*
+ * Power spectrum of n real samples through an n / 2 point complex FFT
+ * (even samples as real, odd as imaginary part, split afterwards).
+ * Radix-2 on split real / imaginary arrays; twiddles are stored per
+ * stage (stage with half size h at [h, 2h)), so the butterfly loop
+ * walks all arrays with unit stride.
+ */
+struct Fft {
+    size_t n = 0;                       // real samples
+    size_t m = 0;                       // complex points, n / 2
+    std::vector<uint32_t> rev;
+    std::vector<float> twRe, twIm;      // stage twiddles, size m
+    std::vector<float> spRe, spIm;      // split twiddles e^(-2 pi i k / n), k <= m
+    std::vector<float> window;          // Hann
+    double windowPower = 0.0;           // sum of window^2
+
+    void init(size_t size)
+    {
+        n = size;
+        m = size / 2;
+        unsigned bits = 0;
+        while ((size_t)1 << bits < m)
+            bits++;
+
+        rev.resize(m);
+        for (size_t i = 0; i < m; i++) {
+            uint32_t r = 0;
+            for (unsigned b = 0; b < bits; b++)
+                r |= ((i >> b) & 1u) << (bits - 1 - b);
+            rev[i] = r;
+        }
+
+        twRe.assign(m, 0.0f);
+        twIm.assign(m, 0.0f);
+        for (size_t h = 1; h < m; h <<= 1) {
+            for (size_t k = 0; k < h; k++) {
+                const double a = -M_PI * (double)k / (double)h;
+                twRe[h + k] = (float)cos(a);
+                twIm[h + k] = (float)sin(a);
+            }
+        }
+
+        spRe.resize(m + 1);
+        spIm.resize(m + 1);
+        for (size_t k = 0; k <= m; k++) {
+            const double a = -2.0 * M_PI * (double)k / (double)n;
+            spRe[k] = (float)cos(a);
+            spIm[k] = (float)sin(a);
+        }
+
+        window.resize(n);
+        windowPower = 0.0;
+        for (size_t i = 0; i < n; i++) {
+            window[i] = (float)(0.5 - 0.5 * cos(2.0 * M_PI * (double)i / (double)n));
+            windowPower += (double)window[i] * window[i];
+        }
+    }
+
+    void transform(float* re, float* im) const
+    {
+        for (size_t i = 0; i < m; i++) {
+            const size_t j = rev[i];
+            if (i < j) {
+                std::swap(re[i], re[j]);
+                std::swap(im[i], im[j]);
+            }
+        }
+
+        // First stage: twiddle 1
+        for (size_t s = 0; s < m; s += 2) {
+            const float r = re[s + 1], i = im[s + 1];
+            re[s + 1] = re[s] - r;
+            im[s + 1] = im[s] - i;
+            re[s] += r;
+            im[s] += i;
+        }
+
+        for (size_t h = 2; h < m; h <<= 1) {
+            const float* wr = &twRe[h];
+            const float* wi = &twIm[h];
+            for (size_t s = 0; s < m; s += 2 * h) {
+                float* ar = re + s;
+                float* ai = im + s;
+                float* br = ar + h;
+                float* bi = ai + h;
+                for (size_t k = 0; k < h; k++) {
+                    const float tr = br[k] * wr[k] - bi[k] * wi[k];
+                    const float ti = br[k] * wi[k] + bi[k] * wr[k];
+                    br[k] = ar[k] - tr;
+                    bi[k] = ai[k] - ti;
+                    ar[k] += tr;
+                    ai[k] += ti;
+                }
+            }
+        }
+    }
+
+    /*
+     * x: n samples; re / im: m floats of scratch. Adds |X[k]|^2 for
+     * k = 0 .. n / 2 to acc.
+     */
+    void power(const float* x, float* re, float* im, double* acc) const
+    {
+        for (size_t k = 0; k < m; k++) {
+            re[k] = x[2 * k];
+            im[k] = x[2 * k + 1];
+        }
+        transform(re, im);
+
+        for (size_t k = 0; k <= m; k++) {
+            const size_t a = k < m ? k : 0;
+            const size_t b = k == 0 ? 0 : m - k;
+            // Even part E = (Z[k] + conj Z[m - k]) / 2, odd part O = (Z[k] - conj Z[m - k]) / 2i
+            const float er = 0.5f * (re[a] + re[b]);
+            const float ei = 0.5f * (im[a] - im[b]);
+            const float orr = 0.5f * (im[a] + im[b]);
+            const float oi = -0.5f * (re[a] - re[b]);
+            const float xr = er + spRe[k] * orr - spIm[k] * oi;
+            const float xi = ei + spRe[k] * oi + spIm[k] * orr;
+            acc[k] += (double)xr * xr + (double)xi * xi;
+        }
+    }
+};
+
+/* =========================
+ *  KERNELS
+ * ========================= */
+
+static inline uint8_t binOf(float v, float invWidth, uint32_t bins)
+{
+    // As run_stats.cpp binIndex()
+    const float b = v * invWidth;
+    const uint32_t i = b <= 0.0f ? 0 : (uint32_t)b;
+    return (uint8_t)(i < bins ? i : bins - 1);
+}
+
+static void travelKernel(const EncoderCal& cal, const int32_t* raw, float* travel, size_t n)
+{
+    for (size_t i = 0; i < n; i++)
+        travel[i] = (float)calibrationApply(cal, raw[i]) * -0.001f;
+}
+
+// Welch segments over runs of samples without gaps
+static void psdKernel(const Fft& fft, const float* travel, const uint32_t* dt, size_t n,
+                      Scratch& w, ChannelResult& out)
+{
+    const size_t len = fft.n;
+    const size_t hop = len / 2;
+    w.seg.resize(len);
+    w.re.resize(fft.m);
+    w.im.resize(fft.m);
+    out.psd.assign(len / 2 + 1, 0.0);
+
+    size_t runStart = 0;
+    for (size_t i = 1; i <= n; i++) {
+        if (i < n && dt[i] != 0)
+            continue;
+
+        for (size_t s = runStart; s + len <= i; s += hop) {
+            const float* x = travel + s;
+            float mean = 0.0f;
+            for (size_t k = 0; k < len; k++)
+                mean += x[k];
+            mean /= (float)len;
+
+            for (size_t k = 0; k < len; k++)
+                w.seg[k] = (x[k] - mean) * fft.window[k];
+            fft.power(w.seg.data(), w.re.data(), w.im.data(), out.psd.data());
+            out.segments++;
+        }
+        runStart = i;
+    }
+}
+
+static void analyzeChannel(const ChannelSamples& s, const Carry& carry, float bottomMm,
+                           const Fft* fft, Scratch& w, ChannelResult& out)
+{
+    out = ChannelResult();
+    out.endArmed[0] = false;
+    out.endArmed[1] = true;
+
+    const size_t n = s.ts.size();
+    if (n == 0)
+        return;
+
+    w.travel.resize(n);
+    w.vel.resize(n);
+    w.dt.resize(n);
+    w.travelBin.resize(n);
+    w.velBin.resize(n);
+
+    float* travel = w.travel.data();
+    float* vel = w.vel.data();
+    uint32_t* dt = w.dt.data();
+    const int64_t* ts = s.ts.data();
+
+    // Counts to travel, one run per calibration in effect
+    EncoderCal cal = carry.cal;
+    size_t at = 0;
+    for (const CalChange& c : s.cal) {
+        if (c.at > at) {
+            travelKernel(cal, &s.raw[at], &travel[at], c.at - at);
+            at = c.at;
+        }
+        cal = c.cal;
+    }
+    travelKernel(cal, &s.raw[at], &travel[at], n - at);
+
+    // Backward difference; gaps (and repeated timestamps) credit no time
+    {
+        const int64_t d = carry.havePrev ? ts[0] - carry.prevTs : 0;
+        const bool ok = d > 0 && d <= MEAS_GAP_RESET_US;
+        dt[0] = ok ? (uint32_t)d : 0;
+        vel[0] = ok ? (travel[0] - carry.prevTravel) * 1e6f / (float)d : 0.0f;
+    }
+    for (size_t i = 1; i < n; i++) {
+        const int64_t d = ts[i] - ts[i - 1];
+        const bool ok = d > 0 && d <= MEAS_GAP_RESET_US;
+        const float df = ok ? (float)d : 1.0f;
+        dt[i] = ok ? (uint32_t)d : 0;
+        vel[i] = ok ? (travel[i] - travel[i - 1]) * 1e6f / df : 0.0f;
+    }
+
+    // Reductions and bin indices
+    float tMin = travel[0], tMax = travel[0];
+    float vMax = 0.0f, vMin = 0.0f;
+    double tSum = 0.0;
+    uint64_t total = 0, intervals = 0;
+    for (size_t i = 0; i < n; i++) {
+        const float t = travel[i];
+        const float v = vel[i];
+        tMin = t < tMin ? t : tMin;
+        tMax = t > tMax ? t : tMax;
+        vMax = v > vMax ? v : vMax;
+        vMin = v < vMin ? v : vMin;
+        tSum += (double)t * dt[i];
+        total += dt[i];
+        intervals += dt[i] != 0;
+
+        w.travelBin[i] = binOf(t, 1.0f / STATS_TRAVEL_BIN_MM, STATS_TRAVEL_BINS);
+        w.velBin[i] = binOf(v < 0.0f ? -v : v, 1.0f / STATS_VEL_BIN_MM_S, STATS_VEL_BINS);
+    }
+    out.samples = n;
+    out.intervals = intervals;
+    out.totalUs = total;
+    out.travelUs = tSum;
+    out.travelMin = tMin;
+    out.travelMax = tMax;
+    out.compMax = vMax;
+    out.rebMax = -vMin;
+
+    // Time weighted histograms: the interval before a sample goes to its bins
+    for (size_t i = 0; i < n; i++) {
+        const uint32_t d = dt[i];
+        if (d == 0)
+            continue;
+
+        out.travelBinUs[w.travelBin[i]] += d;
+        const float v = vel[i];
+        if (v >= 0.0f) {
+            out.velCompUs[w.velBin[i]] += d;
+            (v < STATS_LSHS_SPLIT_MM_S ? out.compLsUs : out.compHsUs) += d;
+        } else {
+            out.velRebUs[w.velBin[i]] += d;
+            (-v < STATS_LSHS_SPLIT_MM_S ? out.rebLsUs : out.rebHsUs) += d;
+        }
+    }
+
+    // Bottom-outs with hysteresis, for either arming at the start
+    if (bottomMm > 0.0f) {
+        const float rearm = bottomMm - STATS_BOTTOM_HYST_MM;
+        for (int start = 0; start < 2; start++) {
+            bool armed = start != 0;
+            uint32_t outs = 0;
+            for (size_t i = 0; i < n; i++) {
+                if (armed && travel[i] >= bottomMm) {
+                    outs++;
+                    armed = false;
+                } else if (!armed && travel[i] < rearm) {
+                    armed = true;
+                }
+            }
+            out.outs[start] = outs;
+            out.endArmed[start] = armed;
+        }
+    }
+
+    if (fft)
+        psdKernel(*fft, travel, dt, n, w, out);
+}
+
+/* =========================
+ *  SESSION
+ * ========================= */
+
+// Calibration and previous sample after an item, for the next one
+static void carryOver(const WorkItem& it, FileState& fs)
+{
+    for (unsigned c = 0; c < CHANNELS; c++) {
+        const ChannelSamples& s = it.ch[c];
+        Carry& k = fs.ch[c];
+
+        const size_t n = s.ts.size();
+        EncoderCal last = k.cal;
+        for (const CalChange& cc : s.cal) {
+            if (n > 0 && cc.at <= n - 1)
+                last = cc.cal;
+            k.cal = cc.cal;
+        }
+        if (n > 0) {
+            k.havePrev = true;
+            k.prevTs = s.ts[n - 1];
+            k.prevTravel = (float)calibrationApply(last, s.raw[n - 1]) * -0.001f;
+        }
+    }
+}
+
+static void resetFile(FileState& fs)
+{
+    for (unsigned c = 0; c < CHANNELS; c++) {
+        defaultCal(fs.ch[c].cal);
+        fs.ch[c].havePrev = false;
+        fs.ch[c].prevTs = 0;
+        fs.ch[c].prevTravel = 0.0f;
+        fs.armed[c] = true;
+    }
+}
+
+static void release(WorkItem& it)
+{
+    for (unsigned c = 0; c < CHANNELS; c++) {
+        std::vector<int64_t>().swap(it.ch[c].ts);
+        std::vector<int32_t>().swap(it.ch[c].raw);
+        std::vector<CalChange>().swap(it.ch[c].cal);
+        std::vector<double>().swap(it.res[c].psd);
+    }
+}
+
+static void merge(const ChannelResult& r, bool& armed, double& travelUs, uint64_t& intervals,
+                  EncoderAnalysis& e)
+{
+    if (r.samples > 0) {
+        if (e.samples == 0 || r.travelMin < e.travel_min) e.travel_min = r.travelMin;
+        if (e.samples == 0 || r.travelMax > e.travel_max) e.travel_max = r.travelMax;
+        e.vel_comp_max = std::max(e.vel_comp_max, r.compMax);
+        e.vel_reb_max = std::max(e.vel_reb_max, r.rebMax);
+    }
+    e.samples += r.samples;
+    e.total_us += r.totalUs;
+    travelUs += r.travelUs;
+    intervals += r.intervals;
+    e.comp_ls_us += r.compLsUs;
+    e.comp_hs_us += r.compHsUs;
+    e.reb_ls_us += r.rebLsUs;
+    e.reb_hs_us += r.rebHsUs;
+    for (unsigned b = 0; b < STATS_VEL_BINS; b++) {
+        e.vel_comp_us[b] += r.velCompUs[b];
+        e.vel_reb_us[b] += r.velRebUs[b];
+    }
+    for (unsigned b = 0; b < STATS_TRAVEL_BINS; b++)
+        e.travel_us[b] += r.travelBinUs[b];
+
+    e.bottom_outs += r.outs[armed];
+    armed = r.endArmed[armed];
+
+    if (!r.psd.empty()) {
+        if (e.psd.size() < r.psd.size())
+            e.psd.resize(r.psd.size(), 0.0);
+        for (size_t k = 0; k < r.psd.size(); k++)
+            e.psd[k] += r.psd[k];
+        e.psd_segments += r.segments;
+    }
+}
+
+bool analyzeLogs(const std::vector<std::string>& paths, const AnalysisOptions& opt,
+                 AnalysisResult& out)
+{
+    const auto t0 = Clock::now();
+
+    if (opt.psdSize != 0 && (opt.psdSize < 16 || (opt.psdSize & (opt.psdSize - 1)) != 0))
+        return false;
+
+    ThreadPool pool(opt.threads);
+
+    out.files.assign(paths.size(), FileSummary());
+    out.stream_bytes = out.records = 0;
+    out.items = 0;
+    out.threads = pool.size();
+    out.decode_s = out.total_s = 0.0;
+    for (unsigned c = 0; c < CHANNELS; c++) {
+        out.enc[c] = EncoderAnalysis();
+        out.enc[c].id = (uint8_t)(BriterEncoder::FIRST_ID + c);
+    }
+
+    // Open all files; thresholds from the REC_STATS in each file's last seek interval
+    std::vector<FileState> files(paths.size());
+    pool.run(paths.size(), [&](size_t f, unsigned) {
+        FileState& fs = files[f];
+        FileSummary& sum = out.files[f];
+        sum.path = paths[f];
+        fs.log.reset(new LogFile());
+        resetFile(fs);
+
+        if (!fs.log->open(paths[f].c_str())) {
+            sum.error = fs.log->errorText();
+            return;
+        }
+        sum.version = fs.log->version();
+
+        const size_t points = fs.log->seekPoints().size();
+        for (unsigned c = 0; c < CHANNELS; c++)
+            fs.bottomMm[c] = opt.bottomOutMm >= 0.0f ? opt.bottomOutMm : -1.0f;
+        if (opt.bottomOutMm < 0.0f && points > 1) {
+            WorkItem tail;
+            tail.first = points - 1;
+            tail.last = points;
+            decodeItem(*fs.log, tail);
+            for (unsigned c = 0; c < CHANNELS; c++)
+                fs.bottomMm[c] = std::max(tail.statsBottomMm[c], 0.0f);
+        }
+    });
+
+    // Whole seek intervals, about chunkBytes each
+    std::vector<WorkItem> items;
+    for (size_t f = 0; f < files.size(); f++) {
+        if (out.files[f].error)
+            continue;
+
+        const LogFile& log = *files[f].log;
+        const std::vector<SeekPoint>& pts = log.seekPoints();
+        size_t first = 0;
+        for (size_t p = 1; p <= pts.size(); p++) {
+            const uint64_t end = p < pts.size() ? pts[p].offset : log.dataEnd();
+            if (p == pts.size() || end - pts[first].offset >= opt.chunkBytes) {
+                items.emplace_back();
+                items.back().file = f;
+                items.back().first = first;
+                items.back().last = p;
+                first = p;
+            }
+        }
+    }
+    if (items.empty())
+        return false;
+
+    Fft fft;
+    if (opt.psdSize)
+        fft.init(opt.psdSize);
+    std::vector<Scratch> scratch(pool.size());
+    bool armed[CHANNELS] = {};
+    double travelUs[CHANNELS] = {};
+    uint64_t intervals[CHANNELS] = {};
+
+    const size_t batch = (size_t)pool.size() * BATCH_PER_THREAD;
+    for (size_t b0 = 0; b0 < items.size(); b0 += batch) {
+        const size_t b1 = std::min(items.size(), b0 + batch);
+
+        const auto d0 = Clock::now();
+        pool.run(b1 - b0, [&](size_t i, unsigned) {
+            WorkItem& it = items[b0 + i];
+            decodeItem(*files[it.file].log, it);
+        });
+        out.decode_s += std::chrono::duration<double>(Clock::now() - d0).count();
+
+        for (size_t i = b0; i < b1; i++) {
+            WorkItem& it = items[i];
+            FileState& fs = files[it.file];
+            if (it.first == 0)
+                resetFile(fs);
+            for (unsigned c = 0; c < CHANNELS; c++) {
+                it.carry[c] = fs.ch[c];
+                if (fs.bottomMm[c] < 0.0f)          // single item file: its own REC_STATS
+                    fs.bottomMm[c] = std::max(it.statsBottomMm[c], 0.0f);
+                it.bottomMm[c] = fs.bottomMm[c];
+            }
+            carryOver(it, fs);
+        }
+
+        pool.run((b1 - b0) * CHANNELS, [&](size_t i, unsigned worker) {
+            WorkItem& it = items[b0 + i / CHANNELS];
+            const unsigned c = (unsigned)(i % CHANNELS);
+            analyzeChannel(it.ch[c], it.carry[c], it.bottomMm[c],
+                           opt.psdSize ? &fft : nullptr, scratch[worker], it.res[c]);
+        });
+
+        for (size_t i = b0; i < b1; i++) {
+            WorkItem& it = items[i];
+            FileSummary& sum = out.files[it.file];
+            sum.stream_bytes += it.bytes;
+            sum.items++;
+            sum.damaged += it.damaged;
+            out.stream_bytes += it.bytes;
+            out.records += it.records;
+            out.items++;
+
+            for (unsigned c = 0; c < CHANNELS; c++) {
+                if (it.first == 0)
+                    armed[c] = true;
+                merge(it.res[c], armed[c], travelUs[c], intervals[c], out.enc[c]);
+                out.enc[c].bottom_out_mm = it.bottomMm[c];
+            }
+            release(it);
+        }
+    }
+
+    for (unsigned c = 0; c < CHANNELS; c++) {
+        EncoderAnalysis& e = out.enc[c];
+        if (e.total_us == 0)
+            continue;
+
+        e.travel_mean = (float)(travelUs[c] / (double)e.total_us);
+        e.sample_hz = (float)(intervals[c] * 1e6 / (double)e.total_us);
+
+        // One-sided density: |X|^2 / (fs * sum(w^2)), doubled but for DC and Nyquist
+        if (e.psd_segments > 0) {
+            const double fs = e.sample_hz;
+            const double scale = 1.0 / (fs * fft.windowPower * e.psd_segments);
+            for (size_t k = 0; k < e.psd.size(); k++) {
+                const bool edge = k == 0 || k == e.psd.size() - 1;
+                e.psd[k] *= edge ? scale : 2.0 * scale;
+            }
+            e.psd_bin_hz = (float)(fs / (double)opt.psdSize);
+        }
+    }
+
+    out.total_s = std::chrono::duration<double>(Clock::now() - t0).count();
+    return true;
+}
+
+} // namespace sdlog
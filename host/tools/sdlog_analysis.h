@@ -0,0 +1,114 @@
+#pragma once
+
+/*
+ * Offline analysis of SD log sessions (host build).
+ *
+ * Recomputes the run statistics of the firmware (run_stats.h) from the
+ * raw encoder counts of one or more log files, with the calibration
+ * logged alongside them (REC_CALIB), and adds what the device has no
+ * room for: the power spectral density of travel.
+ *
+ *   sdlog::AnalysisOptions opt;
+ *   sdlog::AnalysisResult  res;
+ *   if (sdlog::analyzeLogs(paths, opt, res)) ...
+ *
+ * Every file is cut into work items of whole seek intervals (about
+ * chunkBytes of record stream each, see LogFile::mapPoints()), which
+ * are decoded on all cores. Samples go into per-channel arrays
+ * (timestamps, raw counts) and the kernels - calibration, velocity,
+ * histograms, spectra - are plain loops over those arrays. What
+ * crosses item boundaries (calibration in effect, the previous sample,
+ * bottom-out arming) is carried over in a short sequential step
+ * between decoding and analysis. Items are processed in batches, so
+ * memory stays bounded for sessions of any length.
+ *
+ * Files without seek points (v1..v3) are one work item each; their
+ * encoder values are the logged READ responses (REC_VEHICLE).
+ *
+ * Differences to the device statistics:
+ *  - velocity is the plain difference over the sample interval (the
+ *    device low-pass filters it, MEAS_VEL_TAU_US), so peaks read higher
+ *  - statistics run over all given files, not per REC_STATS run
+ */
+
+#include "sdlog.h"
+#include "run_stats.h"
+
+#include <stdint.h>
+#include <stddef.h>
+
+#include <string>
+#include <vector>
+
+namespace sdlog {
+
+struct AnalysisOptions {
+    unsigned threads = 0;               // 0 = one per core
+    uint64_t chunkBytes = 1 << 20;      // record stream per work item
+    float    bottomOutMm = -1.0f;       // < 0: threshold from each file's REC_STATS, 0: off
+    size_t   psdSize = 1024;            // samples per PSD segment (power of two), 0: no PSD
+};
+
+struct EncoderAnalysis {
+    uint8_t  id;                        // encoder CAN ID
+    uint64_t samples;
+    uint64_t total_us;                  // time covered, gaps excluded
+    float    sample_hz;                 // mean sample rate
+
+    float    travel_min;                // mm
+    float    travel_max;
+    float    travel_mean;               // time weighted
+    float    vel_comp_max;              // mm/s, positive
+    float    vel_reb_max;
+
+    float    bottom_out_mm;             // threshold of the last file, 0 = disabled
+    uint32_t bottom_outs;
+
+    // Time per speed range and per bin, us (bins as in run_stats.h)
+    uint64_t comp_ls_us;
+    uint64_t comp_hs_us;
+    uint64_t reb_ls_us;
+    uint64_t reb_hs_us;
+    uint64_t vel_comp_us[STATS_VEL_BINS];
+    uint64_t vel_reb_us[STATS_VEL_BINS];
+    uint64_t travel_us[STATS_TRAVEL_BINS];
+
+    /*
+     * Welch PSD of travel (Hann window, 50 % overlap, mean removed per
+     * segment), one-sided, mm^2/Hz; bin i is i * psd_bin_hz. Segments
+     * do not span gaps or work item boundaries.
+     */
+    std::vector<double> psd;
+    float    psd_bin_hz;
+    uint32_t psd_segments;
+};
+
+struct FileSummary {
+    std::string path;
+    const char* error;                  // nullptr if the file was analysed
+    uint8_t  version;
+    uint64_t stream_bytes;              // records analysed
+    uint32_t items;
+    uint32_t damaged;                   // items that stopped at a malformed record
+};
+
+struct AnalysisResult {
+    std::vector<FileSummary> files;
+    uint64_t stream_bytes;
+    uint64_t records;
+    uint32_t items;
+    unsigned threads;
+    double   decode_s;                  // wall time mapping and decoding
+    double   total_s;
+    EncoderAnalysis enc[SDLOG_SENSOR_CHANNELS];
+};
+
+/*
+ * Analyse the files as one session, in the given order. Returns false
+ * if none of them could be opened or an option is invalid; files that
+ * fail to open are reported in out.files and skipped.
+ */
+bool analyzeLogs(const std::vector<std::string>& paths, const AnalysisOptions& opt,
+                 AnalysisResult& out);
+
+} // namespace sdlog
@@ -0,0 +1,159 @@
+/*
+ * sdlog_analyze - run statistics and travel spectra of SD log sessions
+ *
+ * Decodes one or more LOG_XXXX.BIN files (any SDLOG_VERSION) on all
+ * cores and prints per encoder: travel and velocity summary, bottom-outs,
+ * optionally the histograms and the travel PSD (see sdlog_analysis.h).
+ * The files are taken as one session, in the order given.
+ *
+ *   sdlog_analyze LOG_0003.BIN LOG_0004.BIN
+ *   sdlog_analyze LOG_*.BIN --hist --psd 2048 --bottom 140
+ */
+
+#include "sdlog_analysis.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <string>
+#include <vector>
+
+struct AnalyzeOptions {
+    std::vector<std::string> paths;
+    sdlog::AnalysisOptions analysis;
+    bool     hist = false;
+    bool     psd = false;
+};
+
+static void usage()
+{
+    fprintf(stderr,
+        "usage: sdlog_analyze <LOG.BIN>... [options]\n"
+        "  --threads <n>     worker threads (default: one per core)\n"
+        "  --chunk <KiB>     record stream per work item (default 1024)\n"
+        "  --bottom <mm>     bottom-out threshold, 0 = off (default: from the log)\n"
+        "  --psd <n>         print the travel PSD, n samples per segment (power of two)\n"
+        "  --hist            print the velocity and travel histograms\n");
+}
+
+static bool parseArgs(int argc, char** argv, AnalyzeOptions& opt)
+{
+    for (int i = 1; i < argc; i++) {
+        std::string a = argv[i];
+        const char* v = (i + 1 < argc) ? argv[i + 1] : nullptr;
+
+        if (a == "--threads" && v)      { opt.analysis.threads = (unsigned)atoi(v); i++; }
+        else if (a == "--chunk" && v)   { opt.analysis.chunkBytes = strtoull(v, nullptr, 10) * 1024; i++; }
+        else if (a == "--bottom" && v)  { opt.analysis.bottomOutMm = (float)atof(v); i++; }
+        else if (a == "--psd" && v)     { opt.analysis.psdSize = strtoul(v, nullptr, 10); opt.psd = true; i++; }
+        else if (a == "--hist")         opt.hist = true;
+        else if (a[0] != '-')           opt.paths.push_back(a);
+        else return false;
+    }
+    return !opt.paths.empty() && opt.analysis.chunkBytes > 0;
+}
+
+static void printHistogram(const char* name, const uint64_t* us, unsigned bins, unsigned width,
+                           const char* unit)
+{
+    uint64_t total = 0;
+    for (unsigned b = 0; b < bins; b++)
+        total += us[b];
+    if (total == 0)
+        return;
+
+    printf("  %s\n", name);
+    for (unsigned b = 0; b < bins; b++) {
+        if (us[b] == 0)
+            continue;
+        const double pct = 100.0 * us[b] / total;
+        printf("    %5u%s %-6s %6.2f %%  ", b * width, b + 1 == bins ? "+" : " ", unit, pct);
+        for (int k = 0; k < (int)(pct / 2.0 + 0.5); k++)
+            putchar('#');
+        putchar('\n');
+    }
+}
+
+static void printEncoder(const sdlog::EncoderAnalysis& e, const AnalyzeOptions& opt)
+{
+    printf("\nencoder %u\n", e.id);
+    if (e.samples == 0) {
+        printf("  no samples\n");
+        return;
+    }
+
+    printf("  samples        : %llu, %.1f s, %.1f Hz\n",
+           (unsigned long long)e.samples, e.total_us * 1e-6, e.sample_hz);
+    printf("  travel         : %.2f .. %.2f mm, mean %.2f mm\n",
+           e.travel_min, e.travel_max, e.travel_mean);
+    printf("  velocity peak  : comp %.0f mm/s, reb %.0f mm/s\n", e.vel_comp_max, e.vel_reb_max);
+    if (e.total_us > 0) {
+        printf("  comp LS / HS   : %5.1f / %5.1f %%\n",
+               100.0 * e.comp_ls_us / e.total_us, 100.0 * e.comp_hs_us / e.total_us);
+        printf("  reb  LS / HS   : %5.1f / %5.1f %%\n",
+               100.0 * e.reb_ls_us / e.total_us, 100.0 * e.reb_hs_us / e.total_us);
+    }
+    if (e.bottom_out_mm > 0.0f)
+        printf("  bottom-outs    : %u (at %.1f mm)\n", e.bottom_outs, e.bottom_out_mm);
+    else
+        printf("  bottom-outs    : off\n");
+
+    if (opt.hist) {
+        printHistogram("compression velocity", e.vel_comp_us, STATS_VEL_BINS, STATS_VEL_BIN_MM_S, "mm/s");
+        printHistogram("rebound velocity", e.vel_reb_us, STATS_VEL_BINS, STATS_VEL_BIN_MM_S, "mm/s");
+        printHistogram("travel", e.travel_us, STATS_TRAVEL_BINS, STATS_TRAVEL_BIN_MM, "mm");
+    }
+
+    if (opt.psd && e.psd_segments > 0) {
+        printf("  travel PSD     : %u segments, %.3f Hz bins (mm^2/Hz)\n",
+               e.psd_segments, e.psd_bin_hz);
+        for (size_t k = 1; k < e.psd.size(); k++)
+            printf("    %8.3f Hz  %.4e\n", k * e.psd_bin_hz, e.psd[k]);
+    } else if (e.psd_segments > 0) {
+        // Dominant frequency, DC excluded
+        size_t peak = 1;
+        for (size_t k = 2; k < e.psd.size(); k++)
+            if (e.psd[k] > e.psd[peak])
+                peak = k;
+        printf("  travel PSD     : peak at %.2f Hz (%.3e mm^2/Hz), %u segments\n",
+               peak * e.psd_bin_hz, e.psd[peak], e.psd_segments);
+    }
+}
+
+int main(int argc, char** argv)
+{
+    AnalyzeOptions opt;
+    if (!parseArgs(argc, argv, opt)) {
+        usage();
+        return 2;
+    }
+
+    sdlog::AnalysisResult res;
+    if (!sdlog::analyzeLogs(opt.paths, opt.analysis, res)) {
+        for (const auto& f : res.files)
+            if (f.error)
+                fprintf(stderr, "%s: %s\n", f.path.c_str(), f.error);
+        fprintf(stderr, "nothing to analyse (bad --psd size?)\n");
+        return 1;
+    }
+
+    printf("\n=== SD log analysis ===\n");
+    for (const auto& f : res.files) {
+        if (f.error) {
+            printf("%-16s: %s\n", f.path.c_str(), f.error);
+            continue;
+        }
+        printf("%-16s: SDLOG_VERSION %u, %llu stream bytes, %u items%s\n",
+               f.path.c_str(), f.version, (unsigned long long)f.stream_bytes, f.items,
+               f.damaged ? " (damaged, see sdlog_recover)" : "");
+    }
+    printf("decoded         : %llu records, %.1f MB in %u work items, %u threads\n",
+           (unsigned long long)res.records, res.stream_bytes / 1e6, res.items, res.threads);
+    printf("time            : %.3f s (decode %.3f s), %.2f GB/s decoded\n",
+           res.total_s, res.decode_s, res.stream_bytes / 1e9 / (res.decode_s > 0 ? res.decode_s : 1e-9));
+
+    for (const auto& e : res.enc)
+        printEncoder(e, opt);
+    return 0;
+}
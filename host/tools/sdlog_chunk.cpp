@@ -0,0 +1,225 @@
+#include "sdlog_chunk.h"
+#include "lz_block.h"
+
+#include <string.h>
+
+namespace sdlog {
+
+enum ChunkState {
+    CHUNK_GOOD,
+    CHUNK_BAD,
+    CHUNK_FOREIGN,
+    CHUNK_EMPTY
+};
+
+/*
+ * crc32_ieee() with eight 256-entry tables (slicing-by-8). The nibble
+ * table in crc.h is sized for the ESP32; on the host it would limit
+ * chunk checking to about 100 MB/s. Same polynomial, same result.
+ */
+struct Crc32Tables {
+    uint32_t t[8][256];
+
+    Crc32Tables()
+    {
+        for (uint32_t i = 0; i < 256; i++) {
+            uint32_t c = i;
+            for (int k = 0; k < 8; k++)
+                c = (c & 1) ? (c >> 1) ^ 0xEDB88320u : c >> 1;
+            t[0][i] = c;
+        }
+        for (uint32_t i = 0; i < 256; i++)
+            for (int k = 1; k < 8; k++)
+                t[k][i] = (t[k - 1][i] >> 8) ^ t[0][t[k - 1][i] & 0xFF];
+    }
+};
+
+static uint32_t crc32Host(const uint8_t* p, size_t len, uint32_t crc = 0)
+{
+    static const Crc32Tables tables;
+    const uint32_t (*t)[256] = tables.t;
+
+    crc = ~crc;
+    for (; len >= 8; p += 8, len -= 8) {
+        uint32_t a, b;
+        memcpy(&a, p, 4);           // little endian host
+        memcpy(&b, p + 4, 4);
+        a ^= crc;
+        crc = t[7][a & 0xFF] ^ t[6][(a >> 8) & 0xFF] ^ t[5][(a >> 16) & 0xFF] ^ t[4][a >> 24] ^
+              t[3][b & 0xFF] ^ t[2][(b >> 8) & 0xFF] ^ t[1][(b >> 16) & 0xFF] ^ t[0][b >> 24];
+    }
+    while (len--)
+        crc = (crc >> 8) ^ t[0][(crc ^ *p++) & 0xFF];
+    return ~crc;
+}
+
+// p: start of the chunk, avail: file bytes from there on
+static ChunkState checkChunk(const uint8_t* p, size_t avail, uint64_t seq,
+                             uint32_t fileId, SdlogChunkHeader& h)
+{
+    if (avail < sizeof(h))
+        return CHUNK_BAD;
+
+    memcpy(&h, p, sizeof(h));
+
+    // Preallocated but never written: erased or zeroed sectors
+    bool blank = true;
+    for (size_t i = 1; i < sizeof(h) && blank; i++)
+        blank = p[i] == p[0];
+    if (blank && (p[0] == 0x00 || p[0] == 0xFF))
+        return CHUNK_EMPTY;
+
+    if (memcmp(h.magic, SDLOG_CHUNK_MAGIC, 4) != 0 ||
+        h.len > SDLOG_CHUNK_PAYLOAD || avail < sizeof(h) + h.len)
+        return CHUNK_BAD;
+
+    const size_t crcOffset = sizeof(h) - sizeof(h.crc);
+    uint32_t crc = crc32Host(p, crcOffset);
+    crc = crc32Host(p + sizeof(h), h.len, crc);
+    if (crc != h.crc)
+        return CHUNK_BAD;
+
+    if (h.seq != seq || (fileId != 0 && h.file_id != fileId))
+        return CHUNK_FOREIGN;
+
+    return CHUNK_GOOD;
+}
+
+// Stream bytes of a good chunk
+static bool decodeChunk(const SdlogChunkHeader& h, const uint8_t* payload, uint64_t seq,
+                        std::vector<uint8_t>& out, uint64_t* start)
+{
+    if (h.codec == SDLOG_CODEC_NONE) {
+        *start = seq * SDLOG_CHUNK_PAYLOAD;
+        out.assign(payload, payload + h.len);
+        return true;
+    }
+
+    SdlogBlockHeader b;
+    if (h.len < sizeof(b))
+        return false;
+    memcpy(&b, payload, sizeof(b));
+    const uint8_t* data = payload + sizeof(b);
+    const size_t dataLen = h.len - sizeof(b);
+    *start = b.offset;
+
+    switch (h.codec) {
+    case SDLOG_CODEC_STORED:
+        if (dataLen != b.raw_len)
+            return false;
+        out.assign(data, data + dataLen);
+        return true;
+    case SDLOG_CODEC_LZ:
+        out.resize(b.raw_len);
+        return lzb_decompress(data, dataLen, out.data(), b.raw_len);
+    default:
+        return false;
+    }
+}
+
+bool isChunked(const uint8_t* file, size_t len)
+{
+    return len >= sizeof(SdlogChunkHeader) && memcmp(file, SDLOG_CHUNK_MAGIC, 4) == 0;
+}
+
+const uint8_t* chunkPayload(const uint8_t* chunk, size_t avail, uint64_t seq,
+                            uint32_t* fileId, uint16_t* payloadLen)
+{
+    SdlogChunkHeader h;
+    if (checkChunk(chunk, avail, seq, *fileId, h) != CHUNK_GOOD)
+        return nullptr;
+
+    *fileId = h.file_id;
+    *payloadLen = h.len;
+    return chunk + sizeof(h);
+}
+
+bool chunkData(const uint8_t* chunk, size_t avail, uint64_t seq, uint32_t* fileId,
+               std::vector<uint8_t>& out, uint64_t* start)
+{
+    SdlogChunkHeader h;
+    if (checkChunk(chunk, avail, seq, *fileId, h) != CHUNK_GOOD)
+        return false;
+
+    *fileId = h.file_id;
+    return decodeChunk(h, chunk + sizeof(h), seq, out, start);
+}
+
+bool chunkExtent(const uint8_t* chunk, size_t avail, uint64_t seq, uint32_t fileId,
+                 uint64_t* start, uint32_t* len)
+{
+    SdlogChunkHeader h;
+    if (avail < sizeof(h))
+        return false;
+    memcpy(&h, chunk, sizeof(h));
+    if (memcmp(h.magic, SDLOG_CHUNK_MAGIC, 4) != 0 || h.seq != seq || h.file_id != fileId ||
+        h.len > SDLOG_CHUNK_PAYLOAD)
+        return false;
+
+    if (h.codec == SDLOG_CODEC_NONE) {
+        *start = seq * SDLOG_CHUNK_PAYLOAD;
+        *len = h.len;
+        return true;
+    }
+
+    SdlogBlockHeader b;
+    if (h.len < sizeof(b) || avail < sizeof(h) + sizeof(b))
+        return false;
+    memcpy(&b, chunk + sizeof(h), sizeof(b));
+    *start = b.offset;
+    *len = b.raw_len;
+    return true;
+}
+
+bool unchunk(const uint8_t* file, size_t len, std::vector<uint8_t>& stream,
+             std::vector<StreamRange>& valid, ChunkStats& st)
+{
+    st = {};
+    stream.clear();
+    valid.clear();
+
+    const uint64_t chunks = (len + SDLOG_CHUNK_SIZE - 1) / SDLOG_CHUNK_SIZE;
+    SdlogChunkHeader h;
+
+    for (uint64_t i = 0; i < chunks && st.file_id == 0; i++) {
+        const uint64_t off = i * SDLOG_CHUNK_SIZE;
+        if (checkChunk(file + off, len - off, i, 0, h) == CHUNK_GOOD)
+            st.file_id = h.file_id;
+    }
+    if (st.file_id == 0)
+        return false;
+
+    std::vector<uint8_t> data;
+    for (uint64_t i = 0; i < chunks; i++) {
+        const uint64_t off = i * SDLOG_CHUNK_SIZE;
+        switch (checkChunk(file + off, len - off, i, st.file_id, h)) {
+        case CHUNK_BAD:     st.bad++;     continue;
+        case CHUNK_FOREIGN: st.foreign++; continue;
+        case CHUNK_EMPTY:   st.empty++;   continue;
+        case CHUNK_GOOD:    break;
+        }
+
+        uint64_t start;
+        if (!decodeChunk(h, file + off + sizeof(h), i, data, &start)) {
+            st.bad++;
+            continue;
+        }
+        st.good++;
+        if (data.empty())
+            continue;
+
+        const uint64_t end = start + data.size();
+        if (stream.size() < end)
+            stream.resize(end);
+        memcpy(&stream[start], data.data(), data.size());
+
+        if (!valid.empty() && valid.back().end == start)
+            valid.back().end = end;
+        else
+            valid.push_back({ start, end });
+    }
+
+    return true;
+}
+
+} // namespace sdlog
@@ -0,0 +1,93 @@
+#pragma once
+
+/*
+ * Chunk framing of SD log files (SDLOG_VERSION 5+, see sdlog.h).
+ *
+ * The card holds a sequence of CRC-checked chunks; the record stream
+ * that sdlog::Reader decodes is the concatenation of their payloads,
+ * or of their decoded blocks in a compressed file (v6+).
+ * A chunk only counts if its CRC passes and its seq and file_id match
+ * its place in this file, so stale chunks in reused clusters and the
+ * unwritten tail of a preallocated file are told apart from damage.
+ *
+ *   std::vector<uint8_t> stream;
+ *   std::vector<sdlog::StreamRange> valid;
+ *   sdlog::ChunkStats st;
+ *   if (sdlog::isChunked(data, len))
+ *       sdlog::unchunk(data, len, stream, valid, st);
+ */
+
+#include "sdlog.h"
+
+#include <stdint.h>
+#include <stddef.h>
+#include <vector>
+
+namespace sdlog {
+
+// Stream offset -> file offset of an uncompressed v5+ file
+static inline uint64_t chunkFileOffset(uint64_t streamOffset)
+{
+    return (streamOffset / SDLOG_CHUNK_PAYLOAD) * SDLOG_CHUNK_SIZE +
+           sizeof(SdlogChunkHeader) + streamOffset % SDLOG_CHUNK_PAYLOAD;
+}
+
+// Stream length of an uncompressed v5+ file of fileLen bytes, if every chunk is intact
+static inline uint64_t chunkStreamLength(uint64_t fileLen)
+{
+    const uint64_t tail = fileLen % SDLOG_CHUNK_SIZE;
+    return (fileLen / SDLOG_CHUNK_SIZE) * SDLOG_CHUNK_PAYLOAD +
+           (tail > sizeof(SdlogChunkHeader) ? tail - sizeof(SdlogChunkHeader) : 0);
+}
+
+struct ChunkStats {
+    uint32_t good;          // passed every check
+    uint32_t bad;           // damaged: header or CRC wrong
+    uint32_t foreign;       // intact, but another file's (stale cluster)
+    uint32_t empty;         // never written (erased / zeroed)
+    uint32_t file_id;       // of this file
+};
+
+struct StreamRange {
+    uint64_t start;         // stream offsets
+    uint64_t end;
+};
+
+// The file starts with a chunk header rather than "SDLG"
+bool isChunked(const uint8_t* file, size_t len);
+
+/*
+ * Checks chunk number seq; chunk points at it, avail is the number of
+ * file bytes from there on. *fileId 0 accepts any file and is set to
+ * the chunk's. Returns the payload, nullptr if the chunk does not count.
+ */
+const uint8_t* chunkPayload(const uint8_t* chunk, size_t avail, uint64_t seq,
+                            uint32_t* fileId, uint16_t* payloadLen);
+
+/*
+ * Checks chunk number seq like chunkPayload() and decodes it: out gets
+ * its stream bytes, *start their stream offset. False if the chunk
+ * does not count or its block does not decode.
+ */
+bool chunkData(const uint8_t* chunk, size_t avail, uint64_t seq, uint32_t* fileId,
+               std::vector<uint8_t>& out, uint64_t* start);
+
+/*
+ * Where chunk number seq of file fileId goes in the stream, from its
+ * headers alone (no CRC check; for searching, the chunk is checked
+ * when read). avail >= sizeof(SdlogChunkHeader) + sizeof(SdlogBlockHeader)
+ * covers every codec.
+ */
+bool chunkExtent(const uint8_t* chunk, size_t avail, uint64_t seq, uint32_t fileId,
+                 uint64_t* start, uint32_t* len);
+
+/*
+ * Whole-file salvage: every good chunk's stream bytes are put at their
+ * offset in 'stream' (holes stay zero), 'valid' lists the covered
+ * ranges in order, adjacent chunks merged. The file id is taken from
+ * the first intact chunk that sits where its seq says.
+ */
+bool unchunk(const uint8_t* file, size_t len, std::vector<uint8_t>& stream,
+             std::vector<StreamRange>& valid, ChunkStats& st);
+
+} // namespace sdlog
@@ -0,0 +1,58 @@
+#pragma once
+
+/*
+ * Column files written by sdlog_export.
+ *
+ * One file per field, each a 64-byte SdcolHeader followed by one
+ * contiguous little endian array of rows x width values, so a loader
+ * can map the data directly:
+ *
+ *   numpy.memmap("frame_ts_us.col", dtype="<u8", mode="r", offset=64)
+ *   numpy.memmap("frame_data.col", dtype="u1", mode="r", offset=64).reshape(-1, 8)
+ *
+ * Two tables, rows in log order:
+ *
+ *   frame_*    REC_VEHICLE / REC_SNIFF records
+ *     ts_us    u64   device time
+ *     can_id   u32
+ *     flags    u8    SDCOL_FRAME_*
+ *     dlc      u8
+ *     data     u8 x 8, zero past dlc
+ *
+ *   sample_*   encoder samples (REC_SENSORS, one row per channel
+ *              present; logged READ responses before v4)
+ *     ts_us    u64   RX time of the sample
+ *     id       u8    encoder CAN ID
+ *     raw      i32   counts
+ *     pos_um   i32   calibrated length (calibration.h), with the
+ *                    REC_CALIB in effect
+ */
+
+#include <stdint.h>
+
+#define SDCOL_MAGIC             "SDCL"
+#define SDCOL_VERSION           1
+#define SDCOL_HEADER_SIZE       64
+
+typedef enum : uint8_t {
+    SDCOL_U8  = 1,
+    SDCOL_I32 = 2,
+    SDCOL_U32 = 3,
+    SDCOL_U64 = 4,
+} SdcolType;
+
+#define SDCOL_FRAME_EXTD        0x01    // 29-bit ID
+#define SDCOL_FRAME_SNIFF       0x02    // REC_SNIFF (else REC_VEHICLE)
+
+typedef struct __attribute__((packed)) {
+    uint8_t  magic[4];          // SDCOL_MAGIC
+    uint8_t  version;           // SDCOL_VERSION
+    uint8_t  type;              // SdcolType
+    uint8_t  width;             // values per row
+    uint8_t  log_version;       // SDLOG_VERSION of the (first) source file
+    uint64_t rows;
+    char     name[24];          // NUL padded, e.g. "frame_ts_us"
+    uint8_t  reserved[24];
+} SdcolHeader;
+
+static_assert(sizeof(SdcolHeader) == SDCOL_HEADER_SIZE, "SdcolHeader must be 64 bytes");
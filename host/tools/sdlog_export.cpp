@@ -0,0 +1,583 @@
+/*
+ * sdlog_export - SD logs to column files or CSV
+ *
+ * Writes the CAN frames and encoder samples of one or more log files
+ * (any SDLOG_VERSION, taken as one session in the order given) into an
+ * output directory:
+ *
+ *   column files (default)   one file per field, see sdlog_columns.h
+ *   --csv                    frames.csv   ts_us,type,can_id,extd,dlc,data
+ *                            samples.csv  ts_us,id,raw,pos_mm
+ *
+ * Files are cut into work items of whole seek intervals
+ * (LogFile::mapPoints()) which are decoded and encoded on all cores;
+ * every item's rows are written straight to their place in the output
+ * files, so the output is the same for any thread count.
+ *
+ *   sdlog_export LOG_0003.BIN -o ride3
+ *   sdlog_export LOG_0003.BIN LOG_0004.BIN -o ride3 --csv
+ */
+
+#include "sdlog_index.h"
+#include "sdlog_columns.h"
+#include "thread_pool.h"
+#include "sdlog.h"
+#include "calibration.h"
+#include "BriterEncoder.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <memory>
+#include <string>
+#include <vector>
+
+using Clock = std::chrono::steady_clock;
+
+static const unsigned CHANNELS = BriterEncoder::NUM_ENCODERS;
+
+// Work items encoded per thread before they are written and released
+static const unsigned BATCH_PER_THREAD = 4;
+
+struct ExportOptions {
+    std::vector<std::string> paths;
+    std::string out;
+    bool     csv = false;
+    unsigned threads = 0;
+    uint64_t chunkBytes = 1 << 20;
+};
+
+static void usage()
+{
+    fprintf(stderr,
+        "usage: sdlog_export <LOG.BIN>... -o <dir> [options]\n"
+        "  -o <dir>          output directory (created if missing)\n"
+        "  --csv             frames.csv and samples.csv instead of column files\n"
+        "  --threads <n>     worker threads (default: one per core)\n"
+        "  --chunk <KiB>     record stream per work item (default 1024)\n");
+}
+
+static bool parseArgs(int argc, char** argv, ExportOptions& opt)
+{
+    for (int i = 1; i < argc; i++) {
+        std::string a = argv[i];
+        const char* v = (i + 1 < argc) ? argv[i + 1] : nullptr;
+
+        if ((a == "-o" || a == "--out") && v) { opt.out = v; i++; }
+        else if (a == "--csv")          opt.csv = true;
+        else if (a == "--threads" && v) { opt.threads = (unsigned)atoi(v); i++; }
+        else if (a == "--chunk" && v)   { opt.chunkBytes = strtoull(v, nullptr, 10) * 1024; i++; }
+        else if (a[0] != '-')           opt.paths.push_back(a);
+        else return false;
+    }
+    return !opt.paths.empty() && !opt.out.empty() && opt.chunkBytes > 0;
+}
+
+/* =========================
+ *  WORK ITEMS
+ * ========================= */
+
+struct CalChange {
+    uint64_t   row;             // first sample row (in the item) it applies to
+    unsigned   ch;
+    EncoderCal cal;
+};
+
+struct ExportItem {
+    size_t   file;
+    size_t   first, last;       // seek points
+
+    // Frame table
+    std::vector<uint64_t> fTs;
+    std::vector<uint32_t> fId;
+    std::vector<uint8_t>  fFlags;
+    std::vector<uint8_t>  fDlc;
+    std::vector<uint8_t>  fData;    // 8 per row
+
+    // Sample table
+    std::vector<uint64_t> sTs;
+    std::vector<uint8_t>  sId;
+    std::vector<int32_t>  sRaw;
+    std::vector<int32_t>  sPos;
+    std::vector<CalChange> cal;
+
+    EncoderCal calIn[CHANNELS]; // in effect at the start of the item
+    std::string csvFrames;
+    std::string csvSamples;
+
+    uint64_t frameAt;           // first row, or CSV byte offset
+    uint64_t sampleAt;
+    uint64_t bytes;
+    bool     damaged;
+};
+
+static void defaultCal(EncoderCal& c)
+{
+    c.scale_q16 = CAL_DEFAULT_SCALE_Q16;
+    c.offset    = 0;
+    c.wrap_at   = CAL_DEFAULT_WRAP_AT;
+    c.wrap_span = CAL_DEFAULT_WRAP_SPAN;
+    c.invert    = false;
+}
+
+static void addSample(ExportItem& it, uint64_t tsUs, uint8_t id, int32_t raw)
+{
+    it.sTs.push_back(tsUs);
+    it.sId.push_back(id);
+    it.sRaw.push_back(raw);
+}
+
+static void addFrame(ExportItem& it, const sdlog::Record& rec, bool readFrames)
+{
+    uint8_t id;
+    int32_t raw;
+    if (readFrames && sdlog::readResponse(rec, id, raw))
+        addSample(it, rec.ts_us, id, raw);
+
+    it.fTs.push_back(rec.ts_us);
+    it.fId.push_back(rec.can_id);
+    it.fFlags.push_back((rec.extd ? SDCOL_FRAME_EXTD : 0) |
+                        (rec.type == REC_SNIFF ? SDCOL_FRAME_SNIFF : 0));
+    it.fDlc.push_back(rec.dlc);
+    uint8_t data[8] = {};
+    memcpy(data, rec.data, rec.dlc < 8 ? rec.dlc : 8);
+    it.fData.insert(it.fData.end(), data, data + 8);
+}
+
+static void decodeCalib(const sdlog::Record& rec, ExportItem& it)
+{
+    SdlogCalEntry ce;
+    for (size_t e = 0; sdlog::calibEntry(rec, e, ce); e++) {
+        if (ce.id < BriterEncoder::FIRST_ID || ce.id > BriterEncoder::LAST_ID)
+            continue;
+        CalChange c;
+        c.row = it.sTs.size();
+        c.ch = ce.id - BriterEncoder::FIRST_ID;
+        c.cal.scale_q16 = ce.scale_q16;
+        c.cal.offset    = ce.offset;
+        c.cal.wrap_at   = ce.wrap_at;
+        c.cal.wrap_span = ce.wrap_span;
+        c.cal.invert    = (ce.flags & SDLOG_CAL_INVERT) != 0;
+        it.cal.push_back(c);
+    }
+}
+
+static void decodeItem(const sdlog::LogFile& log, ExportItem& it)
+{
+    sdlog::Slice slice;
+    sdlog::Reader r;
+    if (!log.mapPoints(it.first, it.last, slice) || !slice.reader(r)) {
+        it.damaged = true;
+        return;
+    }
+    it.bytes = slice.size();
+
+    // Up to four samples per 34 byte sensor frame: reserve once instead of regrowing
+    if (log.version() >= 0x04) {
+        const size_t rows = slice.size() / 8;
+        it.sTs.reserve(rows);
+        it.sId.reserve(rows);
+        it.sRaw.reserve(rows);
+    }
+
+    // Delta-coded CAN records have absolute time only after a REC_TIMESYNC
+    bool synced = log.version() == 0x01;
+    const bool readFrames = log.version() < 0x04;
+    sdlog::Record rec;
+
+    while (r.next(rec)) {
+        switch (rec.type) {
+        case REC_SENSORS: {
+            SdlogSensorRecord f;
+            memcpy(&f, rec.raw, sizeof(f));
+            for (unsigned c = 0; c < CHANNELS; c++)
+                if (f.valid & (1u << c))
+                    addSample(it, f.ts_us + f.dt_us[c], (uint8_t)(BriterEncoder::FIRST_ID + c), f.raw[c]);
+            break;
+        }
+        case REC_VEHICLE:
+        case REC_SNIFF:
+            if (synced)
+                addFrame(it, rec, readFrames);
+            break;
+        case REC_TIMESYNC:
+            synced = true;
+            break;
+        case REC_CALIB:
+            decodeCalib(rec, it);
+            break;
+        default:
+            break;
+        }
+    }
+    if (r.error())
+        it.damaged = true;
+}
+
+// Calibrated positions, with the calibration carried in and changed along the way
+static void calibrateItem(ExportItem& it)
+{
+    EncoderCal cal[CHANNELS];
+    memcpy(cal, it.calIn, sizeof(cal));
+
+    const size_t n = it.sTs.size();
+    it.sPos.resize(n);
+    size_t next = 0;
+    for (size_t i = 0; i < n; i++) {
+        for (; next < it.cal.size() && it.cal[next].row <= i; next++)
+            cal[it.cal[next].ch] = it.cal[next].cal;
+        it.sPos[i] = calibrationApply(cal[it.sId[i] - BriterEncoder::FIRST_ID], it.sRaw[i]);
+    }
+}
+
+/* =========================
+ *  CSV
+ * ========================= */
+
+static char* putU64(char* p, uint64_t v)
+{
+    char tmp[20];
+    int n = 0;
+    do {
+        tmp[n++] = (char)('0' + v % 10);
+        v /= 10;
+    } while (v);
+    while (n)
+        *p++ = tmp[--n];
+    return p;
+}
+
+static char* putHex(char* p, uint32_t v, int digits)
+{
+    static const char hex[] = "0123456789ABCDEF";
+    for (int d = digits - 1; d >= 0; d--)
+        *p++ = hex[(v >> (4 * d)) & 0xF];
+    return p;
+}
+
+// Micrometres as millimetres with three decimals
+static char* putMm(char* p, int32_t um)
+{
+    uint32_t a = um < 0 ? (uint32_t)(-(int64_t)um) : (uint32_t)um;
+    if (um < 0)
+        *p++ = '-';
+    p = putU64(p, a / 1000);
+    *p++ = '.';
+    a %= 1000;
+    *p++ = (char)('0' + a / 100);
+    *p++ = (char)('0' + a / 10 % 10);
+    *p++ = (char)('0' + a % 10);
+    return p;
+}
+
+static void formatItem(ExportItem& it)
+{
+    char line[96];
+
+    it.csvFrames.clear();
+    it.csvFrames.reserve(it.fTs.size() * 48);
+    for (size_t i = 0; i < it.fTs.size(); i++) {
+        const bool extd = it.fFlags[i] & SDCOL_FRAME_EXTD;
+        const char* type = it.fFlags[i] & SDCOL_FRAME_SNIFF ? ",sniff," : ",vehicle,";
+        char* p = putU64(line, it.fTs[i]);
+        const size_t len = strlen(type);
+        memcpy(p, type, len);
+        p += len;
+        p = putHex(p, it.fId[i], extd ? 8 : 3);
+        *p++ = ',';
+        *p++ = extd ? '1' : '0';
+        *p++ = ',';
+        p = putU64(p, it.fDlc[i]);
+        *p++ = ',';
+        for (uint8_t b = 0; b < it.fDlc[i] && b < 8; b++)
+            p = putHex(p, it.fData[i * 8 + b], 2);
+        *p++ = '\n';
+        it.csvFrames.append(line, p - line);
+    }
+
+    it.csvSamples.clear();
+    it.csvSamples.reserve(it.sTs.size() * 32);
+    for (size_t i = 0; i < it.sTs.size(); i++) {
+        char* p = putU64(line, it.sTs[i]);
+        *p++ = ',';
+        p = putU64(p, it.sId[i]);
+        *p++ = ',';
+        if (it.sRaw[i] < 0)
+            *p++ = '-';
+        p = putU64(p, it.sRaw[i] < 0 ? (uint64_t)(-(int64_t)it.sRaw[i]) : (uint64_t)it.sRaw[i]);
+        *p++ = ',';
+        p = putMm(p, it.sPos[i]);
+        *p++ = '\n';
+        it.csvSamples.append(line, p - line);
+    }
+}
+
+/* =========================
+ *  OUTPUT
+ * ========================= */
+
+struct Column {
+    const char* name;
+    SdcolType   type;
+    uint8_t     width;
+    bool        frames;         // frame table, else sample table
+};
+
+static const Column COLUMNS[] = {
+    { "frame_ts_us",  SDCOL_U64, 1, true  },
+    { "frame_can_id", SDCOL_U32, 1, true  },
+    { "frame_flags",  SDCOL_U8,  1, true  },
+    { "frame_dlc",    SDCOL_U8,  1, true  },
+    { "frame_data",   SDCOL_U8,  8, true  },
+    { "sample_ts_us", SDCOL_U64, 1, false },
+    { "sample_id",    SDCOL_U8,  1, false },
+    { "sample_raw",   SDCOL_I32, 1, false },
+    { "sample_pos_um", SDCOL_I32, 1, false },
+};
+static const size_t NUM_COLUMNS = sizeof(COLUMNS) / sizeof(COLUMNS[0]);
+
+static size_t typeSize(SdcolType t)
+{
+    switch (t) {
+    case SDCOL_U64: return 8;
+    case SDCOL_I32:
+    case SDCOL_U32: return 4;
+    default:        return 1;
+    }
+}
+
+// Column k of an item: its rows as bytes
+static const void* columnData(const ExportItem& it, size_t k, size_t* rows)
+{
+    *rows = COLUMNS[k].frames ? it.fTs.size() : it.sTs.size();
+    switch (k) {
+    case 0: return it.fTs.data();
+    case 1: return it.fId.data();
+    case 2: return it.fFlags.data();
+    case 3: return it.fDlc.data();
+    case 4: return it.fData.data();
+    case 5: return it.sTs.data();
+    case 6: return it.sId.data();
+    case 7: return it.sRaw.data();
+    default: return it.sPos.data();
+    }
+}
+
+static bool writeAt(int fd, const void* data, size_t len, uint64_t offset)
+{
+    const uint8_t* p = static_cast<const uint8_t*>(data);
+    while (len > 0) {
+        const ssize_t n = pwrite(fd, p, len, (off_t)offset);
+        if (n < 0 && errno == EINTR)
+            continue;
+        if (n <= 0)
+            return false;
+        p += n;
+        len -= (size_t)n;
+        offset += (uint64_t)n;
+    }
+    return true;
+}
+
+static void release(ExportItem& it)
+{
+    ExportItem done;
+    done.file = it.file;
+    done.first = it.first;
+    done.last = it.last;
+    std::swap(it, done);
+}
+
+int main(int argc, char** argv)
+{
+    ExportOptions opt;
+    if (!parseArgs(argc, argv, opt)) {
+        usage();
+        return 2;
+    }
+
+    const auto t0 = Clock::now();
+    sdlog::ThreadPool pool(opt.threads);
+
+    // Open everything first: a missing file is an error, not a gap
+    std::vector<std::unique_ptr<sdlog::LogFile>> logs(opt.paths.size());
+    std::atomic<bool> openFailed{false};
+    pool.run(opt.paths.size(), [&](size_t f, unsigned) {
+        logs[f].reset(new sdlog::LogFile());
+        if (!logs[f]->open(opt.paths[f].c_str())) {
+            fprintf(stderr, "%s: %s\n", opt.paths[f].c_str(), logs[f]->errorText());
+            openFailed = true;
+        }
+    });
+    if (openFailed)
+        return 1;
+
+    std::vector<ExportItem> items;
+    for (size_t f = 0; f < logs.size(); f++) {
+        const std::vector<sdlog::SeekPoint>& pts = logs[f]->seekPoints();
+        size_t first = 0;
+        for (size_t p = 1; p <= pts.size(); p++) {
+            const uint64_t end = p < pts.size() ? pts[p].offset : logs[f]->dataEnd();
+            if (p == pts.size() || end - pts[first].offset >= opt.chunkBytes) {
+                items.emplace_back();
+                items.back().file = f;
+                items.back().first = first;
+                items.back().last = p;
+                first = p;
+            }
+        }
+    }
+
+    if (mkdir(opt.out.c_str(), 0755) != 0 && errno != EEXIST) {
+        fprintf(stderr, "%s: %s\n", opt.out.c_str(), strerror(errno));
+        return 1;
+    }
+
+    // Output files; column data starts after the header, written last
+    std::vector<std::string> names;
+    if (opt.csv) {
+        names = { "frames.csv", "samples.csv" };
+    } else {
+        for (const Column& c : COLUMNS)
+            names.push_back(std::string(c.name) + ".col");
+    }
+    std::vector<int> fds;
+    for (const std::string& n : names) {
+        const std::string path = opt.out + "/" + n;
+        const int fd = ::open(path.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+        if (fd < 0) {
+            fprintf(stderr, "%s: %s\n", path.c_str(), strerror(errno));
+            return 1;
+        }
+        fds.push_back(fd);
+    }
+
+    static const char FRAMES_CSV[] = "ts_us,type,can_id,extd,dlc,data\n";
+    static const char SAMPLES_CSV[] = "ts_us,id,raw,pos_mm\n";
+    uint64_t at[2] = {};        // frames, samples: CSV next byte, else next row
+    if (opt.csv) {
+        writeAt(fds[0], FRAMES_CSV, sizeof(FRAMES_CSV) - 1, 0);
+        writeAt(fds[1], SAMPLES_CSV, sizeof(SAMPLES_CSV) - 1, 0);
+        at[0] = sizeof(FRAMES_CSV) - 1;
+        at[1] = sizeof(SAMPLES_CSV) - 1;
+    }
+
+    EncoderCal cal[CHANNELS];
+    uint64_t streamBytes = 0, frames = 0, samples = 0;
+    uint32_t damaged = 0;
+    std::atomic<bool> writeFailed{false};
+    double decodeS = 0.0, writeS = 0.0;
+
+    const size_t batch = (size_t)pool.size() * BATCH_PER_THREAD;
+    for (size_t b0 = 0; b0 < items.size(); b0 += batch) {
+        const size_t b1 = std::min(items.size(), b0 + batch);
+
+        const auto d0 = Clock::now();
+        pool.run(b1 - b0, [&](size_t i, unsigned) {
+            ExportItem& it = items[b0 + i];
+            decodeItem(*logs[it.file], it);
+        });
+
+        // Calibration in effect at each item (from the file start on)
+        for (size_t i = b0; i < b1; i++) {
+            ExportItem& it = items[i];
+            if (it.first == 0)
+                for (unsigned c = 0; c < CHANNELS; c++)
+                    defaultCal(cal[c]);
+            memcpy(it.calIn, cal, sizeof(cal));
+            for (const CalChange& c : it.cal)
+                cal[c.ch] = c.cal;
+        }
+
+        pool.run(b1 - b0, [&](size_t i, unsigned) {
+            ExportItem& it = items[b0 + i];
+            calibrateItem(it);
+            if (opt.csv)
+                formatItem(it);
+        });
+        decodeS += std::chrono::duration<double>(Clock::now() - d0).count();
+
+        // Every item's place in the output
+        for (size_t i = b0; i < b1; i++) {
+            ExportItem& it = items[i];
+            it.frameAt = at[0];
+            it.sampleAt = at[1];
+            at[0] += opt.csv ? it.csvFrames.size() : it.fTs.size();
+            at[1] += opt.csv ? it.csvSamples.size() : it.sTs.size();
+            streamBytes += it.bytes;
+            frames += it.fTs.size();
+            samples += it.sTs.size();
+            damaged += it.damaged;
+        }
+
+        const auto w0 = Clock::now();
+        const size_t perItem = fds.size();
+        pool.run((b1 - b0) * perItem, [&](size_t i, unsigned) {
+            const ExportItem& it = items[b0 + i / perItem];
+            const size_t k = i % perItem;
+            bool ok;
+            if (opt.csv) {
+                const std::string& s = k == 0 ? it.csvFrames : it.csvSamples;
+                ok = writeAt(fds[k], s.data(), s.size(), k == 0 ? it.frameAt : it.sampleAt);
+            } else {
+                size_t rows;
+                const void* data = columnData(it, k, &rows);
+                const size_t row = typeSize(COLUMNS[k].type) * COLUMNS[k].width;
+                const uint64_t first = COLUMNS[k].frames ? it.frameAt : it.sampleAt;
+                ok = writeAt(fds[k], data, rows * row, SDCOL_HEADER_SIZE + first * row);
+            }
+            if (!ok)
+                writeFailed = true;
+        });
+        writeS += std::chrono::duration<double>(Clock::now() - w0).count();
+
+        for (size_t i = b0; i < b1; i++)
+            release(items[i]);
+    }
+
+    uint64_t outBytes = 0;
+    for (size_t k = 0; k < fds.size(); k++) {
+        if (!opt.csv) {
+            SdcolHeader h = {};
+            memcpy(h.magic, SDCOL_MAGIC, 4);
+            h.version = SDCOL_VERSION;
+            h.type = COLUMNS[k].type;
+            h.width = COLUMNS[k].width;
+            h.log_version = logs.empty() ? 0 : logs[0]->version();
+            h.rows = COLUMNS[k].frames ? frames : samples;
+            strncpy(h.name, COLUMNS[k].name, sizeof(h.name) - 1);
+            if (!writeAt(fds[k], &h, sizeof(h), 0))
+                writeFailed = true;
+        }
+        struct stat st;
+        if (fstat(fds[k], &st) == 0)
+            outBytes += (uint64_t)st.st_size;
+        if (::close(fds[k]) != 0)
+            writeFailed = true;
+    }
+    if (writeFailed) {
+        fprintf(stderr, "%s: write failed\n", opt.out.c_str());
+        return 1;
+    }
+
+    const double totalS = std::chrono::duration<double>(Clock::now() - t0).count();
+    printf("files           : %zu, %llu stream bytes in %zu work items, %u threads\n",
+           logs.size(), (unsigned long long)streamBytes, items.size(), pool.size());
+    if (damaged)
+        printf("damaged         : %u work items stopped early (see sdlog_recover)\n", damaged);
+    printf("rows            : %llu frames, %llu samples\n",
+           (unsigned long long)frames, (unsigned long long)samples);
+    printf("output          : %s/ (%s), %llu bytes\n", opt.out.c_str(),
+           opt.csv ? "CSV" : "column files", (unsigned long long)outBytes);
+    printf("time            : %.3f s (decode %.3f s, write %.3f s), %.1f MB/s in, %.1f MB/s out\n",
+           totalS, decodeS, writeS, streamBytes / 1e6 / totalS, outBytes / 1e6 / totalS);
+    return 0;
+}
@@ -0,0 +1,370 @@
+#include "sdlog_index.h"
+#include "sdlog_chunk.h"
+#include "sdlog.h"
+
+#include <fcntl.h>
+#include <stddef.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <algorithm>
+
+namespace sdlog {
+
+static const size_t HEADER_SIZE = 5;   // "SDLG" + version
+
+/* =========================
+ *  SLICE
+ * ========================= */
+
+Slice::~Slice()
+{
+    release();
+}
+
+void Slice::release()
+{
+    if (map_ != nullptr)
+        munmap(map_, mapLen_);
+    map_ = nullptr;
+    mapLen_ = 0;
+    copy_.clear();
+    data_ = nullptr;
+    len_ = 0;
+}
+
+bool Slice::reader(Reader& r) const
+{
+    return r.openAt(data_, len_, version_);
+}
+
+/* =========================
+ *  LOG FILE
+ * ========================= */
+
+LogFile::~LogFile()
+{
+    close();
+}
+
+void LogFile::close()
+{
+    if (fd_ >= 0)
+        ::close(fd_);
+    fd_ = -1;
+    size_ = dataEnd_ = streamLen_ = 0;
+    version_ = 0;
+    chunked_ = false;
+    compressed_ = false;
+    fileId_ = 0;
+    footer_ = false;
+    points_.clear();
+}
+
+bool LogFile::fail(const char* why)
+{
+    errorText_ = why;
+    return false;
+}
+
+bool LogFile::open(const char* path)
+{
+    close();
+    errorText_ = "";
+
+    fd_ = ::open(path, O_RDONLY);
+    if (fd_ < 0)
+        return fail("cannot open file");
+
+    struct stat st;
+    if (fstat(fd_, &st) != 0)
+        return fail("cannot stat file");
+    size_ = streamLen_ = (uint64_t)st.st_size;
+
+    uint8_t first[SDLOG_CHUNK_SIZE];
+    const size_t firstLen = size_ < sizeof(first) ? (size_t)size_ : sizeof(first);
+    if (pread(fd_, first, firstLen, 0) != (ssize_t)firstLen)
+        return fail("cannot read file");
+
+    // v5+: the stream header is in the first chunk
+    const uint8_t* hdr = first;
+    std::vector<uint8_t> firstData;
+    if (isChunked(first, firstLen)) {
+        uint64_t start;
+        if (!chunkData(first, firstLen, 0, &fileId_, firstData, &start) ||
+            start != 0 || firstData.size() < HEADER_SIZE)
+            return fail("first chunk damaged (try sdlog_recover)");
+        hdr = firstData.data();
+        chunked_ = true;
+        compressed_ = first[offsetof(SdlogChunkHeader, codec)] != SDLOG_CODEC_NONE;
+        streamLen_ = compressed_ ? blockStreamLength() : chunkStreamLength(size_);
+    }
+    dataEnd_ = streamLen_;
+
+    if (streamLen_ < HEADER_SIZE || memcmp(hdr, "SDLG", 4) != 0)
+        return fail("bad magic");
+
+    version_ = hdr[4];
+    if (version_ < 0x01 || version_ > 0x06)
+        return fail("unsupported SDLOG_VERSION");
+
+    points_.push_back({ 0, HEADER_SIZE });
+
+    if (version_ >= 0x04 && readFooter())
+        return true;
+
+    return scanSeekPoints();
+}
+
+/*
+ * REC_INDEX_TABLE, located through the trailer in the last 8 bytes of
+ * the stream (the end of the file, unless compressed).
+ */
+bool LogFile::readFooter()
+{
+    SdlogIndexTrailer trailer;
+    if (streamLen_ < HEADER_SIZE + sizeof(trailer))
+        return false;
+
+    if (chunked_) {
+        std::vector<uint8_t> tail;
+        if (!readChunks(streamLen_ - sizeof(trailer), streamLen_, tail))
+            return false;
+        memcpy(&trailer, tail.data(), sizeof(trailer));
+    } else if (pread(fd_, &trailer, sizeof(trailer), size_ - sizeof(trailer)) != (ssize_t)sizeof(trailer)) {
+        return false;
+    }
+
+    if (memcmp(trailer.magic, SDLOG_INDEX_MAGIC, 4) != 0 ||
+        trailer.table_offset < HEADER_SIZE || trailer.table_offset >= streamLen_)
+        return false;
+
+    const size_t len = (size_t)(streamLen_ - trailer.table_offset);
+    std::vector<uint8_t> buf(len);
+    if (chunked_) {
+        if (!readChunks(trailer.table_offset, streamLen_, buf))
+            return false;
+    } else if (pread(fd_, buf.data(), len, trailer.table_offset) != (ssize_t)len) {
+        return false;
+    }
+
+    uint16_t payloadLen;
+    memcpy(&payloadLen, &buf[1], 2);
+    if (buf[0] != REC_INDEX_TABLE || SDLOG_LP_HEADER_SIZE + (size_t)payloadLen != len ||
+        payloadLen < sizeof(SdlogIndexTableHeader) + sizeof(trailer))
+        return false;
+
+    SdlogIndexTableHeader h;
+    memcpy(&h, &buf[SDLOG_LP_HEADER_SIZE], sizeof(h));
+    if (sizeof(h) + h.entries * sizeof(SdlogIndexEntry) + sizeof(trailer) != payloadLen)
+        return false;
+
+    const uint8_t* p = &buf[SDLOG_LP_HEADER_SIZE + sizeof(h)];
+    for (uint16_t i = 0; i < h.entries; i++, p += sizeof(SdlogIndexEntry)) {
+        SdlogIndexEntry e;
+        memcpy(&e, p, sizeof(e));
+        if (e.offset <= points_.back().offset || e.offset >= trailer.table_offset)
+            return false;
+        points_.push_back({ e.ts_us, e.offset });
+    }
+
+    dataEnd_ = trailer.table_offset;
+    footer_ = true;
+    return true;
+}
+
+/*
+ * No footer: decode the whole file once and collect REC_INDEX records.
+ * Stops quietly at a damaged or truncated tail.
+ */
+bool LogFile::scanSeekPoints()
+{
+    points_.resize(1);
+
+    Slice all;
+    if (!mapBytes(0, streamLen_, all))
+        return fail("cannot read file");
+
+    Reader r;
+    if (!r.open(all.data(), all.size()))
+        return fail(r.errorText());
+
+    Record rec;
+    while (r.next(rec)) {
+        if (rec.type != REC_INDEX || rec.payload_len < sizeof(SdlogIndexRecord))
+            continue;
+
+        SdlogIndexRecord idx;
+        memcpy(&idx, rec.payload, sizeof(idx));
+        points_.push_back({ idx.ts_us, (uint64_t)(rec.raw - all.data()) });
+    }
+
+    return true;
+}
+
+size_t LogFile::find(uint64_t tsUs) const
+{
+    // First seek point after tsUs, then one back
+    auto it = std::upper_bound(points_.begin() + 1, points_.end(), tsUs,
+                               [](uint64_t t, const SeekPoint& p) { return t < p.ts_us; });
+    return (size_t)(it - points_.begin()) - 1;
+}
+
+bool LogFile::map(uint64_t fromUs, uint64_t toUs, Slice& out) const
+{
+    if (fd_ < 0 || points_.empty())
+        return false;
+
+    fromUs = fromUs > SEEK_SLACK_US ? fromUs - SEEK_SLACK_US : 0;
+    toUs   = toUs + SEEK_SLACK_US;
+
+    const size_t first = find(fromUs);
+    size_t last = find(toUs) + 1;
+
+    const uint64_t start = points_[first].offset;
+    const uint64_t end   = last < points_.size() ? points_[last].offset : dataEnd_;
+
+    return mapBytes(start, end, out);
+}
+
+bool LogFile::mapPoints(size_t first, size_t last, Slice& out) const
+{
+    if (fd_ < 0 || first >= last || last > points_.size())
+        return false;
+
+    const uint64_t end = last < points_.size() ? points_[last].offset : dataEnd_;
+    return mapBytes(points_[first].offset, end, out);
+}
+
+/*
+ * Stream bytes [start, end) of a chunk framed file, one chunk read,
+ * checked and decoded at a time. Stops at the first chunk that does
+ * not count; out then holds what came before it.
+ */
+bool LogFile::readChunks(uint64_t start, uint64_t end, std::vector<uint8_t>& out) const
+{
+    out.clear();
+    out.reserve((size_t)(end - start));
+
+    uint8_t chunk[SDLOG_CHUNK_SIZE];
+    std::vector<uint8_t> data;
+    uint64_t seq = compressed_ ? findChunk(start) : start / SDLOG_CHUNK_PAYLOAD;
+
+    for (; start < end; seq++) {
+        const uint64_t off = seq * SDLOG_CHUNK_SIZE;
+        if (off >= size_)
+            return false;
+
+        const size_t n = (size_ - off < sizeof(chunk)) ? (size_t)(size_ - off) : sizeof(chunk);
+        if (pread(fd_, chunk, n, (off_t)off) != (ssize_t)n)
+            return false;
+
+        uint32_t id = fileId_;
+        uint64_t chunkStart;
+        if (!chunkData(chunk, n, seq, &id, data, &chunkStart))
+            return false;
+
+        const uint64_t chunkEnd = chunkStart + data.size();
+        const uint64_t to = end < chunkEnd ? end : chunkEnd;
+        if (start < chunkStart || start >= to)
+            return false;
+
+        out.insert(out.end(), data.begin() + (start - chunkStart), data.begin() + (to - chunkStart));
+        start = to;
+    }
+    return true;
+}
+
+// Stream extent of chunk seq from its headers, false if it is not this file's
+bool LogFile::blockOffset(uint64_t seq, uint64_t* start, uint32_t* len) const
+{
+    uint8_t head[sizeof(SdlogChunkHeader) + sizeof(SdlogBlockHeader)];
+    const uint64_t off = seq * SDLOG_CHUNK_SIZE;
+    if (off >= size_)
+        return false;
+
+    const size_t n = (size_ - off < sizeof(head)) ? (size_t)(size_ - off) : sizeof(head);
+    if (pread(fd_, head, n, (off_t)off) != (ssize_t)n)
+        return false;
+    return chunkExtent(head, n, seq, fileId_, start, len);
+}
+
+/*
+ * Compressed file: the last chunk whose block starts at or before
+ * streamOffset. Block offsets ascend with seq; chunks that are not
+ * this file's (damaged, unwritten) are stepped over.
+ */
+uint64_t LogFile::findChunk(uint64_t streamOffset) const
+{
+    uint64_t lo = 0;
+    uint64_t hi = (size_ - 1) / SDLOG_CHUNK_SIZE;
+
+    while (lo < hi) {
+        const uint64_t mid = lo + (hi - lo + 1) / 2;
+        uint64_t k = mid, start = 0;
+        uint32_t len;
+        while (k <= hi && !blockOffset(k, &start, &len))
+            k++;
+
+        if (k > hi || start > streamOffset)
+            hi = mid - 1;
+        else
+            lo = k;
+    }
+    return lo;
+}
+
+/*
+ * Compressed file: end of the last block that is this file's. After a
+ * power cut the preallocated tail is unwritten, so search backwards.
+ */
+uint64_t LogFile::blockStreamLength() const
+{
+    for (uint64_t seq = (size_ - 1) / SDLOG_CHUNK_SIZE + 1; seq-- > 0;) {
+        uint64_t start;
+        uint32_t len;
+        if (blockOffset(seq, &start, &len))
+            return start + len;
+    }
+    return 0;
+}
+
+bool LogFile::mapBytes(uint64_t start, uint64_t end, Slice& out) const
+{
+    out.release();
+
+    if (start >= end || end > streamLen_)
+        return false;
+
+    if (chunked_) {
+        // Up to the first damaged chunk; the reader ends there
+        readChunks(start, end, out.copy_);
+        if (out.copy_.empty())
+            return false;
+        out.data_    = out.copy_.data();
+        out.len_     = out.copy_.size();
+        out.offset_  = start;
+        out.version_ = version_;
+        return true;
+    }
+
+    static const uint64_t page = (uint64_t)sysconf(_SC_PAGESIZE);
+    const uint64_t mapStart = start & ~(page - 1);
+    const size_t mapLen = (size_t)(end - mapStart);
+
+    void* m = mmap(nullptr, mapLen, PROT_READ, MAP_PRIVATE, fd_, (off_t)mapStart);
+    if (m == MAP_FAILED)
+        return false;
+
+    out.map_     = m;
+    out.mapLen_  = mapLen;
+    out.data_    = static_cast<const uint8_t*>(m) + (start - mapStart);
+    out.len_     = (size_t)(end - start);
+    out.offset_  = start;
+    out.version_ = version_;
+    return true;
+}
+
+} // namespace sdlog
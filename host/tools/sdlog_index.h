@@ -0,0 +1,146 @@
+#pragma once
+
+/*
+ * Seekable access to SD log files.
+ *
+ * Opening a file reads only its header and the footer index
+ * (REC_INDEX_TABLE, see sdlog.h). Files without a footer (power loss,
+ * older firmware) are scanned once for REC_INDEX seek points instead.
+ * A time range is then found by binary search over the seek points and
+ * only the bytes between the two surrounding seek points are mapped.
+ * Chunk framed files (v5+, sdlog_chunk.h) are read chunk by chunk
+ * instead and every chunk's CRC is checked; offsets are always stream
+ * offsets. In compressed files (v6+) the chunks of a range are found
+ * by binary search over their block offsets and decoded one by one.
+ *
+ *   sdlog::LogFile log;
+ *   sdlog::Slice   slice;
+ *   if (log.open("LOG_0003.BIN") && log.map(from_us, to_us, slice)) {
+ *       sdlog::Reader r;
+ *       slice.reader(r);
+ *       while (r.next(rec)) ...     // records in and around the range
+ *   }
+ */
+
+#include "sdlog_reader.h"
+
+#include <stdint.h>
+#include <stddef.h>
+#include <vector>
+
+namespace sdlog {
+
+/*
+ * SEEK_SLACK_US
+ *
+ * Record timestamps are not strictly ordered in the file (a
+ * REC_SENSORS frame carries the time of its first sample and is
+ * logged when its last one arrives), so ranges are widened by this
+ * much before picking seek points.
+ */
+static const uint64_t SEEK_SLACK_US = 10000;
+
+struct SeekPoint {
+    uint64_t ts_us;
+    uint64_t offset;        // record boundary, decodable from here
+};
+
+/*
+ * A read-only window of a log's record stream, starting at a seek
+ * point: mapped from the file, or a copy of the chunk payloads for
+ * chunk framed files. Released when destroyed.
+ */
+class Slice {
+public:
+    Slice() = default;
+    ~Slice();
+    Slice(const Slice&) = delete;
+    Slice& operator=(const Slice&) = delete;
+
+    const uint8_t* data() const { return data_; }
+    size_t   size() const { return len_; }
+    uint64_t offset() const { return offset_; }     // stream offset of data()
+
+    // Reader positioned at the start of the slice
+    bool reader(Reader& r) const;
+
+private:
+    friend class LogFile;
+    void release();
+
+    void*    map_ = nullptr;
+    size_t   mapLen_ = 0;
+    std::vector<uint8_t> copy_;
+    const uint8_t* data_ = nullptr;
+    size_t   len_ = 0;
+    uint64_t offset_ = 0;
+    uint8_t  version_ = 0;
+};
+
+class LogFile {
+public:
+    LogFile() = default;
+    ~LogFile();
+    LogFile(const LogFile&) = delete;
+    LogFile& operator=(const LogFile&) = delete;
+
+    bool open(const char* path);
+    void close();
+
+    uint8_t  version() const { return version_; }
+    uint64_t size() const { return size_; }                 // file bytes
+    bool     chunked() const { return chunked_; }
+    bool     compressed() const { return compressed_; }
+    uint64_t streamLength() const { return streamLen_; }
+    bool     hasFooter() const { return footer_; }
+    uint64_t dataEnd() const { return dataEnd_; }   // footer offset, or stream end
+
+    /*
+     * Seek points in file order. The first one is always the first
+     * record after the file header (ts_us 0).
+     */
+    const std::vector<SeekPoint>& seekPoints() const { return points_; }
+
+    // Index of the last seek point at or before tsUs
+    size_t find(uint64_t tsUs) const;
+
+    /*
+     * Map the part of the file holding all records from fromUs to toUs
+     * (plus up to one seek interval on either side).
+     */
+    bool map(uint64_t fromUs, uint64_t toUs, Slice& out) const;
+
+    /*
+     * Map the records from seek point first up to seek point last
+     * (exclusive; seekPoints().size() = to the end of the data). Slices
+     * of disjoint point ranges decode independently, and may be mapped
+     * from several threads at once.
+     */
+    bool mapPoints(size_t first, size_t last, Slice& out) const;
+
+    const char* errorText() const { return errorText_; }
+
+private:
+    bool fail(const char* why);
+    bool mapBytes(uint64_t start, uint64_t end, Slice& out) const;
+    bool readChunks(uint64_t start, uint64_t end, std::vector<uint8_t>& out) const;
+    bool blockOffset(uint64_t seq, uint64_t* start, uint32_t* len) const;
+    uint64_t findChunk(uint64_t streamOffset) const;
+    uint64_t blockStreamLength() const;
+    bool readFooter();
+    bool scanSeekPoints();
+
+    int      fd_ = -1;
+    uint64_t size_ = 0;
+    uint64_t dataEnd_ = 0;
+    uint64_t streamLen_ = 0;
+    uint8_t  version_ = 0;
+    bool     chunked_ = false;
+    bool     compressed_ = false;
+    uint32_t fileId_ = 0;
+    bool     footer_ = false;
+    std::vector<SeekPoint> points_;
+    const char* errorText_ = "";
+};
+
+} // namespace sdlog
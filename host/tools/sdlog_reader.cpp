@@ -0,0 +1,232 @@
+#include "sdlog_reader.h"
+#include "sdlog.h"
+#include "BriterEncoder.h"
+
+#include <string.h>
+
+namespace sdlog {
+
+static const size_t HEADER_SIZE = 5;   // "SDLG" + version
+
+bool Reader::open(const uint8_t* data, size_t len)
+{
+    data_ = data;
+    len_ = len;
+    pos_ = 0;
+    lastTsUs_ = 0;
+    error_ = false;
+    errorText_ = "";
+
+    if (len < HEADER_SIZE || memcmp(data, "SDLG", 4) != 0)
+        return fail("bad magic");
+
+    version_ = data[4];
+    if (version_ < 0x01 || version_ > 0x06)
+        return fail("unsupported SDLOG_VERSION");
+
+    pos_ = HEADER_SIZE;
+    return true;
+}
+
+bool Reader::openAt(const uint8_t* data, size_t len, uint8_t version)
+{
+    data_ = data;
+    len_ = len;
+    pos_ = 0;
+    lastTsUs_ = 0;
+    error_ = false;
+    errorText_ = "";
+    version_ = version;
+
+    if (version_ < 0x01 || version_ > 0x06)
+        return fail("unsupported SDLOG_VERSION");
+    return true;
+}
+
+bool Reader::fail(const char* why)
+{
+    error_ = true;
+    errorText_ = why;
+    return false;
+}
+
+bool Reader::next(Record& rec)
+{
+    if (error_ || pos_ >= len_)
+        return false;
+
+    return (version_ == 0x01) ? nextV1(rec) : nextV2(rec);
+}
+
+/*
+ * v1: fixed 22-byte CAN records with absolute timestamps.
+ */
+bool Reader::nextV1(Record& rec)
+{
+    const uint8_t type = data_[pos_];
+    if (type != REC_SNIFF && type != REC_VEHICLE)
+        return fail("unknown v1 record type");
+
+    if (len_ - pos_ < sizeof(SdlogSniffRecord))
+        return false;   // truncated tail
+
+    SdlogSniffRecord r;
+    memcpy(&r, data_ + pos_, sizeof(r));
+
+    rec.type    = r.type;
+    rec.ts_us   = r.ts_us;
+    rec.can_id  = r.can_id;
+    rec.extd    = r.can_id > 0x7FF;
+    rec.dlc     = r.dlc > 8 ? 8 : r.dlc;
+    memcpy(rec.data, r.data, 8);
+    rec.raw     = data_ + pos_;
+    rec.raw_len = sizeof(r);
+
+    pos_ += sizeof(r);
+    lastTsUs_ = rec.ts_us;
+    return true;
+}
+
+/*
+ * v2: variable-length records, delta timestamps (see sdlog.h).
+ * v3: same, plus length-prefixed record types.
+ * v4: same, plus fixed-size REC_SENSORS frames.
+ */
+bool Reader::nextV2(Record& rec)
+{
+    const uint8_t* p   = data_ + pos_;
+    const uint8_t* end = data_ + len_;
+    const uint8_t type = *p;
+
+    rec = {};
+    rec.type = type;
+    rec.raw  = p;
+
+    if (type == REC_TIMESYNC) {
+        if ((size_t)(end - p) < sizeof(SdlogTimeSyncRecord))
+            return false;
+
+        SdlogTimeSyncRecord sync;
+        memcpy(&sync, p, sizeof(sync));
+
+        rec.ts_us   = lastTsUs_ = sync.ts_us;
+        rec.raw_len = sizeof(sync);
+        pos_ += sizeof(sync);
+        return true;
+    }
+
+    if (version_ >= 0x04 && type == REC_SENSORS) {
+        if ((size_t)(end - p) < sizeof(SdlogSensorRecord))
+            return false;
+
+        // Absolute time, not part of the delta chain
+        SdlogSensorRecord frame;
+        memcpy(&frame, p, sizeof(frame));
+
+        rec.ts_us   = frame.ts_us;
+        rec.raw_len = sizeof(frame);
+        pos_ += sizeof(frame);
+        return true;
+    }
+
+    if (version_ >= 0x03 && type >= SDLOG_LP_FIRST_TYPE) {
+        if ((size_t)(end - p) < SDLOG_LP_HEADER_SIZE)
+            return false;
+
+        uint16_t len;
+        memcpy(&len, p + 1, 2);
+        if ((size_t)(end - p) < SDLOG_LP_HEADER_SIZE + (size_t)len)
+            return false;
+
+        rec.payload     = p + SDLOG_LP_HEADER_SIZE;
+        rec.payload_len = len;
+        rec.raw_len     = SDLOG_LP_HEADER_SIZE + len;
+        pos_ += rec.raw_len;
+        return true;
+    }
+
+    if (type != REC_SNIFF && type != REC_VEHICLE)
+        return fail("unknown v2 record type");
+
+    p++;
+    if (p >= end)
+        return false;
+
+    const uint8_t info = *p++;
+    rec.dlc  = info & SDLOG_INFO_DLC_MASK;
+    rec.extd = (info & SDLOG_INFO_EXTD) != 0;
+    if (rec.dlc > 8)
+        return fail("bad dlc");
+
+    uint64_t dt = 0;
+    for (unsigned shift = 0;; shift += 7) {
+        if (p >= end)
+            return false;
+        if (shift > 63)
+            return fail("bad varint");
+        uint8_t b = *p++;
+        dt |= (uint64_t)(b & 0x7F) << shift;
+        if (!(b & 0x80))
+            break;
+    }
+
+    const size_t idLen = rec.extd ? 4 : 2;
+    if ((size_t)(end - p) < idLen + rec.dlc)
+        return false;
+
+    if (rec.extd) {
+        uint32_t id;
+        memcpy(&id, p, 4);
+        rec.can_id = id;
+    } else {
+        uint16_t id;
+        memcpy(&id, p, 2);
+        rec.can_id = id;
+    }
+    p += idLen;
+
+    memcpy(rec.data, p, rec.dlc);
+    p += rec.dlc;
+
+    rec.ts_us   = lastTsUs_ + dt;
+    rec.raw_len = (size_t)(p - rec.raw);
+
+    lastTsUs_ = rec.ts_us;
+    pos_ += rec.raw_len;
+    return true;
+}
+
+/* =========================
+ *  ENCODER DATA
+ * ========================= */
+
+bool readResponse(const Record& rec, uint8_t& id, int32_t& raw)
+{
+    // Same frame check as BriterEncoder::isBriterMessage()
+    if (rec.type != REC_VEHICLE || rec.extd || rec.dlc != 7 || rec.data[0] != 0x07 ||
+        rec.data[1] != rec.can_id || rec.data[2] != BriterEncoder::FUNC_READ ||
+        rec.can_id < BriterEncoder::FIRST_ID || rec.can_id > BriterEncoder::LAST_ID)
+        return false;
+
+    id = (uint8_t)rec.can_id;
+    raw = (int32_t)((uint32_t)rec.data[3] | ((uint32_t)rec.data[4] << 8) |
+                    ((uint32_t)rec.data[5] << 16) | ((uint32_t)rec.data[6] << 24));
+    return true;
+}
+
+bool calibEntry(const Record& rec, size_t i, SdlogCalEntry& out)
+{
+    if (rec.type != REC_CALIB || rec.payload_len < sizeof(SdlogCalHeader))
+        return false;
+
+    SdlogCalHeader h;
+    memcpy(&h, rec.payload, sizeof(h));
+    const size_t pos = sizeof(h) + i * sizeof(SdlogCalEntry);
+    if (i >= h.encoders || pos + sizeof(SdlogCalEntry) > rec.payload_len)
+        return false;
+
+    memcpy(&out, rec.payload + pos, sizeof(out));
+    return true;
+}
+
+} // namespace sdlog
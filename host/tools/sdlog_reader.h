@@ -0,0 +1,88 @@
+#pragma once
+
+/*
+ * Host-side SD log decoder.
+ *
+ * Decodes the record stream of LOG_XXXX.BIN files written by sdlog for
+ * every SDLOG_VERSION this tree knows about. Works on an in-memory (or
+ * memory-mapped) byte range; never copies the file. Up to v4 the file is
+ * the stream; v5 files are chunk framed, see sdlog_chunk.h.
+ */
+
+#include "sdlog.h"
+
+#include <stdint.h>
+#include <stddef.h>
+
+namespace sdlog {
+
+struct Record {
+    uint8_t  type;          // SdlogRecordType
+    uint64_t ts_us;         // absolute, reconstructed for v2
+    uint32_t can_id;
+    bool     extd;
+    uint8_t  dlc;
+    uint8_t  data[8];
+
+    const uint8_t* raw;     // encoded record in the source buffer
+    size_t   raw_len;       // REC_SENSORS: raw is the SdlogSensorRecord
+
+    // Length-prefixed records (v3+, type >= SDLOG_LP_FIRST_TYPE)
+    const uint8_t* payload;
+    uint16_t payload_len;
+};
+
+class Reader {
+public:
+    /*
+     * Parse the file header. Returns false if the magic is wrong or the
+     * version is not supported.
+     */
+    bool open(const uint8_t* data, size_t len);
+
+    /*
+     * Start decoding mid-file: data begins at a seek point (REC_INDEX,
+     * see sdlog_index.h) of a file with the given version. Offsets are
+     * relative to data.
+     */
+    bool openAt(const uint8_t* data, size_t len, uint8_t version);
+
+    /*
+     * Decode the next record. Returns false at end of data or on a
+     * malformed record (see error()). Length-prefixed records of types
+     * this reader does not know are returned with only type / payload set.
+     */
+    bool next(Record& rec);
+
+    uint8_t version() const { return version_; }
+    size_t  offset() const { return pos_; }
+    bool    error() const { return error_; }
+    const char* errorText() const { return errorText_; }
+
+private:
+    bool fail(const char* why);
+    bool nextV1(Record& rec);
+    bool nextV2(Record& rec);
+
+    const uint8_t* data_ = nullptr;
+    size_t   len_ = 0;
+    size_t   pos_ = 0;
+    uint8_t  version_ = 0;
+    uint64_t lastTsUs_ = 0;
+    bool     error_ = false;
+    const char* errorText_ = "";
+};
+
+/*
+ * Encoder data in the record stream.
+ *
+ * readResponse(): an encoder READ response (BriterEncoder.h) logged as
+ * a REC_VEHICLE frame, which is how encoder values were logged up to
+ * v3 (v4+ logs REC_SENSORS). id is the encoder's CAN ID.
+ *
+ * calibEntry(): entry i of a REC_CALIB record, false past the last.
+ */
+bool readResponse(const Record& rec, uint8_t& id, int32_t& raw);
+bool calibEntry(const Record& rec, size_t i, SdlogCalEntry& out);
+
+} // namespace sdlog
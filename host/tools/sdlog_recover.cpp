@@ -0,0 +1,158 @@
+/*
+ * sdlog_recover - salvage a truncated or damaged SD log
+ *
+ * Checks every chunk of a chunk framed log (SDLOG_VERSION 5+, see
+ * sdlog_chunk.h), keeps the payload of the intact ones and writes every
+ * record that can still be decoded as a plain record stream ("SDLG"
+ * header, no chunks), which the other tools read like any log.
+ *
+ * After a gap, decoding resumes at the next REC_INDEX seek point (its
+ * offset field equals its own stream offset, so it cannot be mistaken);
+ * a record cut by the gap is dropped. With gaps the footer index is
+ * dropped as well, its offsets would no longer match.
+ *
+ *   sdlog_recover LOG_0007.BIN                  # report only
+ *   sdlog_recover LOG_0007.BIN LOG_0007.REC     # write what is left
+ */
+
+#include "sdlog_chunk.h"
+#include "sdlog_reader.h"
+#include "sdlog.h"
+
+#include <stdio.h>
+#include <string.h>
+
+#include <vector>
+
+static const size_t HEADER_SIZE = 5;   // "SDLG" + version
+
+static bool readFile(const char* path, std::vector<uint8_t>& out)
+{
+    FILE* fp = fopen(path, "rb");
+    if (!fp)
+        return false;
+
+    uint8_t buf[64 * 1024];
+    size_t n;
+    while ((n = fread(buf, 1, sizeof(buf), fp)) > 0)
+        out.insert(out.end(), buf, buf + n);
+    fclose(fp);
+    return true;
+}
+
+// First REC_INDEX in [from, to) that sits where its offset field says
+static bool findSeekPoint(const std::vector<uint8_t>& stream, uint64_t from, uint64_t to,
+                          uint64_t* at)
+{
+    const size_t recLen = SDLOG_LP_HEADER_SIZE + sizeof(SdlogIndexRecord);
+
+    for (uint64_t p = from; p + recLen <= to; p++) {
+        if (stream[p] != REC_INDEX)
+            continue;
+
+        uint16_t len;
+        SdlogIndexRecord idx;
+        memcpy(&len, &stream[p + 1], 2);
+        memcpy(&idx, &stream[p + SDLOG_LP_HEADER_SIZE], sizeof(idx));
+        if (len == sizeof(idx) && idx.offset == p) {
+            *at = p;
+            return true;
+        }
+    }
+    return false;
+}
+
+int main(int argc, char** argv)
+{
+    if (argc < 2 || argc > 3) {
+        fprintf(stderr, "usage: sdlog_recover <LOG.BIN> [out]\n");
+        return 2;
+    }
+
+    std::vector<uint8_t> file;
+    if (!readFile(argv[1], file)) {
+        fprintf(stderr, "%s: cannot read\n", argv[1]);
+        return 1;
+    }
+
+    std::vector<uint8_t> stream;
+    std::vector<sdlog::StreamRange> valid;
+    sdlog::ChunkStats st;
+    if (!sdlog::unchunk(file.data(), file.size(), stream, valid, st)) {
+        fprintf(stderr, "%s: no intact chunk (not chunk framed, SDLOG_VERSION < 5?)\n", argv[1]);
+        return 1;
+    }
+
+    const bool gaps = valid.size() > 1 || valid[0].start != 0;
+
+    printf("file            : %s, %zu bytes\n", argv[1], file.size());
+    printf("chunks          : %u intact, %u damaged, %u stale, %u unwritten (file id %08X)\n",
+           st.good, st.bad, st.foreign, st.empty, st.file_id);
+
+    std::vector<uint8_t> out;
+    uint8_t version = 0;
+    uint32_t records = 0, ranges = 0;
+    uint64_t lostBytes = 0, prevEnd = 0;
+
+    for (const sdlog::StreamRange& r : valid) {
+        if (r.start > prevEnd) {
+            printf("  lost          : stream %llu .. %llu\n",
+                   (unsigned long long)prevEnd, (unsigned long long)r.start);
+            lostBytes += r.start - prevEnd;
+        }
+        prevEnd = r.end;
+
+        uint64_t start;
+        if (r.start == 0) {
+            if (r.end < HEADER_SIZE || memcmp(stream.data(), "SDLG", 4) != 0) {
+                fprintf(stderr, "bad stream header\n");
+                return 1;
+            }
+            version = stream[4];
+            start = HEADER_SIZE;
+        } else if (!findSeekPoint(stream, r.start, r.end, &start)) {
+            lostBytes += r.end - r.start;
+            continue;
+        }
+
+        if (out.empty()) {
+            // Header chunk lost: records are this tree's format
+            if (version == 0)
+                version = SDLOG_VERSION;
+            const uint8_t hdr[HEADER_SIZE] = { 'S', 'D', 'L', 'G', version };
+            out.insert(out.end(), hdr, hdr + HEADER_SIZE);
+        }
+
+        sdlog::Reader reader;
+        reader.openAt(&stream[start], (size_t)(r.end - start), version);
+
+        size_t good = 0;
+        sdlog::Record rec;
+        while (reader.next(rec)) {
+            if (gaps && rec.type == REC_INDEX_TABLE)
+                break;
+            good = reader.offset();
+            records++;
+        }
+
+        out.insert(out.end(), &stream[start], &stream[start] + good);
+        lostBytes += (r.start == 0 ? 0 : start - r.start) + (r.end - start - good);
+        ranges++;
+    }
+
+    printf("recovered       : %u records in %u ranges, %zu bytes%s\n",
+           records, ranges, out.size(), gaps ? "" : ", no gaps");
+    printf("lost            : %llu stream bytes\n", (unsigned long long)lostBytes);
+
+    if (argc == 3) {
+        FILE* fp = fopen(argv[2], "wb");
+        if (!fp || fwrite(out.data(), 1, out.size(), fp) != out.size()) {
+            fprintf(stderr, "%s: cannot write\n", argv[2]);
+            return 1;
+        }
+        fclose(fp);
+        printf("written         : %s\n", argv[2]);
+    }
+
+    return 0;
+}
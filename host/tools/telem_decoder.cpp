@@ -0,0 +1,166 @@
+#include "telem_decoder.h"
+#include "crc.h"
+#include "cobs.h"
+#include "debug_fmt.h"
+
+#include <string.h>
+
+namespace telem {
+
+void Decoder::feed(const uint8_t* data, size_t len)
+{
+    stats_.bytes += len;
+
+    for (size_t i = 0; i < len; i++) {
+        const uint8_t b = data[i];
+
+        if (b == 0x00) {
+            endFrame();
+            continue;
+        }
+
+        if (frameLen_ < sizeof(frame_))
+            frame_[frameLen_++] = b;
+        else
+            overflow_ = true;
+    }
+}
+
+/*
+ * COBS decode, then check length and CRC.
+ */
+void Decoder::endFrame()
+{
+    const size_t encLen = frameLen_;
+    const bool overflow = overflow_;
+    frameLen_ = 0;
+    overflow_ = false;
+
+    if (encLen == 0)
+        return;     // back-to-back delimiters
+
+    if (overflow) {
+        stats_.framing_errors++;
+        return;
+    }
+
+    uint8_t pkt[TELEM_MAX_FRAME];
+    int decoded = cobs_decode(frame_, encLen, pkt);
+    if (decoded < 0) {
+        stats_.framing_errors++;
+        return;
+    }
+    const size_t n = (size_t)decoded;
+
+    // type + seq + crc at least
+    if (n < 4) {
+        stats_.crc_errors++;
+        return;
+    }
+
+    uint16_t crc;
+    memcpy(&crc, &pkt[n - 2], 2);
+    if (crc16_ccitt(pkt, n - 2) != crc) {
+        stats_.crc_errors++;
+        return;
+    }
+
+    Packet p;
+    p.type        = pkt[0];
+    p.seq         = pkt[1];
+    p.payload     = &pkt[2];
+    p.payload_len = n - 4;
+
+    if (haveSeq_)
+        stats_.seq_gaps += (uint8_t)(p.seq - lastSeq_ - 1);
+    haveSeq_ = true;
+    lastSeq_ = p.seq;
+
+    stats_.packets++;
+    if (cb_)
+        cb_(p);
+}
+
+bool parseSamples(const Packet& pkt, TelemSamplesPayload& out)
+{
+    if (pkt.type != TELEM_PKT_SAMPLES || pkt.payload_len != sizeof(out))
+        return false;
+    memcpy(&out, pkt.payload, sizeof(out));
+    return true;
+}
+
+bool parseCounters(const Packet& pkt, TelemCountersPayload& out)
+{
+    if (pkt.type != TELEM_PKT_COUNTERS || pkt.payload_len != sizeof(out))
+        return false;
+    memcpy(&out, pkt.payload, sizeof(out));
+    return true;
+}
+
+bool DebugFormatter::handle(const Packet& pkt, uint32_t& t_us, std::string& text)
+{
+    if (haveSeq_ && pkt.seq != (uint8_t)(lastSeq_ + 1))
+        formats_.clear();
+    haveSeq_ = true;
+    lastSeq_ = pkt.seq;
+
+    if (pkt.type == TELEM_PKT_COUNTERS) {
+        formats_.clear();
+        return false;
+    }
+
+    if (pkt.type == TELEM_PKT_DBG_FORMAT) {
+        if (pkt.payload_len < 2)
+            return false;
+        uint16_t id;
+        memcpy(&id, pkt.payload, 2);
+        if (formats_.size() <= id)
+            formats_.resize(id + 1);
+        formats_[id].assign((const char*)pkt.payload + 2, pkt.payload_len - 2);
+        return false;
+    }
+
+    if (pkt.type != TELEM_PKT_DBG_RECORD)
+        return false;
+
+    TelemDbgRecordHeader h;
+    if (pkt.payload_len < sizeof(h)) {
+        bad_records++;
+        return false;
+    }
+    memcpy(&h, pkt.payload, sizeof(h));
+
+    const uint8_t* kinds = pkt.payload + sizeof(h);
+    size_t nwords = 0;
+    if (pkt.payload_len < sizeof(h) + h.nargs) {
+        bad_records++;
+        return false;
+    }
+    for (uint8_t i = 0; i < h.nargs; i++)
+        nwords += debugArgWords(kinds[i]);
+
+    if (pkt.payload_len != sizeof(h) + h.nargs + nwords * 4) {
+        bad_records++;
+        return false;
+    }
+    if (h.id >= formats_.size() || formats_[h.id].empty()) {
+        unknown_ids++;
+        return false;
+    }
+
+    uint32_t words[16];
+    if (nwords > 16) {
+        bad_records++;
+        return false;
+    }
+    memcpy(words, kinds + h.nargs, nwords * 4);
+
+    char buf[512];
+    debugFormatRecord(buf, sizeof(buf), formats_[h.id].c_str(), kinds, h.nargs, words);
+
+    t_us = h.t_us;
+    text = buf;
+    return true;
+}
+
+} // namespace telem
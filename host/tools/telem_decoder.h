@@ -0,0 +1,88 @@
+#pragma once
+
+/*
+ * Host-side decoder for the binary telemetry stream (telemetry.h).
+ *
+ * Byte-stream in, validated packets out: COBS unframing, CRC check and
+ * sequence gap counting. Bytes that are not part of a valid frame (CLI
+ * text, line noise, a frame cut by a baud switch) are skipped up to the
+ * next delimiter.
+ */
+
+#include <stdint.h>
+#include <stddef.h>
+#include <functional>
+#include <string>
+#include <vector>
+
+#include "telemetry.h"
+
+namespace telem {
+
+struct Packet {
+    uint8_t        type;        // TelemPacketType
+    uint8_t        seq;
+    const uint8_t* payload;     // valid during the callback only
+    size_t         payload_len;
+};
+
+struct DecoderStats {
+    uint64_t bytes;
+    uint32_t packets;
+    uint32_t crc_errors;        // includes CLI text between frames
+    uint32_t framing_errors;    // bad COBS or oversize frame
+    uint32_t seq_gaps;          // packets missing according to seq
+};
+
+class Decoder {
+public:
+    using Callback = std::function<void(const Packet&)>;
+
+    explicit Decoder(Callback cb) : cb_(std::move(cb)) {}
+
+    void feed(const uint8_t* data, size_t len);
+
+    const DecoderStats& stats() const { return stats_; }
+
+private:
+    void endFrame();
+
+    Callback cb_;
+    DecoderStats stats_ = {};
+
+    uint8_t frame_[TELEM_MAX_FRAME];
+    size_t  frameLen_ = 0;
+    bool    overflow_ = false;
+
+    bool    haveSeq_ = false;
+    uint8_t lastSeq_ = 0;
+};
+
+/*
+ * Decode a samples / counters payload. Returns false on a size mismatch.
+ */
+bool parseSamples(const Packet& pkt, TelemSamplesPayload& out);
+bool parseCounters(const Packet& pkt, TelemCountersPayload& out);
+
+/*
+ * Deferred debug records: remembers the format strings announced in
+ * DBG_FORMAT packets and formats DBG_RECORD packets with them.
+ * Ids are reassigned by the device after every counters packet, so the
+ * table is cleared whenever one passes through, and after a sequence
+ * gap (the lost packet may have been one).
+ */
+class DebugFormatter {
+public:
+    // Returns true if pkt was a debug record and text was produced
+    bool handle(const Packet& pkt, uint32_t& t_us, std::string& text);
+
+    uint32_t unknown_ids = 0;   // record before its format (decoder started late)
+    uint32_t bad_records = 0;
+
+private:
+    std::vector<std::string> formats_;
+    bool    haveSeq_ = false;
+    uint8_t lastSeq_ = 0;
+};
+
+} // namespace telem
@@ -0,0 +1,240 @@
+/*
+ * telem_dump - read the binary telemetry stream from a serial port
+ *
+ * Opens a tty (USB serial adapter, or one end of a pty pair), switches
+ * it to raw mode at the given baud rate and prints decoded packets.
+ * A regular file or "-" (stdin) works too, for captured streams.
+ *
+ *   telem_dump /dev/ttyUSB0 --baud 921600
+ *   telem_dump /dev/pts/5 --csv > ride.csv
+ *
+ * Testing without hardware:
+ *   socat -d -d pty,raw,echo=0 pty,raw,echo=0     # prints two pty paths
+ *   can_replay_bench --mode poll --telem-hz 500 --serial-out /dev/pts/A
+ *   telem_dump /dev/pts/B
+ */
+
+#include "telem_decoder.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <termios.h>
+#include <time.h>
+#include <unistd.h>
+
+#include <string>
+
+struct DumpOptions {
+    std::string path;
+    unsigned long baud = TELEM_DEFAULT_BAUD;
+    bool     csv = false;
+    bool     quiet = false;
+    double   seconds = 0.0;       // 0 = until EOF / Ctrl-C
+};
+
+static volatile sig_atomic_t stopRequested = 0;
+
+static void onSignal(int)
+{
+    stopRequested = 1;
+}
+
+static void usage()
+{
+    fprintf(stderr,
+        "usage: telem_dump <tty|file|-> [options]\n"
+        "  --baud <n>       tty baud rate (default %d)\n"
+        "  --csv            one CSV line per samples packet\n"
+        "  --quiet          summary only\n"
+        "  --seconds <s>    stop after s seconds\n",
+        TELEM_DEFAULT_BAUD);
+}
+
+static bool parseArgs(int argc, char** argv, DumpOptions& opt)
+{
+    for (int i = 1; i < argc; i++) {
+        std::string a = argv[i];
+        const char* v = (i + 1 < argc) ? argv[i + 1] : nullptr;
+
+        if (a == "--baud" && v)         { opt.baud = strtoul(v, nullptr, 10); i++; }
+        else if (a == "--seconds" && v) { opt.seconds = atof(v); i++; }
+        else if (a == "--csv")          opt.csv = true;
+        else if (a == "--quiet")        opt.quiet = true;
+        else if (opt.path.empty() && (a == "-" || a[0] != '-')) opt.path = a;
+        else return false;
+    }
+    return !opt.path.empty();
+}
+
+static speed_t baudConstant(unsigned long baud)
+{
+    switch (baud) {
+        case 9600:    return B9600;
+        case 19200:   return B19200;
+        case 38400:   return B38400;
+        case 57600:   return B57600;
+        case 115200:  return B115200;
+        case 230400:  return B230400;
+        case 460800:  return B460800;
+        case 500000:  return B500000;
+        case 921600:  return B921600;
+        case 1000000: return B1000000;
+        case 2000000: return B2000000;
+        default:      return 0;
+    }
+}
+
+static int openInput(const DumpOptions& opt)
+{
+    if (opt.path == "-")
+        return STDIN_FILENO;
+
+    int fd = open(opt.path.c_str(), O_RDONLY | O_NOCTTY);
+    if (fd < 0) {
+        fprintf(stderr, "open %s: %s\n", opt.path.c_str(), strerror(errno));
+        return -1;
+    }
+
+    if (!isatty(fd))
+        return fd;
+
+    struct termios tio;
+    if (tcgetattr(fd, &tio) != 0) {
+        fprintf(stderr, "tcgetattr: %s\n", strerror(errno));
+        close(fd);
+        return -1;
+    }
+
+    cfmakeraw(&tio);
+    tio.c_cflag |= CLOCAL | CREAD;
+    tio.c_cc[VMIN] = 1;
+    tio.c_cc[VTIME] = 0;
+
+    speed_t speed = baudConstant(opt.baud);
+    if (speed == 0) {
+        fprintf(stderr, "unsupported baud rate %lu\n", opt.baud);
+        close(fd);
+        return -1;
+    }
+    cfsetispeed(&tio, speed);
+    cfsetospeed(&tio, speed);
+
+    if (tcsetattr(fd, TCSANOW, &tio) != 0) {
+        fprintf(stderr, "tcsetattr: %s\n", strerror(errno));
+        close(fd);
+        return -1;
+    }
+
+    tcflush(fd, TCIFLUSH);
+    return fd;
+}
+
+static double nowSec()
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+int main(int argc, char** argv)
+{
+    DumpOptions opt;
+    if (!parseArgs(argc, argv, opt)) {
+        usage();
+        return 2;
+    }
+
+    int fd = openInput(opt);
+    if (fd < 0)
+        return 1;
+
+    signal(SIGINT, onSignal);
+    signal(SIGTERM, onSignal);
+
+    uint32_t samplePackets = 0;
+    uint32_t debugRecords = 0;
+    telem::DebugFormatter dbg;
+
+    if (opt.csv)
+        printf("t_us,id,sample_t_us,pos_mm,vel_mm_s,samples\n");
+
+    telem::Decoder dec([&](const telem::Packet& pkt) {
+        TelemSamplesPayload s;
+        TelemCountersPayload c;
+        uint32_t dbgUs;
+        std::string dbgText;
+
+        if (dbg.handle(pkt, dbgUs, dbgText)) {
+            debugRecords++;
+            if (!opt.csv && !opt.quiet)
+                printf("# dbg %10u us %s", dbgUs, dbgText.c_str());
+            return;
+        }
+
+        if (telem::parseSamples(pkt, s)) {
+            samplePackets++;
+            if (opt.quiet)
+                return;
+
+            for (int i = 0; i < TELEM_ENCODERS; i++) {
+                if (opt.csv) {
+                    printf("%u,%d,%u,%.3f,%d,%u\n",
+                           s.t_us, 3 + i, s.enc[i].t_us,
+                           s.enc[i].pos_um / 1000.0, s.enc[i].vel_mm_s, s.enc[i].samples);
+                }
+            }
+            if (!opt.csv) {
+                printf("%10u us ", s.t_us);
+                for (int i = 0; i < TELEM_ENCODERS; i++)
+                    printf(" | ID %d %8.3f mm %6d mm/s", 3 + i, s.enc[i].pos_um / 1000.0, s.enc[i].vel_mm_s);
+                printf("\n");
+            }
+        }
+        else if (telem::parseCounters(pkt, c)) {
+            if (!opt.csv && !opt.quiet) {
+                printf("# counters v%u %u Hz: sent %u dropped %u poll timeouts %u can rx_missed %u sdlog dropped %u\n",
+                       c.version, c.rate_hz, c.sent, c.dropped,
+                       c.poll_timeouts, c.can_rx_missed, c.sdlog_dropped);
+            }
+        }
+    });
+
+    const double t0 = nowSec();
+    uint8_t buf[4096];
+
+    while (!stopRequested) {
+        if (opt.seconds > 0.0 && nowSec() - t0 >= opt.seconds)
+            break;
+
+        struct pollfd pfd = { fd, POLLIN, 0 };
+        int r = poll(&pfd, 1, 100);
+        if (r < 0 && errno != EINTR)
+            break;
+        if (r <= 0)
+            continue;
+
+        ssize_t n = read(fd, buf, sizeof(buf));
+        if (n <= 0)
+            break;      // EOF, or pty peer closed
+        dec.feed(buf, (size_t)n);
+    }
+
+    const double elapsed = nowSec() - t0;
+    const telem::DecoderStats& st = dec.stats();
+
+    fprintf(stderr, "telem_dump: %llu bytes, %u packets (%u samples, %.0f/s), "
+                    "crc errors %u, framing errors %u, seq gaps %u\n",
+            (unsigned long long)st.bytes, st.packets, samplePackets,
+            elapsed > 0.0 ? samplePackets / elapsed : 0.0,
+            st.crc_errors, st.framing_errors, st.seq_gaps);
+    if (debugRecords > 0 || dbg.unknown_ids > 0)
+        fprintf(stderr, "telem_dump: %u debug records (%u before their format)\n",
+                debugRecords, dbg.unknown_ids);
+
+    return 0;
+}
@@ -0,0 +1,77 @@
+#include "thread_pool.h"
+
+namespace sdlog {
+
+ThreadPool::ThreadPool(unsigned threads)
+{
+    if (threads == 0)
+        threads = std::thread::hardware_concurrency();
+    if (threads == 0)
+        threads = 1;
+
+    for (unsigned w = 1; w < threads; w++)
+        workers_.emplace_back(&ThreadPool::work, this, w);
+}
+
+ThreadPool::~ThreadPool()
+{
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        stop_ = true;
+    }
+    start_.notify_all();
+    for (std::thread& t : workers_)
+        t.join();
+}
+
+void ThreadPool::drain(unsigned worker)
+{
+    size_t i;
+    while ((i = next_.fetch_add(1, std::memory_order_relaxed)) < count_)
+        (*fn_)(i, worker);
+}
+
+void ThreadPool::work(unsigned worker)
+{
+    uint64_t seen = 0;
+
+    for (;;) {
+        {
+            std::unique_lock<std::mutex> lock(mutex_);
+            start_.wait(lock, [&] { return stop_ || generation_ != seen; });
+            if (stop_)
+                return;
+            seen = generation_;
+        }
+
+        drain(worker);
+
+        std::lock_guard<std::mutex> lock(mutex_);
+        if (--busy_ == 0)
+            done_.notify_one();
+    }
+}
+
+void ThreadPool::run(size_t count, const std::function<void(size_t, unsigned)>& fn)
+{
+    if (count == 0)
+        return;
+
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        fn_ = &fn;
+        count_ = count;
+        next_.store(0, std::memory_order_relaxed);
+        busy_ = (unsigned)workers_.size();
+        generation_++;
+    }
+    start_.notify_all();
+
+    drain(0);
+
+    std::unique_lock<std::mutex> lock(mutex_);
+    done_.wait(lock, [&] { return busy_ == 0; });
+    fn_ = nullptr;
+}
+
+} // namespace sdlog
@@ -0,0 +1,60 @@
+#pragma once
+
+/*
+ * Fixed set of worker threads for the host tools.
+ *
+ * run() hands out the indices 0..count-1 to the workers (and the
+ * calling thread) one at a time, so uneven work items balance out, and
+ * returns when all are done. Items must not depend on each other.
+ *
+ *   sdlog::ThreadPool pool;                 // one thread per core
+ *   pool.run(chunks.size(), [&](size_t i, unsigned worker) { ... });
+ */
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include <atomic>
+#include <condition_variable>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace sdlog {
+
+class ThreadPool {
+public:
+    // 0 = std::thread::hardware_concurrency()
+    explicit ThreadPool(unsigned threads = 0);
+    ~ThreadPool();
+    ThreadPool(const ThreadPool&) = delete;
+    ThreadPool& operator=(const ThreadPool&) = delete;
+
+    // Threads taking part in run(), the caller included
+    unsigned size() const { return (unsigned)workers_.size() + 1; }
+
+    /*
+     * fn(i, worker) for every i < count; worker < size() identifies the
+     * thread, for per-thread scratch buffers. Not reentrant.
+     */
+    void run(size_t count, const std::function<void(size_t, unsigned)>& fn);
+
+private:
+    void work(unsigned worker);
+    void drain(unsigned worker);
+
+    std::vector<std::thread> workers_;
+    std::mutex mutex_;
+    std::condition_variable start_;
+    std::condition_variable done_;
+
+    const std::function<void(size_t, unsigned)>* fn_ = nullptr;
+    size_t   count_ = 0;
+    std::atomic<size_t> next_{0};
+    uint64_t generation_ = 0;
+    unsigned busy_ = 0;
+    bool     stop_ = false;
+};
+
+} // namespace sdlog
@@ -0,0 +1,195 @@
+#pragma once
+
+#include <stdint.h>
+#include <stddef.h>
+#include <string.h>
+
+/*
+ * LZ block codec (LZ4 style sequences, own framing).
+ *
+ * A block is a run of sequences:
+ *   token                  high nibble literal count, low nibble match length - 4
+ *   [count extension]      if the nibble is 15: bytes added until one is < 255
+ *   literals
+ *   offset (uint16, LE)    distance back to the match, 1..65535
+ *   [length extension]     as above
+ * The decoder is told the decoded length; a block may end after the
+ * literals or after a match. Every block is independent (no dictionary
+ * carried over), so a damaged block costs only its own bytes.
+ *
+ * The compressor is greedy with a single-entry hash table owned by the
+ * caller (LZB_HASH_SIZE x uint16, no initialisation needed, contents
+ * are verified before use). It compresses "to fit": as much of the
+ * input as fits the output, which lets a writer fill fixed-size blocks.
+ * No allocation, no recursion; stack use is a few words.
+ */
+
+#define LZB_MIN_MATCH       4
+#define LZB_HASH_BITS       12
+#define LZB_HASH_SIZE       (1u << LZB_HASH_BITS)
+
+// Input positions are kept in uint16
+#define LZB_MAX_INPUT       65535
+
+static inline uint32_t lzb_read32(const uint8_t* p)
+{
+    uint32_t v;
+    memcpy(&v, p, sizeof(v));
+    return v;
+}
+
+static inline uint32_t lzb_hash(uint32_t v)
+{
+    return (v * 2654435761u) >> (32 - LZB_HASH_BITS);
+}
+
+// Extension bytes for a literal count / match length nibble value of n
+static inline size_t lzb_ext_len(size_t n)
+{
+    return n < 15 ? 0 : 1 + (n - 15) / 255;
+}
+
+static inline uint8_t* lzb_put_ext(uint8_t* op, size_t n)
+{
+    if (n < 15)
+        return op;
+    n -= 15;
+    while (n >= 255) {
+        *op++ = 255;
+        n -= 255;
+    }
+    *op++ = (uint8_t)n;
+    return op;
+}
+
+/*
+ * Compress a prefix of in[0, inLen) into out (outCap bytes), as long as
+ * it fits. Returns the compressed length; *consumed is the number of
+ * input bytes it decodes to. table: LZB_HASH_SIZE entries.
+ */
+static inline size_t lzb_compress(const uint8_t* in, size_t inLen, uint8_t* out, size_t outCap,
+                                  uint16_t* table, size_t* consumed)
+{
+    if (inLen > LZB_MAX_INPUT)
+        inLen = LZB_MAX_INPUT;
+
+    size_t ip = 0, anchor = 0;
+    uint8_t* op = out;
+    uint8_t* const end = out + outCap;
+
+    while (ip + LZB_MIN_MATCH <= inLen) {
+        const uint32_t v = lzb_read32(in + ip);
+        const uint32_t h = lzb_hash(v);
+        const size_t cand = table[h];
+        table[h] = (uint16_t)ip;
+
+        if (cand >= ip || lzb_read32(in + cand) != v) {
+            // Step faster through data that does not match
+            ip += 1 + ((ip - anchor) >> 6);
+            continue;
+        }
+
+        size_t len = LZB_MIN_MATCH;
+        while (ip + len < inLen && in[cand + len] == in[ip + len])
+            len++;
+
+        const size_t lit = ip - anchor;
+        const size_t need = 1 + lzb_ext_len(lit) + lit + 2 + lzb_ext_len(len - LZB_MIN_MATCH);
+        if (need > (size_t)(end - op))
+            break;
+
+        const size_t ml = len - LZB_MIN_MATCH;
+        *op++ = (uint8_t)(((lit < 15 ? lit : 15) << 4) | (ml < 15 ? ml : 15));
+        op = lzb_put_ext(op, lit);
+        memcpy(op, in + anchor, lit);
+        op += lit;
+        const uint16_t off = (uint16_t)(ip - cand);
+        *op++ = (uint8_t)off;
+        *op++ = (uint8_t)(off >> 8);
+        op = lzb_put_ext(op, ml);
+
+        ip += len;
+        anchor = ip;
+    }
+
+    // Tail: the remaining literals, as many as fit
+    size_t lit = inLen - anchor;
+    const size_t room = (size_t)(end - op);
+    if (room < 2)
+        lit = 0;
+    else if (1 + lzb_ext_len(lit) + lit > room) {
+        lit = room - 1;
+        while (lit > 0 && 1 + lzb_ext_len(lit) + lit > room)
+            lit--;
+    }
+
+    if (lit > 0) {
+        *op++ = (uint8_t)((lit < 15 ? lit : 15) << 4);
+        op = lzb_put_ext(op, lit);
+        memcpy(op, in + anchor, lit);
+        op += lit;
+    }
+
+    *consumed = anchor + lit;
+    return (size_t)(op - out);
+}
+
+/*
+ * Decode a block of inLen bytes into exactly outLen bytes. Returns
+ * false if the block is malformed; never reads or writes out of bounds.
+ */
+static inline bool lzb_decompress(const uint8_t* in, size_t inLen, uint8_t* out, size_t outLen)
+{
+    size_t ip = 0, op = 0;
+
+    while (op < outLen) {
+        if (ip >= inLen)
+            return false;
+        const uint8_t token = in[ip++];
+
+        size_t lit = token >> 4;
+        if (lit == 15) {
+            uint8_t b;
+            do {
+                if (ip >= inLen)
+                    return false;
+                b = in[ip++];
+                lit += b;
+            } while (b == 255);
+        }
+        if (lit > inLen - ip || lit > outLen - op)
+            return false;
+        memcpy(out + op, in + ip, lit);
+        ip += lit;
+        op += lit;
+        if (op == outLen)
+            break;
+
+        if (inLen - ip < 2)
+            return false;
+        const size_t off = (size_t)in[ip] | ((size_t)in[ip + 1] << 8);
+        ip += 2;
+
+        size_t len = token & 0x0F;
+        if (len == 15) {
+            uint8_t b;
+            do {
+                if (ip >= inLen)
+                    return false;
+                b = in[ip++];
+                len += b;
+            } while (b == 255);
+        }
+        len += LZB_MIN_MATCH;
+        if (off == 0 || off > op || len > outLen - op)
+            return false;
+
+        // Byte by byte: the match may overlap what it produces
+        const uint8_t* src = out + op - off;
+        for (size_t i = 0; i < len; i++)
+            out[op + i] = src[i];
+        op += len;
+    }
+
+    return ip == inLen;
+}
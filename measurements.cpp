@@ -1,50 +1,216 @@
 #include "measurements.h"
 #include "BriterEncoder.h"
+#include "encoder_poll.h"
+#include "run_stats.h"
+#include "calibration.h"
+#include "sdlog.h"
+#include "sensor_frame.h"
+#include "can_bus.h"
 #include "debug.h"
+#include "perf.h"
+
+#include <atomic>
+#include <string.h>
 
 float measuredLength[BriterEncoder::NUM_ENCODERS] = {0};
+static volatile int32_t lastRaw[BriterEncoder::NUM_ENCODERS] = {0};
+
+static_assert((MEAS_HISTORY_LEN & (MEAS_HISTORY_LEN - 1)) == 0,
+              "MEAS_HISTORY_LEN must be a power of two");
+
+/*
+ * Per-encoder history and derivative state.
+ *
+ * Written only from the CAN RX path (single writer). Readers in other
+ * tasks use the sequence counter: odd while an update is in progress.
+ * seq / 2 is also the free-running ring head.
+ */
+struct EncoderHistory {
+    MeasSample ring[MEAS_HISTORY_LEN];
+    std::atomic<uint32_t> seq;      // 2 x samples written, +1 while writing
+
+    MeasMotion motion;
+    float prevVel;                  // filtered velocity of the previous sample
+    bool  havePrev;
+};
+
+static EncoderHistory history[BriterEncoder::NUM_ENCODERS];
 
 void initMeasurements()
 {
-    // Nothing to init yet
+    initCalibration();
+
+    for (int i = 0; i < BriterEncoder::NUM_ENCODERS; i++) {
+        EncoderHistory& h = history[i];
+        h.seq.store(0, std::memory_order_relaxed);
+        h.motion = {};
+        h.prevVel = 0.0f;
+        h.havePrev = false;
+    }
+}
+
+/*
+ * O(1) per sample: append to the ring, then update velocity and
+ * acceleration from the previous sample only.
+ */
+static void pushSample(int idx, uint32_t tUs, float pos)
+{
+    EncoderHistory& h = history[idx];
+    MeasMotion m = h.motion;
+
+    uint32_t dtUs = tUs - m.t_us;
+
+    if (!h.havePrev || dtUs > MEAS_GAP_RESET_US) {
+        dtUs = 0;
+        m.vel = 0.0f;
+        m.acc = 0.0f;
+        h.prevVel = 0.0f;
+        h.havePrev = true;
+    }
+    else if (dtUs > 0) {
+        float dt = dtUs * 1e-6f;
+
+        // Finite difference, then first-order low-pass with
+        // alpha = dt / (tau + dt)
+        float rawVel = (pos - m.pos) / dt;
+        m.vel += (rawVel - m.vel) * (dtUs / (float)(MEAS_VEL_TAU_US + dtUs));
+
+        float rawAcc = (m.vel - h.prevVel) / dt;
+        m.acc += (rawAcc - m.acc) * (dtUs / (float)(MEAS_ACC_TAU_US + dtUs));
+
+        h.prevVel = m.vel;
+    }
+    // dtUs == 0: same timestamp, keep derivatives
+
+    m.t_us = tUs;
+    m.pos = pos;
+    m.samples++;
+
+    uint32_t seq = h.seq.load(std::memory_order_relaxed);
+
+    h.seq.store(seq + 1, std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_release);
+
+    h.ring[(seq >> 1) & (MEAS_HISTORY_LEN - 1)] = { tUs, pos };
+    h.motion = m;
+
+    h.seq.store(seq + 2, std::memory_order_release);
+
+    runStatsAddSample(idx, pos, m.vel, dtUs);
 }
 
-void handleCANMessage(const twai_message_t& msg)
+bool handleCANMessage(const twai_message_t& msg, uint64_t rxUs)
 {
     uint8_t id;
     int32_t raw;
 
-    // Try to parse Briter READ response
-    if (!BriterEncoder::parseReadResponse(msg, id, raw)) {
-        DBG_VERBOSE("[MEAS][DROP] frame not read response");
-        DBG_VERBOSEF("[MEAS][DROP] ID=0x%lX DLC=%d\n",
+    PerfScope perf(PERF_MEAS_UPDATE);
+
+    // Try to parse Briter READ response. The full frame check matters:
+    // vehicle frames that merely look like one must still be logged raw.
+    if (!BriterEncoder::isBriterMessage(msg) ||
+        !BriterEncoder::parseReadResponse(msg, id, raw)) {
+        DBG_VERBOSEF("[MEAS][DROP] not a read response ID=0x%lX DLC=%d\n",
                      msg.identifier,
                      msg.data_length_code);
-        return;
+        return false;
     }
 
     // Validate encoder ID
     if (id < BriterEncoder::FIRST_ID || id > BriterEncoder::LAST_ID) {
         DBG_VERBOSEF("[MEAS][DROP] invalid encoder ID=%d\n", id);
-        return;
+        return false;
     }
 
     // Convert ID to array index
     int idx = id - BriterEncoder::FIRST_ID;
     if (idx < 0 || idx >= BriterEncoder::NUM_ENCODERS) {
         DBG_ERRORF("[MEAS][ERR] index out of range id=%d idx=%d\n", id, idx);
-        return;
+        return false;
     }
 
-    // Convert raw value to physical length
-    float value = (485.0f / 32767.0f) * raw;
-    if (value > 700.0f) {
-        value -= 1455.0f;
+    encoderPollOnResponse(id, (uint32_t)rxUs);
+
+    // Calibration changed since the last sample: note it in the log
+    // (this is the log producer task). The open sensor frame still
+    // holds samples taken under the old calibration.
+    if (calibrationTakeChanged()) {
+        sensorFrameFlush();
+        sdlog_log_calibration();
     }
 
+    // Convert raw value to physical length (integer, micrometres)
+    lastRaw[idx] = raw;
+    int32_t um = calibrateUm((uint8_t)idx, raw);
+    float value = um * 0.001f;
+
     measuredLength[idx] = value;
+    pushSample(idx, (uint32_t)rxUs, value);
+
+    // Raw counts go to the log, converted offline with REC_CALIB
+    if (canMode == CAN_MODE_NORMAL) {
+        sensorFrameAdd((uint8_t)idx, raw, rxUs);
+    }
 
     // Verbose debug only
     DBG_VERBOSEF("[MEAS] ID=%d raw=%ld val=%.2f\n",
                  id, raw, value);
+    return true;
+}
+
+int32_t getLastRaw(uint8_t idx)
+{
+    return idx < BriterEncoder::NUM_ENCODERS ? lastRaw[idx] : 0;
+}
+
+bool getMotion(uint8_t idx, MeasMotion& out)
+{
+    if (idx >= BriterEncoder::NUM_ENCODERS)
+        return false;
+
+    const EncoderHistory& h = history[idx];
+    uint32_t s0, s1;
+
+    do {
+        s0 = h.seq.load(std::memory_order_acquire);
+        out = h.motion;
+        std::atomic_thread_fence(std::memory_order_acquire);
+        s1 = h.seq.load(std::memory_order_relaxed);
+    } while ((s0 & 1) || s0 != s1);
+
+    return out.samples != 0;
+}
+
+uint16_t getHistory(uint8_t idx, MeasSample* out, uint16_t maxCount)
+{
+    if (idx >= BriterEncoder::NUM_ENCODERS || maxCount == 0)
+        return 0;
+
+    const EncoderHistory& h = history[idx];
+
+    uint32_t s0 = h.seq.load(std::memory_order_acquire);
+    uint32_t head = s0 >> 1;
+    uint32_t n = head < MEAS_HISTORY_LEN ? head : MEAS_HISTORY_LEN;
+    if (n > maxCount)
+        n = maxCount;
+
+    uint32_t first = head - n;
+    for (uint32_t i = 0; i < n; i++) {
+        out[i] = h.ring[(first + i) & (MEAS_HISTORY_LEN - 1)];
+    }
+
+    // Drop the oldest samples if the writer reached them during the
+    // copy (a write in progress counts as touching its slot)
+    std::atomic_thread_fence(std::memory_order_acquire);
+    uint32_t s1 = h.seq.load(std::memory_order_relaxed);
+    uint32_t touched = ((s1 + 1) >> 1) - head;
+    if (touched > MEAS_HISTORY_LEN - n) {
+        uint32_t lost = touched - (MEAS_HISTORY_LEN - n);
+        if (lost >= n)
+            return 0;
+        memmove(out, out + lost, (n - lost) * sizeof(MeasSample));
+        n -= lost;
+    }
+
+    return (uint16_t)n;
 }
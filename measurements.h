@@ -1,11 +1,75 @@
 #pragma once
 
 #include <driver/twai.h>
+#include <stdint.h>
 
 extern float measuredLength[4];
 
+/* =========================
+ *  SAMPLE HISTORY
+ * ========================= */
+
+/*
+ * MEAS_HISTORY_LEN
+ *
+ * Samples kept per encoder (power of two). 256 samples is ~0.5 s at
+ * 500 Hz. Storage is static: 8 bytes per sample.
+ */
+#define MEAS_HISTORY_LEN        256
+
+/*
+ * MEAS_VEL_TAU_US / MEAS_ACC_TAU_US
+ *
+ * Time constants of the first-order low-pass filters applied to the
+ * finite-difference velocity and acceleration. Given in time rather
+ * than as a fixed coefficient so the filters behave the same at any
+ * polling / push rate.
+ */
+#define MEAS_VEL_TAU_US         4000
+#define MEAS_ACC_TAU_US         8000
+
+/*
+ * MEAS_GAP_RESET_US
+ *
+ * A gap longer than this (encoder lost, polling stopped) restarts the
+ * derivative estimates instead of differentiating across the gap.
+ */
+#define MEAS_GAP_RESET_US       100000
+
+struct MeasSample {
+    uint32_t t_us;           // RX time, low 32 bits of esp_timer (wraps ~71 min)
+    float    pos;            // length, mm
+};
+
+struct MeasMotion {
+    uint32_t t_us;           // time of the latest sample
+    float    pos;            // mm
+    float    vel;            // mm/s, filtered
+    float    acc;            // mm/s^2, filtered
+    uint32_t samples;        // total samples since boot
+};
+
 void initMeasurements();
 void updateMeasurements();
 
-// RX entry point
-void handleCANMessage(const twai_message_t& msg);
+/*
+ * RX entry point; rxUs is the frame's RX time (CanFrame::ts_us).
+ * Returns true if the frame was an encoder value; in normal mode it is
+ * then logged in a REC_SENSORS frame (sensor_frame.h).
+ */
+bool handleCANMessage(const twai_message_t& msg, uint64_t rxUs);
+
+// Latest raw encoder count of encoder index 0..3
+int32_t getLastRaw(uint8_t idx);
+
+/*
+ * Latest position / velocity / acceleration of encoder index 0..3.
+ * Safe to call from any task; returns false if no sample yet.
+ */
+bool getMotion(uint8_t idx, MeasMotion& out);
+
+/*
+ * Copy up to maxCount most recent samples of encoder index 0..3,
+ * oldest first. Returns the number copied.
+ */
+uint16_t getHistory(uint8_t idx, MeasSample* out, uint16_t maxCount);
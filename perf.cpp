@@ -0,0 +1,184 @@
+#include "perf.h"
+#include "sdlog.h"
+
+#include <Arduino.h>
+#include <atomic>
+#include <string.h>
+
+/* =========================
+ *  INTERNAL STATE
+ * ========================= */
+
+/*
+ * perfReset() only bumps the generation; each site clears itself on its
+ * next sample, in the task that owns it, so a reset never races with a
+ * half-done update.
+ */
+struct PerfSlot {
+    uint32_t    gen;
+    PerfCounter c;
+};
+
+static PerfSlot slots[PERF_SITE_COUNT];
+static std::atomic<uint32_t> perfGen{1};
+
+static std::atomic<uint32_t> logIntervalS{PERF_LOG_DEFAULT_S};
+static uint64_t nextLogUs = 0;          // producer task only
+
+static const char* const siteNames[PERF_SITE_COUNT] = {
+    "loop",
+    "can_frame",
+    "meas_update",
+    "sdlog_push",
+    "sdlog_write",
+    "sdlog_flush",
+    "poll_tick",
+    "telem_tick",
+    "sdlog_compress",
+};
+
+static inline uint8_t histBin(uint32_t cycles)
+{
+    if (cycles < 2)
+        return 0;
+    uint8_t bin = (uint8_t)(31 - __builtin_clz(cycles));
+    return bin < PERF_HIST_BINS ? bin : PERF_HIST_BINS - 1;
+}
+
+/* =========================
+ *  PUBLIC API
+ * ========================= */
+
+void initPerf()
+{
+    perfReset();
+}
+
+void perfAdd(PerfSite site, uint32_t cycles)
+{
+    if (site >= PERF_SITE_COUNT)
+        return;
+
+    PerfSlot& s = slots[site];
+    const uint32_t gen = perfGen.load(std::memory_order_relaxed);
+
+    if (s.gen != gen) {
+        memset(&s.c, 0, sizeof(s.c));
+        s.c.min_cycles = UINT32_MAX;
+        s.gen = gen;
+    }
+
+    PerfCounter& c = s.c;
+    c.count++;
+    c.sum_cycles += cycles;
+    if (cycles < c.min_cycles) c.min_cycles = cycles;
+    if (cycles > c.max_cycles) c.max_cycles = cycles;
+    c.hist[histBin(cycles)]++;
+}
+
+void perfReset()
+{
+    perfGen.fetch_add(1, std::memory_order_relaxed);
+}
+
+bool getPerfCounter(PerfSite site, PerfCounter& out)
+{
+    if (site >= PERF_SITE_COUNT)
+        return false;
+
+    const PerfSlot& s = slots[site];
+    if (s.gen != perfGen.load(std::memory_order_relaxed)) {
+        memset(&out, 0, sizeof(out));
+        return true;
+    }
+
+    out = s.c;
+    if (out.count == 0)
+        out.min_cycles = 0;
+    return true;
+}
+
+const char* perfSiteName(PerfSite site)
+{
+    return site < PERF_SITE_COUNT ? siteNames[site] : "?";
+}
+
+uint32_t perfCyclesPerUs()
+{
+    return getCpuFrequencyMhz();
+}
+
+void setPerfLogInterval(uint32_t seconds)
+{
+    logIntervalS.store(seconds, std::memory_order_relaxed);
+}
+
+uint32_t getPerfLogInterval()
+{
+    return logIntervalS.load(std::memory_order_relaxed);
+}
+
+bool perfLogDue(uint64_t nowUs)
+{
+    const uint32_t s = logIntervalS.load(std::memory_order_relaxed);
+    if (s == 0)
+        return false;
+
+    if (nowUs < nextLogUs && nextLogUs - nowUs <= (uint64_t)s * 1000000ULL)
+        return false;
+
+    nextLogUs = nowUs + (uint64_t)s * 1000000ULL;
+    return true;
+}
+
+/* =========================
+ *  SD LOG RECORD
+ * ========================= */
+
+size_t perfEncodeRecord(uint8_t* out, size_t max, uint64_t tsUs)
+{
+    const size_t siteLen = sizeof(SdlogPerfSite) + PERF_HIST_BINS * sizeof(uint32_t);
+    const size_t payload = sizeof(SdlogPerfHeader) + PERF_SITE_COUNT * siteLen;
+
+    if (SDLOG_LP_HEADER_SIZE + payload > max)
+        return 0;
+
+    SdlogStats st;
+    sdlog_get_stats(&st);
+
+    size_t n = 0;
+    out[n++] = REC_PERF;
+    const uint16_t len = (uint16_t)payload;
+    memcpy(&out[n], &len, 2);
+    n += 2;
+
+    SdlogPerfHeader h = {
+        .ts_us             = tsUs,
+        .cpu_mhz           = (uint16_t)perfCyclesPerUs(),
+        .sites             = PERF_SITE_COUNT,
+        .hist_bins         = PERF_HIST_BINS,
+        .buffer_high_water = st.buffer_high_water,
+        .dropped           = sdlog_dropped()
+    };
+    memcpy(&out[n], &h, sizeof(h));
+    n += sizeof(h);
+
+    for (uint8_t i = 0; i < PERF_SITE_COUNT; i++) {
+        PerfCounter c;
+        getPerfCounter((PerfSite)i, c);
+
+        SdlogPerfSite s = {
+            .site       = i,
+            .count      = c.count,
+            .min_cycles = c.min_cycles,
+            .max_cycles = c.max_cycles,
+            .sum_cycles = c.sum_cycles
+        };
+        memcpy(&out[n], &s, sizeof(s));
+        n += sizeof(s);
+        memcpy(&out[n], c.hist, sizeof(c.hist));
+        n += sizeof(c.hist);
+    }
+
+    return n;
+}
@@ -0,0 +1,119 @@
+#pragma once
+
+#include <stdint.h>
+#include <stddef.h>
+#include <esp_cpu.h>
+
+/*
+ * Hot-path performance counters.
+ *
+ * Each instrumented site measures its duration with the CPU cycle
+ * counter (one register read on the ESP32) and keeps count, min, max,
+ * sum and a log2 histogram. Recording costs a few dozen cycles, so the
+ * counters stay enabled in normal builds.
+ *
+ * Every site is updated by one task only (noted per site); readers may
+ * see a sample half applied, which is fine for statistics.
+ */
+
+/*
+ * PERF_ENABLED
+ *
+ * 0 compiles all PerfScope / perfRecord calls away.
+ */
+#ifndef PERF_ENABLED
+#define PERF_ENABLED            1
+#endif
+
+/*
+ * PERF_HIST_BINS
+ *
+ * Bin i counts durations of [2^i, 2^(i+1)) cycles, bin 0 also counts
+ * 0 and 1; the last bin is open ended. 2^25 cycles is ~140 ms at
+ * 240 MHz, longer than anything on the hot path should take.
+ */
+#define PERF_HIST_BINS          26
+
+/*
+ * PERF_LOG_DEFAULT_S
+ *
+ * Interval of the REC_PERF snapshot in the SD log (0 = off).
+ * Runtime: "perf log <s>".
+ */
+#define PERF_LOG_DEFAULT_S      0
+
+typedef enum : uint8_t {
+    PERF_LOOP = 0,              // loop() iteration              (loop task)
+    PERF_CAN_FRAME,             // dispatch of one received frame (CAN RX task)
+    PERF_MEAS_UPDATE,           // handleCANMessage()            (CAN RX task)
+    PERF_SDLOG_PUSH,            // sdlog_push() ring write       (CAN RX task)
+    PERF_SDLOG_WRITE,           // one SD block write            (sdlog task)
+    PERF_SDLOG_FLUSH,           // SD flush                      (sdlog task)
+    PERF_POLL_TICK,             // encoder poll scheduler tick   (poll task)
+    PERF_TELEM_TICK,            // telemetry tick                (telem task)
+    PERF_SDLOG_COMPRESS,        // one chunk compressed          (sdlog task)
+    PERF_SITE_COUNT
+} PerfSite;
+
+struct PerfCounter {
+    uint32_t count;
+    uint32_t min_cycles;
+    uint32_t max_cycles;
+    uint64_t sum_cycles;
+    uint32_t hist[PERF_HIST_BINS];
+};
+
+void initPerf();
+void perfAdd(PerfSite site, uint32_t cycles);
+void perfReset();
+
+// Copy of a counter; false if the site is unknown
+bool getPerfCounter(PerfSite site, PerfCounter& out);
+const char* perfSiteName(PerfSite site);
+uint32_t perfCyclesPerUs();
+
+// Periodic REC_PERF record in the SD log
+void setPerfLogInterval(uint32_t seconds);
+uint32_t getPerfLogInterval();
+bool perfLogDue(uint64_t nowUs);        // producer task, also re-arms
+
+/*
+ * Encode a REC_PERF record (sdlog.h) into out.
+ * Returns bytes written, or 0 if max is too small.
+ */
+size_t perfEncodeRecord(uint8_t* out, size_t max, uint64_t tsUs);
+
+static inline uint32_t perfStart()
+{
+#if PERF_ENABLED
+    return esp_cpu_get_cycle_count();
+#else
+    return 0;
+#endif
+}
+
+static inline void perfRecord(PerfSite site, uint32_t startCycles)
+{
+#if PERF_ENABLED
+    perfAdd(site, esp_cpu_get_cycle_count() - startCycles);
+#else
+    (void)site;
+    (void)startCycles;
+#endif
+}
+
+/*
+ * Measures the enclosing scope.
+ */
+class PerfScope {
+public:
+    explicit PerfScope(PerfSite site) : site_(site), start_(perfStart()) {}
+    ~PerfScope() { perfRecord(site_, start_); }
+
+    PerfScope(const PerfScope&) = delete;
+    PerfScope& operator=(const PerfScope&) = delete;
+
+private:
+    PerfSite site_;
+    uint32_t start_;
+};
@@ -0,0 +1,280 @@
+#include "run_stats.h"
+#include "BriterEncoder.h"
+#include "sdlog.h"
+
+#include <esp_timer.h>
+#include <atomic>
+#include <string.h>
+
+/* =========================
+ *  INTERNAL STATE
+ * ========================= */
+
+/*
+ * Accumulators per encoder. Times are kept in microseconds (64-bit, a
+ * run can be hours long) and converted to ms only for readers.
+ *
+ * Single writer (sample path); readers copy under the sequence counter
+ * (odd while an update is in progress).
+ */
+struct StatsAcc {
+    std::atomic<uint32_t> seq;
+    uint32_t resetGen;             // last runStatsReset() applied
+
+    uint32_t samples;
+    uint64_t totalUs;
+    int64_t  travelSum;            // travel in 0.01 mm x us, for the time weighted mean
+    float    travelMin;
+    float    travelMax;
+    float    velCompMax;
+    float    velRebMax;
+
+    float    bottomOutMm;
+    bool     bottomArmed;
+    uint32_t bottomOuts;
+
+    uint64_t compLsUs, compHsUs, rebLsUs, rebHsUs;
+    uint64_t velCompUs[STATS_VEL_BINS];
+    uint64_t velRebUs[STATS_VEL_BINS];
+    uint64_t travelUs[STATS_TRAVEL_BINS];
+};
+
+static StatsAcc acc[BriterEncoder::NUM_ENCODERS];
+
+static std::atomic<uint32_t> resetGen{0};
+static std::atomic<int64_t>  runStartUs{0};
+
+static void clearAcc(StatsAcc& a)
+{
+    a.samples    = 0;
+    a.totalUs    = 0;
+    a.travelSum  = 0;
+    a.travelMin  = 0.0f;
+    a.travelMax  = 0.0f;
+    a.velCompMax = 0.0f;
+    a.velRebMax  = 0.0f;
+    a.bottomArmed = true;
+    a.bottomOuts = 0;
+    a.compLsUs = a.compHsUs = a.rebLsUs = a.rebHsUs = 0;
+    memset(a.velCompUs, 0, sizeof(a.velCompUs));
+    memset(a.velRebUs, 0, sizeof(a.velRebUs));
+    memset(a.travelUs, 0, sizeof(a.travelUs));
+}
+
+static inline uint32_t binIndex(float v, float invWidth, uint32_t bins)
+{
+    if (v <= 0.0f)
+        return 0;
+    uint32_t b = (uint32_t)(v * invWidth);
+    return b < bins ? b : bins - 1;
+}
+
+/* =========================
+ *  SAMPLE PATH
+ * ========================= */
+
+void runStatsAddSample(uint8_t idx, float pos, float vel, uint32_t dtUs)
+{
+    if (idx >= BriterEncoder::NUM_ENCODERS)
+        return;
+
+    StatsAcc& a = acc[idx];
+    const uint32_t seq = a.seq.load(std::memory_order_relaxed);
+
+    a.seq.store(seq + 1, std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_release);
+
+    const uint32_t gen = resetGen.load(std::memory_order_acquire);
+    if (a.resetGen != gen) {
+        a.resetGen = gen;
+        clearAcc(a);
+    }
+
+    const float travel = -pos;
+
+    if (a.samples == 0 || travel < a.travelMin) a.travelMin = travel;
+    if (a.samples == 0 || travel > a.travelMax) a.travelMax = travel;
+    a.samples++;
+
+    // Bottom-out with hysteresis
+    if (a.bottomOutMm > 0.0f) {
+        if (a.bottomArmed && travel >= a.bottomOutMm) {
+            a.bottomOuts++;
+            a.bottomArmed = false;
+        }
+        else if (!a.bottomArmed && travel < a.bottomOutMm - STATS_BOTTOM_HYST_MM) {
+            a.bottomArmed = true;
+        }
+    }
+
+    // Compression is positive travel velocity
+    const float tv = -vel;
+    if (tv > a.velCompMax)  a.velCompMax = tv;
+    if (-tv > a.velRebMax)  a.velRebMax = -tv;
+
+    // Histograms are time weighted: the interval since the previous
+    // sample is credited to this sample's bins
+    if (dtUs > 0) {
+        a.totalUs += dtUs;
+        a.travelSum += (int64_t)(travel * 100.0f) * dtUs;
+
+        a.travelUs[binIndex(travel, 1.0f / STATS_TRAVEL_BIN_MM, STATS_TRAVEL_BINS)] += dtUs;
+
+        if (tv >= 0.0f) {
+            a.velCompUs[binIndex(tv, 1.0f / STATS_VEL_BIN_MM_S, STATS_VEL_BINS)] += dtUs;
+            if (tv < STATS_LSHS_SPLIT_MM_S) a.compLsUs += dtUs;
+            else                            a.compHsUs += dtUs;
+        } else {
+            a.velRebUs[binIndex(-tv, 1.0f / STATS_VEL_BIN_MM_S, STATS_VEL_BINS)] += dtUs;
+            if (-tv < STATS_LSHS_SPLIT_MM_S) a.rebLsUs += dtUs;
+            else                             a.rebHsUs += dtUs;
+        }
+    }
+
+    a.seq.store(seq + 2, std::memory_order_release);
+}
+
+/* =========================
+ *  PUBLIC API
+ * ========================= */
+
+void runStatsReset()
+{
+    runStartUs.store(esp_timer_get_time(), std::memory_order_relaxed);
+    resetGen.fetch_add(1, std::memory_order_release);
+}
+
+bool setBottomOutThreshold(uint8_t idx, float mm)
+{
+    if (idx >= BriterEncoder::NUM_ENCODERS || mm < 0.0f)
+        return false;
+
+    acc[idx].bottomOutMm = mm;
+    return true;
+}
+
+bool getRunStats(uint8_t idx, RunStats& out)
+{
+    if (idx >= BriterEncoder::NUM_ENCODERS)
+        return false;
+
+    const StatsAcc& a = acc[idx];
+    static StatsAcc copy;      // too big for the CLI stack; callers are not concurrent
+    uint32_t s0, s1;
+
+    do {
+        s0 = a.seq.load(std::memory_order_acquire);
+        copy.resetGen   = a.resetGen;
+        copy.samples    = a.samples;
+        copy.totalUs    = a.totalUs;
+        copy.travelSum  = a.travelSum;
+        copy.travelMin  = a.travelMin;
+        copy.travelMax  = a.travelMax;
+        copy.velCompMax = a.velCompMax;
+        copy.velRebMax  = a.velRebMax;
+        copy.bottomOuts = a.bottomOuts;
+        copy.compLsUs = a.compLsUs;  copy.compHsUs = a.compHsUs;
+        copy.rebLsUs  = a.rebLsUs;   copy.rebHsUs  = a.rebHsUs;
+        memcpy(copy.velCompUs, a.velCompUs, sizeof(copy.velCompUs));
+        memcpy(copy.velRebUs, a.velRebUs, sizeof(copy.velRebUs));
+        memcpy(copy.travelUs, a.travelUs, sizeof(copy.travelUs));
+        std::atomic_thread_fence(std::memory_order_acquire);
+        s1 = a.seq.load(std::memory_order_relaxed);
+    } while ((s0 & 1) || s0 != s1);
+
+    // Reset requested but no sample since: report an empty run
+    if (copy.resetGen != resetGen.load(std::memory_order_acquire))
+        clearAcc(copy);
+
+    out = {};
+    out.samples       = copy.samples;
+    out.duration_ms   = (uint32_t)((esp_timer_get_time() - runStartUs.load(std::memory_order_relaxed)) / 1000);
+    out.travel_min    = copy.travelMin;
+    out.travel_max    = copy.travelMax;
+    out.travel_mean   = copy.totalUs ? (float)(copy.travelSum / (int64_t)copy.totalUs) / 100.0f : 0.0f;
+    out.vel_comp_max  = copy.velCompMax;
+    out.vel_reb_max   = copy.velRebMax;
+    out.bottom_outs   = copy.bottomOuts;
+    out.bottom_out_mm = a.bottomOutMm;
+    out.comp_ls_ms    = (uint32_t)(copy.compLsUs / 1000);
+    out.comp_hs_ms    = (uint32_t)(copy.compHsUs / 1000);
+    out.reb_ls_ms     = (uint32_t)(copy.rebLsUs / 1000);
+    out.reb_hs_ms     = (uint32_t)(copy.rebHsUs / 1000);
+
+    for (int i = 0; i < STATS_VEL_BINS; i++) {
+        out.vel_comp_ms[i] = (uint32_t)(copy.velCompUs[i] / 1000);
+        out.vel_reb_ms[i]  = (uint32_t)(copy.velRebUs[i] / 1000);
+    }
+    for (int i = 0; i < STATS_TRAVEL_BINS; i++) {
+        out.travel_ms[i] = (uint32_t)(copy.travelUs[i] / 1000);
+    }
+
+    return true;
+}
+
+/* =========================
+ *  LOG RECORD
+ * ========================= */
+
+size_t runStatsEncodeRecord(uint8_t* out, size_t maxLen, uint64_t tsUs)
+{
+    const size_t perEncoder = sizeof(SdlogStatsEncoder) +
+                              sizeof(uint32_t) * (2 * STATS_VEL_BINS + STATS_TRAVEL_BINS);
+    const size_t payloadLen = sizeof(SdlogStatsHeader) + BriterEncoder::NUM_ENCODERS * perEncoder;
+    const size_t total = SDLOG_LP_HEADER_SIZE + payloadLen;
+
+    if (total > maxLen || payloadLen > 0xFFFF)
+        return 0;
+
+    static RunStats st;
+    size_t n = 0;
+
+    out[n++] = REC_STATS;
+    uint16_t len = (uint16_t)payloadLen;
+    memcpy(&out[n], &len, 2);
+    n += 2;
+
+    SdlogStatsHeader hdr = {
+        .ts_us           = tsUs,
+        .duration_ms     = (uint32_t)((int64_t)tsUs / 1000 - runStartUs.load(std::memory_order_relaxed) / 1000),
+        .encoders        = BriterEncoder::NUM_ENCODERS,
+        .vel_bins        = STATS_VEL_BINS,
+        .vel_bin_mm_s    = STATS_VEL_BIN_MM_S,
+        .lshs_split_mm_s = STATS_LSHS_SPLIT_MM_S,
+        .travel_bins     = STATS_TRAVEL_BINS,
+        .travel_bin_mm   = STATS_TRAVEL_BIN_MM
+    };
+    memcpy(&out[n], &hdr, sizeof(hdr));
+    n += sizeof(hdr);
+
+    for (uint8_t i = 0; i < BriterEncoder::NUM_ENCODERS; i++) {
+        getRunStats(i, st);
+
+        SdlogStatsEncoder e = {
+            .id            = (uint8_t)(BriterEncoder::FIRST_ID + i),
+            .samples       = st.samples,
+            .travel_min    = st.travel_min,
+            .travel_max    = st.travel_max,
+            .travel_mean   = st.travel_mean,
+            .vel_comp_max  = st.vel_comp_max,
+            .vel_reb_max   = st.vel_reb_max,
+            .bottom_out_mm = st.bottom_out_mm,
+            .bottom_outs   = st.bottom_outs,
+            .comp_ls_ms    = st.comp_ls_ms,
+            .comp_hs_ms    = st.comp_hs_ms,
+            .reb_ls_ms     = st.reb_ls_ms,
+            .reb_hs_ms     = st.reb_hs_ms
+        };
+        memcpy(&out[n], &e, sizeof(e));
+        n += sizeof(e);
+
+        memcpy(&out[n], st.vel_comp_ms, sizeof(st.vel_comp_ms));
+        n += sizeof(st.vel_comp_ms);
+        memcpy(&out[n], st.vel_reb_ms, sizeof(st.vel_reb_ms));
+        n += sizeof(st.vel_reb_ms);
+        memcpy(&out[n], st.travel_ms, sizeof(st.travel_ms));
+        n += sizeof(st.travel_ms);
+    }
+
+    return n;
+}
@@ -0,0 +1,108 @@
+#pragma once
+
+#include <stdint.h>
+#include <stddef.h>
+
+/*
+ * Online run statistics.
+ *
+ * Fed with every measurement sample (from the CAN RX path), kept in
+ * constant memory per encoder:
+ *  - damper velocity histogram, time weighted, separate compression and
+ *    rebound bins, low / high speed split
+ *  - travel usage histogram, time weighted
+ *  - min / max / mean travel, peak velocities
+ *  - bottom-out events
+ *
+ * Sign convention: travel is compression from the zero point
+ * (travel = -length), so negative velocity (length decreasing) is
+ * compression.
+ *
+ * A run starts at boot, at sdlog_start() and on runStatsReset();
+ * sdlog_stop() writes the summary to the log file (REC_STATS).
+ */
+
+/* =========================
+ *  HISTOGRAM CONFIGURATION
+ * ========================= */
+
+/*
+ * STATS_VEL_BINS / STATS_VEL_BIN_MM_S
+ *
+ * Velocity bins per direction and their width. The last bin also
+ * collects everything faster (30 x 100 mm/s -> 3 m/s and above).
+ */
+#define STATS_VEL_BINS          30
+#define STATS_VEL_BIN_MM_S      100
+
+/*
+ * STATS_LSHS_SPLIT_MM_S
+ *
+ * Boundary between low and high speed damping.
+ */
+#define STATS_LSHS_SPLIT_MM_S   150
+
+/*
+ * STATS_TRAVEL_BINS / STATS_TRAVEL_BIN_MM
+ *
+ * Travel usage bins from the zero point (0..320 mm). Travel outside
+ * the range is counted in the first / last bin.
+ */
+#define STATS_TRAVEL_BINS       64
+#define STATS_TRAVEL_BIN_MM     5
+
+/*
+ * STATS_BOTTOM_HYST_MM
+ *
+ * A bottom-out is counted when travel reaches the threshold and re-armed
+ * only after travel drops this far below it, so ringing at full
+ * compression counts once.
+ */
+#define STATS_BOTTOM_HYST_MM    5.0f
+
+struct RunStats {
+    uint32_t samples;
+    uint32_t duration_ms;          // run time so far
+
+    float    travel_min;           // mm
+    float    travel_max;
+    float    travel_mean;
+    float    vel_comp_max;         // mm/s, peak compression speed (positive)
+    float    vel_reb_max;          // mm/s, peak rebound speed (positive)
+
+    uint32_t bottom_outs;
+    float    bottom_out_mm;        // threshold, 0 = disabled
+
+    // Time in each speed range, ms
+    uint32_t comp_ls_ms;
+    uint32_t comp_hs_ms;
+    uint32_t reb_ls_ms;
+    uint32_t reb_hs_ms;
+
+    // Time per bin, ms
+    uint32_t vel_comp_ms[STATS_VEL_BINS];
+    uint32_t vel_reb_ms[STATS_VEL_BINS];
+    uint32_t travel_ms[STATS_TRAVEL_BINS];
+};
+
+/*
+ * Sample hook, called from the measurement path for every sample.
+ * dtUs is the time since the previous sample of the same encoder
+ * (0 for the first sample after a gap). O(1), no allocation.
+ */
+void runStatsAddSample(uint8_t idx, float pos, float vel, uint32_t dtUs);
+
+// Start a new run (applied by the sample path, safe from any task)
+void runStatsReset();
+
+// Consistent copy of encoder index 0..3
+bool getRunStats(uint8_t idx, RunStats& out);
+
+// Bottom-out threshold in travel mm, 0 disables
+bool setBottomOutThreshold(uint8_t idx, float mm);
+
+/*
+ * Encode the REC_STATS record (see sdlog.h) for all encoders into out.
+ * Returns the record length, 0 if it does not fit.
+ */
+size_t runStatsEncodeRecord(uint8_t* out, size_t maxLen, uint64_t tsUs);
@@ -1,8 +1,19 @@
 #include "sdlog.h"
+#include "run_stats.h"
+#include "sensor_frame.h"
+#include "calibration.h"
+#include "BriterEncoder.h"
+#include "perf.h"
+#include "tasks.h"
+#include "crc.h"
+#include "lz_block.h"
 
 #include <Arduino.h>
 #include <SD.h>
+#include <Preferences.h>
 #include <esp_timer.h>
+#include <atomic>
+#include <unistd.h>
 
 /* =========================
  *  SDLOG CONFIGURATION
@@ -17,6 +28,7 @@
  * - Decrease only if RAM usage becomes an issue.
  *
  * IMPORTANT:
+ * - Must be a power of two (index wrap uses masking).
  * - Must be larger than the largest single record.
  * - Must leave enough free RAM for other tasks and stacks.
  * - Changing this does NOT change the on-disk file format.
@@ -27,43 +39,282 @@
  */
 #define SDLOG_BUFFER_SIZE   (32 * 1024)
 
+static_assert((SDLOG_BUFFER_SIZE & (SDLOG_BUFFER_SIZE - 1)) == 0,
+              "SDLOG_BUFFER_SIZE must be a power of two");
+
+// SDLOG_TASK_STACK / SDLOG_TASK_PRIO: see tasks.h
+
 /*
- * SDLOG_TASK_STACK
+ * SDLOG_WRITE_BLOCK
  *
- * Stack size for the SD writer task.
+ * Size of a single SD write in bytes: one chunk (SDLOG_CHUNK_SIZE,
+ * sdlog.h), header included.
+ *
+ * Chunks start at multiples of this size in the file (sector aligned),
+ * so the card never has to do a partial-sector read-modify-write.
  *
  * IMPORTANT:
- * - This task performs only buffered file writes.
- * - Do NOT reduce this unless you know actual stack usage.
- * - Increasing this is safe but usually unnecessary.
+ * - Changing SDLOG_CHUNK_SIZE changes the file format.
+ * - Must be at most half of SDLOG_BUFFER_SIZE.
  */
-#define SDLOG_TASK_STACK    4096
+#define SDLOG_WRITE_BLOCK   SDLOG_CHUNK_SIZE
+
+static_assert((SDLOG_WRITE_BLOCK & (SDLOG_WRITE_BLOCK - 1)) == 0 &&
+              SDLOG_WRITE_BLOCK >= 512 &&
+              SDLOG_WRITE_BLOCK <= SDLOG_BUFFER_SIZE / 2,
+              "SDLOG_WRITE_BLOCK must be a power of two, >= 512 and <= SDLOG_BUFFER_SIZE / 2");
 
 /*
- * SDLOG_TASK_PRIO
+ * SDLOG_COMPRESS_WINDOW / SDLOG_CODEC_DEFAULT
  *
- * FreeRTOS task priority for the SD writer.
+ * Optional compression between the ring and the card (SDLOG_CODEC_LZ,
+ * sdlog.h). Up to SDLOG_COMPRESS_WINDOW stream bytes are staged and as
+ * many of them as fit are compressed into one chunk; the rest starts
+ * the next one. Chunks stay one aligned SDLOG_CHUNK_SIZE write.
  *
- * IMPORTANT:
- * - Must be lower than real-time data acquisition tasks.
- * - Must be high enough to drain the buffer in time.
+ * - The window bounds the ratio of a chunk (24 kB: about 3:1) and is
+ *   RAM, as is the match table (LZB_HASH_SIZE x 2 bytes).
+ * - Must be <= LZB_MAX_INPUT (block raw_len is 16 bit).
+ * - Chosen per file: sdlog_set_codec(), "log compress on|off".
+ */
+#define SDLOG_COMPRESS_WINDOW     (24 * 1024)
+#define SDLOG_CODEC_DEFAULT       SDLOG_CODEC_LZ
+
+static_assert(SDLOG_COMPRESS_WINDOW > SDLOG_BLOCK_CAPACITY &&
+              SDLOG_COMPRESS_WINDOW <= LZB_MAX_INPUT,
+              "SDLOG_COMPRESS_WINDOW must be > one chunk and <= LZB_MAX_INPUT");
+
+/*
+ * SDLOG_FLUSH_INTERVAL_MS / SDLOG_FLUSH_BYTES
+ *
+ * Sync policy. Whichever comes first:
+ * - time since last flush: the open chunk is written as it is (and
+ *   written again once complete), then the file is flushed
+ * - bytes written since last flush: flush only
+ *
+ * A power cut loses at most the last interval plus what is still in
+ * the ring; everything on the card before it is in CRC-checked chunks.
+ * Costs one extra chunk write and one flush per interval, never one
+ * per record.
+ */
+#define SDLOG_FLUSH_INTERVAL_MS   1000
+#define SDLOG_FLUSH_BYTES         (256 * 1024)
+
+/*
+ * SDLOG_PREALLOC_BYTES
+ *
+ * Size a log file is extended to ahead of its data, so FAT allocates
+ * contiguous clusters up front instead of during logging: the first
+ * SDLOG_PREOPEN_STEP when it is created, the rest from idle writer
+ * passes. The file is truncated to its real length when closed.
+ *
+ * 0 disables preallocation.
+ */
+#define SDLOG_PREALLOC_BYTES      (64UL * 1024 * 1024)
+
+/*
+ * SDLOG_MOUNT_POINT
+ *
+ * VFS mount point used by SD.begin(). Needed for truncate(), which the
+ * Arduino FS API does not provide.
+ */
+#define SDLOG_MOUNT_POINT   "/sd"
+
+/*
+ * SDLOG_SYNC_INTERVAL_US
+ *
+ * Maximum time between REC_TIMESYNC records. Bounds how far a reader
+ * has to scan to recover absolute time; costs 9 bytes per interval.
+ */
+#define SDLOG_SYNC_INTERVAL_US    (1000 * 1000)
+
+/*
+ * SDLOG_INDEX_INTERVAL_US / SDLOG_INDEX_BYTES
+ *
+ * Spacing of REC_INDEX seek points, whichever comes first. Bounds how
+ * much a reader has to decode to reach a given time, and how much is
+ * lost after a damaged chunk (decoding resumes at the next seek point);
+ * costs 27 bytes plus one REC_TIMESYNC per seek point.
+ */
+#define SDLOG_INDEX_INTERVAL_US   (1000 * 1000)
+#define SDLOG_INDEX_BYTES         (64 * 1024)
+
+/*
+ * SDLOG_INDEX_TABLE_MAX
+ *
+ * Entries of the footer index (12 bytes each). When full, every other
+ * entry is dropped and only every 2nd, 4th, ... seek point is kept,
+ * so any log length fits: 256 entries cover 4 min at one seek point
+ * per second and a 10 h log at one entry per ~2 min.
  */
-#define SDLOG_TASK_PRIO     1
+#define SDLOG_INDEX_TABLE_MAX     256
+
+/*
+ * SDLOG_ROTATE_BYTES_DEFAULT / SDLOG_ROTATE_SECONDS_DEFAULT
+ *
+ * A new file is started when the current one reaches this size or age,
+ * whichever comes first (0 = no limit). Changeable at runtime with
+ * sdlog_set_rotation(). The next file is opened and preallocated by
+ * the writer ahead of time, so switching costs the producer only a
+ * header push and drops nothing.
+ *
+ * Must stay well below 4 GB (FAT32, 32-bit index offsets).
+ */
+#define SDLOG_ROTATE_BYTES_DEFAULT    (1024UL * 1024 * 1024)
+#define SDLOG_ROTATE_SECONDS_DEFAULT  0
+
+/*
+ * SDLOG_PREOPEN_STEP
+ *
+ * Files are preallocated in steps of this size, one step per idle
+ * writer pass, so neither sdlog_start() nor the writer blocks long
+ * enough to let the ring overflow.
+ */
+#define SDLOG_PREOPEN_STEP        (1024UL * 1024)
+
+/*
+ * SDLOG_MAX_FILES / SDLOG_NVS_NAMESPACE / SDLOG_NVS_KEY_NEXT
+ *
+ * Log files are /LOG_0000.BIN .. /LOG_9999.BIN. The next free number is
+ * kept in NVS, so starting a log costs one SD.exists() instead of one
+ * per existing file. If NVS is empty or the stored name is taken
+ * (card swapped), the root directory is listed once and the number
+ * after the highest LOG_n.BIN is used.
+ */
+#define SDLOG_MAX_FILES           10000
+#define SDLOG_NVS_NAMESPACE       "suspmeas"
+#define SDLOG_NVS_KEY_NEXT        "lognext"
 
 /* =========================
  *  INTERNAL STATE
  * ========================= */
 
+/*
+ * Single-producer / single-consumer ring.
+ *
+ * Producer: CAN / measurement path (sdlog_push)
+ * Consumer: sdlog_task
+ *
+ * Positions are free-running byte counters; only the low bits index the
+ * buffer. Each side owns one position and publishes it with release
+ * ordering, the other side reads it with acquire ordering, so data bytes
+ * are always visible before the position that covers them (dual-core safe).
+ */
 static uint8_t  buffer[SDLOG_BUFFER_SIZE];
-static volatile size_t writePos = 0;
-static volatile size_t readPos  = 0;
+static std::atomic<size_t> writePos{0};
+static std::atomic<size_t> readPos{0};
 
-static volatile bool logRunning = false;
-static volatile uint32_t droppedRecords = 0;
+/*
+ * logRunning   : producer side may push records
+ * writerState  : who owns logFile
+ *   WRITER_IDLE    nobody (no session, or sdlog_stop() closing it)
+ *   WRITER_ACTIVE  sdlog_task, draining the ring
+ *   WRITER_CLOSES  sdlog_task, and it closes the file itself when drained
+ *
+ * sdlog_stop() clears logRunning first, then waits for the writer to
+ * drain everything and hand the file back (ACTIVE -> IDLE) before
+ * closing it. A writer stuck on the card is never raced: if the wait
+ * times out, sdlog_stop() moves ACTIVE -> CLOSES instead and returns;
+ * whichever transition wins the compare-exchange decides who closes.
+ * A writer that never comes back leaves the file to power-loss recovery.
+ */
+enum : uint8_t {
+    WRITER_IDLE = 0,
+    WRITER_ACTIVE,
+    WRITER_CLOSES,
+};
+static std::atomic<bool> logRunning{false};
+static std::atomic<uint8_t> writerState{WRITER_IDLE};
+static std::atomic<uint32_t> droppedRecords{0};
+static std::atomic<size_t> bufferHighWater{0};
 
 static File logFile;
+static char logFileName[32];
+
+/*
+ * Chunk being filled, writer side. Ring bytes are copied in and
+ * consumed right away; the chunk goes to the card when it is full or
+ * at a sync (then again when full, same file offset).
+ */
+static uint8_t  chunkBuf[SDLOG_CHUNK_SIZE];
+static size_t   chunkFill = 0;              // payload bytes in chunkBuf
+static uint32_t chunkSeq = 0;               // chunk number in the file
+static bool     chunkOnCard = false;        // partial version already written
+static bool     chunkSynced = false;        // ... and nothing added since
+static uint8_t  chunkCodec = SDLOG_CODEC_NONE;
+static uint32_t fileId = 0;
+
+/*
+ * Compression stage, files with fileCodec != SDLOG_CODEC_NONE. Stream
+ * bytes are staged in rawBuf instead of chunkBuf (rawStart: stream
+ * offset of rawBuf[0]) and packed into a chunk when rawBuf is full,
+ * the bytes that did not fit moving to the front, or at a sync.
+ */
+static uint8_t  rawBuf[SDLOG_COMPRESS_WINDOW];
+static size_t   rawFill = 0;
+static uint32_t rawStart = 0;
+static uint16_t lzTable[LZB_HASH_SIZE];
+static uint8_t  fileCodec = SDLOG_CODEC_NONE;
+static std::atomic<uint8_t> codecSetting{SDLOG_CODEC_DEFAULT};
+
+// Producer-side delta base for v2 timestamps
+static uint64_t lastTsUs   = 0;
+static uint64_t lastSyncUs = 0;
+static bool     syncPending = true;
+static std::atomic<uint32_t> fileEpoch{0};
+static SdlogStats stats;
+static uint64_t writeTimeTotalUs = 0;
+static int64_t  sessionStartUs = 0;
 static TaskHandle_t sdTaskHandle = nullptr;
 
+/*
+ * Footer index of one file. Built by the producer; on rotation a copy
+ * is handed to the writer, which closes the old file with it.
+ */
+typedef struct {
+    uint32_t records;
+    uint32_t count;             // REC_INDEX records in the file
+    uint16_t stride;
+    uint16_t entries;
+    SdlogIndexEntry table[SDLOG_INDEX_TABLE_MAX];
+} FileIndex;
+
+// Seek points, producer side. Offsets are relative to fileBase.
+static FileIndex curIndex;
+static uint64_t lastIndexUs = 0;
+static size_t   lastIndexPos = 0;           // 0 = none yet
+
+/*
+ * Rotation
+ *
+ * Producer: when the current file is due and nextReady is set, it
+ * stores rotateAt (end of the old file), sets rotatePending and pushes
+ * the new file header. Ring positions stay stream offsets plus fileBase.
+ *
+ * Writer: writes the old file up to rotateAt, closes it with
+ * closingIndex, switches to nextFile and clears rotatePending. Only one
+ * rotation is in flight at a time.
+ */
+static std::atomic<uint32_t> rotateBytes{SDLOG_ROTATE_BYTES_DEFAULT};
+static std::atomic<uint32_t> rotateSeconds{SDLOG_ROTATE_SECONDS_DEFAULT};
+static std::atomic<bool> rotatePending{false};
+static std::atomic<bool> nextReady{false};
+static size_t   rotateAt = 0;
+static size_t   fileBase = 0;               // producer: ring position of stream offset 0
+static uint64_t fileStartUs = 0;
+static FileIndex closingIndex;
+static uint32_t closingDropped = 0;         // dropped records at rotateAt
+
+// Next file, writer side until nextReady is handed over
+static File     nextFile;
+static char     nextFileName[32];
+static uint32_t nextFileNumber = 0;
+static uint32_t nextPrealloc = 0;
+
+// Preallocated length of logFile, writer side once logging
+static uint32_t logPrealloc = 0;
+static uint32_t nextRetryMs = 0;
+
 /* =========================
  *  FILE HEADER
  * ========================= */
@@ -77,85 +328,875 @@ typedef struct __attribute__((packed)) {
  *  RING BUFFER
  * ========================= */
 
-static size_t buffer_free(void)
-{
-    if (writePos >= readPos)
-        return SDLOG_BUFFER_SIZE - (writePos - readPos) - 1;
-    else
-        return (readPos - writePos) - 1;
-}
+static constexpr size_t BUFFER_MASK = SDLOG_BUFFER_SIZE - 1;
 
 static bool buffer_write(const uint8_t* data, size_t len)
 {
-    if (buffer_free() < len)
+    const size_t w = writePos.load(std::memory_order_relaxed);
+    const size_t r = readPos.load(std::memory_order_acquire);
+
+    if (SDLOG_BUFFER_SIZE - (w - r) < len)
         return false;
 
-    for (size_t i = 0; i < len; i++) {
-        buffer[writePos] = data[i];
-        writePos = (writePos + 1) % SDLOG_BUFFER_SIZE;
+    // At most two segments: up to the end of the buffer, then from the start
+    const size_t offset = w & BUFFER_MASK;
+    const size_t first  = (len < SDLOG_BUFFER_SIZE - offset) ? len : SDLOG_BUFFER_SIZE - offset;
+
+    memcpy(&buffer[offset], data, first);
+    memcpy(buffer, data + first, len - first);
+
+    writePos.store(w + len, std::memory_order_release);
+
+    const size_t used = w + len - r;
+    if (used > bufferHighWater.load(std::memory_order_relaxed))
+        bufferHighWater.store(used, std::memory_order_relaxed);
+
+    return true;
+}
+
+/*
+ * Contiguous read: returns a pointer to the oldest unread bytes and the
+ * length that can be used without wrapping. Data stays valid until
+ * buffer_consume() is called.
+ */
+static size_t buffer_peek(const uint8_t** out)
+{
+    const size_t r = readPos.load(std::memory_order_relaxed);
+    const size_t w = writePos.load(std::memory_order_acquire);
+
+    const size_t used = w - r;
+    if (used == 0)
+        return 0;
+
+    const size_t offset = r & BUFFER_MASK;
+    const size_t contig = SDLOG_BUFFER_SIZE - offset;
+
+    *out = &buffer[offset];
+    return (used < contig) ? used : contig;
+}
+
+static void buffer_consume(size_t len)
+{
+    const size_t r = readPos.load(std::memory_order_relaxed);
+    readPos.store(r + len, std::memory_order_release);
+}
+
+// File header plus the calibration record that follows it
+static constexpr size_t FILE_HEADER_MAX =
+    sizeof(SdlogFileHeader) + SDLOG_LP_HEADER_SIZE + sizeof(SdlogCalHeader) +
+    BriterEncoder::NUM_ENCODERS * sizeof(SdlogCalEntry);
+
+/*
+ * Start of every file: header, then the calibration in effect so raw
+ * encoder values can be converted offline. Goes through the ring so
+ * ring offsets equal stream offsets.
+ */
+static void push_file_header(void)
+{
+    SdlogFileHeader hdr = {
+        .magic   = { 'S', 'D', 'L', 'G' },
+        .version = SDLOG_VERSION
+    };
+    buffer_write(reinterpret_cast<const uint8_t*>(&hdr), sizeof(hdr));
+
+    uint8_t cal[FILE_HEADER_MAX - sizeof(SdlogFileHeader)];
+    size_t calLen = calibrationEncodeRecord(cal, sizeof(cal), (uint64_t)esp_timer_get_time());
+    buffer_write(cal, calLen);
+}
+
+/* =========================
+ *  FILE NAMES
+ * ========================= */
+
+static void format_file_name(char* out, size_t len, uint32_t number)
+{
+    snprintf(out, len, "/LOG_%04lu.BIN", (unsigned long)number);
+}
+
+static void store_next_number(uint32_t number)
+{
+    Preferences prefs;
+    if (prefs.begin(SDLOG_NVS_NAMESPACE, false)) {
+        prefs.putBytes(SDLOG_NVS_KEY_NEXT, &number, sizeof(number));
+        prefs.end();
     }
+}
+
+// One pass over the root directory: number after the highest LOG_n.BIN
+static uint32_t scan_next_number(void)
+{
+    uint32_t next = 0;
+
+    File root = SD.open("/");
+    if (!root || !root.isDirectory())
+        return 0;
+
+    for (File f = root.openNextFile(); f; f = root.openNextFile()) {
+        const char* name = f.name();
+        const char* slash = strrchr(name, '/');
+        if (slash)
+            name = slash + 1;
+
+        char* end;
+        if (strncmp(name, "LOG_", 4) == 0) {
+            unsigned long n = strtoul(name + 4, &end, 10);
+            if (end != name + 4 && strcmp(end, ".BIN") == 0 && n + 1 > next)
+                next = (uint32_t)(n + 1);
+        }
+        f.close();
+    }
+    root.close();
+
+    return next;
+}
+
+/*
+ * Picks a new, unused file name and reserves its number in NVS.
+ * Existing files are never overwritten or appended to.
+ */
+static bool next_file_name(char* out, size_t len, uint32_t* number, bool* scanned)
+{
+    uint32_t n = 0;
+    bool stored = false;
+
+    Preferences prefs;
+    if (prefs.begin(SDLOG_NVS_NAMESPACE, true)) {
+        stored = prefs.getBytesLength(SDLOG_NVS_KEY_NEXT) == sizeof(n) &&
+                 prefs.getBytes(SDLOG_NVS_KEY_NEXT, &n, sizeof(n)) == sizeof(n);
+        prefs.end();
+    }
+
+    format_file_name(out, len, n);
+    *scanned = !stored || n >= SDLOG_MAX_FILES || SD.exists(out);
+    if (*scanned) {
+        n = scan_next_number();
+        format_file_name(out, len, n);
+    }
+
+    if (n >= SDLOG_MAX_FILES)
+        return false;
+
+    store_next_number(n + 1);
+    *number = n;
     return true;
 }
 
-static size_t buffer_read(uint8_t* dst, size_t maxLen)
+static bool rotation_enabled(void)
+{
+    return rotateBytes.load(std::memory_order_relaxed) != 0 ||
+           rotateSeconds.load(std::memory_order_relaxed) != 0;
+}
+
+// Preallocation for a new file: never (much) more than it will hold
+static uint32_t prealloc_bytes(void)
 {
-    size_t count = 0;
+    const uint32_t maxBytes = rotateBytes.load(std::memory_order_relaxed);
+    if (maxBytes != 0 && maxBytes < SDLOG_PREALLOC_BYTES)
+        return maxBytes + SDLOG_WRITE_BLOCK;
+    return SDLOG_PREALLOC_BYTES;
+}
 
-    while ((readPos != writePos) && (count < maxLen)) {
-        dst[count++] = buffer[readPos];
-        readPos = (readPos + 1) % SDLOG_BUFFER_SIZE;
+static void preallocate(File& f, uint32_t bytes)
+{
+    if (f.seek(bytes - 1)) {
+        f.write((uint8_t)0);
+        f.flush();
     }
-    return count;
 }
 
 /* =========================
  *  SD WRITER TASK
  * ========================= */
 
+// File length of the chunks written so far
+static uint64_t file_length(void)
+{
+    return (uint64_t)chunkSeq * SDLOG_CHUNK_SIZE +
+           (chunkOnCard ? sizeof(SdlogChunkHeader) + chunkFill : 0);
+}
+
+// Stream bytes of the current file taken so far
+static uint32_t stream_length(void)
+{
+    if (fileCodec != SDLOG_CODEC_NONE)
+        return rawStart + (uint32_t)rawFill;
+    return (uint32_t)(chunkSeq * SDLOG_CHUNK_PAYLOAD + chunkFill);
+}
+
+/*
+ * Writes chunkBuf (complete, or partial at a sync) at its place in the
+ * file. A partial chunk is written again, header and all, once
+ * complete.
+ */
+static void writer_write_chunk(bool complete)
+{
+    SdlogChunkHeader h = {
+        .magic    = { 'S', 'D', 'C', 'K' },
+        .seq      = chunkSeq,
+        .file_id  = fileId,
+        .len      = (uint16_t)chunkFill,
+        .codec    = chunkCodec,
+        .reserved = 0,
+        .crc      = 0
+    };
+    memcpy(chunkBuf, &h, sizeof(h));
+    const size_t crcOffset = sizeof(h) - sizeof(h.crc);
+    h.crc = crc32_ieee(chunkBuf, crcOffset);
+    h.crc = crc32_ieee(&chunkBuf[sizeof(h)], chunkFill, h.crc);
+    memcpy(&chunkBuf[crcOffset], &h.crc, sizeof(h.crc));
+
+    // A complete block may end short of the chunk: still one full
+    // chunk on the card, so the next one starts aligned
+    const size_t len = complete ? SDLOG_CHUNK_SIZE : sizeof(h) + chunkFill;
+    memset(&chunkBuf[sizeof(h) + chunkFill], 0, len - sizeof(h) - chunkFill);
+
+    int64_t t0 = esp_timer_get_time();
+    uint32_t c0 = perfStart();
+    if (chunkOnCard)
+        logFile.seek((uint32_t)chunkSeq * SDLOG_CHUNK_SIZE);
+    size_t written = logFile.write(chunkBuf, len);
+    perfRecord(PERF_SDLOG_WRITE, c0);
+    uint32_t dt = (uint32_t)(esp_timer_get_time() - t0);
+
+    if (written != len)
+        stats.write_errors++;
+
+    stats.writes++;
+    stats.bytes_written += written;
+    writeTimeTotalUs += dt;
+    if (dt > stats.write_max_us)
+        stats.write_max_us = dt;
+    stats.write_avg_us = (uint32_t)(writeTimeTotalUs / stats.writes);
+
+    if (complete) {
+        stats.chunks++;
+        chunkSeq++;
+        chunkFill = 0;
+        chunkOnCard = false;
+    } else {
+        if (chunkOnCard)
+            stats.chunk_rewrites++;
+        chunkOnCard = true;
+        chunkSynced = true;
+    }
+}
+
+/*
+ * Compresses the front of rawBuf into chunkBuf as one block, stored as
+ * it is if that carries more. full: rawBuf is full, write one complete
+ * chunk. Otherwise (sync) all of rawBuf goes out, the last chunk
+ * partial, to be packed again with what follows.
+ */
+static void writer_pack(bool full)
+{
+    uint8_t* block = &chunkBuf[sizeof(SdlogChunkHeader) + sizeof(SdlogBlockHeader)];
+
+    while (rawFill > 0) {
+        const size_t storable = rawFill < SDLOG_BLOCK_CAPACITY ? rawFill : SDLOG_BLOCK_CAPACITY;
+        size_t used;
+        uint32_t c0 = perfStart();
+        size_t n = lzb_compress(rawBuf, rawFill, block, SDLOG_BLOCK_CAPACITY, lzTable, &used);
+        perfRecord(PERF_SDLOG_COMPRESS, c0);
+
+        chunkCodec = SDLOG_CODEC_LZ;
+        if (used < storable || (used == storable && n >= used)) {
+            memcpy(block, rawBuf, storable);
+            n = used = storable;
+            chunkCodec = SDLOG_CODEC_STORED;
+        }
+
+        SdlogBlockHeader b = {
+            .offset   = rawStart,
+            .raw_len  = (uint16_t)used,
+            .reserved = 0
+        };
+        memcpy(&chunkBuf[sizeof(SdlogChunkHeader)], &b, sizeof(b));
+        chunkFill = sizeof(b) + n;
+
+        const bool complete = full || used < rawFill;
+        writer_write_chunk(complete);
+        if (!complete)
+            return;
+
+        rawFill -= used;
+        rawStart += (uint32_t)used;
+        memmove(rawBuf, &rawBuf[used], rawFill);
+        if (full)
+            return;
+    }
+}
+
+// Appends stream bytes, writing every chunk that fills up
+static void writer_append(const uint8_t* data, size_t len)
+{
+    stats.stream_bytes += len;
+
+    if (fileCodec != SDLOG_CODEC_NONE) {
+        while (len > 0) {
+            size_t n = SDLOG_COMPRESS_WINDOW - rawFill;
+            if (n > len)
+                n = len;
+
+            memcpy(&rawBuf[rawFill], data, n);
+            rawFill += n;
+            chunkSynced = false;
+            data += n;
+            len -= n;
+
+            if (rawFill == SDLOG_COMPRESS_WINDOW)
+                writer_pack(true);
+        }
+        return;
+    }
+
+    while (len > 0) {
+        size_t n = SDLOG_CHUNK_PAYLOAD - chunkFill;
+        if (n > len)
+            n = len;
+
+        memcpy(&chunkBuf[sizeof(SdlogChunkHeader) + chunkFill], data, n);
+        chunkFill += n;
+        chunkSynced = false;
+        data += n;
+        len -= n;
+
+        if (chunkFill == SDLOG_CHUNK_PAYLOAD)
+            writer_write_chunk(true);
+    }
+}
+
+// Stream bytes the open chunk (or the compression window) still takes
+static size_t writer_room(void)
+{
+    if (fileCodec != SDLOG_CODEC_NONE)
+        return SDLOG_COMPRESS_WINDOW - rawFill;
+    return SDLOG_CHUNK_PAYLOAD - chunkFill;
+}
+
+// Moves len ring bytes into the chunk (may wrap around the ring end)
+static void writer_take(size_t len)
+{
+    while (len > 0) {
+        const uint8_t* data;
+        size_t n = buffer_peek(&data);
+        if (n > len)
+            n = len;
+
+        writer_append(data, n);
+        buffer_consume(n);
+        len -= n;
+    }
+}
+
+static void writer_flush(void)
+{
+    int64_t t0 = esp_timer_get_time();
+    uint32_t c0 = perfStart();
+    logFile.flush();
+    perfRecord(PERF_SDLOG_FLUSH, c0);
+    uint32_t dt = (uint32_t)(esp_timer_get_time() - t0);
+
+    stats.flushes++;
+    if (dt > stats.flush_max_us)
+        stats.flush_max_us = dt;
+}
+
+// Sync point: the open chunk as it is, then the file
+static void writer_sync(void)
+{
+    if (fileCodec != SDLOG_CODEC_NONE) {
+        if (rawFill > 0 && !chunkSynced)
+            writer_pack(false);
+    } else if (chunkFill > 0 && !chunkSynced) {
+        writer_write_chunk(false);
+    }
+    writer_flush();
+}
+
+// Per-file chunk state for a new file
+static void begin_chunks(uint32_t number)
+{
+    chunkFill = 0;
+    chunkSeq = 0;
+    chunkOnCard = false;
+    chunkSynced = false;
+    rawFill = 0;
+    rawStart = 0;
+    fileCodec = codecSetting.load(std::memory_order_relaxed);
+    chunkCodec = SDLOG_CODEC_NONE;
+    stats.codec = fileCodec;
+
+    // Differs between files, so chunks of a deleted log left in the
+    // preallocated clusters never pass as this file's
+    fileId = crc32_ieee(reinterpret_cast<const uint8_t*>(&number), sizeof(number),
+                        (uint32_t)esp_timer_get_time());
+    if (fileId == 0)
+        fileId = 1;     // 0 means "any file" to readers
+}
+
+/*
+ * Appends REC_INDEX_TABLE (the stream tail of a file). Its trailer ends
+ * up as the last 8 bytes of the file.
+ */
+static void append_index_table(const FileIndex& idx, uint32_t dropped)
+{
+    const uint32_t offset = stream_length();
+    const size_t tableLen = idx.entries * sizeof(SdlogIndexEntry);
+    const uint16_t len = (uint16_t)(sizeof(SdlogIndexTableHeader) + tableLen +
+                                    sizeof(SdlogIndexTrailer));
+
+    uint8_t head[SDLOG_LP_HEADER_SIZE + sizeof(SdlogIndexTableHeader)];
+    head[0] = REC_INDEX_TABLE;
+    memcpy(&head[1], &len, 2);
+
+    SdlogIndexTableHeader h = {
+        .ts_us   = (uint64_t)esp_timer_get_time(),
+        .records = idx.records,
+        .dropped = dropped,
+        .entries = idx.entries,
+        .stride  = idx.stride
+    };
+    memcpy(&head[SDLOG_LP_HEADER_SIZE], &h, sizeof(h));
+
+    SdlogIndexTrailer trailer = { .table_offset = offset, .magic = { 'S', 'D', 'I', 'X' } };
+
+    writer_append(head, sizeof(head));
+    writer_append(reinterpret_cast<const uint8_t*>(idx.table), tableLen);
+    writer_append(reinterpret_cast<const uint8_t*>(&trailer), sizeof(trailer));
+}
+
+/*
+ * Finishes logFile once all its records are taken: run summary,
+ * footer index, last chunk, close, truncate the preallocation away.
+ * Called by the writer on rotation and at a stop sdlog_stop() gave up
+ * waiting for, and by sdlog_stop() once the writer is idle. dropped is
+ * the session's dropped record count at the end of the file.
+ */
+static void close_file(const FileIndex& idx, uint32_t dropped)
+{
+    if (!logFile)
+        return;
+
+    // Run summary, cumulative over all files of the session. Appended by
+    // the writer side: the ring is single producer and this is not it
+    static uint8_t summary[2560];
+    size_t n = runStatsEncodeRecord(summary, sizeof(summary), (uint64_t)esp_timer_get_time());
+    if (n > 0)
+        writer_append(summary, n);
+    else
+        stats.write_errors++;
+
+    // Footer index, the very last record so it is found from the end
+    append_index_table(idx, dropped);
+
+    writer_sync();
+    const uint64_t length = file_length();
+    logFile.close();
+
+#if SDLOG_PREALLOC_BYTES > 0
+    char vfsPath[48];
+    snprintf(vfsPath, sizeof(vfsPath), "%s%s", SDLOG_MOUNT_POINT, logFileName);
+    if (truncate(vfsPath, (off_t)length) != 0) {
+        stats.write_errors++;
+    }
+#endif
+}
+
+/*
+ * Writer side of a rotation, once the old file's stream is taken up to
+ * rotateAt. The new file's header is next in the ring.
+ */
+static void writer_rotate(void)
+{
+    close_file(closingIndex, closingDropped);
+
+    logFile = nextFile;
+    nextFile = File();
+    logPrealloc = nextPrealloc;
+    memcpy(logFileName, nextFileName, sizeof(logFileName));
+    begin_chunks(nextFileNumber);
+    stats.files++;
+
+    nextReady.store(false, std::memory_order_relaxed);
+    rotatePending.store(false, std::memory_order_release);
+}
+
+/*
+ * One step of getting the next file ready (idle writer passes only):
+ * pick a name and open, then preallocate SDLOG_PREOPEN_STEP at a time.
+ */
+static void prepare_next_file(void)
+{
+    if (!nextFile) {
+        if (millis() - nextRetryMs < 1000)
+            return;
+        nextRetryMs = millis();
+
+        bool scanned;
+        if (!next_file_name(nextFileName, sizeof(nextFileName), &nextFileNumber, &scanned))
+            return;
+        nextFile = SD.open(nextFileName, FILE_WRITE);
+        nextPrealloc = 0;
+        return;
+    }
+
+#if SDLOG_PREALLOC_BYTES > 0
+    const uint32_t target = prealloc_bytes();
+    if (nextPrealloc < target) {
+        nextPrealloc = (target - nextPrealloc > SDLOG_PREOPEN_STEP) ?
+                       nextPrealloc + SDLOG_PREOPEN_STEP : target;
+        preallocate(nextFile, nextPrealloc);
+        return;
+    }
+    nextFile.seek(0);
+#endif
+
+    nextReady.store(true, std::memory_order_release);
+}
+
+/*
+ * One step of preallocating logFile (idle writer passes only), ahead
+ * of the data written so far. False when there is nothing to do.
+ */
+static bool extend_log_file(void)
+{
+#if SDLOG_PREALLOC_BYTES > 0
+    const uint32_t target = prealloc_bytes();
+    const uint32_t length = (uint32_t)file_length();
+    if (!logFile || logPrealloc >= target || length >= target)
+        return false;
+
+    // Never below the data: the extension writes a byte at its end
+    const uint32_t from = logPrealloc > length ? logPrealloc : length;
+    logPrealloc = (target - from > SDLOG_PREOPEN_STEP) ? from + SDLOG_PREOPEN_STEP : target;
+    preallocate(logFile, logPrealloc);
+    logFile.seek(length);
+    return true;
+#else
+    return false;
+#endif
+}
+
+// sdlog_stop(): give back a next file that was never used
+static void discard_next_file(void)
+{
+    nextReady.store(false, std::memory_order_relaxed);
+    if (!nextFile)
+        return;
+
+    nextFile.close();
+    nextFile = File();
+    SD.remove(nextFileName);
+    store_next_number(nextFileNumber);
+}
+
 static void sdlog_task(void*)
 {
-    uint8_t localBuf[512];
+    uint32_t lastFlushMs = millis();
+    uint32_t bytesSinceFlush = 0;
 
     while (true) {
-        if (!logRunning) {
+        if (writerState.load(std::memory_order_acquire) == WRITER_IDLE) {
             vTaskDelay(pdMS_TO_TICKS(50));
+            lastFlushMs = millis();
+            bytesSinceFlush = 0;
             continue;
         }
 
-        size_t n = buffer_read(localBuf, sizeof(localBuf));
-        if (n > 0) {
-            logFile.write(localBuf, n);
-        } else {
+        const bool stopping = !logRunning.load(std::memory_order_acquire);
+        const bool flushDue = (millis() - lastFlushMs) >= SDLOG_FLUSH_INTERVAL_MS;
+
+        const size_t r = readPos.load(std::memory_order_relaxed);
+        size_t avail = writePos.load(std::memory_order_acquire) - r;
+
+        // Checked after writePos: a rotation is published before the
+        // bytes past rotateAt, so avail never covers them unnoticed
+        if (rotatePending.load(std::memory_order_acquire)) {
+            if (r == rotateAt) {
+                writer_rotate();
+                lastFlushMs = millis();
+                bytesSinceFlush = 0;
+                continue;
+            }
+            if (avail > rotateAt - r)
+                avail = rotateAt - r;
+        }
+
+        // Compressing: the window is filled in write-block steps, the
+        // ring never has to hold a whole window
+        const size_t room = writer_room();
+        const size_t step = room < SDLOG_WRITE_BLOCK ? room : SDLOG_WRITE_BLOCK;
+
+        if (avail >= step) {
+            // Normal path: complete the chunk, one aligned block on the card
+            const uint64_t written = stats.bytes_written;
+            writer_take(step);
+            bytesSinceFlush += (uint32_t)(stats.bytes_written - written);
+        }
+        else if (avail > 0 && (stopping || flushDue || rotatePending.load(std::memory_order_relaxed))) {
+            // Rest of the stream at a sync, stop or end of file
+            writer_take(avail);
+        }
+        else if (stopping) {
+            // Ring drained: hand the file back to sdlog_stop(), or close
+            // it here if sdlog_stop() gave up waiting
+            uint8_t expected = WRITER_ACTIVE;
+            if (!writerState.compare_exchange_strong(expected, WRITER_IDLE,
+                                                     std::memory_order_acq_rel)) {
+                close_file(curIndex, droppedRecords.load(std::memory_order_relaxed));
+                discard_next_file();
+                writerState.store(WRITER_IDLE, std::memory_order_release);
+            }
+            continue;
+        }
+        else if (!flushDue) {
+            if (!extend_log_file() && rotation_enabled() &&
+                !nextReady.load(std::memory_order_relaxed))
+                prepare_next_file();
             vTaskDelay(pdMS_TO_TICKS(5));
+            continue;
         }
+
+        if (flushDue || bytesSinceFlush >= SDLOG_FLUSH_BYTES) {
+            if (flushDue)
+                writer_sync();
+            else
+                writer_flush();
+            lastFlushMs = millis();
+            bytesSinceFlush = 0;
+        }
+
+        uint32_t elapsedMs = (uint32_t)((esp_timer_get_time() - sessionStartUs) / 1000);
+        if (elapsedMs > 0)
+            stats.bytes_per_sec = (uint32_t)(stats.bytes_written * 1000ULL / elapsedMs);
     }
 }
 
 /* =========================
- *  VEHICLE / CAN LOGGING
+ *  V2 RECORD ENCODING
  * ========================= */
 
-void sdlog_log_vehicle_frame(const CanFrame& frame)
+static size_t put_varint(uint8_t* out, uint64_t v)
 {
-    if (!logRunning)
+    size_t n = 0;
+    while (v >= 0x80) {
+        out[n++] = (uint8_t)(v | 0x80);
+        v >>= 7;
+    }
+    out[n++] = (uint8_t)v;
+    return n;
+}
+
+/*
+ * Seek point before the next record when due. Ring positions are stream
+ * offsets (plus fileBase), so the producer knows where the record will
+ * land.
+ */
+static void log_index_if_due(uint64_t tsUs)
+{
+    const size_t pos = writePos.load(std::memory_order_relaxed) - fileBase;
+
+    if (lastIndexPos != 0 &&
+        tsUs < lastIndexUs + SDLOG_INDEX_INTERVAL_US &&
+        pos - lastIndexPos < SDLOG_INDEX_BYTES)
         return;
 
-    SdlogVehicleRecord rec = {
-        .type   = REC_VEHICLE,
-        .ts_us  = esp_timer_get_time(),
-        .can_id = frame.id,
-        .dlc    = frame.dlc
+    uint8_t rec[SDLOG_LP_HEADER_SIZE + sizeof(SdlogIndexRecord)];
+    rec[0] = REC_INDEX;
+    const uint16_t len = sizeof(SdlogIndexRecord);
+    memcpy(&rec[1], &len, 2);
+
+    SdlogIndexRecord idx = {
+        .ts_us       = tsUs,
+        .offset      = (uint32_t)pos,
+        .records     = curIndex.records,
+        .dropped     = droppedRecords.load(std::memory_order_relaxed),
+        .prev_offset = (uint32_t)lastIndexPos
     };
+    memcpy(&rec[SDLOG_LP_HEADER_SIZE], &idx, sizeof(idx));
+
+    if (!sdlog_push(rec, sizeof(rec)))
+        return;
+
+    lastIndexUs  = tsUs;
+    lastIndexPos = pos;
+    syncPending  = true;    // next CAN record is decodable on its own
+
+    // Footer table: every stride-th seek point, thinned out when full
+    FileIndex& fi = curIndex;
+    if (fi.count % fi.stride == 0) {
+        if (fi.entries == SDLOG_INDEX_TABLE_MAX) {
+            for (uint16_t i = 0; i < SDLOG_INDEX_TABLE_MAX / 2; i++)
+                fi.table[i] = fi.table[2 * i];
+            fi.entries = SDLOG_INDEX_TABLE_MAX / 2;
+            fi.stride *= 2;
+        }
+        if (fi.count % fi.stride == 0)
+            fi.table[fi.entries++] = { tsUs, (uint32_t)pos };
+    }
+    fi.count++;
+}
+
+// Producer state of a new file starting at ring position 'base'
+static void begin_file(size_t base, uint64_t tsUs)
+{
+    fileBase    = base;
+    fileStartUs = tsUs;
+
+    curIndex.records = 0;
+    curIndex.count   = 0;
+    curIndex.stride  = 1;
+    curIndex.entries = 0;
+    lastIndexUs  = 0;
+    lastIndexPos = 0;
+
+    // First CAN record of every file carries a REC_TIMESYNC
+    lastTsUs = lastSyncUs = 0;
+    syncPending = true;
+
+    fileEpoch.fetch_add(1, std::memory_order_release);
+}
+
+/*
+ * Switch to the next file before this record when the current one is
+ * full or old enough. Nothing happens until the writer has the next
+ * file open (nextReady) and the previous switch is done; until then
+ * the current file simply grows a little longer.
+ */
+static void log_rotate_if_due(uint64_t tsUs)
+{
+    const uint32_t maxBytes = rotateBytes.load(std::memory_order_relaxed);
+    const uint32_t maxSeconds = rotateSeconds.load(std::memory_order_relaxed);
+    const size_t w = writePos.load(std::memory_order_relaxed);
+
+    if (!(maxBytes != 0 && w - fileBase >= maxBytes) &&
+        !(maxSeconds != 0 && tsUs >= fileStartUs + maxSeconds * 1000000ULL))
+        return;
+
+    if (!nextReady.load(std::memory_order_acquire) ||
+        rotatePending.load(std::memory_order_acquire))
+        return;
+
+    const size_t r = readPos.load(std::memory_order_acquire);
+    if (SDLOG_BUFFER_SIZE - (w - r) < FILE_HEADER_MAX)
+        return;     // ring too full for the header, next record retries
+
+    closingIndex = curIndex;
+    closingDropped = droppedRecords.load(std::memory_order_relaxed);
+    rotateAt = w;
+    rotatePending.store(true, std::memory_order_release);
+
+    push_file_header();
+
+    begin_file(w, tsUs);
+}
+
+/*
+ * Periodic counter snapshot, pushed from the record paths because
+ * those run in the producer task.
+ */
+static void log_perf_if_due(uint64_t tsUs)
+{
+    if (perfLogDue(tsUs)) {
+        static uint8_t perfRec[SDLOG_LP_HEADER_SIZE + sizeof(SdlogPerfHeader) +
+                               PERF_SITE_COUNT * (sizeof(SdlogPerfSite) + PERF_HIST_BINS * 4)];
+        size_t len = perfEncodeRecord(perfRec, sizeof(perfRec), tsUs);
+        if (len > 0)
+            sdlog_push(perfRec, len);
+    }
+}
+
+/*
+ * Encode one CAN frame (plus a REC_TIMESYNC when due) and push it as a
+ * single ring write. The delta base only advances when the push
+ * succeeds, so dropped records never break the timestamp chain.
+ */
+static void log_can_record(uint8_t type, uint64_t tsUs, const CanFrame& frame)
+{
+    uint8_t rec[sizeof(SdlogTimeSyncRecord) + SDLOG_V2_MAX_CAN_RECORD];
+    size_t n = 0;
+
+    log_rotate_if_due(tsUs);
+    log_index_if_due(tsUs);
+
+    uint64_t base = lastTsUs;
+    uint64_t syncUs = lastSyncUs;
+
+    if (syncPending || tsUs < lastTsUs || tsUs - lastSyncUs >= SDLOG_SYNC_INTERVAL_US) {
+        SdlogTimeSyncRecord sync = {
+            .type  = REC_TIMESYNC,
+            .ts_us = tsUs
+        };
+        memcpy(&rec[n], &sync, sizeof(sync));
+        n += sizeof(sync);
+        base = syncUs = tsUs;
+    }
+
+    const uint8_t dlc = (frame.dlc > 8) ? 8 : frame.dlc;
 
-    // Copy valid data bytes
-    memcpy(rec.data, frame.data, frame.dlc);
+    rec[n++] = type;
+    rec[n++] = dlc | (frame.extd ? SDLOG_INFO_EXTD : 0);
+    n += put_varint(&rec[n], tsUs - base);
 
-    // Zero remaining bytes (clean binary layout)
-    if (frame.dlc < 8) {
-        memset(rec.data + frame.dlc, 0, 8 - frame.dlc);
+    if (frame.extd) {
+        uint32_t id = frame.id & 0x1FFFFFFF;
+        memcpy(&rec[n], &id, 4);
+        n += 4;
+    } else {
+        uint16_t id = (uint16_t)(frame.id & 0x7FF);
+        memcpy(&rec[n], &id, 2);
+        n += 2;
     }
 
+    memcpy(&rec[n], frame.data, dlc);
+    n += dlc;
+
+    if (sdlog_push(rec, n)) {
+        lastTsUs    = tsUs;
+        lastSyncUs  = syncUs;
+        syncPending = false;
+    }
+
+    log_perf_if_due(tsUs);
+}
+
+/* =========================
+ *  VEHICLE / CAN LOGGING
+ * ========================= */
+
+void sdlog_log_vehicle_frame(const CanFrame& frame)
+{
+    if (!logRunning)
+        return;
+
+    log_can_record(REC_VEHICLE, frame.ts_us, frame);
+}
+
+void sdlog_log_sensors(const SdlogSensorRecord& rec)
+{
+    if (!logRunning)
+        return;
+
+    log_rotate_if_due(rec.ts_us);
+    log_index_if_due(rec.ts_us);
     sdlog_push(&rec, sizeof(rec));
+
+    log_perf_if_due(rec.ts_us);
+}
+
+/*
+ * Producer side: the calibration changed while logging.
+ */
+void sdlog_log_calibration(void)
+{
+    if (!logRunning)
+        return;
+
+    uint8_t rec[SDLOG_LP_HEADER_SIZE + sizeof(SdlogCalHeader) +
+                BriterEncoder::NUM_ENCODERS * sizeof(SdlogCalEntry)];
+    size_t n = calibrationEncodeRecord(rec, sizeof(rec), (uint64_t)esp_timer_get_time());
+    if (n > 0)
+        sdlog_push(rec, n);
 }
 
 /* =========================
@@ -168,14 +1209,8 @@ bool sdlog_init(void)
         return false;
 
     if (sdTaskHandle == nullptr) {
-        xTaskCreate(
-            sdlog_task,
-            "sdlog",
-            SDLOG_TASK_STACK,
-            nullptr,
-            SDLOG_TASK_PRIO,
-            &sdTaskHandle
-        );
+        startTask(sdlog_task, "sdlog", SDLOG_TASK_STACK,
+                  SDLOG_TASK_PRIO, TASK_CORE_IO, &sdTaskHandle);
     }
 
     return true;
@@ -183,49 +1218,108 @@ bool sdlog_init(void)
 
 bool sdlog_start(void)
 {
-    if (logRunning)
+    if (logRunning || writerState.load(std::memory_order_acquire) != WRITER_IDLE)
         return false;
 
-    char filename[32];
-    uint32_t idx = 0;
+    const int64_t t0 = esp_timer_get_time();
+
+    uint32_t number;
+    bool scanned;
+    if (!next_file_name(logFileName, sizeof(logFileName), &number, &scanned))
+        return false;
 
-    do {
-        snprintf(filename, sizeof(filename), "/LOG_%04lu.BIN", idx++);
-    } while (SD.exists(filename) && idx < 10000);
+    const int64_t t1 = esp_timer_get_time();
 
-    logFile = SD.open(filename, FILE_WRITE);
+    logFile = SD.open(logFileName, FILE_WRITE);
     if (!logFile)
         return false;
 
-    // NOTE:
-    // Log files are always created with a new filename.
-    // Existing files are never overwritten or appended to.
+#if SDLOG_PREALLOC_BYTES > 0
+    // First step only, the writer extends the file from its idle
+    // passes (extend_log_file()). Truncated back when closed.
+    logPrealloc = prealloc_bytes() < SDLOG_PREOPEN_STEP ? prealloc_bytes() : SDLOG_PREOPEN_STEP;
+    preallocate(logFile, logPrealloc);
+    logFile.seek(0);
+#endif
 
-    SdlogFileHeader hdr = {
-        .magic   = { 'S', 'D', 'L', 'G' },
-        .version = SDLOG_VERSION
-    };
+    readPos.store(0, std::memory_order_relaxed);
+    writePos.store(0, std::memory_order_relaxed);
+    bufferHighWater.store(0, std::memory_order_relaxed);
+    droppedRecords = 0;
+    rotatePending.store(false, std::memory_order_relaxed);
+    begin_chunks(number);
 
-    logFile.write(reinterpret_cast<const uint8_t*>(&hdr), sizeof(hdr));
-    logFile.flush();
+    begin_file(0, (uint64_t)esp_timer_get_time());
 
-    writePos = readPos = 0;
-    droppedRecords = 0;
-    logRunning = true;
+    stats = {};
+    stats.files = 1;
+    stats.codec = fileCodec;
+    stats.start_lookup_us = (uint32_t)(t1 - t0);
+    stats.start_us = (uint32_t)(esp_timer_get_time() - t0);
+    stats.start_scanned = scanned;
+    writeTimeTotalUs = 0;
+    sessionStartUs = esp_timer_get_time();
+
+    push_file_header();
+    calibrationTakeChanged();
+
+    // One run per session, however many files it spans
+    runStatsReset();
+    resetSensorFrameStats();
+
+    writerState.store(WRITER_ACTIVE, std::memory_order_release);
+    logRunning.store(true, std::memory_order_release);
 
     return true;
 }
 
 void sdlog_stop(void)
 {
-    logRunning = false;
+    if (!logRunning)
+        return;
 
-    vTaskDelay(pdMS_TO_TICKS(50));
+    logRunning.store(false, std::memory_order_release);
 
-    if (logFile) {
-        logFile.flush();
-        logFile.close();
+    // Let the writer drain the ring (bounded wait)
+    uint32_t t0 = millis();
+    while (writerState.load(std::memory_order_acquire) == WRITER_ACTIVE &&
+           millis() - t0 < 2000) {
+        vTaskDelay(pdMS_TO_TICKS(5));
     }
+
+    // Writer stuck on the card: it finishes the file when it gets back
+    uint8_t expected = WRITER_ACTIVE;
+    if (writerState.compare_exchange_strong(expected, WRITER_CLOSES,
+                                            std::memory_order_acq_rel))
+        return;
+
+    close_file(curIndex, droppedRecords.load(std::memory_order_relaxed));
+    discard_next_file();
+}
+
+void sdlog_set_rotation(uint32_t maxBytes, uint32_t maxSeconds)
+{
+    rotateBytes.store(maxBytes, std::memory_order_relaxed);
+    rotateSeconds.store(maxSeconds, std::memory_order_relaxed);
+}
+
+void sdlog_get_rotation(uint32_t* maxBytes, uint32_t* maxSeconds)
+{
+    if (maxBytes)
+        *maxBytes = rotateBytes.load(std::memory_order_relaxed);
+    if (maxSeconds)
+        *maxSeconds = rotateSeconds.load(std::memory_order_relaxed);
+}
+
+void sdlog_set_codec(SdlogCodec codec)
+{
+    codecSetting.store(codec == SDLOG_CODEC_NONE ? SDLOG_CODEC_NONE : SDLOG_CODEC_LZ,
+                       std::memory_order_relaxed);
+}
+
+SdlogCodec sdlog_get_codec(void)
+{
+    return (SdlogCodec)codecSetting.load(std::memory_order_relaxed);
 }
 
 bool sdlog_push(const void* data, size_t len)
@@ -233,10 +1327,13 @@ bool sdlog_push(const void* data, size_t len)
     if (!logRunning)
         return true;
 
+    PerfScope perf(PERF_SDLOG_PUSH);
+
     if (!buffer_write(static_cast<const uint8_t*>(data), len)) {
         droppedRecords++;
         return false;
     }
+    curIndex.records++;
     return true;
 }
 
@@ -250,22 +1347,27 @@ uint32_t sdlog_dropped(void)
     return droppedRecords;
 }
 
-void sdlog_log_sniff(const CanFrame& frame)
+uint32_t sdlog_file_epoch(void)
 {
-    if (!logRunning)
+    return fileEpoch.load(std::memory_order_acquire);
+}
+
+void sdlog_get_stats(SdlogStats* out)
+{
+    if (!out)
         return;
 
-    SdlogSniffRecord rec = {
-        .type   = REC_SNIFF,
-        .ts_us  = esp_timer_get_time(),
-        .can_id = frame.id,
-        .dlc    = frame.dlc
-    };
+    *out = stats;
+    out->buffer_high_water = (uint32_t)bufferHighWater.load(std::memory_order_relaxed);
+    out->buffer_size       = SDLOG_BUFFER_SIZE;
+    memcpy(out->file_name, logFileName, sizeof(out->file_name));
+    out->file_name[sizeof(out->file_name) - 1] = '\0';
+}
 
-    memcpy(rec.data, frame.data, frame.dlc);
-    if (frame.dlc < 8) {
-        memset(rec.data + frame.dlc, 0, 8 - frame.dlc);
-    }
+void sdlog_log_sniff(const CanFrame& frame)
+{
+    if (!logRunning)
+        return;
 
-    sdlog_push(&rec, sizeof(rec));
-}
\ No newline at end of file
+    log_can_record(REC_SNIFF, frame.ts_us, frame);
+}
@@ -17,7 +17,7 @@
  * This version is written once at the beginning of each log file.
  * Offline parsers MUST check this value before decoding.
  */
-#define SDLOG_VERSION 0x01
+#define SDLOG_VERSION 0x06
 
 /* =========================
  *  SDLOG RECORD TYPES
@@ -27,20 +27,356 @@ typedef enum : uint8_t {
     REC_SENSORS  = 0x01,    // Suspension, IMU, future sensors
     REC_VEHICLE  = 0x02,    // CAN bus (ECU, speed, RPM, etc)
     REC_SNIFF    = 0x03,    // RAW sniffing without scaling
+    REC_TIMESYNC = 0x04,    // Absolute timestamp, delta base (v2+)
+    REC_STATS    = 0x05,    // Run statistics summary (v3+, length prefixed)
+    REC_CALIB    = 0x06,    // Encoder calibration table (v3+, length prefixed)
+    REC_PERF     = 0x07,    // Performance counter snapshot (v3+, length prefixed)
+    REC_INDEX    = 0x08,    // Seek point (v4+, length prefixed)
+    REC_INDEX_TABLE = 0x09, // Footer index, last record of a file (v4+, length prefixed)
+    REC_CAN_HEALTH  = 0x0A, // CAN bus health interval (v5+, length prefixed)
+    REC_SNIFF_FILTER = 0x0B, // Sniff filter counters (v6+, length prefixed)
 } SdlogRecordType;
 
+/* =========================
+ *  V2 RECORD LAYOUT
+ * =========================
+ * Records are variable length, little endian. CAN record timestamps are
+ * delta encoded against the previous record's timestamp (unsigned
+ * LEB128 varint, microseconds).
+ *
+ * REC_VEHICLE / REC_SNIFF:
+ *   uint8_t  type
+ *   uint8_t  info        bits 0..3 dlc, bit 7 extended (29-bit) ID
+ *   varint   dt_us       delta to previous record timestamp
+ *   uint16_t can_id      standard (11-bit) ID
+ *   uint32_t can_id      extended (29-bit) ID, instead of the above
+ *   uint8_t  data[dlc]
+ *
+ * REC_TIMESYNC (SdlogTimeSyncRecord):
+ *   absolute timestamp, becomes the delta base for following records.
+ *   It is the first record of every file and repeats periodically,
+ *   so a reader can resync without decoding from the start.
+ *
+ * REC_SENSORS keeps its fixed layout with an absolute timestamp
+ * (SdlogSensorRecord, written from v4 on) and does not take part in
+ * the delta chain.
+ */
+
+/* =========================
+ *  V3 LENGTH-PREFIXED RECORDS
+ * =========================
+ * v3 = v2 plus record types >= REC_STATS, which all carry their length:
+ *   uint8_t  type
+ *   uint16_t len         payload bytes that follow
+ *   uint8_t  payload[len]
+ * A reader can skip such records without knowing the type. They do not
+ * take part in the timestamp delta chain.
+ *
+ * REC_STATS payload (run summary, written at the end of every file,
+ * cumulative over all files of a session):
+ *   SdlogStatsHeader
+ *   per encoder:
+ *     SdlogStatsEncoder
+ *     uint32_t vel_comp_ms[vel_bins]   time per compression velocity bin
+ *     uint32_t vel_reb_ms[vel_bins]    time per rebound velocity bin
+ *     uint32_t travel_ms[travel_bins]  time per travel bin
+ * Bin i covers [i * width, (i + 1) * width), the last bin is open ended.
+ *
+ * REC_CALIB payload (after the file header, and again whenever the
+ * calibration changes while logging):
+ *   SdlogCalHeader
+ *   SdlogCalEntry x encoders
+ * Applies to encoder values logged after it (see calibration.h for
+ * the conversion). Encoder values themselves are logged as raw counts
+ * in REC_SENSORS frames in normal mode (v4+; v3 logged the READ
+ * responses as REC_VEHICLE frames).
+ *
+ * REC_PERF payload (every "perf log <s>" seconds while logging, see
+ * perf.h):
+ *   SdlogPerfHeader
+ *   per site:
+ *     SdlogPerfSite
+ *     uint32_t hist[hist_bins]         bin i: [2^i, 2^(i+1)) cycles
+ * Counters are cumulative since the last "perf reset".
+ *
+ * REC_INDEX payload (SdlogIndexRecord, every SDLOG_INDEX_INTERVAL_US or
+ * SDLOG_INDEX_BYTES of log, whichever comes first):
+ *   a seek point. It starts at a record boundary and the next CAN
+ *   record carries a REC_TIMESYNC, so decoding can begin right at
+ *   'offset' without the preceding data. prev_offset chains the seek
+ *   points backwards.
+ *
+ * REC_INDEX_TABLE payload (written when a file is closed, after REC_STATS):
+ *   SdlogIndexTableHeader
+ *   SdlogIndexEntry x entries          every stride-th REC_INDEX
+ *   SdlogIndexTrailer                  last 8 bytes of the stream
+ * A reader finds the table from the end of the stream. Files without it
+ * (power loss) can still be indexed by scanning for REC_INDEX.
+ *
+ * REC_CAN_HEALTH payload (every CAN_HEALTH_INTERVAL_MS while logging,
+ * see can_bus.h):
+ *   SdlogCanHealthHeader
+ *   SdlogCanIdRate x ids               frames per ID in the interval
+ * Lost-frame and error counters are cumulative; any increase of
+ * rx_missed or rx_overrun between two records (SDLOG_CANH_LOSS) means
+ * frames on the bus never reached the log.
+ *
+ * REC_SNIFF_FILTER payload (every SNIFF_REPORT_INTERVAL_MS while logging
+ * in sniffer mode, see sniff_filter.h):
+ *   SdlogSniffFilterHeader
+ *   SdlogSniffIdCount x ids            per tracked ID
+ * With SDLOG_SNIFF_CHANGES_ONLY a REC_SNIFF frame stands until the next
+ * one of its ID: repeats of the same data were not logged, but at least
+ * every keyframe_ms. Counters are cumulative since "sniff reset".
+ *
+ * Offsets are stream offsets: byte positions in the record stream,
+ * starting with the "SDLG" header at 0. Up to v4 the stream is the file;
+ * from v5 on it is split into chunks (below).
+ */
+
+#define SDLOG_LP_HEADER_SIZE    3
+#define SDLOG_LP_FIRST_TYPE     REC_STATS
+
+/* =========================
+ *  V4 SENSOR FRAMES
+ * =========================
+ * v4 = v3 plus REC_SENSORS: one record per polling cycle with the raw
+ * counts of all four corners (see sensor_frame.h). Channel i is
+ * encoder BriterEncoder::FIRST_ID + i; it is present if bit i of valid
+ * is set, and was received at ts_us + dt_us[i].
+ */
+#define SDLOG_SENSOR_CHANNELS   4
+
+typedef struct __attribute__((packed)) {
+    uint64_t ts_us;             // end of run
+    uint32_t duration_ms;
+    uint8_t  encoders;
+    uint8_t  vel_bins;
+    uint16_t vel_bin_mm_s;
+    uint16_t lshs_split_mm_s;
+    uint8_t  travel_bins;
+    uint8_t  travel_bin_mm;
+} SdlogStatsHeader;
+
+typedef struct __attribute__((packed)) {
+    uint8_t  id;                // encoder CAN ID
+    uint32_t samples;
+    float    travel_min;        // mm
+    float    travel_max;
+    float    travel_mean;       // time weighted
+    float    vel_comp_max;      // mm/s
+    float    vel_reb_max;
+    float    bottom_out_mm;     // threshold, 0 = disabled
+    uint32_t bottom_outs;
+    uint32_t comp_ls_ms;
+    uint32_t comp_hs_ms;
+    uint32_t reb_ls_ms;
+    uint32_t reb_hs_ms;
+} SdlogStatsEncoder;
+
+#define SDLOG_CAL_INVERT        0x01
+
+typedef struct __attribute__((packed)) {
+    uint64_t ts_us;
+    uint8_t  encoders;
+} SdlogCalHeader;
+
+typedef struct __attribute__((packed)) {
+    uint8_t  id;                // encoder CAN ID
+    int32_t  scale_q16;         // micrometres per count, Q16.16
+    int32_t  offset;            // counts
+    int32_t  wrap_at;           // counts
+    int32_t  wrap_span;         // counts, 0 = no wrap
+    uint8_t  flags;             // SDLOG_CAL_*
+} SdlogCalEntry;
+
+typedef struct __attribute__((packed)) {
+    uint64_t ts_us;
+    uint16_t cpu_mhz;           // cycles per microsecond
+    uint8_t  sites;
+    uint8_t  hist_bins;
+    uint32_t buffer_high_water; // ring bytes, this log file
+    uint32_t dropped;           // records, this log file
+} SdlogPerfHeader;
+
+typedef struct __attribute__((packed)) {
+    uint8_t  site;              // PerfSite
+    uint32_t count;
+    uint32_t min_cycles;
+    uint32_t max_cycles;
+    uint64_t sum_cycles;
+} SdlogPerfSite;
+
+typedef struct __attribute__((packed)) {
+    uint64_t ts_us;
+    uint32_t offset;            // stream offset of this record
+    uint32_t records;           // records logged before it
+    uint32_t dropped;
+    uint32_t prev_offset;       // previous REC_INDEX, 0 = first
+} SdlogIndexRecord;
+
+typedef struct __attribute__((packed)) {
+    uint64_t ts_us;             // end of log
+    uint32_t records;
+    uint32_t dropped;
+    uint16_t entries;
+    uint16_t stride;            // REC_INDEX records per entry
+} SdlogIndexTableHeader;
+
+typedef struct __attribute__((packed)) {
+    uint64_t ts_us;
+    uint32_t offset;            // stream offset of a REC_INDEX record
+} SdlogIndexEntry;
+
+#define SDLOG_INDEX_MAGIC       "SDIX"
+
+typedef struct __attribute__((packed)) {
+    uint32_t table_offset;      // stream offset of the REC_INDEX_TABLE record
+    uint8_t  magic[4];          // SDLOG_INDEX_MAGIC
+} SdlogIndexTrailer;
+
+#define SDLOG_CANH_LOSS         0x01    // frames missed / overrun in this interval
+#define SDLOG_CANH_RECOVERED    0x02    // bus-off recovery completed in this interval
+#define SDLOG_CANH_ID_EXTD      0x80000000u
+
+typedef struct __attribute__((packed)) {
+    uint64_t ts_us;             // end of the interval
+    uint32_t interval_ms;
+    uint8_t  state;             // twai_state_t
+    uint8_t  flags;             // SDLOG_CANH_*
+    uint16_t bus_load_permille; // estimated from frame lengths
+    uint16_t tx_error_counter;
+    uint16_t rx_error_counter;
+    uint32_t frames;            // on the bus in the interval (RX + TX + missed)
+    uint32_t rx_missed;         // cumulative since "can reset"
+    uint32_t rx_overrun;
+    uint32_t tx_failed;
+    uint32_t arb_lost;
+    uint32_t bus_errors;
+    uint16_t bus_off;
+    uint16_t rx_queue_len;
+    uint16_t tx_queue_len;
+    uint16_t ids;
+    uint32_t other_frames;      // IDs that did not fit the table
+    uint32_t dropped;           // sdlog records, this log file
+} SdlogCanHealthHeader;
+
+typedef struct __attribute__((packed)) {
+    uint32_t id;                // | SDLOG_CANH_ID_EXTD for 29-bit IDs
+    uint32_t frames;
+} SdlogCanIdRate;
+
+#define SDLOG_SNIFF_CHANGES_ONLY    0x01
+
+typedef struct __attribute__((packed)) {
+    uint64_t ts_us;
+    uint32_t keyframe_ms;       // 0 = no keyframes
+    uint8_t  flags;             // SDLOG_SNIFF_*
+    uint8_t  ranges;            // include / exclude ranges in use
+    uint16_t ids;
+    uint32_t frames;            // seen while logging
+    uint32_t logged;
+    uint32_t suppressed;        // unchanged repeats
+    uint32_t excluded;          // outside the ranges
+    uint32_t untracked;         // logged unfiltered, ID table full
+} SdlogSniffFilterHeader;
+
+typedef struct __attribute__((packed)) {
+    uint32_t id;                // | SDLOG_CANH_ID_EXTD for 29-bit IDs
+    uint32_t logged;
+    uint32_t suppressed;
+} SdlogSniffIdCount;
+
+/* =========================
+ *  V5 / V6 CHUNK FRAMING
+ * =========================
+ * v5 = v4 records, stored on the card as a sequence of chunks of
+ * exactly SDLOG_CHUNK_SIZE bytes (one sector aligned write each):
+ *   SdlogChunkHeader
+ *   uint8_t  payload[len]      next len bytes of the record stream
+ * Every chunk but the last carries SDLOG_CHUNK_PAYLOAD bytes, so stream
+ * offset s is in chunk s / SDLOG_CHUNK_PAYLOAD. The last chunk is cut
+ * to its real length, which keeps SdlogIndexTrailer the last 8 bytes of
+ * the file.
+ *
+ * crc covers the header up to crc plus the payload. seq is the chunk
+ * number in the file, file_id is the same for all chunks of one file,
+ * so stale chunks of an older file in a reused cluster are not taken
+ * for this one. After a power cut every chunk that passes its CRC is
+ * good; records are picked up again at the next REC_INDEX, whose
+ * offset field equals its own stream offset.
+ *
+ * v6 = v5 + codec. SDLOG_CODEC_NONE chunks are the v5 layout above.
+ * In a compressed file every chunk holds one block instead:
+ *   SdlogChunkHeader           codec SDLOG_CODEC_STORED or SDLOG_CODEC_LZ
+ *   SdlogBlockHeader           where the block goes in the stream
+ *   uint8_t  data[len - 8]     raw_len stream bytes, as they are (STORED)
+ *                              or LZ coded (lz_block.h)
+ * Chunks keep their size and file offsets, but carry a variable amount
+ * of stream: a reader finds the chunk of a stream offset through the
+ * block offsets (ascending with seq) and decodes it on its own, blocks
+ * share no state. The stream itself, index offsets included, is the
+ * same as uncompressed; its last 8 bytes (SdlogIndexTrailer) are then
+ * in the decoded last block rather than at the end of the file. All
+ * chunks of a file use the same framing, the first chunk's codec tells
+ * which.
+ */
+
+#define SDLOG_CHUNK_MAGIC       "SDCK"
+#define SDLOG_CHUNK_SIZE        8192
+
+typedef enum : uint8_t {
+    SDLOG_CODEC_NONE   = 0,     // payload is stream bytes (v5 layout)
+    SDLOG_CODEC_STORED = 1,     // block, not compressed (did not shrink)
+    SDLOG_CODEC_LZ     = 2,     // block, lz_block.h
+} SdlogCodec;
+
+typedef struct __attribute__((packed)) {
+    uint8_t  magic[4];          // SDLOG_CHUNK_MAGIC
+    uint32_t seq;               // chunk number in the file, from 0
+    uint32_t file_id;
+    uint16_t len;               // payload bytes
+    uint8_t  codec;             // SdlogCodec (v6+, 0 before)
+    uint8_t  reserved;          // 0
+    uint32_t crc;               // CRC-32 (crc.h) over magic..reserved + payload
+} SdlogChunkHeader;
+
+#define SDLOG_CHUNK_PAYLOAD     (SDLOG_CHUNK_SIZE - sizeof(SdlogChunkHeader))
+
+typedef struct __attribute__((packed)) {
+    uint32_t offset;            // stream offset of the first decoded byte
+    uint16_t raw_len;           // decoded bytes
+    uint16_t reserved;          // 0
+} SdlogBlockHeader;
+
+// Coded bytes a chunk can hold in a compressed file
+#define SDLOG_BLOCK_CAPACITY    (SDLOG_CHUNK_PAYLOAD - sizeof(SdlogBlockHeader))
+
+#define SDLOG_INFO_DLC_MASK     0x0F
+#define SDLOG_INFO_EXTD         0x80
+
+// Largest encoded v2 CAN record: type + info + varint(64) + id + data
+#define SDLOG_V2_MAX_CAN_RECORD (1 + 1 + 10 + 4 + 8)
+
+typedef struct __attribute__((packed)) {
+    uint8_t  type;       // REC_TIMESYNC
+    uint64_t ts_us;
+} SdlogTimeSyncRecord;
+
 /* =========================
  *  RECORD DEFINITIONS
  * ========================= */
 
-// --- Sensor record (example, existing structure) ---
+// --- Sensor frame record (v4+) ---
 typedef struct __attribute__((packed)) {
     uint8_t  type;       // REC_SENSORS
-    uint64_t ts_us;
-    /* sensor payload continues */
+    uint64_t ts_us;      // RX time of the earliest sample
+    uint8_t  valid;      // bit i: channel i present
+    uint16_t dt_us[SDLOG_SENSOR_CHANNELS];
+    int32_t  raw[SDLOG_SENSOR_CHANNELS];
 } SdlogSensorRecord;
 
-// --- Vehicle / CAN record ---
+// --- Vehicle / CAN record (SDLOG_VERSION 1 layout, kept for decoders) ---
 typedef struct __attribute__((packed)) {
     uint8_t  type;       // REC_VEHICLE
     uint64_t ts_us;
@@ -49,7 +385,7 @@ typedef struct __attribute__((packed)) {
     uint8_t  data[8];
 } SdlogVehicleRecord;
 
-// --- Sniff record --- //
+// --- Sniff record (SDLOG_VERSION 1 layout, kept for decoders) --- //
 typedef struct __attribute__((packed)) {
     uint8_t  type;      // REC_SNIFF
     uint64_t ts_us;
@@ -58,6 +394,37 @@ typedef struct __attribute__((packed)) {
     uint8_t  data[8];
 } SdlogSniffRecord;
 
+/* =========================
+ *  WRITER STATISTICS
+ * ========================= */
+
+/*
+ * Counters for the current (or last) log session.
+ * Use these to size SDLOG_BUFFER_SIZE / SDLOG_WRITE_BLOCK from data:
+ * the ring must hold at least write_max_us worth of incoming bytes.
+ */
+typedef struct {
+    uint64_t bytes_written;
+    uint32_t writes;
+    uint32_t write_max_us;
+    uint32_t write_avg_us;
+    uint32_t flushes;
+    uint32_t flush_max_us;
+    uint32_t bytes_per_sec;
+    uint32_t write_errors;
+    uint32_t buffer_high_water;   // bytes
+    uint32_t buffer_size;         // bytes
+    uint32_t chunks;              // complete chunks written
+    uint32_t chunk_rewrites;      // partial chunks written at a sync, completed later
+    uint64_t stream_bytes;        // record stream taken into chunks (before compression)
+    uint8_t  codec;               // SdlogCodec of the current file
+    uint32_t files;               // files of this session (1 + rotations)
+    uint32_t start_us;            // sdlog_start() duration
+    uint32_t start_lookup_us;     // ... of which finding the file name
+    bool     start_scanned;       // name came from a directory scan, not NVS
+    char     file_name[16];       // current file, "/LOG_0042.BIN"
+} SdlogStats;
+
 /* =========================
  *  SDLOG API
  * ========================= */
@@ -66,12 +433,36 @@ bool sdlog_init(void);
 bool sdlog_start(void);
 void sdlog_stop(void);
 
+/*
+ * File rotation: start a new file when the current one reaches maxBytes
+ * or maxSeconds (0 = no limit, both 0 = off). Takes effect immediately,
+ * also while logging. The files of one session are consecutive
+ * LOG_n.BIN, each complete with header, calibration and footer index.
+ */
+void sdlog_set_rotation(uint32_t maxBytes, uint32_t maxSeconds);
+void sdlog_get_rotation(uint32_t* maxBytes, uint32_t* maxSeconds);
+
+/*
+ * Stream compression (SDLOG_CODEC_LZ) or none (SDLOG_CODEC_NONE). Takes
+ * effect with the next file (start or rotation). Rotation limits count
+ * stream bytes, compressed files end up smaller.
+ */
+void sdlog_set_codec(SdlogCodec codec);
+SdlogCodec sdlog_get_codec(void);
+
 bool sdlog_push(const void* data, size_t len);
 
 bool sdlog_is_running(void);
 uint32_t sdlog_dropped(void);
 
+/*
+ * Changes whenever a new file begins (start or rotation). Producers
+ * that only log changes use it to start every file from full state.
+ */
+uint32_t sdlog_file_epoch(void);
+void sdlog_get_stats(SdlogStats* out);
+
 void sdlog_log_sniff(const CanFrame& frame);
-void sdlog_log_vehicle_frame(uint32_t can_id,
-                             uint8_t dlc,
-                             const uint8_t* data);
+void sdlog_log_vehicle_frame(const CanFrame& frame);
+void sdlog_log_sensors(const SdlogSensorRecord& rec);
+void sdlog_log_calibration(void);
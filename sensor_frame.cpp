@@ -0,0 +1,93 @@
+#include "sensor_frame.h"
+#include "BriterEncoder.h"
+#include "encoder_poll.h"
+#include "sdlog.h"
+
+#include <string.h>
+
+static_assert(BriterEncoder::NUM_ENCODERS <= SDLOG_SENSOR_CHANNELS,
+              "REC_SENSORS has too few channels for all encoders");
+static_assert(SENSOR_FRAME_MAX_SPAN_US <= UINT16_MAX,
+              "channel offsets are 16 bit");
+
+/* =========================
+ *  INTERNAL STATE
+ * ========================= */
+
+// Open frame, RX path only
+static SdlogSensorRecord frame;
+static bool frameOpen = false;
+
+static SensorFrameStats stats = {};
+
+static void closeFrame(uint8_t expected)
+{
+    if (!frameOpen)
+        return;
+
+    frameOpen = false;
+
+    stats.frames++;
+    if (expected != 0 && (frame.valid & expected) == expected)
+        stats.complete++;
+
+    uint16_t span = 0;
+    for (uint8_t i = 0; i < SDLOG_SENSOR_CHANNELS; i++) {
+        if ((frame.valid & (1u << i)) && frame.dt_us[i] > span)
+            span = frame.dt_us[i];
+    }
+    if (span > stats.span_max_us)
+        stats.span_max_us = span;
+
+    sdlog_log_sensors(frame);
+}
+
+/* =========================
+ *  PUBLIC API
+ * ========================= */
+
+void sensorFrameAdd(uint8_t idx, int32_t raw, uint64_t rxUs)
+{
+    if (idx >= BriterEncoder::NUM_ENCODERS)
+        return;
+
+    const uint8_t expected = encoderPollActiveMask();
+    const uint8_t bit = (uint8_t)(1u << idx);
+
+    if (frameOpen &&
+        ((frame.valid & bit) || rxUs < frame.ts_us ||
+         rxUs - frame.ts_us > SENSOR_FRAME_MAX_SPAN_US)) {
+        closeFrame(expected);
+    }
+
+    if (!frameOpen) {
+        memset(&frame, 0, sizeof(frame));
+        frame.type  = REC_SENSORS;
+        frame.ts_us = rxUs;
+        frameOpen = true;
+    }
+
+    frame.valid |= bit;
+    frame.dt_us[idx] = (uint16_t)(rxUs - frame.ts_us);
+    frame.raw[idx] = raw;
+
+    // All expected corners in. Nothing expected (polling stopped, no
+    // auto-report, e.g. a replay): frames close on repeat / span only.
+    if (expected != 0 && (frame.valid & expected) == expected)
+        closeFrame(expected);
+}
+
+void sensorFrameFlush()
+{
+    closeFrame(encoderPollActiveMask());
+}
+
+void getSensorFrameStats(SensorFrameStats& out)
+{
+    out = stats;
+}
+
+void resetSensorFrameStats()
+{
+    stats = {};
+}
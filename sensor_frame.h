@@ -0,0 +1,49 @@
+#pragma once
+
+#include <stdint.h>
+
+/*
+ * Four-corner sensor frame assembler.
+ *
+ * Groups the encoder samples of one polling cycle into a single
+ * REC_SENSORS record (sdlog.h): raw counts of all corners, the RX time
+ * of the earliest sample and a per-channel offset from it. Offsets are
+ * kept instead of interpolating to a common time, so no information is
+ * lost and an offline tool can still resample as it likes.
+ *
+ * A frame is closed and logged when
+ *  - every expected channel has a sample (polled or auto-report
+ *    encoders, see encoderPollActiveMask()),
+ *  - a channel that is already in the frame delivers again, or
+ *  - a sample arrives more than SENSOR_FRAME_MAX_SPAN_US after the
+ *    frame started (lost response).
+ * Missing channels are left out of the record's valid mask. With no
+ * expected channels only the last two rules apply.
+ *
+ * Fed from the CAN RX path only (the sdlog producer task), in normal
+ * mode; sniffer mode logs the raw frames instead.
+ */
+
+/*
+ * SENSOR_FRAME_MAX_SPAN_US
+ *
+ * Longest time between the first and the last sample of one frame.
+ * A pipelined burst of four READ exchanges takes ~1.3 ms on the wire
+ * at 500 kbit/s; must stay below the poll period.
+ */
+#define SENSOR_FRAME_MAX_SPAN_US    1500
+
+struct SensorFrameStats {
+    uint32_t frames;         // frames closed
+    uint32_t complete;       // ... with every expected channel
+    uint32_t span_max_us;    // widest frame seen
+};
+
+// RX hook: one converted encoder sample, idx 0..3
+void sensorFrameAdd(uint8_t idx, int32_t raw, uint64_t rxUs);
+
+// Close the open frame now (before a calibration change is logged)
+void sensorFrameFlush();
+
+void getSensorFrameStats(SensorFrameStats& out);
+void resetSensorFrameStats();
@@ -3,7 +3,18 @@
 
 #include <Arduino.h>
 #include "BriterEncoder.h"
+#include "can_bus.h"
+#include "sniff_filter.h"
 #include "measurements.h"
+#include "encoder_poll.h"
+#include "sensor_frame.h"
+#include "sdlog.h"
+#include "run_stats.h"
+#include "calibration.h"
+#include "telemetry.h"
+#include "file_xfer.h"
+#include "perf.h"
+#include "tasks.h"
 
 static String command;
 
@@ -20,7 +31,8 @@ static const char* debugLevelToString(DebugLevel lvl)
 
 void initSerialCli()
 {
-    Serial.begin(115200);
+    Serial.setTxBufferSize(SERIAL_TX_BUFFER);   // before begin()
+    Serial.begin(SERIAL_CLI_BAUD);
     Serial.println();
     Serial.println("Serial CLI ready. Type 'help' for commands.");
 }
@@ -30,22 +42,904 @@ static void printHelp()
     Serial.println();
     Serial.println("Available commands:");
     Serial.println("  help");
-    Serial.println("  status              Show measured values");
+    Serial.println("  status              Show length, velocity and acceleration");
     Serial.println("  zero <id>           Zero encoder (ID 3..6)");
     Serial.println("  zeroall             Zero all encoders");
     Serial.println("  debug               Show current debug level");
     Serial.println("  debug off|error|info|verbose");
+    Serial.println("  debug defer on|off  Deferred debug output (ring buffer, low-priority task)");
+    Serial.println("  poll                Show encoder polling rates and stats");
+    Serial.println("  poll on|off         Start / stop encoder polling");
+    Serial.println("  poll rate <id|all> <hz>  Set polling rate (0 = off)");
+    Serial.println("  push <id|all> <ms>  Encoder auto-report every <ms> (no polling)");
+    Serial.println("  push <id|all> off   Back to polled (query) mode");
+    Serial.println("  stats               Run statistics (travel, velocity, bottom-outs)");
+    Serial.println("  stats <id>          Velocity and travel histograms");
+    Serial.println("  stats reset         Start a new run");
+    Serial.println("  stats bottom <id|all> <mm>  Bottom-out travel threshold (0 = off)");
+    Serial.println("  cal                 Show encoder calibration");
+    Serial.println("  cal <id> scale <um/count> | offset <counts> | zero");
+    Serial.println("  cal <id> wrap <at> <span> | invert on|off | default");
+    Serial.println("  telem               Show binary telemetry status");
+    Serial.println("  telem on [baud] [hz]  Start binary telemetry (default 921600 baud, 500 Hz)");
+    Serial.println("  telem off           Stop telemetry, back to CLI baud");
+    Serial.println("  perf                Hot-path timing: min/avg/max and log2 histograms");
+    Serial.println("  perf reset          Clear the timing counters");
+    Serial.println("  perf log <s>|off    REC_PERF snapshot in the SD log every <s> seconds");
+    Serial.println("  can                 CAN bus health: state, errors, load, lost frames, busiest IDs");
+    Serial.println("  can reset           Clear the health counters");
+    Serial.println("  can queue <rx> [tx] TWAI queue lengths (driver restart, saved in NVS)");
+    Serial.println("  can queue auto on|off  Grow the RX queue when frames are missed");
+    Serial.println("  sniff               Sniff log filter: ranges, logged / suppressed frames per ID");
+    Serial.println("  sniff changes on|off  Log a sniffed frame only when its data changed");
+    Serial.println("  sniff keyframe <ms> Log unchanged frames again after <ms> (0 = never)");
+    Serial.println("  sniff include|exclude <lo>[-<hi>] [ext]  ID range (hex; include also sets the HW filter)");
+    Serial.println("  sniff clear         Remove all ID ranges");
+    Serial.println("  sniff reset         Clear the filter counters");
+    Serial.println("  tasks               Task topology (core, prio, free stack) and jitter histograms");
+    Serial.println("  tasks reset         Clear the jitter histograms");
+    Serial.println("  log                 Show SD log status and writer stats");
+    Serial.println("  log start|stop      Start / stop SD logging");
+    Serial.println("  log rotate <MB> [min] | off  New file every <MB> / <min> minutes");
+    Serial.println("  log compress on|off Compress the SD log stream (from the next file)");
+    Serial.println("  ls [dir]            List SD card files");
+    Serial.println("  get <path> [offset] [baud]  Binary file transfer (use sd_get on the PC)");
     Serial.println();
 }
 
+static void printLogStatus()
+{
+    SdlogStats st;
+    sdlog_get_stats(&st);
+
+    uint32_t rotBytes, rotSeconds;
+    sdlog_get_rotation(&rotBytes, &rotSeconds);
+
+    Serial.print("SD log: ");
+    Serial.println(sdlog_is_running() ? "RUNNING" : "STOPPED");
+    Serial.printf("  file          : %s (%lu in session)\n",
+                  st.file_name[0] ? st.file_name : "-", (unsigned long)st.files);
+    Serial.printf("  start latency : %lu us (name %lu us, %s)\n",
+                  (unsigned long)st.start_us,
+                  (unsigned long)st.start_lookup_us,
+                  st.start_scanned ? "directory scan" : "NVS");
+    if (rotBytes || rotSeconds)
+        Serial.printf("  rotation      : %lu MB / %lu min (0 = no limit)\n",
+                      (unsigned long)(rotBytes >> 20), (unsigned long)(rotSeconds / 60));
+    else
+        Serial.println("  rotation      : off");
+    Serial.printf("  compression   : %s (this file: %s)\n",
+                  sdlog_get_codec() == SDLOG_CODEC_NONE ? "off" : "lz",
+                  st.codec == SDLOG_CODEC_NONE ? "off" : "lz");
+    if (st.chunks > 0)
+        Serial.printf("  stream bytes  : %llu (%.2f per card byte)\n",
+                      (unsigned long long)st.stream_bytes,
+                      (double)st.stream_bytes / ((double)st.chunks * SDLOG_CHUNK_SIZE));
+    Serial.printf("  bytes written : %llu\n", (unsigned long long)st.bytes_written);
+    Serial.printf("  throughput    : %lu B/s\n", (unsigned long)st.bytes_per_sec);
+    Serial.printf("  writes        : %lu (avg %lu us, max %lu us)\n",
+                  (unsigned long)st.writes,
+                  (unsigned long)st.write_avg_us,
+                  (unsigned long)st.write_max_us);
+    Serial.printf("  flushes       : %lu (max %lu us)\n",
+                  (unsigned long)st.flushes,
+                  (unsigned long)st.flush_max_us);
+    Serial.printf("  chunks        : %lu (%lu partial rewrites)\n",
+                  (unsigned long)st.chunks,
+                  (unsigned long)st.chunk_rewrites);
+    Serial.printf("  buffer peak   : %lu / %lu bytes\n",
+                  (unsigned long)st.buffer_high_water,
+                  (unsigned long)st.buffer_size);
+    Serial.printf("  dropped       : %lu records\n", (unsigned long)sdlog_dropped());
+    Serial.printf("  write errors  : %lu\n", (unsigned long)st.write_errors);
+
+    SensorFrameStats sf;
+    getSensorFrameStats(sf);
+    Serial.printf("  sensor frames : %lu (%lu complete, span max %lu us)\n",
+                  (unsigned long)sf.frames,
+                  (unsigned long)sf.complete,
+                  (unsigned long)sf.span_max_us);
+}
+
+static const char* twaiStateName(twai_state_t state)
+{
+    switch (state) {
+        case TWAI_STATE_STOPPED:    return "STOPPED";
+        case TWAI_STATE_RUNNING:    return "RUNNING";
+        case TWAI_STATE_BUS_OFF:    return "BUS-OFF";
+        case TWAI_STATE_RECOVERING: return "RECOVERING";
+        default:                    return "UNKNOWN";
+    }
+}
+
+static void printCanHealth()
+{
+    CanHealth h;
+    getCANHealth(h);
+    CanRxStats rx;
+    getCANRxStats(rx);
+
+    Serial.printf("CAN bus: %s, TEC %lu, REC %lu\n", twaiStateName(h.state),
+                  (unsigned long)h.tx_error_counter, (unsigned long)h.rx_error_counter);
+    if (h.ts_us == 0)
+        Serial.println("  (no health interval closed yet)");
+    else
+        Serial.printf("  load          : ~%lu.%lu %%, %lu frames/s (last %lu ms)\n",
+                      (unsigned long)(h.bus_load_permille / 10),
+                      (unsigned long)(h.bus_load_permille % 10),
+                      (unsigned long)h.frame_rate, (unsigned long)h.interval_ms);
+
+    const bool losing = h.rx_missed || h.rx_overrun;
+    Serial.printf("  lost frames   : %s, missed %lu (queue full), overrun %lu, in %lu intervals\n",
+                  losing ? "YES" : "none",
+                  (unsigned long)h.rx_missed, (unsigned long)h.rx_overrun,
+                  (unsigned long)h.loss_intervals);
+    Serial.printf("  errors        : bus %lu, arb lost %lu, tx failed %lu, rx failed %lu\n",
+                  (unsigned long)h.bus_errors, (unsigned long)h.arb_lost,
+                  (unsigned long)h.tx_failed, (unsigned long)rx.rx_errors);
+    Serial.printf("  bus-off       : %lu (%lu recovered)\n",
+                  (unsigned long)h.bus_off, (unsigned long)h.recoveries);
+    Serial.printf("  queues        : RX %lu%s, TX %lu, batch max %lu\n",
+                  (unsigned long)h.rx_queue_len,
+                  getCANQueueAuto() ? " (auto)" : "",
+                  (unsigned long)h.tx_queue_len, (unsigned long)rx.batch_max);
+    if (h.queue_grows)
+        Serial.printf("  RX queue grown %lu times\n", (unsigned long)h.queue_grows);
+
+    CanIdRate ids[16];
+    const size_t n = getCANIdRates(ids, 16);
+    Serial.printf("  IDs           : %lu tracked", (unsigned long)h.ids);
+    if (h.other_rate)
+        Serial.printf(", others %lu frames/s", (unsigned long)h.other_rate);
+    Serial.println();
+    for (size_t i = 0; i < n; i++) {
+        Serial.printf("    %0*lX  %5lu /s  %lu\n", ids[i].extd ? 8 : 3,
+                      (unsigned long)ids[i].id, (unsigned long)ids[i].rate,
+                      (unsigned long)ids[i].frames);
+    }
+}
+
+static void handleCanCommand()
+{
+    if (command.equalsIgnoreCase("can")) {
+        printCanHealth();
+    }
+    else if (command.equalsIgnoreCase("can reset")) {
+        resetCANHealth();
+        Serial.println("CAN health counters reset");
+    }
+    else if (command.startsWith("can queue auto ")) {
+        if (command.endsWith(" on"))
+            setCANQueueAuto(true);
+        else if (command.endsWith(" off"))
+            setCANQueueAuto(false);
+        else {
+            Serial.println("Usage: can queue auto on|off");
+            return;
+        }
+        Serial.printf("RX queue auto growth %s\n", getCANQueueAuto() ? "ON" : "OFF");
+    }
+    else if (command.startsWith("can queue ")) {
+        String arg = command.substring(10);
+        arg.trim();
+        int sp = arg.indexOf(' ');
+        CanHealth h;
+        getCANHealth(h);
+        long rxLen = (sp < 0 ? arg : arg.substring(0, sp)).toInt();
+        long txLen = (sp < 0) ? (long)h.tx_queue_len : arg.substring(sp + 1).toInt();
+
+        if (rxLen <= 0 || txLen <= 0 || !setCANQueueLengths((uint32_t)rxLen, (uint32_t)txLen)) {
+            Serial.println("Usage: can queue <rx 16..1024> [tx 4..64]");
+            return;
+        }
+        Serial.printf("TWAI queues RX %ld, TX %ld (driver restarts now, saved)\n", rxLen, txLen);
+    }
+    else {
+        Serial.println("Usage: can [reset|queue <rx> [tx]|queue auto on|off]");
+    }
+}
+
+static void printSniffStatus()
+{
+    SniffConfig cfg;
+    getSniffConfig(cfg);
+    SniffStats st;
+    getSniffStats(st);
+
+    Serial.println("Sniff log filter:");
+    Serial.printf("  changes only  : %s, keyframe %lu ms%s\n",
+                  cfg.changes_only ? "ON" : "OFF", (unsigned long)cfg.keyframe_ms,
+                  cfg.keyframe_ms == 0 ? " (off)" : "");
+    if (cfg.ranges == 0)
+        Serial.println("  ranges        : none (all IDs)");
+    for (uint8_t i = 0; i < cfg.ranges; i++) {
+        const SniffRange& r = cfg.range[i];
+        Serial.printf("  %-13s : %0*lX-%0*lX\n", r.exclude ? "exclude" : "include",
+                      r.extd ? 8 : 3, (unsigned long)r.lo, r.extd ? 8 : 3, (unsigned long)r.hi);
+    }
+    Serial.printf("  frames        : %lu seen, %lu logged (%.1f %%)\n",
+                  (unsigned long)st.frames, (unsigned long)st.logged,
+                  st.frames ? 100.0 * st.logged / st.frames : 0.0);
+    Serial.printf("  not logged    : %lu unchanged, %lu excluded\n",
+                  (unsigned long)st.suppressed, (unsigned long)st.excluded);
+    Serial.printf("  IDs           : %lu tracked", (unsigned long)st.ids);
+    if (st.untracked)
+        Serial.printf(", %lu frames untracked (table full)", (unsigned long)st.untracked);
+    Serial.println();
+
+    SniffIdCount ids[16];
+    const size_t n = getSniffIdCounts(ids, 16);
+    for (size_t i = 0; i < n; i++) {
+        Serial.printf("    %0*lX  %8lu logged  %8lu suppressed\n", ids[i].extd ? 8 : 3,
+                      (unsigned long)ids[i].id, (unsigned long)ids[i].logged,
+                      (unsigned long)ids[i].suppressed);
+    }
+}
+
+// "<lo>[-<hi>] [ext]", hex; IDs above 7FF are extended anyway
+static bool parseSniffRange(String arg, bool exclude, SniffRange& out)
+{
+    arg.trim();
+    bool extd = false;
+    if (arg.endsWith(" ext")) {
+        extd = true;
+        arg = arg.substring(0, arg.length() - 4);
+        arg.trim();
+    }
+    if (arg.length() == 0)
+        return false;
+
+    char* end;
+    const char* p = arg.c_str();
+    unsigned long lo = strtoul(p, &end, 16);
+    if (end == p)
+        return false;
+    unsigned long hi = lo;
+    if (*end == '-') {
+        p = end + 1;
+        hi = strtoul(p, &end, 16);
+        if (end == p)
+            return false;
+    }
+    if (*end != '\0')
+        return false;
+
+    out.lo = (uint32_t)lo;
+    out.hi = (uint32_t)hi;
+    out.extd = extd || hi > 0x7FF;
+    out.exclude = exclude;
+    return true;
+}
+
+static void handleSniffCommand()
+{
+    if (command.equalsIgnoreCase("sniff")) {
+        printSniffStatus();
+    }
+    else if (command.equalsIgnoreCase("sniff reset")) {
+        resetSniffFilter();
+        Serial.println("Sniff filter counters reset");
+    }
+    else if (command.equalsIgnoreCase("sniff clear")) {
+        clearSniffRanges();
+        Serial.println("Sniff ID ranges cleared (all IDs)");
+    }
+    else if (command.startsWith("sniff changes ")) {
+        if (command.endsWith(" on"))
+            setSniffChangesOnly(true);
+        else if (command.endsWith(" off"))
+            setSniffChangesOnly(false);
+        else {
+            Serial.println("Usage: sniff changes on|off");
+            return;
+        }
+        SniffConfig cfg;
+        getSniffConfig(cfg);
+        Serial.printf("Change-only sniff logging %s\n", cfg.changes_only ? "ON" : "OFF");
+    }
+    else if (command.startsWith("sniff keyframe ")) {
+        String arg = command.substring(15);
+        arg.trim();
+        long ms = arg.toInt();
+        if (ms < 0 || (ms == 0 && arg != "0") || !setSniffKeyframe((uint32_t)ms)) {
+            Serial.printf("Usage: sniff keyframe <0..%d ms>\n", SNIFF_KEYFRAME_MS_MAX);
+            return;
+        }
+        Serial.printf("Sniff keyframe %ld ms%s\n", ms, ms == 0 ? " (changes only)" : "");
+    }
+    else if (command.startsWith("sniff include ") || command.startsWith("sniff exclude ")) {
+        const bool exclude = command.startsWith("sniff exclude ");
+        SniffRange r;
+        if (!parseSniffRange(command.substring(14), exclude, r) || !addSniffRange(r)) {
+            Serial.printf("Usage: sniff %s <lo>[-<hi>] [ext] (hex, up to %d ranges)\n",
+                          exclude ? "exclude" : "include", SNIFF_MAX_RANGES);
+            return;
+        }
+        Serial.printf("Sniff %s %0*lX-%0*lX%s\n", exclude ? "exclude" : "include",
+                      r.extd ? 8 : 3, (unsigned long)r.lo, r.extd ? 8 : 3, (unsigned long)r.hi,
+                      exclude ? "" : " (acceptance filter updated, driver restarts)");
+    }
+    else {
+        Serial.println("Usage: sniff [changes on|off|keyframe <ms>|include|exclude <lo>[-<hi>] [ext]|clear|reset]");
+    }
+}
+
+static void printPollStatus()
+{
+    PollTimingStats t;
+    getPollTimingStats(t);
+
+    Serial.print("Polling: ");
+    Serial.println(isEncoderPollingRunning() ? "RUNNING" : "STOPPED");
+    Serial.printf("  tick %lu us, jitter max %lu us, missed ticks %lu\n",
+                  (unsigned long)t.tick_us,
+                  (unsigned long)t.jitter_max_us,
+                  (unsigned long)t.missed_ticks);
+    Serial.printf("  est. bus load %u %%\n", estimatePollBusLoad());
+
+    for (uint8_t id = BriterEncoder::FIRST_ID; id <= BriterEncoder::LAST_ID; id++) {
+        EncoderPollStats st;
+        getEncoderPollStats(id, st);
+
+        if (BriterEncoder::isAutoReport(id)) {
+            Serial.printf("  ID %u: push %u ms  pushed %lu\n",
+                          id, BriterEncoder::autoReportInterval(id),
+                          (unsigned long)st.pushed);
+            continue;
+        }
+
+        Serial.printf("  ID %u: %4u Hz  req %lu  resp %lu  timeout %lu  late %lu  txfail %lu\n",
+                      id, st.rate_hz,
+                      (unsigned long)st.requests,
+                      (unsigned long)st.responses,
+                      (unsigned long)st.timeouts,
+                      (unsigned long)st.late,
+                      (unsigned long)st.tx_fail);
+
+        if (st.responses == 0)
+            continue;
+
+        uint32_t lossPermille = st.requests ? (uint32_t)((uint64_t)st.timeouts * 1000 / st.requests) : 0;
+        Serial.printf("        latency min %lu  avg %lu  max %lu us  loss %lu.%lu %%\n",
+                      (unsigned long)st.latency_min_us,
+                      (unsigned long)st.latency_avg_us,
+                      (unsigned long)st.latency_max_us,
+                      (unsigned long)(lossPermille / 10),
+                      (unsigned long)(lossPermille % 10));
+        Serial.print("        <128");
+        for (uint8_t b = 1; b < POLL_LATENCY_BINS; b++)
+            Serial.printf(b + 1 < POLL_LATENCY_BINS ? " <%u" : " >=%u", b + 1 < POLL_LATENCY_BINS ? 128u << b : 64u << b);
+        Serial.print(" us:");
+        for (uint8_t b = 0; b < POLL_LATENCY_BINS; b++)
+            Serial.printf(" %lu", (unsigned long)st.latency_hist[b]);
+        Serial.println();
+    }
+}
+
+static void handlePollCommand()
+{
+    if (command.equalsIgnoreCase("poll")) {
+        printPollStatus();
+    }
+    else if (command.equalsIgnoreCase("poll on")) {
+        resetEncoderPollStats();
+        startEncoderPolling();
+        Serial.println("Polling started");
+    }
+    else if (command.equalsIgnoreCase("poll off")) {
+        stopEncoderPolling();
+        Serial.println("Polling stopped");
+    }
+    else if (command.startsWith("poll rate ")) {
+        String args = command.substring(10);
+        args.trim();
+        int sp = args.indexOf(' ');
+        if (sp < 0) {
+            Serial.println("Usage: poll rate <id|all> <hz>");
+            return;
+        }
+
+        String target = args.substring(0, sp);
+        long hz = args.substring(sp + 1).toInt();
+        if (hz < 0 || hz > UINT16_MAX) {
+            Serial.println("Invalid rate");
+            return;
+        }
+
+        bool ok = true;
+        if (target.equalsIgnoreCase("all")) {
+            for (uint8_t id = BriterEncoder::FIRST_ID; id <= BriterEncoder::LAST_ID; id++)
+                ok &= setEncoderPollRate(id, (uint16_t)hz);
+        } else {
+            long id = target.toInt();
+            ok = id >= BriterEncoder::FIRST_ID && id <= BriterEncoder::LAST_ID &&
+                 setEncoderPollRate((uint8_t)id, (uint16_t)hz);
+        }
+
+        if (!ok) {
+            Serial.println("Invalid ID or rate (ID 3..6, max 1000 Hz)");
+            return;
+        }
+        printPollStatus();
+    }
+    else {
+        Serial.println("Usage: poll [on|off|rate <id|all> <hz>]");
+    }
+}
+
+static void handlePushCommand()
+{
+    String args = command.substring(5);
+    args.trim();
+    int sp = args.indexOf(' ');
+    if (sp < 0) {
+        Serial.println("Usage: push <id|all> <ms>|off");
+        return;
+    }
+
+    String target = args.substring(0, sp);
+    String value = args.substring(sp + 1);
+    value.trim();
+
+    bool off = value.equalsIgnoreCase("off");
+    long ms = value.toInt();
+    if (!off && (ms < BriterEncoder::AUTO_TIME_MIN_MS || ms > BriterEncoder::AUTO_TIME_MAX_MS ||
+                 ms > UINT16_MAX)) {
+        Serial.println("Invalid interval (ms)");
+        return;
+    }
+
+    uint8_t first = BriterEncoder::FIRST_ID;
+    uint8_t last = BriterEncoder::LAST_ID;
+    if (!target.equalsIgnoreCase("all")) {
+        int id = target.toInt();
+        if (id < BriterEncoder::FIRST_ID || id > BriterEncoder::LAST_ID) {
+            Serial.println("Invalid ID (use 3..6)");
+            return;
+        }
+        first = last = (uint8_t)id;
+    }
+
+    for (uint8_t id = first; id <= last; id++) {
+        bool ok = off ? BriterEncoder::setQueryMode(id)
+                      : BriterEncoder::setAutoReport(id, (uint16_t)ms);
+        Serial.printf("  ID %u: %s\n", id, ok ? (off ? "query mode" : "auto-report") : "TX failed");
+    }
+}
+
+static uint32_t pct(uint32_t part, uint32_t total)
+{
+    return total ? (uint32_t)((uint64_t)part * 100 / total) : 0;
+}
+
+static void printRunStats()
+{
+    static RunStats st;
+
+    Serial.println("Run statistics (travel = compression from zero point):");
+    for (uint8_t i = 0; i < BriterEncoder::NUM_ENCODERS; i++) {
+        getRunStats(i, st);
+        uint32_t total = st.comp_ls_ms + st.comp_hs_ms + st.reb_ls_ms + st.reb_hs_ms;
+
+        Serial.printf("  ID %u: %lu samples in %lu s\n",
+                      i + BriterEncoder::FIRST_ID,
+                      (unsigned long)st.samples,
+                      (unsigned long)(st.duration_ms / 1000));
+        if (st.samples == 0)
+            continue;
+
+        Serial.printf("    travel   min %.1f  max %.1f  mean %.1f mm\n",
+                      st.travel_min, st.travel_max, st.travel_mean);
+        Serial.printf("    velocity comp max %.0f  reb max %.0f mm/s\n",
+                      st.vel_comp_max, st.vel_reb_max);
+        Serial.printf("    time     comp LS %lu%%  HS %lu%%   reb LS %lu%%  HS %lu%%  (split %d mm/s)\n",
+                      (unsigned long)pct(st.comp_ls_ms, total),
+                      (unsigned long)pct(st.comp_hs_ms, total),
+                      (unsigned long)pct(st.reb_ls_ms, total),
+                      (unsigned long)pct(st.reb_hs_ms, total),
+                      STATS_LSHS_SPLIT_MM_S);
+        if (st.bottom_out_mm > 0.0f)
+            Serial.printf("    bottom-outs %lu (at %.1f mm)\n", (unsigned long)st.bottom_outs, st.bottom_out_mm);
+        else
+            Serial.println("    bottom-outs: threshold not set");
+    }
+}
+
+static void printHistograms(uint8_t idx)
+{
+    static RunStats st;
+    getRunStats(idx, st);
+
+    uint32_t velTotal = st.comp_ls_ms + st.comp_hs_ms + st.reb_ls_ms + st.reb_hs_ms;
+    uint32_t travelTotal = 0;
+    for (int i = 0; i < STATS_TRAVEL_BINS; i++)
+        travelTotal += st.travel_ms[i];
+
+    Serial.printf("ID %u velocity histogram (mm/s, %% of time):\n", idx + BriterEncoder::FIRST_ID);
+    Serial.println("       from     comp      reb");
+    for (int i = 0; i < STATS_VEL_BINS; i++) {
+        if (st.vel_comp_ms[i] == 0 && st.vel_reb_ms[i] == 0)
+            continue;
+        Serial.printf("  %7d%s %7lu.%lu %7lu.%lu\n",
+                      i * STATS_VEL_BIN_MM_S, (i == STATS_VEL_BINS - 1) ? "+" : " ",
+                      (unsigned long)(pct(st.vel_comp_ms[i] * 10, velTotal) / 10),
+                      (unsigned long)(pct(st.vel_comp_ms[i] * 10, velTotal) % 10),
+                      (unsigned long)(pct(st.vel_reb_ms[i] * 10, velTotal) / 10),
+                      (unsigned long)(pct(st.vel_reb_ms[i] * 10, velTotal) % 10));
+    }
+
+    Serial.println("Travel histogram (mm, % of time):");
+    for (int i = 0; i < STATS_TRAVEL_BINS; i++) {
+        if (st.travel_ms[i] == 0)
+            continue;
+        Serial.printf("  %5d%s %7lu.%lu\n",
+                      i * STATS_TRAVEL_BIN_MM, (i == STATS_TRAVEL_BINS - 1) ? "+" : " ",
+                      (unsigned long)(pct(st.travel_ms[i] * 10, travelTotal) / 10),
+                      (unsigned long)(pct(st.travel_ms[i] * 10, travelTotal) % 10));
+    }
+}
+
+static void handleStatsCommand()
+{
+    if (command.equalsIgnoreCase("stats")) {
+        printRunStats();
+    }
+    else if (command.equalsIgnoreCase("stats reset")) {
+        runStatsReset();
+        Serial.println("Run statistics reset");
+    }
+    else if (command.startsWith("stats bottom ")) {
+        String args = command.substring(13);
+        args.trim();
+        int sp = args.indexOf(' ');
+        if (sp < 0) {
+            Serial.println("Usage: stats bottom <id|all> <mm>");
+            return;
+        }
+
+        String target = args.substring(0, sp);
+        float mm = args.substring(sp + 1).toFloat();
+
+        bool ok = true;
+        if (target.equalsIgnoreCase("all")) {
+            for (uint8_t i = 0; i < BriterEncoder::NUM_ENCODERS; i++)
+                ok &= setBottomOutThreshold(i, mm);
+        } else {
+            long id = target.toInt();
+            ok = id >= BriterEncoder::FIRST_ID && id <= BriterEncoder::LAST_ID &&
+                 setBottomOutThreshold((uint8_t)(id - BriterEncoder::FIRST_ID), mm);
+        }
+
+        Serial.println(ok ? "Bottom-out threshold set" : "Invalid ID or threshold (ID 3..6, mm >= 0)");
+    }
+    else {
+        int id = command.substring(6).toInt();
+        if (id < BriterEncoder::FIRST_ID || id > BriterEncoder::LAST_ID) {
+            Serial.println("Usage: stats [<id>|reset|bottom <id|all> <mm>]");
+            return;
+        }
+        printHistograms((uint8_t)(id - BriterEncoder::FIRST_ID));
+    }
+}
+
+static void printCalibration()
+{
+    Serial.println("Calibration (um = ((raw [- span if >= wrap]) - offset) * scale):");
+    for (uint8_t i = 0; i < BriterEncoder::NUM_ENCODERS; i++) {
+        EncoderCal c;
+        getCalibration(i, c);
+        Serial.printf("  ID %u: scale %.5f um/count  offset %ld  wrap %ld / %ld  %s  (raw %ld)\n",
+                      i + BriterEncoder::FIRST_ID,
+                      c.scale_q16 / 65536.0,
+                      (long)c.offset, (long)c.wrap_at, (long)c.wrap_span,
+                      c.invert ? "inverted" : "normal",
+                      (long)getLastRaw(i));
+    }
+}
+
+static void handleCalCommand()
+{
+    if (command.equalsIgnoreCase("cal")) {
+        printCalibration();
+        return;
+    }
+
+    // cal <id> <field> [values]
+    String args = command.substring(4);
+    args.trim();
+    int sp = args.indexOf(' ');
+    int id = args.substring(0, sp < 0 ? args.length() : sp).toInt();
+    if (sp < 0 || id < BriterEncoder::FIRST_ID || id > BriterEncoder::LAST_ID) {
+        Serial.println("Usage: cal <id> scale|offset|zero|wrap|invert|default ...");
+        return;
+    }
+
+    const uint8_t idx = (uint8_t)(id - BriterEncoder::FIRST_ID);
+    String field = args.substring(sp + 1);
+    field.trim();
+    String value;
+    sp = field.indexOf(' ');
+    if (sp >= 0) {
+        value = field.substring(sp + 1);
+        value.trim();
+        field = field.substring(0, sp);
+    }
+
+    EncoderCal c;
+    getCalibration(idx, c);
+    bool ok;
+
+    if (field.equalsIgnoreCase("default")) {
+        ok = resetCalibration(idx);
+    }
+    else {
+        if (field.equalsIgnoreCase("scale") && value.length() > 0 && value.toFloat() > 0.0f) {
+            c.scale_q16 = (int32_t)(value.toFloat() * 65536.0f + 0.5f);
+        }
+        else if (field.equalsIgnoreCase("offset") && value.length() > 0) {
+            c.offset = value.toInt();
+        }
+        else if (field.equalsIgnoreCase("zero")) {
+            // Current position becomes 0
+            int32_t raw = getLastRaw(idx);
+            if (c.wrap_span != 0 && raw >= c.wrap_at)
+                raw -= c.wrap_span;
+            c.offset = raw;
+        }
+        else if (field.equalsIgnoreCase("wrap") && value.indexOf(' ') > 0) {
+            c.wrap_at = value.substring(0, value.indexOf(' ')).toInt();
+            c.wrap_span = value.substring(value.indexOf(' ') + 1).toInt();
+        }
+        else if (field.equalsIgnoreCase("invert") && (value == "on" || value == "off")) {
+            c.invert = (value == "on");
+        }
+        else {
+            Serial.println("Usage: cal <id> scale|offset|zero|wrap|invert|default ...");
+            return;
+        }
+        ok = setCalibration(idx, c);
+    }
+
+    if (!ok)
+        Serial.println("Calibration applied, but NVS save failed");
+    printCalibration();
+}
+
+static void handleTelemCommand()
+{
+    if (command.equalsIgnoreCase("telem")) {
+        TelemetryStats st;
+        getTelemetryStats(st);
+        Serial.print("Telemetry: ");
+        Serial.println(isTelemetryRunning() ? "STREAMING" : "OFF");
+        Serial.printf("  %lu baud, %u Hz, sent %lu, dropped %lu, %lu bytes\n",
+                      (unsigned long)st.baud, st.rate_hz,
+                      (unsigned long)st.sent, (unsigned long)st.dropped,
+                      (unsigned long)st.bytes);
+    }
+    else if (command.equalsIgnoreCase("telem off")) {
+        stopTelemetry();
+        Serial.println("Telemetry stopped");
+    }
+    else if (command.equalsIgnoreCase("telem on") || command.startsWith("telem on ")) {
+        long baud = TELEM_DEFAULT_BAUD;
+        long hz = TELEM_DEFAULT_HZ;
+
+        String args = command.substring(8);
+        args.trim();
+        if (args.length() > 0) {
+            int sp = args.indexOf(' ');
+            baud = args.substring(0, sp < 0 ? args.length() : sp).toInt();
+            if (sp >= 0)
+                hz = args.substring(sp + 1).toInt();
+        }
+
+        if (baud <= 0 || hz <= 0 || hz > TELEM_MAX_HZ) {
+            Serial.println("Invalid baud or rate");
+            return;
+        }
+
+        Serial.printf("Telemetry: switching to %ld baud, %ld Hz\n", baud, hz);
+        if (!startTelemetry((uint32_t)baud, (uint16_t)hz))
+            Serial.println("Telemetry start failed");
+    }
+    else {
+        Serial.println("Usage: telem [on [baud] [hz]|off]");
+    }
+}
+
+static void printDuration(uint32_t cycles, uint32_t mhz)
+{
+    const uint64_t ns = (uint64_t)cycles * 1000 / mhz;
+    if (ns < 10000)
+        Serial.printf("%lluns", (unsigned long long)ns);
+    else if (ns < 10000000)
+        Serial.printf("%lluus", (unsigned long long)(ns / 1000));
+    else
+        Serial.printf("%llums", (unsigned long long)(ns / 1000000));
+}
+
+static void printPerf()
+{
+    const uint32_t mhz = perfCyclesPerUs();
+
+    Serial.printf("Perf counters (%lu MHz cycle counter):\n", (unsigned long)mhz);
+    Serial.println("  site            count      min us      avg us      max us");
+
+    for (uint8_t i = 0; i < PERF_SITE_COUNT; i++) {
+        PerfCounter c;
+        getPerfCounter((PerfSite)i, c);
+
+        if (c.count == 0) {
+            Serial.printf("  %-12s %8lu\n", perfSiteName((PerfSite)i), 0UL);
+            continue;
+        }
+
+        Serial.printf("  %-12s %8lu %11.2f %11.2f %11.2f\n",
+                      perfSiteName((PerfSite)i), (unsigned long)c.count,
+                      (double)c.min_cycles / mhz,
+                      (double)c.sum_cycles / c.count / mhz,
+                      (double)c.max_cycles / mhz);
+
+        // Histogram: "<upper bound>:count" for non-empty bins
+        Serial.print("     ");
+        for (uint8_t b = 0; b < PERF_HIST_BINS; b++) {
+            if (c.hist[b] == 0)
+                continue;
+            Serial.print(" <");
+            if (b == PERF_HIST_BINS - 1)
+                Serial.print("inf");
+            else
+                printDuration(2u << b, mhz);
+            Serial.printf(":%lu", (unsigned long)c.hist[b]);
+        }
+        Serial.println();
+    }
+
+    SdlogStats st;
+    sdlog_get_stats(&st);
+    Serial.printf("  sdlog ring peak %lu / %lu bytes, dropped %lu, write max %lu us\n",
+                  (unsigned long)st.buffer_high_water, (unsigned long)st.buffer_size,
+                  (unsigned long)sdlog_dropped(), (unsigned long)st.write_max_us);
+
+    const uint32_t logS = getPerfLogInterval();
+    if (logS > 0)
+        Serial.printf("  SD log snapshot every %lu s\n", (unsigned long)logS);
+}
+
+static void printTasks()
+{
+    Serial.println("Tasks:");
+    Serial.println("  name       core  prio   stack  free");
+    for (size_t i = 0; i < taskCount(); i++) {
+        TaskInfo t;
+        getTaskInfo(i, t);
+        Serial.printf("  %-9s %5d %5u %7lu %5lu\n", t.name, t.core, t.prio,
+                      (unsigned long)t.stack, (unsigned long)t.stack_free);
+    }
+    // The CLI runs in the Arduino loop task itself
+    Serial.printf("  %-9s %5d %5u %7s %5lu\n", "loop", (int)xPortGetCoreID(), 1u, "-",
+                  (unsigned long)uxTaskGetStackHighWaterMark(nullptr));
+
+    Serial.println("Jitter (us):");
+    for (uint8_t i = 0; i < JITTER_SOURCE_COUNT; i++) {
+        JitterHist h;
+        getJitter((JitterSource)i, h);
+        Serial.printf("  %-12s %8lu  avg %lu  max %lu\n",
+                      jitterSourceName((JitterSource)i), (unsigned long)h.count,
+                      (unsigned long)(h.count ? h.sum_us / h.count : 0),
+                      (unsigned long)h.max_us);
+        if (h.count == 0)
+            continue;
+
+        // Histogram: "<upper bound>:count" for non-empty bins
+        Serial.print("     ");
+        for (uint8_t b = 0; b < JITTER_BINS; b++) {
+            if (h.hist[b] == 0)
+                continue;
+            if (b == JITTER_BINS - 1)
+                Serial.printf(" >=%lu", (unsigned long)jitterBinUs(b));
+            else
+                Serial.printf(" <%lu", (unsigned long)jitterBinUs(b + 1));
+            Serial.printf(":%lu", (unsigned long)h.hist[b]);
+        }
+        Serial.println();
+    }
+}
+
+static void handlePerfCommand()
+{
+    if (command.equalsIgnoreCase("perf")) {
+        printPerf();
+    }
+    else if (command.equalsIgnoreCase("perf reset")) {
+        perfReset();
+        Serial.println("Perf counters reset");
+    }
+    else if (command.startsWith("perf log ")) {
+        String arg = command.substring(9);
+        arg.trim();
+        long s = arg.equalsIgnoreCase("off") ? 0 : arg.toInt();
+        if (s < 0 || (s == 0 && !arg.equalsIgnoreCase("off") && arg != "0")) {
+            Serial.println("Usage: perf log <seconds>|off");
+            return;
+        }
+        setPerfLogInterval((uint32_t)s);
+        if (s > 0)
+            Serial.printf("REC_PERF every %ld s while logging\n", s);
+        else
+            Serial.println("REC_PERF logging off");
+    }
+    else {
+        Serial.println("Usage: perf [reset|log <s>|off]");
+    }
+}
+
+static void handleLogRotateCommand()
+{
+    String arg = command.substring(10);
+    arg.trim();
+
+    if (arg.equalsIgnoreCase("off")) {
+        sdlog_set_rotation(0, 0);
+        Serial.println("Log rotation off");
+        return;
+    }
+
+    int sp = arg.indexOf(' ');
+    long mb  = (sp < 0 ? arg : arg.substring(0, sp)).toInt();
+    long min = (sp < 0) ? 0 : arg.substring(sp + 1).toInt();
+
+    // FAT32 files end below 4 GB
+    if (mb < 0 || mb > 4000 || min < 0 || (mb == 0 && min == 0)) {
+        Serial.println("Usage: log rotate <MB> [minutes] | off");
+        return;
+    }
+
+    sdlog_set_rotation((uint32_t)mb << 20, (uint32_t)min * 60);
+    Serial.printf("New log file every %ld MB / %ld min (0 = no limit)\n", mb, min);
+}
+
+static void handleGetCommand()
+{
+    String args = command.substring(4);
+    args.trim();
+
+    String path = args;
+    uint32_t offset = 0;
+    uint32_t baud = XFER_DEFAULT_BAUD;
+
+    int sp = args.indexOf(' ');
+    if (sp > 0) {
+        path = args.substring(0, sp);
+        String rest = args.substring(sp + 1);
+        rest.trim();
+        int sp2 = rest.indexOf(' ');
+        offset = (uint32_t)rest.substring(0, sp2 < 0 ? rest.length() : sp2).toInt();
+        if (sp2 > 0)
+            baud = (uint32_t)rest.substring(sp2 + 1).toInt();
+    }
+
+    if (path.length() == 0 || baud == 0) {
+        Serial.println("XFER ERR usage: get <path> [offset] [baud]");
+        return;
+    }
+
+    runFileTransfer(path.c_str(), offset, baud);
+}
+
 static void printStatus()
 {
     Serial.println("Measured lengths:");
     for (int i = 0; i < BriterEncoder::NUM_ENCODERS; i++) {
-        Serial.print("  ID ");
-        Serial.print(i + BriterEncoder::FIRST_ID);
-        Serial.print(": ");
-        Serial.println(measuredLength[i]);
+        MeasMotion m;
+        if (!getMotion(i, m)) {
+            Serial.printf("  ID %d: no data\n", i + BriterEncoder::FIRST_ID);
+            continue;
+        }
+        Serial.printf("  ID %d: %8.2f mm  %9.1f mm/s  %10.0f mm/s2  (%lu samples)\n",
+                      i + BriterEncoder::FIRST_ID, m.pos, m.vel, m.acc,
+                      (unsigned long)m.samples);
     }
 }
 
@@ -80,11 +974,99 @@ void handleSerialCli()
             Serial.println("Invalid ID (use 3..6)");
         }
     }
+    else if (command.startsWith("poll")) {
+        handlePollCommand();
+    }
+    else if (command.startsWith("push ")) {
+        handlePushCommand();
+    }
+    else if (command.equalsIgnoreCase("can") || command.startsWith("can ")) {
+        handleCanCommand();
+    }
+    else if (command.equalsIgnoreCase("sniff") || command.startsWith("sniff ")) {
+        handleSniffCommand();
+    }
+    else if (command.equalsIgnoreCase("cal") || command.startsWith("cal ")) {
+        handleCalCommand();
+    }
+    else if (command.startsWith("telem")) {
+        handleTelemCommand();
+    }
+    else if (command.startsWith("stats")) {
+        handleStatsCommand();
+    }
+    else if (command.startsWith("perf")) {
+        handlePerfCommand();
+    }
+    else if (command.equalsIgnoreCase("tasks")) {
+        printTasks();
+    }
+    else if (command.equalsIgnoreCase("tasks reset")) {
+        jitterReset();
+        Serial.println("Jitter histograms reset");
+    }
+    else if (command.equalsIgnoreCase("log")) {
+        printLogStatus();
+    }
+    else if (command.equalsIgnoreCase("log start")) {
+        if (sdlog_start()) {
+            SdlogStats st;
+            sdlog_get_stats(&st);
+            Serial.printf("SD log started: %s in %lu us\n",
+                          st.file_name, (unsigned long)st.start_us);
+        } else {
+            Serial.println("SD log start failed");
+        }
+    }
+    else if (command.equalsIgnoreCase("log stop")) {
+        sdlog_stop();
+        Serial.println("SD log stopped");
+        printLogStatus();
+    }
+    else if (command.startsWith("log rotate ")) {
+        handleLogRotateCommand();
+    }
+    else if (command.equalsIgnoreCase("log compress on")) {
+        sdlog_set_codec(SDLOG_CODEC_LZ);
+        Serial.println("SD log compression on (from the next file)");
+    }
+    else if (command.equalsIgnoreCase("log compress off")) {
+        sdlog_set_codec(SDLOG_CODEC_NONE);
+        Serial.println("SD log compression off (from the next file)");
+    }
+    else if (command.equalsIgnoreCase("ls") || command.startsWith("ls ")) {
+        String dir = command.substring(2);
+        dir.trim();
+        listSdFiles(dir.length() > 0 ? dir.c_str() : "/");
+    }
+    else if (command.startsWith("get ")) {
+        handleGetCommand();
+    }
     else if (command.startsWith("debug")) {
 
         if (command == "debug") {
+            DebugStats st;
+            getDebugStats(st);
             Serial.print("Debug level: ");
             Serial.println(debugLevelToString(debugLevel));
+            Serial.printf("  deferred %s: %lu queued, %lu dropped, %lu printed directly\n",
+                          debugDeferred ? "ON" : "OFF",
+                          (unsigned long)st.deferred, (unsigned long)st.dropped,
+                          (unsigned long)st.direct);
+            return;
+        }
+
+        if (command.startsWith("debug defer")) {
+            if (command.endsWith(" on"))
+                debugDeferred = true;
+            else if (command.endsWith(" off"))
+                debugDeferred = false;
+            else {
+                Serial.println("Usage: debug defer on|off");
+                return;
+            }
+            Serial.print("Deferred debug ");
+            Serial.println(debugDeferred ? "ON" : "OFF");
             return;
         }
 
@@ -1,5 +1,13 @@
 #pragma once
 
+#define SERIAL_CLI_BAUD     115200
+
+/*
+ * UART TX buffer. Large enough for a burst of CLI text or a few
+ * telemetry frames without blocking the writer.
+ */
+#define SERIAL_TX_BUFFER    2048
+
 void initSerialCli();
 void handleSerialCli();
 void ShowValues();
@@ -0,0 +1,506 @@
+#include "sniff_filter.h"
+#include "BriterEncoder.h"
+#include "sdlog.h"
+#include "debug.h"
+#include "can_id_table.h"
+
+#include <Preferences.h>
+#include <atomic>
+#include <string.h>
+
+/* =========================
+ *  NVS LAYOUT
+ * ========================= */
+
+#define SNIFF_NVS_NAMESPACE "suspmeas"
+#define SNIFF_NVS_KEY       "sniff"
+
+/*
+ * SNIFF_NVS_VERSION
+ *
+ * Increment whenever SniffBlob changes; a stored blob of another
+ * version (or size) is ignored and defaults are used.
+ */
+#define SNIFF_NVS_VERSION   1
+
+typedef struct __attribute__((packed)) {
+    uint8_t  version;
+    uint8_t  changes_only;
+    uint32_t keyframe_ms;
+    uint8_t  ranges;
+    struct __attribute__((packed)) {
+        uint32_t lo;
+        uint32_t hi;
+        uint8_t  flags;         // SNIFF_RANGE_*
+    } range[SNIFF_MAX_RANGES];
+} SniffBlob;
+
+#define SNIFF_RANGE_EXTD    0x01
+#define SNIFF_RANGE_EXCLUDE 0x02
+
+#define STD_ID_MAX          0x7FFu
+#define EXT_ID_MAX          0x1FFFFFFFu
+
+/* =========================
+ *  INTERNAL STATE
+ * ========================= */
+
+#define STD_ID_WORDS        ((STD_ID_MAX + 1) / 32)
+
+/*
+ * Configuration: written by the CLI, read by the RX task with a
+ * sequence counter (odd while being updated). The ranges come resolved
+ * for 11-bit IDs, a bit per ID, built by the CLI before it publishes.
+ * The RX task works on its own copy, taken over in sniffFilterAccept().
+ */
+static std::atomic<uint32_t> configSeq{0};
+static SniffConfig config = { true, SNIFF_KEYFRAME_MS_DEFAULT, 0, {} };
+static uint32_t    configStdAllowed[STD_ID_WORDS];
+static std::atomic<bool> resetPending{false};
+
+#define SLOT_STALE          0xFF
+
+// RX task state
+struct SniffSlot {
+    uint8_t  dlc = SLOT_STALE;  // SLOT_STALE: nothing logged in this file yet
+    uint8_t  data[8] = {};
+    uint64_t last_us = 0;       // RX time of the last logged frame
+    uint32_t logged = 0;
+    uint32_t suppressed = 0;
+};
+
+static SniffConfig active = { true, SNIFF_KEYFRAME_MS_DEFAULT, 0, {} };
+static uint32_t    activeSeq = UINT32_MAX;                // never a valid (even) seq
+static uint32_t    stdAllowed[STD_ID_WORDS];              // bit per 11-bit ID
+
+/*
+ * Counters and per-ID table: written by the RX task only, read by the
+ * CLI. counters is published with its own sequence counter (odd while
+ * a frame is being counted), the table per slot (can_id_table.h).
+ */
+static CanIdTable<SniffSlot, SNIFF_ID_SLOTS, SNIFF_MAX_IDS> table;
+static std::atomic<uint32_t> countersSeq{0};
+static SniffStats counters = {};
+static uint32_t   epoch = 0;
+static uint64_t   lastReportUs = 0;
+
+/* =========================
+ *  CONFIGURATION
+ * ========================= */
+
+static bool rangeValid(const SniffRange& r)
+{
+    return r.lo <= r.hi && r.hi <= (r.extd ? EXT_ID_MAX : STD_ID_MAX);
+}
+
+// Ranges only, without the encoder exception: with any include range
+// an ID must be in one of them, and in no exclude range
+static bool rangesAllow(const SniffConfig& cfg, uint32_t id, bool extd)
+{
+    bool included = true;
+    for (uint8_t i = 0; i < cfg.ranges; i++) {
+        if (!cfg.range[i].exclude) {
+            included = false;
+            break;
+        }
+    }
+
+    for (uint8_t i = 0; i < cfg.ranges; i++) {
+        const SniffRange& r = cfg.range[i];
+        if (r.extd != extd || id < r.lo || id > r.hi)
+            continue;
+        if (r.exclude)
+            return false;
+        included = true;
+    }
+    return included;
+}
+
+/*
+ * Consistent copy of the configuration, from any task; with stdOut also
+ * the 11-bit ID bitmap. Returns the sequence the copy belongs to.
+ */
+static uint32_t readConfig(SniffConfig& out, uint32_t* stdOut = nullptr)
+{
+    uint32_t seq;
+    do {
+        seq = configSeq.load(std::memory_order_acquire);
+        out = config;
+        if (stdOut)
+            memcpy(stdOut, configStdAllowed, sizeof(configStdAllowed));
+        std::atomic_thread_fence(std::memory_order_acquire);
+    } while ((seq & 1) || seq != configSeq.load(std::memory_order_relaxed));
+    return seq;
+}
+
+// CLI: resolve the ranges for 11-bit IDs on this side, then publish
+static void writeConfig(const SniffConfig& cfg)
+{
+    uint32_t allowed[STD_ID_WORDS] = {};
+    for (uint32_t id = 0; id <= STD_ID_MAX; id++) {
+        if (rangesAllow(cfg, id, false))
+            allowed[id >> 5] |= 1u << (id & 31);
+    }
+
+    const uint32_t seq = configSeq.load(std::memory_order_relaxed);
+
+    configSeq.store(seq + 1, std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_release);
+    config = cfg;
+    memcpy(configStdAllowed, allowed, sizeof(allowed));
+    configSeq.store(seq + 2, std::memory_order_release);
+}
+
+static void save(const SniffConfig& cfg)
+{
+    SniffBlob blob = {};
+    blob.version      = SNIFF_NVS_VERSION;
+    blob.changes_only = cfg.changes_only ? 1 : 0;
+    blob.keyframe_ms  = cfg.keyframe_ms;
+    blob.ranges       = cfg.ranges;
+    for (uint8_t i = 0; i < cfg.ranges; i++) {
+        blob.range[i].lo    = cfg.range[i].lo;
+        blob.range[i].hi    = cfg.range[i].hi;
+        blob.range[i].flags = (cfg.range[i].extd ? SNIFF_RANGE_EXTD : 0) |
+                              (cfg.range[i].exclude ? SNIFF_RANGE_EXCLUDE : 0);
+    }
+
+    Preferences prefs;
+    if (prefs.begin(SNIFF_NVS_NAMESPACE, false)) {
+        prefs.putBytes(SNIFF_NVS_KEY, &blob, sizeof(blob));
+        prefs.end();
+    }
+}
+
+static bool load(SniffConfig& cfg)
+{
+    SniffBlob blob;
+    Preferences prefs;
+    if (!prefs.begin(SNIFF_NVS_NAMESPACE, true))
+        return false;
+
+    bool ok = prefs.getBytesLength(SNIFF_NVS_KEY) == sizeof(blob) &&
+              prefs.getBytes(SNIFF_NVS_KEY, &blob, sizeof(blob)) == sizeof(blob) &&
+              blob.version == SNIFF_NVS_VERSION &&
+              blob.keyframe_ms <= SNIFF_KEYFRAME_MS_MAX &&
+              blob.ranges <= SNIFF_MAX_RANGES;
+    prefs.end();
+    if (!ok)
+        return false;
+
+    SniffConfig c = {};
+    c.changes_only = blob.changes_only != 0;
+    c.keyframe_ms  = blob.keyframe_ms;
+    for (uint8_t i = 0; i < blob.ranges; i++) {
+        SniffRange r = {
+            .lo      = blob.range[i].lo,
+            .hi      = blob.range[i].hi,
+            .extd    = (blob.range[i].flags & SNIFF_RANGE_EXTD) != 0,
+            .exclude = (blob.range[i].flags & SNIFF_RANGE_EXCLUDE) != 0
+        };
+        if (rangeValid(r))
+            c.range[c.ranges++] = r;
+    }
+    cfg = c;
+    return true;
+}
+
+/*
+ * Take over the CLI's configuration (RX task, one load per frame when
+ * nothing changed): a copy of the configuration and the 11-bit ID
+ * bitmap, no per-ID work. 29-bit IDs are checked against the (short)
+ * range list.
+ */
+static void applyConfig(void)
+{
+    if (configSeq.load(std::memory_order_acquire) == activeSeq)
+        return;
+
+    activeSeq = readConfig(active, stdAllowed);
+}
+
+void initSniffFilter()
+{
+    SniffConfig cfg;
+    if (load(cfg))
+        writeConfig(cfg);
+    else
+        writeConfig(config);
+
+    applyConfig();
+}
+
+void getSniffConfig(SniffConfig& out)
+{
+    readConfig(out);
+}
+
+void setSniffChangesOnly(bool on)
+{
+    SniffConfig cfg;
+    readConfig(cfg);
+    cfg.changes_only = on;
+    writeConfig(cfg);
+    save(cfg);
+}
+
+bool setSniffKeyframe(uint32_t ms)
+{
+    if (ms > SNIFF_KEYFRAME_MS_MAX)
+        return false;
+
+    SniffConfig cfg;
+    readConfig(cfg);
+    cfg.keyframe_ms = ms;
+    writeConfig(cfg);
+    save(cfg);
+    return true;
+}
+
+bool addSniffRange(const SniffRange& r)
+{
+    SniffConfig cfg;
+    readConfig(cfg);
+    if (!rangeValid(r) || cfg.ranges >= SNIFF_MAX_RANGES)
+        return false;
+
+    cfg.range[cfg.ranges++] = r;
+    writeConfig(cfg);
+    save(cfg);
+    if (!r.exclude)
+        reloadCANFilter();      // exclusions are applied in software only
+    return true;
+}
+
+void clearSniffRanges()
+{
+    SniffConfig cfg;
+    readConfig(cfg);
+    cfg.ranges = 0;
+    writeConfig(cfg);
+    save(cfg);
+    reloadCANFilter();
+}
+
+/* =========================
+ *  ACCEPTANCE FILTER
+ * ========================= */
+
+/*
+ * Single filter layout (mask bit 1 = don't care):
+ *   11-bit frames: ID in bits 31..21, RTR bit 20, data bytes 0 and 1
+ *                  in bits 19..4 (always don't care here)
+ *   29-bit frames: ID in bits 31..3, RTR bit 2
+ * A range becomes its common ID prefix; several ranges are merged by
+ * letting every bit in which their codes differ through.
+ */
+static void mergeFilter(uint32_t& code, uint32_t& mask, bool& any, uint32_t c, uint32_t m)
+{
+    if (!any) {
+        code = c;
+        mask = m;
+        any  = true;
+    } else {
+        mask |= m | (code ^ c);
+    }
+    code &= ~mask;
+}
+
+static uint32_t rangeDontCare(const SniffRange& r)
+{
+    const uint32_t diff = r.lo ^ r.hi;
+    return diff ? 0xFFFFFFFFu >> __builtin_clz(diff) : 0;
+}
+
+void sniffAcceptanceFilter(twai_filter_config_t& out)
+{
+    const twai_filter_config_t all = TWAI_FILTER_CONFIG_ACCEPT_ALL();
+    out = all;
+
+    SniffConfig cfg;
+    readConfig(cfg);
+
+    uint32_t code = 0, mask = 0;
+    bool any = false;
+    for (uint8_t i = 0; i < cfg.ranges; i++) {
+        const SniffRange& r = cfg.range[i];
+        if (r.exclude)
+            continue;
+        if (r.extd)
+            mergeFilter(code, mask, any, r.lo << 3, (rangeDontCare(r) << 3) | 0x7u);
+        else
+            mergeFilter(code, mask, any, r.lo << 21, (rangeDontCare(r) << 21) | 0x1FFFFFu);
+    }
+    if (!any)
+        return;
+
+    // Encoder responses and pushed values must always get through
+    const SniffRange enc = { BriterEncoder::FIRST_ID, BriterEncoder::LAST_ID, false, false };
+    mergeFilter(code, mask, any, enc.lo << 21, (rangeDontCare(enc) << 21) | 0x1FFFFFu);
+
+    out.acceptance_code = code;
+    out.acceptance_mask = mask;
+    out.single_filter   = true;
+}
+
+/* =========================
+ *  RX PATH
+ * ========================= */
+
+static bool isEncoderFrame(const CanFrame& f)
+{
+    return !f.extd && f.id >= BriterEncoder::FIRST_ID && f.id <= BriterEncoder::LAST_ID;
+}
+
+static bool acceptFrame(const CanFrame& frame)
+{
+    counters.frames++;
+
+    const bool allowed = frame.extd
+        ? active.ranges == 0 || rangesAllow(active, frame.id, true)
+        : (stdAllowed[(frame.id & STD_ID_MAX) >> 5] >> (frame.id & 31)) & 1;
+    if (!allowed && !isEncoderFrame(frame)) {
+        counters.excluded++;
+        return false;
+    }
+
+    // A new file starts from full state
+    const uint32_t e = sdlog_file_epoch();
+    if (e != epoch) {
+        epoch = e;
+        table.forEach([](uint32_t, SniffSlot& s) { s.dlc = SLOT_STALE; });
+    }
+
+    bool log = true;
+    const bool tracked = table.update(canIdKey(frame.id, frame.extd), [&](SniffSlot& s) {
+        const bool same = s.dlc == frame.dlc && memcmp(s.data, frame.data, frame.dlc) == 0;
+        const bool keyframe = active.keyframe_ms != 0 &&
+                              frame.ts_us - s.last_us >= active.keyframe_ms * 1000ULL;
+
+        if (active.changes_only && same && !keyframe) {
+            s.suppressed++;
+            log = false;
+            return;
+        }
+
+        s.dlc = frame.dlc;
+        memcpy(s.data, frame.data, frame.dlc);
+        s.last_us = frame.ts_us;
+        s.logged++;
+    });
+    counters.ids = table.count();
+
+    if (!tracked)
+        counters.untracked++;
+    if (log)
+        counters.logged++;
+    else
+        counters.suppressed++;
+    return log;
+}
+
+bool sniffFilterAccept(const CanFrame& frame)
+{
+    applyConfig();
+
+    const uint32_t seq = countersSeq.load(std::memory_order_relaxed);
+    countersSeq.store(seq + 1, std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_release);
+    const bool log = acceptFrame(frame);
+    countersSeq.store(seq + 2, std::memory_order_release);
+    return log;
+}
+
+static void logFilterRecord(uint64_t nowUs)
+{
+    static uint8_t rec[SDLOG_LP_HEADER_SIZE + sizeof(SdlogSniffFilterHeader) +
+                       SNIFF_MAX_IDS * sizeof(SdlogSniffIdCount)];
+    size_t n = SDLOG_LP_HEADER_SIZE + sizeof(SdlogSniffFilterHeader);
+    uint16_t ids = 0;
+
+    table.forEach([&](uint32_t key, const SniffSlot& e) {
+        SdlogSniffIdCount c = {
+            .id         = canIdOf(key) | (canIdExtd(key) ? SDLOG_CANH_ID_EXTD : 0),
+            .logged     = e.logged,
+            .suppressed = e.suppressed
+        };
+        memcpy(&rec[n], &c, sizeof(c));
+        n += sizeof(c);
+        ids++;
+    });
+
+    SdlogSniffFilterHeader h = {
+        .ts_us       = nowUs,
+        .keyframe_ms = active.keyframe_ms,
+        .flags       = (uint8_t)(active.changes_only ? SDLOG_SNIFF_CHANGES_ONLY : 0),
+        .ranges      = active.ranges,
+        .ids         = ids,
+        .frames      = counters.frames,
+        .logged      = counters.logged,
+        .suppressed  = counters.suppressed,
+        .excluded    = counters.excluded,
+        .untracked   = counters.untracked
+    };
+
+    rec[0] = REC_SNIFF_FILTER;
+    const uint16_t len = (uint16_t)(n - SDLOG_LP_HEADER_SIZE);
+    memcpy(&rec[1], &len, 2);
+    memcpy(&rec[SDLOG_LP_HEADER_SIZE], &h, sizeof(h));
+    sdlog_push(rec, n);
+}
+
+void sniffFilterTick(uint64_t nowUs)
+{
+    if (resetPending.exchange(false, std::memory_order_acquire)) {
+        table.clear();
+
+        const uint32_t seq = countersSeq.load(std::memory_order_relaxed);
+        countersSeq.store(seq + 1, std::memory_order_relaxed);
+        std::atomic_thread_fence(std::memory_order_release);
+        counters = {};
+        countersSeq.store(seq + 2, std::memory_order_release);
+    }
+
+    if (canMode != CAN_MODE_SNIFFER || !sdlog_is_running()) {
+        lastReportUs = 0;
+        return;
+    }
+    if (lastReportUs == 0)
+        lastReportUs = nowUs;
+    else if (nowUs - lastReportUs >= SNIFF_REPORT_INTERVAL_MS * 1000ULL) {
+        logFilterRecord(nowUs);
+        lastReportUs = nowUs;
+    }
+}
+
+/* =========================
+ *  STATUS
+ * ========================= */
+
+void resetSniffFilter()
+{
+    resetPending.store(true, std::memory_order_release);
+}
+
+void getSniffStats(SniffStats& out)
+{
+    uint32_t seq;
+    do {
+        seq = countersSeq.load(std::memory_order_acquire);
+        out = counters;
+        std::atomic_thread_fence(std::memory_order_acquire);
+    } while ((seq & 1) || seq != countersSeq.load(std::memory_order_relaxed));
+}
+
+size_t getSniffIdCounts(SniffIdCount* out, size_t max)
+{
+    // By suppressed, then logged
+    return table.sorted(out, max,
+        [](uint32_t key, const SniffSlot& e) {
+            return SniffIdCount{ canIdOf(key), canIdExtd(key), e.logged, e.suppressed };
+        },
+        [](const SniffIdCount& a, const SniffIdCount& b) {
+            return a.suppressed > b.suppressed ||
+                   (a.suppressed == b.suppressed && a.logged > b.logged);
+        });
+}
@@ -0,0 +1,140 @@
+#pragma once
+
+#include <stdint.h>
+#include <stddef.h>
+#include <driver/twai.h>
+
+#include "can_bus.h"
+
+/*
+ * Sniff log filter.
+ *
+ * Vehicle buses repeat most frames unchanged at 10..100 Hz. In sniffer
+ * mode a frame is logged only if
+ *  - its ID passes the include / exclude ranges, and
+ *  - its DLC or data differ from the last logged frame of that ID, or
+ *    the last logged one is older than the keyframe period.
+ * Everything else is counted per ID as suppressed. The keyframe bounds
+ * how far back a reader starting at a seek point has to look for the
+ * current value of every ID; every log file starts with full state
+ * (the first frame of each ID is always logged).
+ *
+ * Per-ID state lives in an open addressed table in the RX task (one or
+ * two probes per frame, standard and extended IDs alike); IDs beyond
+ * SNIFF_MAX_IDS are logged unfiltered and counted as untracked.
+ *
+ * Include ranges are also programmed into the TWAI acceptance filter,
+ * so the controller drops most other traffic before it takes RX queue
+ * slots (see sniffAcceptanceFilter()). The CAN health monitor then only
+ * sees the accepted frames.
+ *
+ * The configuration is saved in NVS; the log gets a REC_SNIFF_FILTER
+ * record with the counters every SNIFF_REPORT_INTERVAL_MS.
+ */
+
+/* =========================
+ *  FILTER CONFIGURATION
+ * ========================= */
+
+/*
+ * SNIFF_MAX_IDS / SNIFF_ID_SLOTS
+ *
+ * IDs with change tracking, and the slots of the open addressed table
+ * (power of two, kept under 75 % full, see can_id_table.h). A slot
+ * is 40 bytes.
+ */
+#define SNIFF_MAX_IDS           192
+#define SNIFF_ID_SLOTS          256
+
+/*
+ * SNIFF_MAX_RANGES
+ *
+ * Include and exclude ranges together.
+ */
+#define SNIFF_MAX_RANGES        8
+
+/*
+ * SNIFF_KEYFRAME_MS_DEFAULT / SNIFF_KEYFRAME_MS_MAX
+ *
+ * An unchanged frame is logged again after this long (0 = only on
+ * change). One second matches the seek point interval of the log.
+ */
+#define SNIFF_KEYFRAME_MS_DEFAULT   1000
+#define SNIFF_KEYFRAME_MS_MAX       60000
+
+/*
+ * SNIFF_REPORT_INTERVAL_MS
+ *
+ * REC_SNIFF_FILTER period while logging in sniffer mode.
+ */
+#define SNIFF_REPORT_INTERVAL_MS    10000
+
+struct SniffRange {
+    uint32_t lo;
+    uint32_t hi;            // inclusive
+    bool     extd;          // 29-bit IDs
+    bool     exclude;
+};
+
+struct SniffConfig {
+    bool       changes_only;
+    uint32_t   keyframe_ms;     // 0 = changes only, no keyframes
+    uint8_t    ranges;
+    SniffRange range[SNIFF_MAX_RANGES];
+};
+
+struct SniffStats {
+    uint32_t frames;        // seen while logging
+    uint32_t logged;
+    uint32_t suppressed;    // unchanged, within the keyframe period
+    uint32_t excluded;      // outside the ranges
+    uint32_t untracked;     // logged without tracking (table full)
+    uint32_t ids;           // IDs in the table
+};
+
+struct SniffIdCount {
+    uint32_t id;
+    bool     extd;
+    uint32_t logged;
+    uint32_t suppressed;
+};
+
+// Load the configuration from NVS (initCAN(), before the driver is installed)
+void initSniffFilter();
+
+/*
+ * RX task, for every sniffed frame while logging: true if the frame is
+ * to be logged. Counts it either way.
+ */
+bool sniffFilterAccept(const CanFrame& frame);
+
+/*
+ * RX task, periodically: takes over configuration changes and counter
+ * resets, writes REC_SNIFF_FILTER when due.
+ */
+void sniffFilterTick(uint64_t nowUs);
+
+/*
+ * Acceptance filter for the include ranges: one single-filter code /
+ * mask covering all of them plus the encoder IDs (wider than the ranges
+ * when they do not share a prefix; the rest is filtered in software).
+ * Accept-all without include ranges.
+ */
+void sniffAcceptanceFilter(twai_filter_config_t& out);
+
+/*
+ * Configuration, from the CLI. Changes are saved in NVS; range changes
+ * restart the TWAI driver with the new acceptance filter.
+ * addSniffRange() returns false for an invalid range or a full list.
+ */
+void getSniffConfig(SniffConfig& out);
+void setSniffChangesOnly(bool on);
+bool setSniffKeyframe(uint32_t ms);
+bool addSniffRange(const SniffRange& r);
+void clearSniffRanges();
+
+// Counters and per-ID state (applied by the RX task, safe from any task)
+void resetSniffFilter();
+
+void getSniffStats(SniffStats& out);
+size_t getSniffIdCounts(SniffIdCount* out, size_t max);   // most suppressed first
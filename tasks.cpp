@@ -0,0 +1,93 @@
+#include "tasks.h"
+
+#include <string.h>
+
+static TaskInfo tasks[TASK_MAX];
+static size_t   taskTotal = 0;
+
+static JitterHist jitter[JITTER_SOURCE_COUNT];
+
+static const char* const jitterNames[JITTER_SOURCE_COUNT] = {
+    "poll period",
+    "rx latency",
+};
+
+bool startTask(TaskFunction_t fn, const char* name, uint32_t stack,
+               UBaseType_t prio, BaseType_t core, TaskHandle_t* out)
+{
+    TaskHandle_t handle = nullptr;
+    if (xTaskCreatePinnedToCore(fn, name, stack, nullptr, prio, &handle, core) != pdPASS)
+        return false;
+
+    if (taskTotal < TASK_MAX) {
+        tasks[taskTotal] = {
+            .name       = name,
+            .handle     = handle,
+            .stack      = stack,
+            .stack_free = 0,
+            .prio       = (uint8_t)prio,
+            .core       = (int8_t)core
+        };
+        taskTotal++;
+    }
+
+    if (out)
+        *out = handle;
+    return true;
+}
+
+size_t taskCount()
+{
+    return taskTotal;
+}
+
+bool getTaskInfo(size_t i, TaskInfo& out)
+{
+    if (i >= taskTotal)
+        return false;
+
+    out = tasks[i];
+    out.stack_free = (uint32_t)uxTaskGetStackHighWaterMark(out.handle);
+    return true;
+}
+
+/* =========================
+ *  JITTER
+ * ========================= */
+
+static uint8_t jitterBin(uint32_t us)
+{
+    if (us < 4)
+        return 0;
+    uint8_t bin = (uint8_t)(31 - __builtin_clz(us)) - 1;
+    return bin < JITTER_BINS ? bin : JITTER_BINS - 1;
+}
+
+void jitterAdd(JitterSource src, uint32_t us)
+{
+    JitterHist& h = jitter[src];
+    h.count++;
+    h.sum_us += us;
+    if (us > h.max_us)
+        h.max_us = us;
+    h.hist[jitterBin(us)]++;
+}
+
+void getJitter(JitterSource src, JitterHist& out)
+{
+    if (src >= JITTER_SOURCE_COUNT) {
+        out = {};
+        return;
+    }
+    out = jitter[src];
+}
+
+const char* jitterSourceName(JitterSource src)
+{
+    return src < JITTER_SOURCE_COUNT ? jitterNames[src] : "?";
+}
+
+void jitterReset()
+{
+    memset(jitter, 0, sizeof(jitter));
+}
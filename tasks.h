@@ -0,0 +1,185 @@
+#pragma once
+
+#include <stdint.h>
+#include <stddef.h>
+#include <freertos/FreeRTOS.h>
+#include <freertos/task.h>
+
+/*
+ * Task topology.
+ *
+ * Acquisition and everything else run on different cores, so an SD
+ * card busy with garbage collection, a long CLI print or a telemetry
+ * burst can delay neither the poll timer nor frame reception:
+ *
+ *   TASK_CORE_ACQ (0)   esp_timer task (system, prio 22: poll timer)
+ *                       can_rx     CAN RX, frame stamping, measurements
+ *                       enc_poll   encoder request scheduler
+ *   TASK_CORE_IO  (1)   can_ctl    CAN driver restarts (queue sizes, filter)
+ *                       telem      binary telemetry
+ *                       sdlog      SD writer
+ *                       loop       Arduino loop: CLI (ARDUINO_RUNNING_CORE)
+ *                       debug      deferred debug output
+ *
+ * Core 0 is otherwise idle (no WiFi / BT). The TWAI interrupt is taken
+ * on the core that installed the driver: setup() on core 1, and every
+ * later restart is handed to can_ctl on the same core. It only moves
+ * frames into the driver queue.
+ *
+ * Every value below can be overridden from the build (-D...).
+ * Priorities only compete within a core. "tasks" on the CLI shows the
+ * topology, the unused stack of each task and the jitter histograms
+ * that show whether the acquisition core stays isolated.
+ */
+
+#ifndef TASK_CORE_ACQ
+#define TASK_CORE_ACQ           0
+#endif
+#ifndef TASK_CORE_IO
+#define TASK_CORE_IO            1
+#endif
+
+#if defined(ARDUINO_RUNNING_CORE) && ARDUINO_RUNNING_CORE != TASK_CORE_IO
+#warning "Arduino loop (CLI) does not run on TASK_CORE_IO; set 'Arduino Runs On' to match"
+#endif
+
+/*
+ * CAN_RX_TASK_STACK / CAN_RX_TASK_PRIO
+ *
+ * Highest application priority on the acquisition core: responses and
+ * frames are drained before new requests go out.
+ */
+#ifndef CAN_RX_TASK_STACK
+#define CAN_RX_TASK_STACK       4096
+#endif
+#ifndef CAN_RX_TASK_PRIO
+#define CAN_RX_TASK_PRIO        5
+#endif
+
+/*
+ * POLL_TASK_STACK / POLL_TASK_PRIO
+ *
+ * One step below CAN RX. Woken by the esp_timer task, which runs on
+ * the same core.
+ */
+#ifndef POLL_TASK_STACK
+#define POLL_TASK_STACK         3072
+#endif
+#ifndef POLL_TASK_PRIO
+#define POLL_TASK_PRIO          4
+#endif
+
+/*
+ * CAN_CTL_TASK_STACK / CAN_CTL_TASK_PRIO
+ *
+ * Started on the first driver restart. Highest on the I/O core: the RX
+ * task waits for it, and a restart takes well under a millisecond.
+ */
+#ifndef CAN_CTL_TASK_STACK
+#define CAN_CTL_TASK_STACK      3072
+#endif
+#ifndef CAN_CTL_TASK_PRIO
+#define CAN_CTL_TASK_PRIO       4
+#endif
+
+/*
+ * TELEM_TASK_STACK / TELEM_TASK_PRIO
+ *
+ * Above the SD writer on the I/O core: a telemetry tick is short and
+ * periodic, an SD write may block for tens of milliseconds.
+ */
+#ifndef TELEM_TASK_STACK
+#define TELEM_TASK_STACK        3072
+#endif
+#ifndef TELEM_TASK_PRIO
+#define TELEM_TASK_PRIO         3
+#endif
+
+/*
+ * SDLOG_TASK_STACK / SDLOG_TASK_PRIO
+ *
+ * Above the Arduino loop (prio 1), so CLI work cannot let the ring
+ * buffer fill up. Only buffered file writes; do not reduce the stack
+ * unless you know the actual usage ("tasks").
+ */
+#ifndef SDLOG_TASK_STACK
+#define SDLOG_TASK_STACK        4096
+#endif
+#ifndef SDLOG_TASK_PRIO
+#define SDLOG_TASK_PRIO         2
+#endif
+
+/*
+ * DEBUG_TASK_STACK / DEBUG_TASK_PRIO
+ *
+ * Deferred debug drain: below everything else that does real work.
+ */
+#ifndef DEBUG_TASK_STACK
+#define DEBUG_TASK_STACK        3072
+#endif
+#ifndef DEBUG_TASK_PRIO
+#define DEBUG_TASK_PRIO         1
+#endif
+
+/*
+ * TASK_MAX
+ *
+ * Tasks started through startTask().
+ */
+#define TASK_MAX                8
+
+struct TaskInfo {
+    const char*  name;
+    TaskHandle_t handle;
+    uint32_t     stack;         // bytes
+    uint32_t     stack_free;    // bytes never used (high water mark)
+    uint8_t      prio;
+    int8_t       core;
+};
+
+/*
+ * Create a task pinned to core and remember it for the "tasks" report.
+ * Returns false if the task could not be created.
+ */
+bool startTask(TaskFunction_t fn, const char* name, uint32_t stack,
+               UBaseType_t prio, BaseType_t core, TaskHandle_t* out);
+
+size_t taskCount();
+bool getTaskInfo(size_t i, TaskInfo& out);
+
+/* =========================
+ *  JITTER
+ * ========================= */
+
+/*
+ * JITTER_BINS
+ *
+ * Bin 0 counts [0, 4) us, bin i [2^(i+1), 2^(i+2)) us, the last bin is
+ * open ended (>= 8 ms).
+ */
+#define JITTER_BINS             13
+
+typedef enum : uint8_t {
+    JITTER_POLL_PERIOD = 0,     // |tick interval - POLL_TICK_US|   (poll task)
+    JITTER_RX_LATENCY,          // frame arrival -> dispatched      (CAN RX task)
+    JITTER_SOURCE_COUNT
+} JitterSource;
+
+struct JitterHist {
+    uint32_t count;
+    uint32_t max_us;
+    uint64_t sum_us;
+    uint32_t hist[JITTER_BINS];
+};
+
+// One writer per source (noted above); readers may see a sample half applied
+void jitterAdd(JitterSource src, uint32_t us);
+void getJitter(JitterSource src, JitterHist& out);
+const char* jitterSourceName(JitterSource src);
+void jitterReset();
+
+// Lower bound of bin b in us
+static inline uint32_t jitterBinUs(uint8_t b)
+{
+    return b == 0 ? 0 : 2u << b;
+}
@@ -0,0 +1,288 @@
+#include "telemetry.h"
+#include "measurements.h"
+#include "encoder_poll.h"
+#include "can_bus.h"
+#include "sdlog.h"
+#include "serial_cli.h"
+#include "BriterEncoder.h"
+#include "crc.h"
+#include "cobs.h"
+#include "debug.h"
+#include "perf.h"
+#include "tasks.h"
+
+#include <Arduino.h>
+#include <esp_timer.h>
+#include <atomic>
+
+static_assert(TELEM_ENCODERS == BriterEncoder::NUM_ENCODERS,
+              "telemetry packet layout assumes one slot per encoder");
+static_assert(2 + sizeof(TelemSamplesPayload) + 2 <= TELEM_MAX_PACKET &&
+              2 + sizeof(TelemCountersPayload) + 2 <= TELEM_MAX_PACKET &&
+              2 + sizeof(TelemDbgRecordHeader) + DEBUG_DEFER_MAX_ARGS + 4 * DEBUG_DEFER_MAX_WORDS + 2 <= TELEM_MAX_PACKET,
+              "telemetry payload too large for TELEM_MAX_PACKET");
+
+// TELEM_TASK_STACK / TELEM_TASK_PRIO: see tasks.h
+
+/* =========================
+ *  INTERNAL STATE
+ * ========================= */
+
+static esp_timer_handle_t telemTimer = nullptr;
+static TaskHandle_t telemTaskHandle = nullptr;
+static std::atomic<bool> telemRunning{false};
+
+static uint16_t rateHz = TELEM_DEFAULT_HZ;
+static uint8_t  seq = 0;
+static uint32_t lastCountersUs = 0;
+static TelemetryStats stats;
+
+// Formats announced since the last counters packet; index = id
+static const DebugFormat* dbgFormats[TELEM_DBG_FORMATS];
+static uint8_t dbgFormatCount = 0;
+
+/* =========================
+ *  FRAMING
+ * ========================= */
+
+/*
+ * Frame and send one packet. Dropped instead of blocking when the UART
+ * TX buffer cannot take the whole frame.
+ */
+static bool sendPacket(uint8_t type, const void* payload, size_t len)
+{
+    uint8_t pkt[TELEM_MAX_PACKET];
+    uint8_t frame[TELEM_MAX_FRAME];
+
+    pkt[0] = type;
+    pkt[1] = seq++;
+    memcpy(&pkt[2], payload, len);
+
+    uint16_t crc = crc16_ccitt(pkt, 2 + len);
+    memcpy(&pkt[2 + len], &crc, 2);
+
+    size_t n = cobs_encode(pkt, 2 + len + 2, frame);
+
+    if (Serial.availableForWrite() < (int)n) {
+        stats.dropped++;
+        return false;
+    }
+
+    Serial.write(frame, n);
+    stats.sent++;
+    stats.bytes += n;
+    return true;
+}
+
+/* =========================
+ *  PACKETS
+ * ========================= */
+
+static void sendSamples(uint32_t nowUs)
+{
+    TelemSamplesPayload p = {};
+    p.t_us = nowUs;
+
+    for (uint8_t i = 0; i < TELEM_ENCODERS; i++) {
+        MeasMotion m;
+        if (!getMotion(i, m))
+            continue;
+
+        float vel = m.vel;
+        if (vel > 32767.0f)  vel = 32767.0f;
+        if (vel < -32768.0f) vel = -32768.0f;
+
+        p.enc[i].t_us     = m.t_us;
+        p.enc[i].pos_um   = (int32_t)lroundf(m.pos * 1000.0f);
+        p.enc[i].vel_mm_s = (int16_t)vel;
+        p.enc[i].samples  = (uint16_t)m.samples;
+    }
+
+    sendPacket(TELEM_PKT_SAMPLES, &p, sizeof(p));
+}
+
+static bool sendCounters(uint32_t nowUs)
+{
+    TelemCountersPayload p = {};
+    p.t_us    = nowUs;
+    p.version = TELEM_PROTOCOL_VERSION;
+    p.rate_hz = rateHz;
+
+    for (uint8_t id = BriterEncoder::FIRST_ID; id <= BriterEncoder::LAST_ID; id++) {
+        EncoderPollStats ps;
+        getEncoderPollStats(id, ps);
+        p.poll_timeouts += ps.timeouts;
+    }
+
+    CanRxStats rx;
+    getCANRxStats(rx);
+    p.can_rx_missed = rx.rx_missed;
+    p.sdlog_dropped = sdlog_dropped();
+
+    // Counted before sending, so the packet includes itself
+    p.sent    = stats.sent + 1;
+    p.dropped = stats.dropped;
+
+    return sendPacket(TELEM_PKT_COUNTERS, &p, sizeof(p));
+}
+
+static int dbgFormatId(const DebugFormat* format)
+{
+    for (uint8_t i = 0; i < dbgFormatCount; i++) {
+        if (dbgFormats[i] == format)
+            return i;
+    }
+    if (dbgFormatCount >= TELEM_DBG_FORMATS)
+        return -1;
+
+    uint8_t pkt[TELEM_MAX_PACKET - 4];
+    const uint16_t id = dbgFormatCount;
+    size_t len = strlen(format->fmt);
+    if (len > sizeof(pkt) - 2)
+        len = sizeof(pkt) - 2;
+    memcpy(&pkt[0], &id, 2);
+    memcpy(&pkt[2], format->fmt, len);
+    if (!sendPacket(TELEM_PKT_DBG_FORMAT, pkt, 2 + len))
+        return -1;
+
+    dbgFormats[dbgFormatCount++] = format;
+    return id;
+}
+
+/*
+ * Move deferred debug records into the stream while the TX buffer has
+ * room for more than a samples packet; the rest waits for the next tick.
+ */
+static void sendDebugRecords()
+{
+    DebugRecord rec;
+
+    while (Serial.availableForWrite() > 2 * TELEM_MAX_FRAME && debugPopRecord(rec)) {
+        int id = dbgFormatId(rec.format);
+        if (id < 0) {
+            stats.dropped++;
+            continue;
+        }
+
+        uint8_t pkt[TELEM_MAX_PACKET - 4];
+        TelemDbgRecordHeader h = { rec.t_us, (uint16_t)id, rec.args.nargs };
+
+        memcpy(&pkt[0], &h, sizeof(h));
+        size_t len = sizeof(h);
+        memcpy(&pkt[len], rec.args.kinds, rec.args.nargs);
+        len += rec.args.nargs;
+        memcpy(&pkt[len], rec.args.words, rec.args.nwords * 4);
+        len += rec.args.nwords * 4;
+
+        sendPacket(TELEM_PKT_DBG_RECORD, pkt, len);
+    }
+}
+
+static void telem_task(void*)
+{
+    while (true) {
+        uint32_t pending = ulTaskNotifyTake(pdTRUE, portMAX_DELAY);
+        if (pending == 0 || !telemRunning)
+            continue;
+
+        PerfScope perf(PERF_TELEM_TICK);
+        const uint32_t now = (uint32_t)esp_timer_get_time();
+
+        sendSamples(now);
+
+        if (now - lastCountersUs >= 1000000UL) {
+            // Format ids start over only once the decoder has seen it
+            if (sendCounters(now))
+                dbgFormatCount = 0;
+            lastCountersUs = now;
+        }
+
+        sendDebugRecords();
+    }
+}
+
+static void telem_timer_cb(void*)
+{
+    xTaskNotifyGive(telemTaskHandle);
+}
+
+/* =========================
+ *  PUBLIC API
+ * ========================= */
+
+void initTelemetry()
+{
+    if (telemTaskHandle == nullptr) {
+        startTask(telem_task, "telem", TELEM_TASK_STACK,
+                  TELEM_TASK_PRIO, TASK_CORE_IO, &telemTaskHandle);
+    }
+
+    if (telemTimer == nullptr) {
+        esp_timer_create_args_t args = {
+            .callback = telem_timer_cb,
+            .arg = nullptr,
+            .dispatch_method = ESP_TIMER_TASK,
+            .name = "telem",
+            .skip_unhandled_events = true
+        };
+
+        if (esp_timer_create(&args, &telemTimer) != ESP_OK) {
+            DBG_ERROR("[TELEM][ERR] timer create failed");
+            telemTimer = nullptr;
+        }
+    }
+}
+
+bool startTelemetry(uint32_t baud, uint16_t hz)
+{
+    if (telemTimer == nullptr || hz == 0 || hz > TELEM_MAX_HZ)
+        return false;
+
+    stopTelemetry();
+
+    rateHz = hz;
+    stats = {};
+    stats.rate_hz = hz;
+    stats.baud = baud;
+
+    // First counters packet right away, so a decoder learns the rate
+    lastCountersUs = (uint32_t)esp_timer_get_time() - 1000000UL;
+    dbgFormatCount = 0;
+
+    // Let the CLI reply go out at the old rate before switching
+    Serial.flush();
+    Serial.updateBaudRate(baud);
+
+    telemRunning = true;
+    debugSetExternalDrain(true);
+    if (esp_timer_start_periodic(telemTimer, 1000000UL / hz) != ESP_OK) {
+        telemRunning = false;
+        debugSetExternalDrain(false);
+        Serial.updateBaudRate(SERIAL_CLI_BAUD);
+        return false;
+    }
+    return true;
+}
+
+void stopTelemetry()
+{
+    if (!telemRunning)
+        return;
+
+    telemRunning = false;
+    esp_timer_stop(telemTimer);
+    debugSetExternalDrain(false);
+
+    Serial.flush();
+    Serial.updateBaudRate(SERIAL_CLI_BAUD);
+}
+
+bool isTelemetryRunning()
+{
+    return telemRunning;
+}
+
+void getTelemetryStats(TelemetryStats& out)
+{
+    out = stats;
+}
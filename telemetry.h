@@ -0,0 +1,117 @@
+#pragma once
+
+#include <stdint.h>
+#include <stdbool.h>
+
+/*
+ * Binary telemetry stream over Serial.
+ *
+ * While enabled, a telemetry task sends the latest sample of every
+ * encoder at a fixed rate, plus a counters packet once per second.
+ * Packets that do not fit in the UART TX buffer are dropped and
+ * counted, so the stream never blocks the sender or loop().
+ *
+ * Text CLI output can still appear between packets (e.g. the reply to
+ * "telem off"); decoders resync on the next frame delimiter and see it
+ * as a CRC error.
+ */
+
+/* =========================
+ *  WIRE FORMAT
+ * =========================
+ * Frame on the wire:
+ *   COBS(packet) 0x00
+ *
+ * packet (before COBS), little endian:
+ *   uint8_t  type        TelemPacketType
+ *   uint8_t  seq         incremented per packet sent (gaps = drops)
+ *   uint8_t  payload[]   layout by type
+ *   uint16_t crc         CRC-16/CCITT-FALSE over type..payload (crc.h)
+ *
+ * COBS guarantees 0x00 only appears as the frame delimiter.
+ */
+
+#define TELEM_PROTOCOL_VERSION  1
+#define TELEM_MAX_PACKET        96      // before COBS
+#define TELEM_MAX_FRAME         (TELEM_MAX_PACKET + TELEM_MAX_PACKET / 254 + 2)   // COBS_MAX_FRAME
+
+typedef enum : uint8_t {
+    TELEM_PKT_SAMPLES   = 0x01,
+    TELEM_PKT_COUNTERS  = 0x02,
+    TELEM_PKT_DBG_FORMAT = 0x03,
+    TELEM_PKT_DBG_RECORD = 0x04,
+} TelemPacketType;
+
+#define TELEM_ENCODERS          4
+
+typedef struct __attribute__((packed)) {
+    uint32_t t_us;                // packet time, low 32 bits of esp_timer
+    struct __attribute__((packed)) {
+        uint32_t t_us;            // time of this encoder's latest sample
+        int32_t  pos_um;
+        int16_t  vel_mm_s;        // saturated
+        uint16_t samples;         // low 16 bits of the sample count
+    } enc[TELEM_ENCODERS];
+} TelemSamplesPayload;
+
+typedef struct __attribute__((packed)) {
+    uint32_t t_us;
+    uint8_t  version;             // TELEM_PROTOCOL_VERSION
+    uint16_t rate_hz;
+    uint32_t sent;                // packets sent
+    uint32_t dropped;             // packets dropped (TX buffer full)
+    uint32_t poll_timeouts;       // all encoders
+    uint32_t can_rx_missed;
+    uint32_t sdlog_dropped;
+} TelemCountersPayload;
+
+/*
+ * Deferred debug records (debug.h), sent instead of text while
+ * streaming. A format is announced once before its first record and
+ * again after every counters packet, so a decoder that starts late
+ * learns it within a second.
+ *
+ * DBG_FORMAT payload:
+ *   uint16_t id
+ *   char     fmt[]             rest of the packet, not NUL terminated
+ * DBG_RECORD payload:
+ *   TelemDbgRecordHeader
+ *   uint8_t  kinds[nargs]      DebugArgKind (debug_fmt.h)
+ *   uint32_t words[]           1 per argument, 2 for 64-bit kinds
+ */
+typedef struct __attribute__((packed)) {
+    uint32_t t_us;                // time of the debug call
+    uint16_t id;                  // from a DBG_FORMAT packet
+    uint8_t  nargs;
+} TelemDbgRecordHeader;
+
+#define TELEM_DBG_FORMATS       32      // format ids per announcement period
+
+/* =========================
+ *  CONFIGURATION
+ * ========================= */
+
+/*
+ * TELEM_DEFAULT_BAUD / TELEM_DEFAULT_HZ
+ *
+ * A samples frame is 58 bytes on the wire: 500 Hz needs ~290 kbit/s,
+ * so at least 460800 baud. The CLI goes back to SERIAL_CLI_BAUD when
+ * streaming stops.
+ */
+#define TELEM_DEFAULT_BAUD      921600
+#define TELEM_DEFAULT_HZ        500
+#define TELEM_MAX_HZ            1000
+
+struct TelemetryStats {
+    uint32_t sent;
+    uint32_t dropped;
+    uint32_t bytes;
+    uint16_t rate_hz;
+    uint32_t baud;
+};
+
+void initTelemetry();
+bool startTelemetry(uint32_t baud, uint16_t hz);
+void stopTelemetry();
+bool isTelemetryRunning();
+void getTelemetryStats(TelemetryStats& out);